@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+# Copyright SpaceRPG 2020
+#
+# Runs a city split into district shards on this machine over loopback: the district coordinator and one dedicated
+# server per shard, each with its own autosave journal. Players join any shard and are handed between them as they
+# cross district borders. Optionally runs load test bots against the first shard. Stops everything on Ctrl-C.
+#
+# Usage: Scripts/DistrictShards.sh [shards] [map]
+# Environment:
+#   UE4_EDITOR         path to UE4Editor, defaults to $UE4_ROOT/Engine/Binaries/Linux/UE4Editor
+#   PORT               game port of the first shard, the others follow it, defaults to 7777
+#   COORDINATOR_PORT   port the coordinator listens on, defaults to 7800
+#   CITY_CELLS         half the width of the city in grid cells, defaults to 1024
+#   BOTS               load test bots joining the first shard, defaults to 0
+
+set -euo pipefail
+
+SHARDS=${1:-4}
+MAP=${2:-/Game/Maps/Prototyping}
+PORT=${PORT:-7777}
+COORDINATOR_PORT=${COORDINATOR_PORT:-7800}
+CITY_CELLS=${CITY_CELLS:-1024}
+BOTS=${BOTS:-0}
+
+PROJECT_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)
+PROJECT="$PROJECT_DIR/CityBuilderRPG.uproject"
+UE4_EDITOR=${UE4_EDITOR:-${UE4_ROOT:-}/Engine/Binaries/Linux/UE4Editor}
+
+if [[ ! -x "$UE4_EDITOR" ]]; then
+	echo "UE4Editor not found at '$UE4_EDITOR', set UE4_EDITOR or UE4_ROOT" >&2
+	exit 1
+fi
+
+RUN_DIR="$PROJECT_DIR/Saved/DistrictShards/$(date +%Y%m%d-%H%M%S)"
+mkdir -p "$RUN_DIR"
+
+OFFLINE_ARGS=(-nosteam "-ini:Engine:[OnlineSubsystem]:DefaultPlatformService=Null" -unattended -nosplash -nosound)
+
+PIDS=()
+cleanup()
+{
+	for pid in ${PIDS[@]+"${PIDS[@]}"}; do
+		kill "$pid" 2>/dev/null || true
+	done
+}
+trap cleanup EXIT
+
+"$UE4_EDITOR" "$PROJECT" -run=SpaceRPGCoordinator -port="$COORDINATOR_PORT" -shards="$SHARDS" -cityCells="$CITY_CELLS" \
+	"${OFFLINE_ARGS[@]}" -abslog="$RUN_DIR/Coordinator.log" &
+PIDS+=($!)
+
+# Shards reconnect until the coordinator is up, so they can start straight away
+for ((i = 0; i < SHARDS; i++)); do
+	"$UE4_EDITOR" "$PROJECT" "$MAP" -server -port=$((PORT + i)) "${OFFLINE_ARGS[@]}" \
+		-DistrictShard="$i" -DistrictCoordinator="127.0.0.1:$COORDINATOR_PORT" -DistrictHost=127.0.0.1 \
+		"-ini:Game:[/Script/SpaceRPG.CityAutosaveSubsystem]:journalName=City_Shard$i.journal" \
+		-abslog="$RUN_DIR/Shard$i.log" &
+	PIDS+=($!)
+done
+
+if ((BOTS > 0)); then
+	sleep "${SERVER_STARTUP_SECONDS:-20}"
+	for ((i = 0; i < BOTS; i++)); do
+		"$UE4_EDITOR" "$PROJECT" "127.0.0.1:$PORT?LoadTestBot=Builder" -game -nullrhi -windowed -resx=64 -resy=64 \
+			"${OFFLINE_ARGS[@]}" -abslog="$RUN_DIR/Bot$i.log" &
+		PIDS+=($!)
+		sleep 1
+	done
+fi
+
+echo "Coordinator on 127.0.0.1:$COORDINATOR_PORT, shards on ports $PORT-$((PORT + SHARDS - 1)), logs in $RUN_DIR"
+echo "Press Ctrl-C to stop"
+wait
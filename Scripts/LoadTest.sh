@@ -0,0 +1,78 @@
+#!/usr/bin/env bash
+# Copyright SpaceRPG 2020
+#
+# Runs a dedicated server and a number of -nullrhi bot clients on this machine over loopback, then prints the
+# server's load test report. Everything stays offline: the null online subsystem is used and clients connect
+# to 127.0.0.1.
+#
+# Usage: Scripts/LoadTest.sh [bots] [seconds] [map]
+# Environment:
+#   UE4_EDITOR   path to UE4Editor, defaults to $UE4_ROOT/Engine/Binaries/Linux/UE4Editor
+#   PORT         server port, defaults to 7777
+#   WALKERS      how many of the bots only walk, the rest build, defaults to a quarter
+
+set -euo pipefail
+
+BOTS=${1:-8}
+SECONDS_TO_RUN=${2:-120}
+MAP=${3:-/Game/Maps/Prototyping}
+PORT=${PORT:-7777}
+WALKERS=${WALKERS:-$((BOTS / 4))}
+
+PROJECT_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)
+PROJECT="$PROJECT_DIR/CityBuilderRPG.uproject"
+UE4_EDITOR=${UE4_EDITOR:-${UE4_ROOT:-}/Engine/Binaries/Linux/UE4Editor}
+
+if [[ ! -x "$UE4_EDITOR" ]]; then
+	echo "UE4Editor not found at '$UE4_EDITOR', set UE4_EDITOR or UE4_ROOT" >&2
+	exit 1
+fi
+
+RUN_DIR="$PROJECT_DIR/Saved/LoadTest/$(date +%Y%m%d-%H%M%S)"
+REPORT="$RUN_DIR/LoadTestReport.json"
+mkdir -p "$RUN_DIR"
+
+OFFLINE_ARGS=(-nosteam "-ini:Engine:[OnlineSubsystem]:DefaultPlatformService=Null" -unattended -nosplash -nosound)
+
+CLIENT_PIDS=()
+cleanup()
+{
+	for pid in ${CLIENT_PIDS[@]+"${CLIENT_PIDS[@]}"}; do
+		kill "$pid" 2>/dev/null || true
+	done
+}
+trap cleanup EXIT
+
+# The server writes the report and exits by itself once the duration has passed
+"$UE4_EDITOR" "$PROJECT" "$MAP" -server -port="$PORT" "${OFFLINE_ARGS[@]}" \
+	-LoadTestReport="$REPORT" -LoadTestDuration="$SECONDS_TO_RUN" \
+	-abslog="$RUN_DIR/Server.log" &
+SERVER_PID=$!
+
+# Give the server time to load the map before clients connect
+sleep "${SERVER_STARTUP_SECONDS:-20}"
+
+for ((i = 0; i < BOTS; i++)); do
+	BEHAVIOUR=Builder
+	if ((i < WALKERS)); then
+		BEHAVIOUR=Walker
+	fi
+
+	"$UE4_EDITOR" "$PROJECT" "127.0.0.1:$PORT?LoadTestBot=$BEHAVIOUR" -game -nullrhi -windowed -resx=64 -resy=64 \
+		"${OFFLINE_ARGS[@]}" -abslog="$RUN_DIR/Bot$i.log" &
+	CLIENT_PIDS+=($!)
+
+	# Staggered joins, so the city snapshot stream of each join shows up separately
+	sleep 1
+done
+
+wait "$SERVER_PID" || true
+
+if [[ -f "$REPORT" ]]; then
+	cat "$REPORT"
+	echo
+	echo "Report written to $REPORT"
+else
+	echo "The server did not write a report, see $RUN_DIR/Server.log" >&2
+	exit 1
+fi
@@ -0,0 +1,96 @@
+#!/usr/bin/env bash
+# Copyright SpaceRPG 2020
+#
+# Measures the time from process start to first playable for a dedicated server and a -nullrhi client, with gameplay
+# assets loaded synchronously on first use and with the startup preload. Every run starts fresh processes, the OS file
+# cache is left as it is, so drop it between runs for disk-cold numbers. The startup traces of every run are written to
+# Saved/Profiling and open in chrome://tracing.
+#
+# Usage: Scripts/StartupTime.sh [runs] [map]
+# Environment:
+#   UE4_EDITOR   path to UE4Editor, defaults to $UE4_ROOT/Engine/Binaries/Linux/UE4Editor
+#   PORT         server port, defaults to 7777
+#   TIMEOUT      seconds to wait for each process to become playable, defaults to 300
+
+set -euo pipefail
+
+RUNS=${1:-3}
+MAP=${2:-/Game/Maps/Prototyping}
+PORT=${PORT:-7777}
+TIMEOUT=${TIMEOUT:-300}
+
+PROJECT_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)
+PROJECT="$PROJECT_DIR/CityBuilderRPG.uproject"
+UE4_EDITOR=${UE4_EDITOR:-${UE4_ROOT:-}/Engine/Binaries/Linux/UE4Editor}
+
+if [[ ! -x "$UE4_EDITOR" ]]; then
+	echo "UE4Editor not found at '$UE4_EDITOR', set UE4_EDITOR or UE4_ROOT" >&2
+	exit 1
+fi
+
+RUN_DIR="$PROJECT_DIR/Saved/StartupTime/$(date +%Y%m%d-%H%M%S)"
+mkdir -p "$RUN_DIR"
+
+OFFLINE_ARGS=(-nosteam "-ini:Engine:[OnlineSubsystem]:DefaultPlatformService=Null" -unattended -nosplash -nosound)
+
+PIDS=()
+cleanup()
+{
+	for pid in ${PIDS[@]+"${PIDS[@]}"}; do
+		kill "$pid" 2>/dev/null || true
+	done
+	PIDS=()
+}
+trap cleanup EXIT
+
+# Prints the seconds from boot to first playable from the log, fails if the process exits or times out first
+wait_for_playable()
+{
+	local log=$1 pid=$2
+	local deadline=$((SECONDS + TIMEOUT))
+	while ((SECONDS < deadline)); do
+		if [[ -f "$log" ]] && grep -q "First playable" "$log"; then
+			sed -n 's/.*First playable \([0-9.]*\) seconds.*/\1/p' "$log" | head -n 1
+			return 0
+		fi
+		if ! kill -0 "$pid" 2>/dev/null; then
+			return 1
+		fi
+		sleep 0.5
+	done
+	return 1
+}
+
+RESULTS="$RUN_DIR/Results.txt"
+printf "%-8s %-4s %12s %12s\n" mode run server_s client_s | tee "$RESULTS"
+
+for MODE in sync preload; do
+	ENABLE=False
+	if [[ "$MODE" == preload ]]; then
+		ENABLE=True
+	fi
+	PRELOAD_ARG="-ini:Game:[/Script/SpaceRPG.StartupPreloadSubsystem]:bEnablePreload=$ENABLE"
+
+	for ((run = 1; run <= RUNS; run++)); do
+		SERVER_LOG="$RUN_DIR/Server-$MODE-$run.log"
+		CLIENT_LOG="$RUN_DIR/Client-$MODE-$run.log"
+
+		"$UE4_EDITOR" "$PROJECT" "$MAP" -server -port="$PORT" "${OFFLINE_ARGS[@]}" "$PRELOAD_ARG" -abslog="$SERVER_LOG" &
+		PIDS+=($!)
+		SERVER_TIME=$(wait_for_playable "$SERVER_LOG" "${PIDS[0]}" || echo failed)
+
+		CLIENT_TIME=failed
+		if [[ "$SERVER_TIME" != failed ]]; then
+			"$UE4_EDITOR" "$PROJECT" "127.0.0.1:$PORT" -game -nullrhi -windowed -resx=64 -resy=64 \
+				"${OFFLINE_ARGS[@]}" "$PRELOAD_ARG" -abslog="$CLIENT_LOG" &
+			PIDS+=($!)
+			CLIENT_TIME=$(wait_for_playable "$CLIENT_LOG" "${PIDS[1]}" || echo failed)
+		fi
+
+		cleanup
+		wait 2>/dev/null || true
+		printf "%-8s %-4s %12s %12s\n" "$MODE" "$run" "$SERVER_TIME" "$CLIENT_TIME" | tee -a "$RESULTS"
+	done
+done
+
+echo "Logs and results in $RUN_DIR, startup traces in $PROJECT_DIR/Saved/Profiling"
@@ -1,8 +1,14 @@
 // Copyright SpaceRPG 2020
 
 #include "Building.h"
-#include "Kismet/KismetMathLibrary.h"
+#include "SpaceRPGMemory.h"
 #include "GameFramework/Actor.h"
+#include "BuildingStreamingSubsystem.h"
+#include "BuildingRegistry.h"
+#include "BuildingGrid.h"
+#include "Engine/World.h"
+#include "Engine/StaticMesh.h"
+#include "Net/UnrealNetwork.h"
 
 // Sets default values
 ABuilding::ABuilding()
@@ -15,42 +21,187 @@ ABuilding::ABuilding()
 	RootComponent = BuildingMesh;
 }
 
+void ABuilding::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(ABuilding, buildingType, COND_InitialOnly);
+}
+
+void ABuilding::SetBuildingType(int32 newType)
+{
+	buildingType = newType;
+	ApplyBuildingTypeMesh();
+}
+
+void ABuilding::OnRep_BuildingType()
+{
+	ApplyBuildingTypeMesh();
+}
+
+void ABuilding::ApplyBuildingTypeMesh()
+{
+	SPACERPG_LLM_SCOPE(Buildings);
+
+	if (buildingType == INDEX_NONE)
+	{
+		return;
+	}
+
+	UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(this);
+	if (streaming == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Building::Could not find the building streaming subsystem."))
+		return;
+	}
+
+	//The bounds are calculated from the mesh in BeginPlay, so the mesh has to be set straight away
+	UStaticMesh* mesh = streaming->LoadMeshSynchronous(buildingType);
+	if (mesh != nullptr)
+	{
+		BuildingMesh->SetStaticMesh(mesh);
+	}
+}
+
 // Called when the game starts or when spawned
 void ABuilding::BeginPlay()
 {
-	Super::BeginPlay();
+	SPACERPG_LLM_SCOPE(Buildings);
 
-	//Calculate Building Bounds
-	//Creating vectors for outputs of GetActorBounds
-	FVector boxExtent;
-	FVector origin;
+	Super::BeginPlay();
 
-	AActor::GetActorBounds(false, origin, boxExtent, false);
+	//Buildings spawned with a type exposed on spawn have not applied their mesh yet
+	if (buildingType != INDEX_NONE && BuildingMesh->GetStaticMesh() == nullptr)
+	{
+		ApplyBuildingTypeMesh();
+	}
 
-	//Multiplying to make bounding box slightly smaller so buildings can be placed directly next to each other without collisions blocking it.
-	boxExtent *= 0.99f;
+	UpdateFootprint();
 
-	//Dividing by 100 for bounding box to be snapped to nearest 100
-	boxExtent /= 100.0f;
+	//Add the building to the grid index
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->RegisterBuilding(this);
+	}
+}
 
-	//Working out upper bounds of x, y, z for building bounds
-	int32 x = UKismetMathLibrary::FCeil(boxExtent.X);
-	int32 y = UKismetMathLibrary::FCeil(boxExtent.Y);
-	int32 z = UKismetMathLibrary::FCeil(boxExtent.Z);
+void ABuilding::UpdateFootprint()
+{
+	//Calculate the building's footprint in whole cells from the mesh's own bounds, then turn it with the building. Yaws
+	//off a quarter turn take up every cell under the turned bounds
+	FVector scale = GetActorScale3D().GetAbs();
+	FBoxSphereBounds localBounds = BuildingMesh->CalcBounds(FTransform(FQuat::Identity, FVector::ZeroVector, scale));
+	float yaw = GetActorRotation().Yaw;
+	int32 quarterTurns = FBuildingGrid::YawToQuarterTurns(yaw);
+	if (FMath::IsNearlyZero(FRotator::NormalizeAxis(yaw - quarterTurns * 90.0f), KINDA_SMALL_NUMBER * 100.0f))
+	{
+		footprintCells = FBuildingGrid::RotateExtent(FBuildingGrid::ExtentToCells(localBounds.BoxExtent), quarterTurns);
+	}
+	else
+	{
+		footprintCells = FBuildingGrid::TurnedExtentToCells(localBounds.BoxExtent, yaw);
+	}
 
-	//Calculating final buildings bound, snapped to the nearest 100
-	buildingBounds = FVector(x, y, z) * 100.0f;
+	//Building bounds are the footprint in world units
+	buildingBounds = FBuildingGrid::CellToWorld(footprintCells);
 
 	//Filling snap positions array
-	snapPositions.Insert(FVector(buildingBounds.X, 0, 0), 0);
-	snapPositions.Insert(FVector(buildingBounds.X * -1.0f, 0, 0), 1);
-	snapPositions.Insert(FVector(0, buildingBounds.Y, 0), 2);
-	snapPositions.Insert(FVector(0, buildingBounds.Y * -1.0f, 0), 3);
-	//snapPositions.Insert(FVector(0, 0, buildingBounds.Z), 4);
-	//snapPositions.Insert(FVector(0, 0, buildingBounds.Z * -1.0f), 5);
-
-	//Ensure size of snap positions is kept at 4
-	snapPositions.SetNum(4);
+	snapPositions.SetNum(6);
+	snapPositions[0] = FVector(buildingBounds.X, 0, 0);
+	snapPositions[1] = FVector(buildingBounds.X * -1.0f, 0, 0);
+	snapPositions[2] = FVector(0, buildingBounds.Y, 0);
+	snapPositions[3] = FVector(0, buildingBounds.Y * -1.0f, 0);
+	snapPositions[4] = FVector(0, 0, buildingBounds.Z);
+	snapPositions[5] = FVector(0, 0, buildingBounds.Z * -1.0f);
+}
+
+void ABuilding::Retire()
+{
+	if (bRetired)
+	{
+		return;
+	}
+
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->UnregisterBuilding(this);
+	}
+
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+	bRetired = true;
+}
+
+void ABuilding::Revive(const FTransform& transform, int32 newType)
+{
+	SPACERPG_LLM_SCOPE(Buildings);
+
+	SetActorTransform(transform, false, nullptr, ETeleportType::TeleportPhysics);
+
+	//Untyped buildings use the class's own mesh
+	if (newType == INDEX_NONE)
+	{
+		buildingType = INDEX_NONE;
+		BuildingMesh->SetStaticMesh(GetClass()->GetDefaultObject<ABuilding>()->GetBuildingMesh()->GetStaticMesh());
+	}
+	else if (newType != buildingType)
+	{
+		SetBuildingType(newType);
+	}
+
+	UpdateFootprint();
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+	bRetired = false;
+
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->RegisterBuilding(this);
+	}
+}
+
+void ABuilding::TurnInPlace(float yaw)
+{
+	UBuildingRegistry* registry = bRetired ? nullptr : GetWorld()->GetSubsystem<UBuildingRegistry>();
+	if (registry != nullptr)
+	{
+		registry->UnregisterBuilding(this);
+	}
+
+	SetActorRotation(FRotator(0.0f, yaw, 0.0f));
+	UpdateFootprint();
+
+	if (registry != nullptr)
+	{
+		registry->RegisterBuilding(this);
+	}
+}
+
+void ABuilding::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->UnregisterBuilding(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ABuilding::GetSocketCells(TArray<FIntVector, TInlineAllocator<6>>& outCells) const
+{
+	//The footprint is worked out as the building begins play
+	if (snapPositions.Num() == 0)
+	{
+		return;
+	}
+
+	//The preview snaps new buildings to twice the snap position, so neighbours sit at those cells
+	FIntVector socketOffsets[6];
+	FBuildingGrid::GetSocketOffsets(footprintCells, socketOffsets);
+	for (const FIntVector& socketOffset : socketOffsets)
+	{
+		outCells.Add(gridCell + socketOffset);
+	}
 }
 
 // Called every frame
@@ -26,10 +26,59 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Building, meta = (AllowPrivateAccess = "true"))
 	FVector buildingBounds;
 
+	//Building type from the palette, INDEX_NONE if the mesh was set directly
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, ReplicatedUsing = OnRep_BuildingType, Category = Building, meta = (ExposeOnSpawn = "true"))
+	int32 buildingType = INDEX_NONE;
+
+	//Grid cell the building was registered at
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Building)
+	FIntVector gridCell;
+
+	//Half size of the building in whole cells, turned with the building
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Building)
+	FIntVector footprintCells;
+
+	//Sets the building type and its mesh, should be called before the building begins play
+	UFUNCTION(BlueprintCallable, Category = Building)
+	void SetBuildingType(int32 newType);
+
+	UFUNCTION()
+	void OnRep_BuildingType();
+
+	FORCEINLINE class UStaticMeshComponent* GetBuildingMesh() const { return BuildingMesh; }
+
+	//Returns the grid cells a neighbour snapped to each snap position would occupy, in the order of the snap positions
+	void GetSocketCells(TArray<FIntVector, TInlineAllocator<6>>& outCells) const;
+
+	//Takes the building out of the world without destroying it, and puts it back at a new place with a new type.
+	//Used by the command log so undo and redo reuse buildings instead of spawning and destroying them
+	void Retire();
+	void Revive(const FTransform& transform, int32 newType);
+
+	FORCEINLINE bool IsRetired() const { return bRetired; }
+
+	//Turns the building about its cell to the yaw. The building leaves the registry and is added again with its new
+	//footprint, so the systems that track the city drop its old sockets and pick up the turned ones
+	void TurnInPlace(float yaw);
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	// Called when the building is destroyed or removed from the world
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+private:
+	//Applies the mesh for the current building type
+	void ApplyBuildingTypeMesh();
+
+	//Works out the footprint, bounds and snap positions from the mesh and the building's rotation
+	void UpdateFootprint();
+
+	bool bRetired = false;
 };
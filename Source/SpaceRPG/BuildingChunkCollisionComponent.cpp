@@ -0,0 +1,103 @@
+// Copyright SpaceRPG 2020
+
+#include "BuildingChunkCollisionComponent.h"
+#include "PhysicsEngine/BodySetup.h"
+
+UBuildingChunkCollisionComponent::UBuildingChunkCollisionComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+	SetGenerateOverlapEvents(true);
+
+	//The preview sweeps for buildings as world dynamic objects
+	SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
+	SetCollisionObjectType(ECC_WorldDynamic);
+	SetCollisionResponseToAllChannels(ECR_Block);
+}
+
+void UBuildingChunkCollisionComponent::SetBuildingBoxes(const FIntVector& cell, TArray<FKBoxElem>&& boxes)
+{
+	buildingBoxes.Add(cell, MoveTemp(boxes));
+}
+
+void UBuildingChunkCollisionComponent::RemoveBuilding(const FIntVector& cell)
+{
+	buildingBoxes.Remove(cell);
+}
+
+void UBuildingChunkCollisionComponent::RebuildBody()
+{
+	if (chunkBodySetup == nullptr)
+	{
+		chunkBodySetup = NewObject<UBodySetup>(this, NAME_None, RF_Transient);
+		chunkBodySetup->CollisionTraceFlag = CTF_UseSimpleAsComplex;
+		chunkBodySetup->bGenerateMirroredCollision = false;
+	}
+
+	//Boxes need no cooking, so the body can be rebuilt at runtime
+	chunkBodySetup->InvalidatePhysicsData();
+	chunkBodySetup->AggGeom.BoxElems.Reset(GetNumBoxes());
+	for (const auto& pair : buildingBoxes)
+	{
+		chunkBodySetup->AggGeom.BoxElems.Append(pair.Value);
+	}
+	chunkBodySetup->CreatePhysicsMeshes();
+
+	RecreatePhysicsState();
+	UpdateBounds();
+}
+
+bool UBuildingChunkCollisionComponent::FindBuildingCell(const FVector& location, float tolerance, FIntVector& outCell) const
+{
+	for (const auto& pair : buildingBoxes)
+	{
+		for (const FKBoxElem& box : pair.Value)
+		{
+			FVector local = box.Rotation.UnrotateVector(location - box.Center);
+			if (FMath::Abs(local.X) <= box.X * 0.5f + tolerance
+				&& FMath::Abs(local.Y) <= box.Y * 0.5f + tolerance
+				&& FMath::Abs(local.Z) <= box.Z * 0.5f + tolerance)
+			{
+				outCell = pair.Key;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+int32 UBuildingChunkCollisionComponent::GetNumBoxes() const
+{
+	int32 numBoxes = 0;
+	for (const auto& pair : buildingBoxes)
+	{
+		numBoxes += pair.Value.Num();
+	}
+	return numBoxes;
+}
+
+SIZE_T UBuildingChunkCollisionComponent::GetAllocatedSize() const
+{
+	SIZE_T size = buildingBoxes.GetAllocatedSize();
+	for (const auto& pair : buildingBoxes)
+	{
+		size += pair.Value.GetAllocatedSize();
+	}
+	if (chunkBodySetup != nullptr)
+	{
+		size += chunkBodySetup->AggGeom.BoxElems.GetAllocatedSize();
+	}
+	return size;
+}
+
+FBoxSphereBounds UBuildingChunkCollisionComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	FBox bounds(ForceInit);
+	for (const auto& pair : buildingBoxes)
+	{
+		for (const FKBoxElem& box : pair.Value)
+		{
+			bounds += box.CalcAABB(LocalToWorld, 1.0f);
+		}
+	}
+	return bounds.IsValid ? FBoxSphereBounds(bounds) : FBoxSphereBounds(LocalToWorld.GetLocation(), FVector::ZeroVector, 0.0f);
+}
@@ -0,0 +1,45 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/PrimitiveComponent.h"
+#include "PhysicsEngine/BoxElem.h"
+#include "BuildingChunkCollisionComponent.generated.h"
+
+//Collision of every building in a chunk merged into one body of boxes, placed at the world origin
+UCLASS()
+class SPACERPG_API UBuildingChunkCollisionComponent : public UPrimitiveComponent
+{
+	GENERATED_BODY()
+
+public:
+	UBuildingChunkCollisionComponent();
+
+	//Sets the world space boxes of the building at the cell, replacing any it had
+	void SetBuildingBoxes(const FIntVector& cell, TArray<FKBoxElem>&& boxes);
+
+	void RemoveBuilding(const FIntVector& cell);
+
+	//Rebuilds the body from the boxes of every building, called once per frame for chunks that changed
+	void RebuildBody();
+
+	//Finds the building whose boxes contain the location, allowing for the tolerance
+	bool FindBuildingCell(const FVector& location, float tolerance, FIntVector& outCell) const;
+
+	FORCEINLINE int32 GetNumBuildings() const { return buildingBoxes.Num(); }
+	int32 GetNumBoxes() const;
+
+	//Memory held by the building boxes and the body built from them
+	SIZE_T GetAllocatedSize() const;
+
+	//UPrimitiveComponent interface
+	virtual UBodySetup* GetBodySetup() override { return chunkBodySetup; }
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+
+private:
+	UPROPERTY(Transient)
+	class UBodySetup* chunkBodySetup;
+
+	TMap<FIntVector, TArray<FKBoxElem>> buildingBoxes;
+};
@@ -0,0 +1,395 @@
+// Copyright SpaceRPG 2020
+
+#include "BuildingCollisionSubsystem.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
+#include "Building.h"
+#include "BuildingChunkCollisionComponent.h"
+#include "BuildingCommandLog.h"
+#include "BuildingRegistry.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "PhysicsEngine/BodySetup.h"
+
+DECLARE_CYCLE_STAT(TEXT("Building Chunk Collision Rebuild"), STAT_BuildingChunkCollisionRebuild, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Building Collision Chunks Rebuilt"), STAT_BuildingCollisionChunksRebuilt, STATGROUP_SpaceRPG);
+
+//Merges the two boxes whose union adds the least volume until at most maxBoxes are left
+static void MergeBoxes(TArray<FBox>& boxes, int32 maxBoxes)
+{
+	while (boxes.Num() > FMath::Max(maxBoxes, 1))
+	{
+		int32 bestA = 0;
+		int32 bestB = 1;
+		float bestGrowth = MAX_flt;
+		for (int32 a = 0; a < boxes.Num(); a++)
+		{
+			for (int32 b = a + 1; b < boxes.Num(); b++)
+			{
+				float growth = (boxes[a] + boxes[b]).GetVolume() - boxes[a].GetVolume() - boxes[b].GetVolume();
+				if (growth < bestGrowth)
+				{
+					bestGrowth = growth;
+					bestA = a;
+					bestB = b;
+				}
+			}
+		}
+
+		boxes[bestA] += boxes[bestB];
+		boxes.RemoveAtSwap(bestB);
+	}
+}
+
+void UBuildingCollisionSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	UBuildingRegistry* registry = Cast<UBuildingRegistry>(Collection.InitializeDependency(UBuildingRegistry::StaticClass()));
+	if (registry != nullptr)
+	{
+		buildingAddedHandle = registry->OnBuildingAdded.AddUObject(this, &UBuildingCollisionSubsystem::OnBuildingAdded);
+		buildingRemovedHandle = registry->OnBuildingRemoved.AddUObject(this, &UBuildingCollisionSubsystem::OnBuildingRemoved);
+	}
+
+	UBuildingCommandLog* commandLog = Cast<UBuildingCommandLog>(Collection.InitializeDependency(UBuildingCommandLog::StaticClass()));
+	if (commandLog != nullptr)
+	{
+		commandsAppliedHandle = commandLog->OnCommandsApplied.AddUObject(this, &UBuildingCollisionSubsystem::OnCommandsApplied);
+	}
+}
+
+void UBuildingCollisionSubsystem::Deinitialize()
+{
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->OnBuildingAdded.Remove(buildingAddedHandle);
+		registry->OnBuildingRemoved.Remove(buildingRemovedHandle);
+	}
+	if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+	{
+		commandLog->OnCommandsApplied.Remove(commandsAppliedHandle);
+	}
+
+	archetypes.Empty();
+	chunkComponents.Empty();
+	dirtyChunks.Empty();
+
+	Super::Deinitialize();
+}
+
+void UBuildingCollisionSubsystem::Tick(float DeltaTime)
+{
+	FlushDirtyChunks();
+}
+
+ETickableTickType UBuildingCollisionSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UBuildingCollisionSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBuildingCollisionSubsystem, STATGROUP_Tickables);
+}
+
+ABuilding* UBuildingCollisionSubsystem::FindHitBuilding(const FHitResult& hit) const
+{
+	UBuildingChunkCollisionComponent* chunkComponent = Cast<UBuildingChunkCollisionComponent>(hit.GetComponent());
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	if (chunkComponent == nullptr || registry == nullptr)
+	{
+		return nullptr;
+	}
+
+	//Look just inside the surface that was hit
+	FIntVector cell;
+	FVector insidePoint = hit.ImpactPoint - hit.ImpactNormal;
+	return chunkComponent->FindBuildingCell(insidePoint, boxInset + 1.0f, cell) ? registry->FindBuilding(cell) : nullptr;
+}
+
+void UBuildingCollisionSubsystem::AddIgnoredChunks(FCollisionQueryParams& queryParams) const
+{
+	for (const auto& pair : chunkComponents)
+	{
+		queryParams.AddIgnoredComponent(pair.Value);
+	}
+}
+
+void UBuildingCollisionSubsystem::SetChunkCollisionEnabled(bool bEnabled)
+{
+	if (bEnabled == bUseChunkCollision)
+	{
+		return;
+	}
+
+	bUseChunkCollision = bEnabled;
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	if (registry == nullptr)
+	{
+		return;
+	}
+
+	if (bUseChunkCollision)
+	{
+		for (const auto& pair : registry->GetBuildings())
+		{
+			AddToChunk(pair.Value);
+		}
+		return;
+	}
+
+	for (const auto& pair : registry->GetBuildings())
+	{
+		RestoreMeshCollision(pair.Value);
+	}
+	for (const auto& pair : chunkComponents)
+	{
+		if (pair.Value != nullptr && pair.Value->GetOwner() != nullptr)
+		{
+			pair.Value->GetOwner()->Destroy();
+		}
+	}
+	chunkComponents.Empty();
+	dirtyChunks.Empty();
+}
+
+void UBuildingCollisionSubsystem::FlushDirtyChunks()
+{
+	SPACERPG_LLM_SCOPE(Collision);
+
+	if (dirtyChunks.Num() == 0)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_BuildingChunkCollisionRebuild);
+	SET_DWORD_STAT(STAT_BuildingCollisionChunksRebuilt, dirtyChunks.Num());
+
+	for (const FIntPoint& chunk : dirtyChunks)
+	{
+		if (UBuildingChunkCollisionComponent** chunkComponent = chunkComponents.Find(chunk))
+		{
+			(*chunkComponent)->RebuildBody();
+		}
+	}
+	dirtyChunks.Reset();
+}
+
+int32 UBuildingCollisionSubsystem::GetNumCollisionShapes() const
+{
+	int32 numShapes = 0;
+	if (bUseChunkCollision)
+	{
+		for (const auto& pair : chunkComponents)
+		{
+			numShapes += pair.Value ? pair.Value->GetNumBoxes() : 0;
+		}
+		return numShapes;
+	}
+
+	//Each building holds its mesh's simple shapes, or one triangle mesh when it uses complex collision
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	if (registry != nullptr)
+	{
+		for (const auto& pair : registry->GetBuildings())
+		{
+			UStaticMesh* mesh = pair.Value->GetBuildingMesh()->GetStaticMesh();
+			UBodySetup* bodySetup = mesh ? mesh->GetBodySetup() : nullptr;
+			if (bodySetup != nullptr)
+			{
+				numShapes += bodySetup->CollisionTraceFlag == CTF_UseComplexAsSimple ? 1 : bodySetup->AggGeom.GetElementCount();
+			}
+		}
+	}
+	return numShapes;
+}
+
+SIZE_T UBuildingCollisionSubsystem::GetAllocatedSize() const
+{
+	SIZE_T size = archetypes.GetAllocatedSize() + chunkComponents.GetAllocatedSize() + dirtyChunks.GetAllocatedSize();
+	for (const auto& pair : archetypes)
+	{
+		size += pair.Value.GetAllocatedSize();
+	}
+	for (const auto& pair : chunkComponents)
+	{
+		size += pair.Value ? pair.Value->GetAllocatedSize() : 0;
+	}
+	return size;
+}
+
+void UBuildingCollisionSubsystem::OnBuildingAdded(ABuilding* building)
+{
+	if (bUseChunkCollision)
+	{
+		AddToChunk(building);
+	}
+}
+
+void UBuildingCollisionSubsystem::OnBuildingRemoved(ABuilding* building)
+{
+	FIntPoint chunk = GetChunk(building->gridCell);
+	if (UBuildingChunkCollisionComponent** chunkComponent = chunkComponents.Find(chunk))
+	{
+		(*chunkComponent)->RemoveBuilding(building->gridCell);
+		dirtyChunks.Add(chunk);
+	}
+}
+
+void UBuildingCollisionSubsystem::OnCommandsApplied(const TArray<FBuildingCommandRecord>& records)
+{
+	if (!bUseChunkCollision)
+	{
+		return;
+	}
+
+	//Rotations don't go through the registry, so move the boxes of rotated buildings here
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	for (const FBuildingCommandRecord& record : records)
+	{
+		ABuilding* building = registry && record.GetCommand() == EBuildingCommand::Rotate ? registry->FindBuilding(record.GetCell()) : nullptr;
+		if (building != nullptr)
+		{
+			AddToChunk(building);
+		}
+	}
+}
+
+void UBuildingCollisionSubsystem::AddToChunk(ABuilding* building)
+{
+	SPACERPG_LLM_SCOPE(Collision);
+
+	UStaticMeshComponent* meshComponent = building->GetBuildingMesh();
+	UStaticMesh* mesh = meshComponent->GetStaticMesh();
+	if (mesh == nullptr)
+	{
+		return;
+	}
+
+	//Transform the archetype's boxes onto the building
+	FTransform transform = meshComponent->GetComponentTransform();
+	FVector scale = transform.GetScale3D().GetAbs();
+	TArray<FKBoxElem> boxes = GetArchetype(mesh);
+	for (FKBoxElem& box : boxes)
+	{
+		box.Center = transform.TransformPosition(box.Center);
+		box.Rotation = (transform.GetRotation() * box.Rotation.Quaternion()).Rotator();
+		box.X *= scale.X;
+		box.Y *= scale.Y;
+		box.Z *= scale.Z;
+	}
+
+	FIntPoint chunk = GetChunk(building->gridCell);
+	UBuildingChunkCollisionComponent* chunkComponent = FindOrCreateChunk(chunk);
+	if (chunkComponent == nullptr)
+	{
+		return;
+	}
+
+	chunkComponent->SetBuildingBoxes(building->gridCell, MoveTemp(boxes));
+	dirtyChunks.Add(chunk);
+
+	meshComponent->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+}
+
+void UBuildingCollisionSubsystem::RestoreMeshCollision(ABuilding* building)
+{
+	building->GetBuildingMesh()->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
+}
+
+const TArray<FKBoxElem>& UBuildingCollisionSubsystem::GetArchetype(UStaticMesh* mesh)
+{
+	SPACERPG_LLM_SCOPE(Collision);
+
+	if (const TArray<FKBoxElem>* archetype = archetypes.Find(mesh))
+	{
+		return *archetype;
+	}
+
+	//Start from the bounds of the mesh's simple shapes, or the mesh bounds if it has none
+	TArray<FBox> boxes;
+	if (UBodySetup* bodySetup = mesh->GetBodySetup())
+	{
+		const FKAggregateGeom& geometry = bodySetup->AggGeom;
+		for (const FKBoxElem& element : geometry.BoxElems)
+		{
+			boxes.Add(element.CalcAABB(FTransform::Identity, 1.0f));
+		}
+		for (const FKSphereElem& element : geometry.SphereElems)
+		{
+			boxes.Add(element.CalcAABB(FTransform::Identity, 1.0f));
+		}
+		for (const FKSphylElem& element : geometry.SphylElems)
+		{
+			boxes.Add(element.CalcAABB(FTransform::Identity, 1.0f));
+		}
+		for (const FKConvexElem& element : geometry.ConvexElems)
+		{
+			boxes.Add(element.CalcAABB(FTransform::Identity, FVector::OneVector));
+		}
+	}
+	if (boxes.Num() == 0)
+	{
+		boxes.Add(mesh->GetBoundingBox());
+	}
+
+	MergeBoxes(boxes, maxArchetypeBoxes);
+
+	TArray<FKBoxElem>& archetype = archetypes.Add(mesh);
+	const float snapSize = UBuildingRegistry::CellSize * 0.5f;
+	for (const FBox& box : boxes)
+	{
+		//Snap each face to the half cell grid, keeping the original size along axes too thin to snap
+		FVector snappedMin = box.Min.GridSnap(snapSize);
+		FVector snappedMax = box.Max.GridSnap(snapSize);
+		FVector min = box.Min;
+		FVector max = box.Max;
+		for (int32 axis = 0; axis < 3; axis++)
+		{
+			if (snappedMax[axis] > snappedMin[axis])
+			{
+				min[axis] = snappedMin[axis];
+				max[axis] = snappedMax[axis];
+			}
+
+			//Shrink so the boxes of buildings placed side by side don't touch
+			if (max[axis] - min[axis] > boxInset * 4.0f)
+			{
+				min[axis] += boxInset;
+				max[axis] -= boxInset;
+			}
+		}
+
+		FVector size = max - min;
+		FKBoxElem& element = archetype.Emplace_GetRef(size.X, size.Y, size.Z);
+		element.Center = (min + max) * 0.5f;
+	}
+	return archetype;
+}
+
+UBuildingChunkCollisionComponent* UBuildingCollisionSubsystem::FindOrCreateChunk(const FIntPoint& chunk)
+{
+	if (UBuildingChunkCollisionComponent** existing = chunkComponents.Find(chunk))
+	{
+		return *existing;
+	}
+
+	//A plain actor at the world origin holds the chunk body, the boxes are already in world space
+	FActorSpawnParameters spawnParams;
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	AActor* chunkActor = GetWorld()->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, spawnParams);
+	if (chunkActor == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("BuildingCollisionSubsystem::Could not spawn the collision actor for chunk %d, %d."), chunk.X, chunk.Y)
+		return nullptr;
+	}
+
+	UBuildingChunkCollisionComponent* chunkComponent = NewObject<UBuildingChunkCollisionComponent>(chunkActor);
+	chunkActor->SetRootComponent(chunkComponent);
+	chunkComponent->RegisterComponent();
+
+	chunkComponents.Add(chunk, chunkComponent);
+	return chunkComponent;
+}
@@ -0,0 +1,97 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "PhysicsEngine/BoxElem.h"
+#include "BuildingCollisionSubsystem.generated.h"
+
+//Replaces the mesh collision of placed buildings with a few grid aligned boxes per building archetype,
+//merged into one body per chunk so the physics scene holds a body per chunk rather than per building
+UCLASS(Config = Game)
+class SPACERPG_API UBuildingCollisionSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	//Finds the building a hit on a merged chunk body belongs to, or nullptr if the hit was not on one
+	class ABuilding* FindHitBuilding(const FHitResult& hit) const;
+
+	//Makes a query ignore every merged chunk body, for traces that are only looking for the ground
+	void AddIgnoredChunks(struct FCollisionQueryParams& queryParams) const;
+
+	//Switches between merged chunk collision and each building's own mesh collision
+	UFUNCTION(BlueprintCallable, Category = Collision)
+	void SetChunkCollisionEnabled(bool bEnabled);
+
+	UFUNCTION(BlueprintPure, Category = Collision)
+	bool IsChunkCollisionEnabled() const { return bUseChunkCollision; }
+
+	//Rebuilds the bodies of chunks that changed, normally done once a frame
+	void FlushDirtyChunks();
+
+	//Collision shapes held by placed buildings in the physics scene
+	int32 GetNumCollisionShapes() const;
+
+	//Memory held by the merged boxes of the chunks and the mesh archetypes
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	UPROPERTY(Config)
+	bool bUseChunkCollision = true;
+
+	//Cells along each side of a collision chunk
+	UPROPERTY(Config)
+	int32 chunkCells = 32;
+
+	//Most boxes generated for one building archetype
+	UPROPERTY(Config)
+	int32 maxArchetypeBoxes = 4;
+
+	//Distance each box is shrunk by so neighbouring buildings don't touch
+	UPROPERTY(Config)
+	float boxInset = 1.0f;
+
+	//Local space boxes generated for each building mesh
+	TMap<TWeakObjectPtr<class UStaticMesh>, TArray<FKBoxElem>> archetypes;
+
+	UPROPERTY()
+	TMap<FIntPoint, class UBuildingChunkCollisionComponent*> chunkComponents;
+
+	TSet<FIntPoint> dirtyChunks;
+
+	FDelegateHandle buildingAddedHandle;
+	FDelegateHandle buildingRemovedHandle;
+	FDelegateHandle commandsAppliedHandle;
+
+	FORCEINLINE FIntPoint GetChunk(const FIntVector& cell) const
+	{
+		return FIntPoint(
+			cell.X >= 0 ? cell.X / chunkCells : (cell.X - chunkCells + 1) / chunkCells,
+			cell.Y >= 0 ? cell.Y / chunkCells : (cell.Y - chunkCells + 1) / chunkCells);
+	}
+
+	void OnBuildingAdded(class ABuilding* building);
+	void OnBuildingRemoved(class ABuilding* building);
+	void OnCommandsApplied(const TArray<struct FBuildingCommandRecord>& records);
+
+	//Moves a building's collision into its chunk body, or back onto its mesh
+	void AddToChunk(class ABuilding* building);
+	void RestoreMeshCollision(class ABuilding* building);
+
+	//Returns the boxes for a mesh, generating them the first time the mesh is used
+	const TArray<FKBoxElem>& GetArchetype(class UStaticMesh* mesh);
+
+	class UBuildingChunkCollisionComponent* FindOrCreateChunk(const FIntPoint& chunk);
+};
@@ -0,0 +1,461 @@
+// Copyright SpaceRPG 2020
+
+#include "BuildingCommandLog.h"
+#include "SpaceRPGMemory.h"
+#include "Building.h"
+#include "BuildingRegistry.h"
+#include "StartupPreloadSubsystem.h"
+#include "Engine/World.h"
+
+FBuildingCommandRecord FBuildingCommandRecord::Make(EBuildingCommand command, const FIntVector& cell, int32 buildingType, uint8 rotation)
+{
+	FBuildingCommandRecord record;
+	record.cellX = cell.X;
+	record.cellY = cell.Y;
+	record.cellZ = cell.Z;
+	record.buildingType = buildingType == INDEX_NONE ? UntypedBuilding : (uint16)buildingType;
+	record.rotation = rotation;
+	record.flags = (uint8)command;
+	return record;
+}
+
+FBuildingCommandRecord FBuildingCommandRecord::Inverse() const
+{
+	//The inverse is not part of the original batch structure, so the batch flag is dropped
+	FBuildingCommandRecord inverse = *this;
+	inverse.flags = 0;
+
+	switch (GetCommand())
+	{
+	case EBuildingCommand::Place:
+		inverse.flags |= (uint8)EBuildingCommand::Demolish;
+		break;
+	case EBuildingCommand::Demolish:
+		inverse.flags |= (uint8)EBuildingCommand::Place;
+		break;
+	case EBuildingCommand::Rotate:
+		//Rotation wraps at a full turn, so the negated byte undoes the delta
+		inverse.flags |= (uint8)EBuildingCommand::Rotate;
+		inverse.rotation = (uint8)(256 - rotation);
+		break;
+	}
+	return inverse;
+}
+
+uint8 FBuildingCommandRecord::EncodeYaw(float yaw)
+{
+	return (uint8)(FMath::RoundToInt(FRotator::ClampAxis(yaw) * 256.0f / 360.0f) & 0xFF);
+}
+
+float FBuildingCommandRecord::DecodeYaw(uint8 rotation)
+{
+	return rotation * 360.0f / 256.0f;
+}
+
+void UBuildingCommandLog::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	records.SetNum(FMath::Max(logCapacity, 1));
+
+	//The class is looked up when the first building is spawned, by which time the preload has normally loaded it
+	if (UStartupPreloadSubsystem* preload = UStartupPreloadSubsystem::Get(this))
+	{
+		preload->Preload(buildingClass.ToSoftObjectPath());
+	}
+}
+
+UClass* UBuildingCommandLog::GetBuildingClass()
+{
+	if (loadedBuildingClass == nullptr)
+	{
+		loadedBuildingClass = buildingClass.IsNull() ? nullptr : buildingClass.LoadSynchronous();
+		if (loadedBuildingClass == nullptr)
+		{
+			loadedBuildingClass = ABuilding::StaticClass();
+		}
+	}
+	return loadedBuildingClass;
+}
+
+bool UBuildingCommandLog::PlaceBuilding(int32 buildingType, FVector location, float yaw)
+{
+	if (buildingType < 0 || buildingType >= FBuildingCommandRecord::UntypedBuilding)
+	{
+		UE_LOG(LogTemp, Error, TEXT("BuildingCommandLog::Invalid building type %d."), buildingType)
+		return false;
+	}
+
+	FIntVector cell = UBuildingRegistry::WorldToCell(location);
+	if (GetCellState(cell).bOccupied)
+	{
+		return false;
+	}
+
+	Submit(FBuildingCommandRecord::Make(EBuildingCommand::Place, cell, buildingType, FBuildingCommandRecord::EncodeYaw(yaw)));
+	return true;
+}
+
+bool UBuildingCommandLog::DemolishBuilding(ABuilding* building)
+{
+	if (building == nullptr)
+	{
+		return false;
+	}
+
+	FCellState state = GetCellState(building->gridCell);
+	if (!state.bOccupied)
+	{
+		return false;
+	}
+
+	//Keep the type and rotation so the demolish can be undone
+	Submit(FBuildingCommandRecord::Make(EBuildingCommand::Demolish, building->gridCell, state.buildingType, state.rotation));
+	return true;
+}
+
+bool UBuildingCommandLog::RotateBuilding(ABuilding* building, float deltaYaw)
+{
+	if (building == nullptr || !GetCellState(building->gridCell).bOccupied)
+	{
+		return false;
+	}
+
+	Submit(FBuildingCommandRecord::Make(EBuildingCommand::Rotate, building->gridCell, 0, FBuildingCommandRecord::EncodeYaw(deltaYaw)));
+	return true;
+}
+
+void UBuildingCommandLog::BeginBatch()
+{
+	batchDepth++;
+}
+
+void UBuildingCommandLog::EndBatch()
+{
+	if (batchDepth == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("BuildingCommandLog::EndBatch called without a matching BeginBatch."))
+		return;
+	}
+
+	batchDepth--;
+	if (batchDepth > 0 || pendingBatch.Num() == 0)
+	{
+		return;
+	}
+
+	ApplyRecords(pendingBatch);
+	WriteBatch(pendingBatch);
+	pendingBatch.Reset();
+	pendingCells.Reset();
+}
+
+bool UBuildingCommandLog::CanUndo() const
+{
+	return undoCursor > GetOldestSequence();
+}
+
+bool UBuildingCommandLog::Undo()
+{
+	if (!CanUndo() || batchDepth > 0)
+	{
+		return false;
+	}
+
+	//Walk back to the end of the previous batch
+	uint64 oldest = GetOldestSequence();
+	uint64 batchStart = undoCursor - 1;
+	while (batchStart > oldest && !GetRecord(batchStart - 1).IsBatchEnd())
+	{
+		batchStart--;
+	}
+
+	//The start of the batch has been overwritten, so it can no longer be undone as a whole
+	if (batchStart == oldest && oldest != oldestBatchStart)
+	{
+		return false;
+	}
+
+	TArray<FBuildingCommandRecord> inverseBatch;
+	inverseBatch.Reserve((int32)(undoCursor - batchStart));
+	for (uint64 sequence = undoCursor; sequence > batchStart; sequence--)
+	{
+		inverseBatch.Add(GetRecord(sequence - 1).Inverse());
+	}
+
+	ApplyRecords(inverseBatch);
+	undoCursor = batchStart;
+	return true;
+}
+
+bool UBuildingCommandLog::Redo()
+{
+	if (!CanRedo() || batchDepth > 0)
+	{
+		return false;
+	}
+
+	TArray<FBuildingCommandRecord> batch;
+	uint64 sequence = undoCursor;
+	while (sequence < writeSequence)
+	{
+		const FBuildingCommandRecord& record = GetRecord(sequence++);
+		batch.Add(record);
+		if (record.IsBatchEnd())
+		{
+			break;
+		}
+	}
+
+	ApplyRecords(batch);
+	undoCursor = sequence;
+	return true;
+}
+
+void UBuildingCommandLog::ApplyRecords(const TArray<FBuildingCommandRecord>& batch)
+{
+	SPACERPG_LLM_SCOPE(Buildings);
+
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	if (registry == nullptr || batch.Num() == 0)
+	{
+		return;
+	}
+
+	//Resolve the final state of every touched cell first, so each cell changes at most once
+	TMap<FIntVector, FCellState> finalStates;
+	finalStates.Reserve(batch.Num());
+	for (const FBuildingCommandRecord& record : batch)
+	{
+		FIntVector cell = record.GetCell();
+		FCellState* state = finalStates.Find(cell);
+		if (state == nullptr)
+		{
+			FCellState currentState;
+			if (ABuilding* existing = registry->FindBuilding(cell))
+			{
+				currentState.bOccupied = true;
+				currentState.buildingType = existing->buildingType;
+				currentState.rotation = FBuildingCommandRecord::EncodeYaw(existing->GetActorRotation().Yaw);
+			}
+			state = &finalStates.Add(cell, currentState);
+		}
+
+		switch (record.GetCommand())
+		{
+		case EBuildingCommand::Place:
+			state->bOccupied = true;
+			state->buildingType = record.GetBuildingType();
+			state->rotation = record.rotation;
+			break;
+		case EBuildingCommand::Demolish:
+			state->bOccupied = false;
+			break;
+		case EBuildingCommand::Rotate:
+			state->rotation += record.rotation;
+			break;
+		}
+	}
+
+	//Retired buildings are only revived while placed buildings stay local, as only then are new buildings local too
+	bool bReuseBuildings = bReplicateThroughSnapshots;
+
+	//First take every building that changes out of the world, turning the ones that stay
+	TArray<TPair<FIntVector, const FCellState*>, TInlineAllocator<64>> placements;
+	for (const auto& pair : finalStates)
+	{
+		const FCellState& state = pair.Value;
+		ABuilding* existing = registry->FindBuilding(pair.Key);
+		if (existing != nullptr)
+		{
+			if (state.bOccupied && existing->buildingType == state.buildingType)
+			{
+				//The footprint and sockets turn with the building, so it is registered again with them
+				if (FBuildingCommandRecord::EncodeYaw(existing->GetActorRotation().Yaw) != state.rotation)
+				{
+					existing->TurnInPlace(FBuildingCommandRecord::DecodeYaw(state.rotation));
+				}
+				continue;
+			}
+
+			//Buildings replicated as actors send their type once and don't replicate movement, so clients would never see
+			//one moved and retyped. Those are always destroyed, whatever spawned them
+			if (bReuseBuildings && !existing->GetIsReplicated())
+			{
+				existing->Retire();
+				retiredBuildings.Add(existing);
+			}
+			else
+			{
+				existing->Destroy();
+			}
+		}
+
+		if (state.bOccupied)
+		{
+			placements.Emplace(pair.Key, &state);
+		}
+	}
+
+	//Then place buildings, reusing retired ones before spawning, with spawns deferred so they all finish together
+	TArray<ABuilding*> spawnedBuildings;
+	for (const auto& placement : placements)
+	{
+		const FCellState& state = *placement.Value;
+		FTransform transform(FRotator(0.0f, FBuildingCommandRecord::DecodeYaw(state.rotation), 0.0f), UBuildingRegistry::CellToWorld(placement.Key));
+
+		ABuilding* retired = nullptr;
+		while (bReuseBuildings && retired == nullptr && retiredBuildings.Num() > 0)
+		{
+			retired = retiredBuildings.Pop(false);
+			retired = retired != nullptr && !retired->IsPendingKillPending() ? retired : nullptr;
+		}
+		if (retired != nullptr)
+		{
+			retired->Revive(transform, state.buildingType);
+			continue;
+		}
+
+		ABuilding* building = GetWorld()->SpawnActorDeferred<ABuilding>(GetBuildingClass(), transform, nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+		if (building != nullptr)
+		{
+			//Clients rebuild the city from snapshots and deltas, so the actors themselves stay local
+			if (bReplicateThroughSnapshots)
+			{
+				building->SetReplicates(false);
+			}
+			building->SetBuildingType(state.buildingType);
+			spawnedBuildings.Add(building);
+		}
+	}
+
+	for (ABuilding* building : spawnedBuildings)
+	{
+		building->FinishSpawning(building->GetTransform());
+	}
+
+	//Buildings retired past the limit are destroyed after all
+	while (retiredBuildings.Num() > FMath::Max(maxRetiredBuildings, 0))
+	{
+		if (ABuilding* retired = retiredBuildings.Pop(false))
+		{
+			retired->Destroy();
+		}
+	}
+
+	OnCommandsApplied.Broadcast(batch);
+}
+
+void UBuildingCommandLog::SubmitRecords(const TArray<FBuildingCommandRecord>& batch)
+{
+	BeginBatch();
+	for (const FBuildingCommandRecord& record : batch)
+	{
+		//Batch flags belong to the batch the records came from
+		FBuildingCommandRecord operation = FBuildingCommandRecord::Make(record.GetCommand(), record.GetCell(), record.GetBuildingType(), record.rotation);
+		FCellState state = GetCellState(operation.GetCell());
+		switch (operation.GetCommand())
+		{
+		case EBuildingCommand::Place:
+			if (!state.bOccupied)
+			{
+				Submit(operation);
+			}
+			break;
+		case EBuildingCommand::Demolish:
+			//The cell's own state is kept, so the demolish undoes to what was really there
+			if (state.bOccupied)
+			{
+				Submit(FBuildingCommandRecord::Make(EBuildingCommand::Demolish, operation.GetCell(), state.buildingType, state.rotation));
+			}
+			break;
+		case EBuildingCommand::Rotate:
+			if (state.bOccupied)
+			{
+				Submit(operation);
+			}
+			break;
+		}
+	}
+	EndBatch();
+}
+
+UBuildingCommandLog::FCellState UBuildingCommandLog::GetCellState(const FIntVector& cell) const
+{
+	if (const FCellState* pending = pendingCells.Find(cell))
+	{
+		return *pending;
+	}
+
+	FCellState state;
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	if (ABuilding* building = registry ? registry->FindBuilding(cell) : nullptr)
+	{
+		state.bOccupied = true;
+		state.buildingType = building->buildingType;
+		state.rotation = FBuildingCommandRecord::EncodeYaw(building->GetActorRotation().Yaw);
+	}
+	return state;
+}
+
+void UBuildingCommandLog::Submit(const FBuildingCommandRecord& record)
+{
+	//Cells simulated by another server are sent there instead
+	if (RouteCommand.IsBound() && RouteCommand.Execute(record))
+	{
+		return;
+	}
+
+	pendingBatch.Add(record);
+
+	//Track the pending state of the cell for validating later operations in the batch
+	FCellState state = GetCellState(record.GetCell());
+	switch (record.GetCommand())
+	{
+	case EBuildingCommand::Place:
+		state.bOccupied = true;
+		state.buildingType = record.GetBuildingType();
+		state.rotation = record.rotation;
+		break;
+	case EBuildingCommand::Demolish:
+		state.bOccupied = false;
+		break;
+	case EBuildingCommand::Rotate:
+		state.rotation += record.rotation;
+		break;
+	}
+	pendingCells.Add(record.GetCell(), state);
+
+	//Operations outside a batch are a batch of their own
+	if (batchDepth == 0)
+	{
+		BeginBatch();
+		EndBatch();
+	}
+}
+
+void UBuildingCommandLog::WriteBatch(TArray<FBuildingCommandRecord>& batch)
+{
+	//New operations replace anything that was undone
+	writeSequence = undoCursor;
+
+	batch.Last().flags |= FBuildingCommandRecord::BatchEndFlag;
+	for (const FBuildingCommandRecord& record : batch)
+	{
+		FBuildingCommandRecord& slot = records[writeSequence % records.Num()];
+
+		//Writing past the highest sequence overwrites the oldest record, track where the oldest whole batch starts
+		if (writeSequence >= highestSequence)
+		{
+			if (writeSequence >= (uint64)records.Num() && slot.IsBatchEnd())
+			{
+				oldestBatchStart = writeSequence - records.Num() + 1;
+			}
+			highestSequence = writeSequence + 1;
+		}
+
+		slot = record;
+		writeSequence++;
+	}
+	undoCursor = writeSequence;
+}
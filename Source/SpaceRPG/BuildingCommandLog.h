@@ -0,0 +1,188 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BuildingCommandLog.generated.h"
+
+//Operations that can be recorded in the building command log
+enum class EBuildingCommand : uint8
+{
+	Place = 0,
+	Demolish = 1,
+	Rotate = 2
+};
+
+//Fixed size record of a single building operation
+struct SPACERPG_API FBuildingCommandRecord
+{
+	//Grid cell the operation applies to
+	int32 cellX = 0;
+	int32 cellY = 0;
+	int32 cellZ = 0;
+
+	//Building type placed or demolished, UntypedBuilding for buildings placed without a palette type
+	uint16 buildingType = 0;
+
+	//Yaw in 1/256ths of a turn, absolute for place and demolish, a delta for rotate
+	uint8 rotation = 0;
+
+	//Command in the low bits, batch end flag in the high bit
+	uint8 flags = 0;
+
+	static constexpr uint8 CommandMask = 0x03;
+	static constexpr uint8 BatchEndFlag = 0x80;
+
+	//Stored type of buildings with a type of INDEX_NONE, palette types stay below it
+	static constexpr uint16 UntypedBuilding = MAX_uint16;
+
+	FORCEINLINE FIntVector GetCell() const { return FIntVector(cellX, cellY, cellZ); }
+	FORCEINLINE EBuildingCommand GetCommand() const { return (EBuildingCommand)(flags & CommandMask); }
+	FORCEINLINE bool IsBatchEnd() const { return (flags & BatchEndFlag) != 0; }
+
+	//Building type of the record, INDEX_NONE for an untyped building
+	FORCEINLINE int32 GetBuildingType() const { return buildingType == UntypedBuilding ? INDEX_NONE : buildingType; }
+
+	//Returns the record that undoes this one
+	FBuildingCommandRecord Inverse() const;
+
+	//Building types of INDEX_NONE are stored as UntypedBuilding
+	static FBuildingCommandRecord Make(EBuildingCommand command, const FIntVector& cell, int32 buildingType, uint8 rotation);
+
+	//Conversions between yaw in degrees and the rotation byte
+	static uint8 EncodeYaw(float yaw);
+	static float DecodeYaw(uint8 rotation);
+
+	friend FArchive& operator<<(FArchive& Ar, FBuildingCommandRecord& record)
+	{
+		Ar << record.cellX << record.cellY << record.cellZ << record.buildingType << record.rotation << record.flags;
+		return Ar;
+	}
+};
+
+static_assert(sizeof(FBuildingCommandRecord) == 16, "Building command records should stay 16 bytes");
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnBuildingCommandsApplied, const TArray<FBuildingCommandRecord>&);
+DECLARE_DELEGATE_RetVal_OneParam(bool, FRouteBuildingCommand, const FBuildingCommandRecord&);
+
+//Records building operations in a ring buffer so they can be undone, redone and journalled
+UCLASS(Config = Game)
+class SPACERPG_API UBuildingCommandLog : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	//Building operations, applied straight away or at the end of the current batch
+	UFUNCTION(BlueprintCallable, Category = Building)
+	bool PlaceBuilding(int32 buildingType, FVector location, float yaw);
+
+	UFUNCTION(BlueprintCallable, Category = Building)
+	bool DemolishBuilding(class ABuilding* building);
+
+	UFUNCTION(BlueprintCallable, Category = Building)
+	bool RotateBuilding(class ABuilding* building, float deltaYaw);
+
+	//Groups every operation until EndBatch into one undo step and one world mutation
+	UFUNCTION(BlueprintCallable, Category = Building)
+	void BeginBatch();
+
+	UFUNCTION(BlueprintCallable, Category = Building)
+	void EndBatch();
+
+	//Undo and redo whole batches
+	UFUNCTION(BlueprintCallable, Category = Building)
+	bool Undo();
+
+	UFUNCTION(BlueprintCallable, Category = Building)
+	bool Redo();
+
+	UFUNCTION(BlueprintPure, Category = Building)
+	bool CanUndo() const;
+
+	UFUNCTION(BlueprintPure, Category = Building)
+	bool CanRedo() const { return undoCursor < writeSequence; }
+
+	//Whether placed buildings reach clients through city snapshots and deltas instead of actor replication
+	FORCEINLINE bool ShouldReplicateThroughSnapshots() const { return bReplicateThroughSnapshots; }
+
+	//Applies records to the world without logging them, used for loading and replaying
+	void ApplyRecords(const TArray<FBuildingCommandRecord>& batch);
+
+	//Validates and submits operations made elsewhere as one batch, skipping any that no longer apply to their cell
+	void SubmitRecords(const TArray<FBuildingCommandRecord>& batch);
+
+	//Called with every batch of records applied to the world, undos are reported as their inverse records
+	FOnBuildingCommandsApplied OnCommandsApplied;
+
+	//Offered every operation before it is submitted, returns true if the operation was taken to be applied elsewhere
+	FRouteBuildingCommand RouteCommand;
+
+private:
+	//Number of records kept for undo
+	UPROPERTY(Config)
+	int32 logCapacity = 65536;
+
+	//Whether placed buildings reach clients through city snapshots and deltas instead of actor replication
+	UPROPERTY(Config)
+	bool bReplicateThroughSnapshots = true;
+
+	//Class spawned for placed buildings
+	UPROPERTY(Config)
+	TSoftClassPtr<class ABuilding> buildingClass;
+
+	//Demolished buildings kept out of the world for later placements to reuse, only while buildings don't replicate as actors
+	UPROPERTY(Config)
+	int32 maxRetiredBuildings = 4096;
+
+	UPROPERTY()
+	TArray<class ABuilding*> retiredBuildings;
+
+	UPROPERTY()
+	UClass* loadedBuildingClass;
+
+	//Class spawned for placed buildings, loading it if the preload hasn't
+	UClass* GetBuildingClass();
+
+	//Ring buffer of records, indexed by sequence number modulo the capacity
+	TArray<FBuildingCommandRecord> records;
+
+	//Sequence number of the next record to write, and of the first record not currently applied
+	uint64 writeSequence = 0;
+	uint64 undoCursor = 0;
+
+	//One past the highest sequence ever written, records below highestSequence - capacity are overwritten
+	uint64 highestSequence = 0;
+
+	//First sequence of the oldest batch still fully in the ring buffer
+	uint64 oldestBatchStart = 0;
+
+	//Operations waiting for the end of the current batch
+	TArray<FBuildingCommandRecord> pendingBatch;
+	int32 batchDepth = 0;
+
+	//State of a cell used while resolving a batch
+	struct FCellState
+	{
+		bool bOccupied = false;
+		int32 buildingType = INDEX_NONE;
+		uint8 rotation = 0;
+	};
+
+	//Cells touched by the pending batch, so later operations in the batch validate against it
+	TMap<FIntVector, FCellState> pendingCells;
+
+	//Returns the state of a cell including pending operations
+	FCellState GetCellState(const FIntVector& cell) const;
+
+	//Adds an operation to the pending batch, applying it if no batch is open
+	void Submit(const FBuildingCommandRecord& record);
+
+	//Writes a batch into the ring buffer, dropping any redo history
+	void WriteBatch(TArray<FBuildingCommandRecord>& batch);
+
+	FORCEINLINE const FBuildingCommandRecord& GetRecord(uint64 sequence) const { return records[sequence % records.Num()]; }
+	FORCEINLINE uint64 GetOldestSequence() const { return highestSequence > (uint64)records.Num() ? highestSequence - records.Num() : 0; }
+};
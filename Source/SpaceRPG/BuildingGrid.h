@@ -0,0 +1,111 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Building grid with a cell size fixed at compile time. Cells are int32 coordinates, so a cell is the same cell wherever it
+//is computed and can be hashed exactly. Conversions between world and cells have no branches, footprints are half sizes in
+//whole cells and are turned in cell space by quarter turns about Z, or from world space for any other yaw
+template<int32 InCellSize>
+struct TBuildingGrid
+{
+	static_assert(InCellSize > 0, "Cells need a positive size");
+
+	//Size of a cell in world units
+	static constexpr int32 CellSize = InCellSize;
+	static constexpr float InvCellSize = 1.0f / InCellSize;
+
+	//Furthest cell whose world location is a whole float, 2^24 units from the origin
+	static constexpr int32 MaxExactCell = (1 << 24) / InCellSize;
+
+	//Fraction of a cell mesh bounds may overhang a cell boundary without taking up the next cell, buildings modelled to the
+	//cell size have bounds that are slightly out
+	static constexpr float ExtentTolerance = 0.01f;
+
+	//Cell the location snaps to, locations halfway between two cells round up
+	static FORCEINLINE int32 WorldToCell(float location)
+	{
+		return FMath::FloorToInt(location * InvCellSize + 0.5f);
+	}
+
+	static FORCEINLINE FIntVector WorldToCell(const FVector& location)
+	{
+		return FIntVector(WorldToCell(location.X), WorldToCell(location.Y), WorldToCell(location.Z));
+	}
+
+	//Location of the cell's snap point, exact up to MaxExactCell
+	static FORCEINLINE float CellToWorld(int32 cell)
+	{
+		return (float)(cell * InCellSize);
+	}
+
+	static FORCEINLINE FVector CellToWorld(const FIntVector& cell)
+	{
+		return FVector(CellToWorld(cell.X), CellToWorld(cell.Y), CellToWorld(cell.Z));
+	}
+
+	//Moves a location onto the snap point of its cell
+	static FORCEINLINE FVector Snap(const FVector& location)
+	{
+		return CellToWorld(WorldToCell(location));
+	}
+
+	//Half size in whole cells of a box with the extent
+	static FORCEINLINE FIntVector ExtentToCells(const FVector& extent)
+	{
+		constexpr float scale = InvCellSize * (1.0f - ExtentTolerance);
+		return FIntVector(FMath::CeilToInt(extent.X * scale), FMath::CeilToInt(extent.Y * scale), FMath::CeilToInt(extent.Z * scale));
+	}
+
+	//Quarter turns about Z nearest to the yaw, from 0 to 3
+	static FORCEINLINE int32 YawToQuarterTurns(float yaw)
+	{
+		return FMath::RoundToInt(yaw * (1.0f / 90.0f)) & 3;
+	}
+
+	//Turns a cell offset by quarter turns about Z, in the direction yaw turns
+	static FORCEINLINE FIntVector RotateCell(const FIntVector& cell, int32 quarterTurns)
+	{
+		//Cosine and sine of the turn, each of 1, 0 or -1
+		int32 sign = 1 - (quarterTurns & 2);
+		int32 odd = quarterTurns & 1;
+		int32 turnCos = sign * (odd ^ 1);
+		int32 turnSin = sign * odd;
+		return FIntVector(cell.X * turnCos - cell.Y * turnSin, cell.X * turnSin + cell.Y * turnCos, cell.Z);
+	}
+
+	//Half size of a footprint after quarter turns about Z, X and Y swap on odd turns
+	static FORCEINLINE FIntVector RotateExtent(const FIntVector& extent, int32 quarterTurns)
+	{
+		int32 odd = quarterTurns & 1;
+		int32 swap = (extent.Y - extent.X) * odd;
+		return FIntVector(extent.X + swap, extent.Y - swap, extent.Z);
+	}
+
+	//Half size in whole cells of the box around an extent turned by any yaw about Z. Quarter turns give the same cells as
+	//RotateExtent, other yaws take up the cells of the turned box's axis aligned bounds
+	static FORCEINLINE FIntVector TurnedExtentToCells(const FVector& extent, float yaw)
+	{
+		float turnSin, turnCos;
+		FMath::SinCos(&turnSin, &turnCos, FMath::DegreesToRadians(yaw));
+		turnSin = FMath::Abs(turnSin);
+		turnCos = FMath::Abs(turnCos);
+		return ExtentToCells(FVector(extent.X * turnCos + extent.Y * turnSin, extent.X * turnSin + extent.Y * turnCos, extent.Z));
+	}
+
+	//Offsets from a building's cell to the cells a neighbour of the same size takes up against each face,
+	//in the order +X, -X, +Y, -Y, +Z, -Z
+	static FORCEINLINE void GetSocketOffsets(const FIntVector& extent, FIntVector outOffsets[6])
+	{
+		outOffsets[0] = FIntVector(extent.X * 2, 0, 0);
+		outOffsets[1] = FIntVector(extent.X * -2, 0, 0);
+		outOffsets[2] = FIntVector(0, extent.Y * 2, 0);
+		outOffsets[3] = FIntVector(0, extent.Y * -2, 0);
+		outOffsets[4] = FIntVector(0, 0, extent.Z * 2);
+		outOffsets[5] = FIntVector(0, 0, extent.Z * -2);
+	}
+};
+
+//Grid every building, preview and system that works in cells is placed on
+typedef TBuildingGrid<100> FBuildingGrid;
@@ -0,0 +1,8 @@
+// Copyright SpaceRPG 2020
+
+#include "BuildingPalette.h"
+
+int32 UBuildingPalette::FindBuildingType(FName typeName) const
+{
+	return buildingTypes.IndexOfByPredicate([typeName](const FBuildingType& type) { return type.typeName == typeName; });
+}
@@ -0,0 +1,81 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "BuildingPalette.generated.h"
+
+//Production, consumption and storage of one economy resource by a building type
+USTRUCT(BlueprintType)
+struct SPACERPG_API FBuildingResource
+{
+	GENERATED_BODY()
+
+	//Name of the resource, as listed in the economy subsystem's config
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Economy)
+	FName resource;
+
+	//Amounts produced and consumed per game hour
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Economy)
+	float production = 0.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Economy)
+	float consumption = 0.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Economy)
+	float capacity = 0.0f;
+};
+
+//Description of a single building type the player can build
+USTRUCT(BlueprintType)
+struct SPACERPG_API FBuildingType
+{
+	GENERATED_BODY()
+
+	//Unique name used to identify the building type
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Building)
+	FName typeName;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Building)
+	FText displayName;
+
+	//Mesh for the building, only loaded while the type is in use
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Building)
+	TSoftObjectPtr<class UStaticMesh> buildingMesh;
+
+	//Utilities produced and consumed per game hour
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Utilities)
+	float powerSupply = 0.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Utilities)
+	float powerDemand = 0.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Utilities)
+	float waterSupply = 0.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Utilities)
+	float waterDemand = 0.0f;
+
+	//Economy resources the building produces, consumes and stores
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Economy)
+	TArray<FBuildingResource> resources;
+};
+
+//Data asset holding every building type available in the game, a type's index in the array is its id
+UCLASS(BlueprintType)
+class SPACERPG_API UBuildingPalette : public UPrimaryDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Building)
+	TArray<FBuildingType> buildingTypes;
+
+	//Returns the id of the building type with the given name, or INDEX_NONE
+	UFUNCTION(BlueprintPure, Category = Building)
+	int32 FindBuildingType(FName typeName) const;
+
+	//Returns whether the id refers to a building type in this palette
+	FORCEINLINE bool IsValidType(int32 typeId) const { return buildingTypes.IsValidIndex(typeId); }
+};
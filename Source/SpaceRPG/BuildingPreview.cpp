@@ -2,13 +2,18 @@
 
 
 #include "BuildingPreview.h"
-#include "Kismet/KismetMathLibrary.h"
+#include "SpaceRPGMemory.h"
 #include "Kismet/KismetSystemLibrary.h"
 #include "GameFramework/Actor.h"
 #include "Components/BoxComponent.h"
 #include "SpaceRPGCharacter.h"
 #include "Camera/CameraComponent.h"
 #include "Building.h"
+#include "BuildingGrid.h"
+#include "BuildingStreamingSubsystem.h"
+#include "BuildingCollisionSubsystem.h"
+#include "BuildingSupportSubsystem.h"
+#include "Engine/StaticMesh.h"
 #include "UObject/ConstructorHelpers.h"
 
 // Sets default values
@@ -35,11 +40,6 @@ void ABuildingPreview::BeginPlay()
 	Super::BeginPlay();
 	
 	//Null pointer checks
-	if (buildingMesh == nullptr)
-	{ 
-		UE_LOG(LogTemp, Error, TEXT("BuildingPreview::Building mesh has not been set, make sure it is set when the object is spawned."))
-		return; 
-	}
 	if (StaticMesh == nullptr)
 	{ 
 		UE_LOG(LogTemp, Error, TEXT("BuildingPreview::Static Mesh has not been initialised correctly."))
@@ -55,29 +55,133 @@ void ABuildingPreview::BeginPlay()
 		UE_LOG(LogTemp, Error, TEXT("BuildingPreview::The owning player has not been set. Make sure it is set when the object is spawned."))
 	}
 
-	//Set the mesh to use the building mesh
+	//Bind box collider functions, unique so a pooled preview never binds twice
+	OverlapBox->OnComponentBeginOverlap.AddUniqueDynamic(this, &ABuildingPreview::OnOverlapBegin);
+	OverlapBox->OnComponentEndOverlap.AddUniqueDynamic(this, &ABuildingPreview::OnOverlapEnd);
+
+	//Set new collision response so character can walk inside preview
+	StaticMesh->SetCollisionResponseToAllChannels(ECollisionResponse::ECR_Overlap);
+
+	//Use the mesh directly if it was given on spawn
+	if (buildingMesh != nullptr)
+	{
+		Reconfigure(buildingMesh);
+	}
+	else if (buildingType != INDEX_NONE)
+	{
+		SetBuildingType(buildingType);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Error, TEXT("BuildingPreview::Building mesh has not been set, make sure it is set when the object is spawned."))
+	}
+}
+
+//Streams the building type's mesh in and reconfigures once it is resident, staying hidden until then
+void ABuildingPreview::SetBuildingType(int32 newType)
+{
+	SPACERPG_LLM_SCOPE(Previews);
+
+	//BeginPlay requests the mesh for previews that are still being spawned
+	if (!HasActorBegunPlay())
+	{
+		buildingType = newType;
+		return;
+	}
+
+	UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(this);
+	if (streaming == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("BuildingPreview::Could not find the building streaming subsystem."))
+		return;
+	}
+
+	buildingType = newType;
+	meshRequestTime = FPlatformTime::Seconds();
+
+	//Keep showing the previous mesh while the new one streams in
+	if (buildingMesh == nullptr)
+	{
+		SetActorHiddenInGame(true);
+	}
+
+	TWeakObjectPtr<ABuildingPreview> weakThis = this;
+	streaming->RequestMesh(newType, FOnBuildingMeshResident::CreateLambda([weakThis, newType](UStaticMesh* mesh)
+	{
+		//Ignore the mesh if the preview was destroyed or changed type while it loaded
+		if (weakThis.IsValid() && weakThis->buildingType == newType)
+		{
+			double swapStartTime = FPlatformTime::Seconds();
+			weakThis->Reconfigure(mesh);
+			weakThis->SetActorHiddenInGame(false);
+
+			if (UBuildingStreamingSubsystem* streamingSubsystem = UBuildingStreamingSubsystem::Get(weakThis.Get()))
+			{
+				streamingSubsystem->RecordSwap(weakThis->meshRequestTime, swapStartTime);
+			}
+		}
+	}));
+}
+
+//Sets the mesh and sizes the overlap box to match it, safe to call any number of times
+void ABuildingPreview::Reconfigure(UStaticMesh* mesh)
+{
+	SPACERPG_LLM_SCOPE(Previews);
+
+	if (mesh == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("BuildingPreview::Cannot reconfigure with a null mesh."))
+		return;
+	}
+
+	buildingMesh = mesh;
+
+	//Set the mesh to use the building mesh, dropping material overrides sized for the previous mesh
 	StaticMesh->SetStaticMesh(buildingMesh);
+	StaticMesh->EmptyOverrideMaterials();
+
+	//Getting the local bounds of the mesh at the component's scale so the actor's rotation does not affect the box
+	FVector scale = StaticMesh->GetComponentScale().GetAbs();
+	FBoxSphereBounds localBounds = StaticMesh->CalcBounds(FTransform(FQuat::Identity, FVector::ZeroVector, scale));
+	FVector boxExtent = localBounds.BoxExtent;
+
+	//Setting absolute positions and scale for the overlap box so repeated calls give the same result. The box keeps
+	//a scale of its own so the extent is its real size, its offset is in the mesh's space where the scale applies
+	OverlapBox->SetUsingAbsoluteScale(true);
+	OverlapBox->SetWorldScale3D(FVector::OneVector);
+	OverlapBox->SetBoxExtent(boxExtent * 0.9999f);
+	OverlapBox->SetRelativeLocation(FVector(0, 0, scale.Z > KINDA_SMALL_NUMBER ? boxExtent.Z / scale.Z : 0.0f));
+
+	//Refresh the overlap state for the new box size
+	TArray<AActor*> overlappingActors;
+	OverlapBox->GetOverlappingActors(overlappingActors, TSubclassOf<AActor>());
+	bHasOverlappingActors = overlappingActors.Num() > 0;
 
 	//Set the placement to be invalid by default
 	SetInvalidPlacement();
+}
 
-	//Getting the bounds of the static mesh object
-	FVector origin;
-	FVector boxExtent;
-	float sphereRadius;
-
-	UKismetSystemLibrary::GetComponentBounds(StaticMesh, origin, boxExtent, sphereRadius);
+//Pool functions
+void ABuildingPreview::Activate(ASpaceRPGCharacter* newOwningPlayer)
+{
+	owningPlayer = newOwningPlayer;
+	currentZRotationValue = 0.0f;
+	SetActorRotation(FRotator::ZeroRotator);
 
-	//Setting new positions and scale for the overlap box
-	OverlapBox->SetBoxExtent(boxExtent * 0.9999f);
-	OverlapBox->AddLocalOffset(FVector(0, 0, boxExtent.Z));
+	SetActorHiddenInGame(buildingMesh == nullptr);
+	SetActorEnableCollision(true);
+	SetActorTickEnabled(true);
+}
 
-	//Bind box collider functions
-	OverlapBox->OnComponentBeginOverlap.AddDynamic(this, &ABuildingPreview::OnOverlapBegin);
-	OverlapBox->OnComponentEndOverlap.AddDynamic(this, &ABuildingPreview::OnOverlapEnd);
+void ABuildingPreview::Deactivate()
+{
+	owningPlayer = nullptr;
+	hitBuilding = nullptr;
 
-	//Set new collision response so character can walk inside preview
-	StaticMesh->SetCollisionResponseToAllChannels(ECollisionResponse::ECR_Overlap);
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+	SetActorTickEnabled(false);
+	SetInvalidPlacement();
 }
 
 //Collision Detection Functions
@@ -137,11 +241,8 @@ void ABuildingPreview::RotateClockwise()
 //Functions to set validity of placement
 void ABuildingPreview::SetInvalidPlacement()
 {
-	//Get all materials on the static mesh
-	TArray<UMaterialInterface*> materials = StaticMesh->GetMaterials();
-
-	//Loop through the materials and set them to the invalid material
-	for (int32 i = 0; i < materials.Num(); i++)
+	//Loop through the materials on the static mesh and set them to the invalid material
+	for (int32 i = 0; i < StaticMesh->GetNumMaterials(); i++)
 	{
 		//Set Material instance
 		StaticMesh->SetMaterial(i, invalidMaterial);
@@ -152,11 +253,8 @@ void ABuildingPreview::SetInvalidPlacement()
 
 void ABuildingPreview::SetValidPlacement()
 {
-	//Get all materials on the static mesh
-	TArray<UMaterialInterface*> materials = StaticMesh->GetMaterials();
-
-	//Loop through the materials and set them to the invalid material
-	for (int32 i = 0; i < materials.Num(); i++)
+	//Loop through the materials on the static mesh and set them to the valid material
+	for (int32 i = 0; i < StaticMesh->GetNumMaterials(); i++)
 	{
 		//Set Material instance
 		StaticMesh->SetMaterial(i, validMaterial);
@@ -170,8 +268,8 @@ void ABuildingPreview::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	//Null check
-	if (owningPlayer == nullptr)
+	//Null check, the mesh may still be streaming in
+	if (owningPlayer == nullptr || buildingMesh == nullptr)
 	{
 		return;
 	}
@@ -185,8 +283,14 @@ void ABuildingPreview::Tick(float DeltaTime)
 		UE_LOG(LogTemp, Error, TEXT("Could not find first person camera."))
 		return;
 	}
-	FVector forwardCamera = camera->GetForwardVector() * buildingRange;
-	FVector cameraLocation = camera->GetComponentLocation();
+
+	UpdatePlacement(camera->GetComponentLocation(), camera->GetForwardVector());
+}
+
+//Function to trace from a view point and move the preview to the resulting placement
+void ABuildingPreview::UpdatePlacement(FVector cameraLocation, FVector cameraDirection)
+{
+	FVector forwardCamera = cameraDirection * buildingRange;
 	
 	FVector cameraEndVector = forwardCamera + cameraLocation;
 
@@ -200,7 +304,7 @@ void ABuildingPreview::Tick(float DeltaTime)
 	if (lineTraceSuccess == true)
 	{
 		//See if it hit a building
-		hitBuilding = Cast<ABuilding>(lineHit.GetActor());
+		hitBuilding = FindHitBuilding(lineHit);
 
 		FVector lineHitLocation = lineHit.Location;
 
@@ -211,10 +315,10 @@ void ABuildingPreview::Tick(float DeltaTime)
 			if (bIsBuildSnappingEnabled == true)
 			{
 				//Find the cloest snap point
-				FVector snapPoint = FindClosestSnapPoint(lineHitLocation, hitBuilding);
+				FVector snapLocation = FindClosestSnapLocation(lineHitLocation, hitBuilding);
 
 				//Set the actor's location 
-				SetActorLocation(hitBuilding->GetActorLocation() + snapPoint);
+				SetActorLocation(snapLocation);
 			}
 			else
 			{
@@ -241,7 +345,7 @@ void ABuildingPreview::Tick(float DeltaTime)
 			if (boxTraceSuccess == true)
 			{
 				//See if the object we hit was a building
-				hitBuilding = Cast<ABuilding>(boxHit.GetActor());
+				hitBuilding = FindHitBuilding(boxHit);
 
 				FVector boxHitLocation = boxHit.Location;
 
@@ -249,8 +353,8 @@ void ABuildingPreview::Tick(float DeltaTime)
 				if (hitBuilding != nullptr && bIsBuildSnappingEnabled)
 				{
 					//Find the closest building snap point
-					FVector snapPoint = FindClosestSnapPoint(boxHitLocation, hitBuilding);
-					SetActorLocation(snapPoint + hitBuilding->GetActorLocation());
+					FVector snapLocation = FindClosestSnapLocation(boxHitLocation, hitBuilding);
+					SetActorLocation(snapLocation);
 				}
 				else
 				{
@@ -274,7 +378,7 @@ void ABuildingPreview::Tick(float DeltaTime)
 		if (bIsGridSnappingEnabled == true)
 		{
 			//Snap the location to the grid and set the actors location to it.
-			FVector snappedLocation = UKismetMathLibrary::Vector_SnappedToGrid(cameraEndVector, 100.0f);
+			FVector snappedLocation = FBuildingGrid::Snap(cameraEndVector);
 			SetActorLocation(snappedLocation);
 		}
 		else
@@ -317,7 +421,7 @@ void ABuildingPreview::GridSnapping(FVector location)
 	if (bIsGridSnappingEnabled)
 	{
 		//Snap the location to the grid and set the actors location to it.
-		FVector snappedLocation = UKismetMathLibrary::Vector_SnappedToGrid(location, 100.0f);
+		FVector snappedLocation = FBuildingGrid::Snap(location);
 		SetActorLocation(snappedLocation);
 	}
 	//If grid snapping is disabled
@@ -327,45 +431,56 @@ void ABuildingPreview::GridSnapping(FVector location)
 	}
 }
 
-//Function to find the cloest snap point on the building
-FVector ABuildingPreview::FindClosestSnapPoint(FVector hitLocation, class ABuilding* m_hitBuilding)
+//Function to find the building a trace hit, either directly or through the merged collision of its chunk
+ABuilding* ABuildingPreview::FindHitBuilding(const FHitResult& hit) const
+{
+	if (ABuilding* building = Cast<ABuilding>(hit.GetActor()))
+	{
+		return building;
+	}
+
+	UBuildingCollisionSubsystem* collision = GetWorld()->GetSubsystem<UBuildingCollisionSubsystem>();
+	return collision ? collision->FindHitBuilding(hit) : nullptr;
+}
+
+//Function to find the location of the cloest snap point on the building
+FVector ABuildingPreview::FindClosestSnapLocation(FVector hitLocation, class ABuilding* m_hitBuilding)
 {
 	if (m_hitBuilding == nullptr)
 	{
 		UE_LOG(LogTemp, Error, TEXT("BuildingPreview::Finding snap point failed, building was null"))
-		return hitLocation;
+		return FBuildingGrid::Snap(hitLocation);
 	}
 
-	TArray<FVector> SnapPositions = m_hitBuilding->snapPositions;
+	//Offsets to the cells a neighbour would take up against each face, the snap positions are halfway there
+	FIntVector socketOffsets[6];
+	FBuildingGrid::GetSocketOffsets(m_hitBuilding->footprintCells, socketOffsets);
 	FVector buildingLocation = m_hitBuilding->GetActorLocation();
 
-	FVector snappingOffset;
-	float closestDistance;
+	//Pieces can hang under other pieces, but the socket under a piece resting on the ground is underground
+	UBuildingSupportSubsystem* support = GetWorld()->GetSubsystem<UBuildingSupportSubsystem>();
+	int32 numSockets = support != nullptr && support->IsFoundation(m_hitBuilding) ? 5 : 6;
+
+	FIntVector snappingOffset = socketOffsets[0];
+	float closestDistance = MAX_FLT;
 
-	//For every position in the building array
-	for (int32 i = 0; i < SnapPositions.Num(); i++)
+	//For every snap position in the building, -Z last
+	for (int32 i = 0; i < numSockets; i++)
 	{
-		//Calculate the vector length for this snap point
-		float vectorLength = (hitLocation - (SnapPositions[i] + buildingLocation)).Size();
-		
-		//If this is the first snap posiiton, set values
-		if (i == 0)
-		{
-			closestDistance = vectorLength;
-			snappingOffset = SnapPositions[i];
-		}
-		else
+		const FIntVector& socketOffset = socketOffsets[i];
+
+		//Calculate the distance to this snap point
+		float distanceSquared = FVector::DistSquared(hitLocation, buildingLocation + FBuildingGrid::CellToWorld(socketOffset) * 0.5f);
+
+		//Check if the new distance is less than the closest distance
+		if (distanceSquared < closestDistance)
 		{
-			//Check if the new vector length is less than the closest distance
-			if (vectorLength < closestDistance)
-			{
-				//Set values
-				closestDistance = vectorLength;
-				snappingOffset = SnapPositions[i];
-			}
+			//Set values
+			closestDistance = distanceSquared;
+			snappingOffset = socketOffset;
 		}
 	}
 
-	//Return the shortest snapping offset
-	return snappingOffset * 2.0f;
-}
\ No newline at end of file
+	//Return the closest snap point from the building's own location, which is only on a cell when grid snapping placed it
+	return buildingLocation + FBuildingGrid::CellToWorld(snappingOffset);
+}
@@ -29,6 +29,24 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = BuildPreviewSetup, meta = (AllowPrivateAccess = "true"))
 	class UMaterialInterface* invalidMaterial;
 
+	//Sets the preview up for a new mesh, can be called repeatedly on the same preview
+	UFUNCTION(BlueprintCallable, Category = BuildPreviewSetup)
+	void Reconfigure(class UStaticMesh* mesh);
+
+	//Switches the preview to a building type from the palette once its mesh is resident
+	UFUNCTION(BlueprintCallable, Category = BuildPreviewSetup)
+	void SetBuildingType(int32 newType);
+
+	//Traces along the view direction and moves the preview to the placement it finds, called by Tick with the owning player's camera
+	void UpdatePlacement(FVector cameraLocation, FVector cameraDirection);
+
+	//Returns whether the preview is currently in a valid place to build
+	FORCEINLINE bool IsPlacementValid() const { return bIsPlacementValid; }
+
+	//Functions used by the preview pool to take the preview in and out of use
+	void Activate(class ASpaceRPGCharacter* newOwningPlayer);
+	void Deactivate();
+
 
 protected:
 	// Called when the game starts or when spawned
@@ -45,6 +63,10 @@ private:
 	UPROPERTY(VisibleAnywhere, BlueprintReadWrite, Category = BuildPreviewSetup, meta = (AllowPrivateAccess = "true", ExposeOnSpawn = "true"))
 	class UStaticMesh* buildingMesh;
 
+	//Building type from the palette, used to stream the mesh in when buildingMesh is not set
+	UPROPERTY(VisibleAnywhere, BlueprintReadWrite, Category = BuildPreviewSetup, meta = (AllowPrivateAccess = "true", ExposeOnSpawn = "true"))
+	int32 buildingType = INDEX_NONE;
+
 	UPROPERTY(VisibleAnywhere, BlueprintReadWrite, Category = BuildSettings, meta = (AllowPrivateAccess = "true"))
 	class ABuilding* hitBuilding;
 
@@ -96,12 +118,19 @@ private:
 	UFUNCTION(BlueprintCallable)
 	void SetValidPlacement();
 
-	//Function to find the closest snap point in a building
-	FVector FindClosestSnapPoint(FVector hitlocation, class ABuilding* hitBuilding);
+	//Function to find the building a trace hit
+	class ABuilding* FindHitBuilding(const FHitResult& hit) const;
+
+	//Function to find the location of the closest snap point in a building, relative to the building so buildings
+	//placed off the grid still snap flush
+	FVector FindClosestSnapLocation(FVector hitlocation, class ABuilding* hitBuilding);
 
 	//Function to check the conditions for the placement validity
 	void CheckBuildingConditions();
 
 	//Function to run grid snap checks and apply actor location
 	void GridSnapping(FVector location);
+
+	//Time the building type mesh was requested, used to measure the swap hitch
+	double meshRequestTime = 0.0;
 };
\ No newline at end of file
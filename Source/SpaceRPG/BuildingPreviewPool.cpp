@@ -0,0 +1,77 @@
+// Copyright SpaceRPG 2020
+
+#include "BuildingPreviewPool.h"
+#include "SpaceRPGMemory.h"
+#include "BuildingPreview.h"
+#include "SpaceRPGCharacter.h"
+#include "Engine/World.h"
+
+void UBuildingPreviewPool::Deinitialize()
+{
+	freePreviews.Empty();
+
+	Super::Deinitialize();
+}
+
+ABuildingPreview* UBuildingPreviewPool::AcquirePreview(TSubclassOf<ABuildingPreview> previewClass, ASpaceRPGCharacter* owningPlayer, int32 buildingType)
+{
+	SPACERPG_LLM_SCOPE(Previews);
+
+	if (previewClass == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("BuildingPreviewPool::No preview class given."))
+		return nullptr;
+	}
+
+	//Reuse a pooled preview of the same class if there is one
+	ABuildingPreview* preview = nullptr;
+	for (int32 i = freePreviews.Num() - 1; i >= 0; i--)
+	{
+		if (freePreviews[i] == nullptr || freePreviews[i]->IsPendingKill())
+		{
+			freePreviews.RemoveAtSwap(i);
+		}
+		else if (freePreviews[i]->GetClass() == previewClass)
+		{
+			preview = freePreviews[i];
+			freePreviews.RemoveAtSwap(i);
+			break;
+		}
+	}
+
+	if (preview == nullptr)
+	{
+		//Spawn deferred so the owning player and building type are set before BeginPlay
+		preview = GetWorld()->SpawnActorDeferred<ABuildingPreview>(previewClass, FTransform::Identity, nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+		if (preview == nullptr)
+		{
+			return nullptr;
+		}
+		preview->Activate(owningPlayer);
+		if (buildingType != INDEX_NONE)
+		{
+			preview->SetBuildingType(buildingType);
+		}
+		preview->FinishSpawning(FTransform::Identity);
+		numSpawned++;
+		return preview;
+	}
+
+	preview->Activate(owningPlayer);
+	if (buildingType != INDEX_NONE)
+	{
+		preview->SetBuildingType(buildingType);
+	}
+	return preview;
+}
+
+void UBuildingPreviewPool::ReleasePreview(ABuildingPreview* preview)
+{
+	if (preview == nullptr || freePreviews.Contains(preview))
+	{
+		return;
+	}
+
+	preview->Deactivate();
+	freePreviews.Add(preview);
+}
@@ -0,0 +1,35 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BuildingPreviewPool.generated.h"
+
+//Keeps building previews alive between selections so switching building type never spawns or destroys actors
+UCLASS()
+class SPACERPG_API UBuildingPreviewPool : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	//Returns a preview for the player, reusing a pooled one when available. INDEX_NONE leaves the mesh as it is,
+	//for callers that reconfigure the preview themselves
+	UFUNCTION(BlueprintCallable, Category = BuildPreviewSetup)
+	class ABuildingPreview* AcquirePreview(TSubclassOf<class ABuildingPreview> previewClass, class ASpaceRPGCharacter* owningPlayer, int32 buildingType);
+
+	//Hides the preview and returns it to the pool
+	UFUNCTION(BlueprintCallable, Category = BuildPreviewSetup)
+	void ReleasePreview(class ABuildingPreview* preview);
+
+	//Number of previews spawned over the pool's lifetime
+	FORCEINLINE int32 GetNumSpawned() const { return numSpawned; }
+
+private:
+	UPROPERTY()
+	TArray<class ABuildingPreview*> freePreviews;
+
+	int32 numSpawned = 0;
+};
@@ -0,0 +1,60 @@
+// Copyright SpaceRPG 2020
+
+#include "BuildingRegistry.h"
+#include "SpaceRPGMemory.h"
+#include "Building.h"
+
+void UBuildingRegistry::Deinitialize()
+{
+	buildingsByCell.Empty();
+
+	Super::Deinitialize();
+}
+
+void UBuildingRegistry::RegisterBuilding(ABuilding* building)
+{
+	SPACERPG_LLM_SCOPE(Buildings);
+
+	if (building == nullptr)
+	{
+		return;
+	}
+
+	FIntVector cell = WorldToCell(building->GetActorLocation());
+
+	//Systems tracking the city drop the displaced building before they see the new one, so none keep state for a building
+	//that is no longer in the index
+	ABuilding* existing = FindBuilding(cell);
+	if (existing != nullptr && existing != building)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("BuildingRegistry::Cell %s already holds %s, replacing it with %s."), *cell.ToString(), *existing->GetName(), *building->GetName())
+		UnregisterBuilding(existing);
+	}
+
+	building->gridCell = cell;
+	buildingsByCell.Add(cell, building);
+
+	OnBuildingAdded.Broadcast(building);
+}
+
+void UBuildingRegistry::UnregisterBuilding(ABuilding* building)
+{
+	if (building == nullptr)
+	{
+		return;
+	}
+
+	//Only remove the cell if it still belongs to this building
+	ABuilding** existing = buildingsByCell.Find(building->gridCell);
+	if (existing != nullptr && *existing == building)
+	{
+		buildingsByCell.Remove(building->gridCell);
+		OnBuildingRemoved.Broadcast(building);
+	}
+}
+
+ABuilding* UBuildingRegistry::FindBuilding(const FIntVector& cell) const
+{
+	ABuilding* const* building = buildingsByCell.Find(cell);
+	return building ? *building : nullptr;
+}
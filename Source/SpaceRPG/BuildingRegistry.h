@@ -0,0 +1,50 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BuildingGrid.h"
+#include "BuildingRegistry.generated.h"
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnBuildingRegistered, class ABuilding*);
+
+//Index of every placed building by the grid cell it occupies
+UCLASS()
+class SPACERPG_API UBuildingRegistry : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	//Size of a grid cell in world units
+	static constexpr float CellSize = (float)FBuildingGrid::CellSize;
+
+	//Converts a world location to the grid cell it snaps to
+	static FORCEINLINE FIntVector WorldToCell(const FVector& location) { return FBuildingGrid::WorldToCell(location); }
+
+	//Converts a grid cell to the world location of its snap point
+	static FORCEINLINE FVector CellToWorld(const FIntVector& cell) { return FBuildingGrid::CellToWorld(cell); }
+
+	//Called by buildings as they begin and end play
+	void RegisterBuilding(class ABuilding* building);
+	void UnregisterBuilding(class ABuilding* building);
+
+	//Returns the building at the cell, or nullptr
+	UFUNCTION(BlueprintPure, Category = Building)
+	class ABuilding* FindBuilding(const FIntVector& cell) const;
+
+	UFUNCTION(BlueprintPure, Category = Building)
+	int32 GetNumBuildings() const { return buildingsByCell.Num(); }
+
+	FORCEINLINE const TMap<FIntVector, class ABuilding*>& GetBuildings() const { return buildingsByCell; }
+
+	//Native events for systems that track the city layout
+	FOnBuildingRegistered OnBuildingAdded;
+	FOnBuildingRegistered OnBuildingRemoved;
+
+private:
+	UPROPERTY()
+	TMap<FIntVector, class ABuilding*> buildingsByCell;
+};
@@ -0,0 +1,301 @@
+// Copyright SpaceRPG 2020
+
+#include "BuildingStreamingSubsystem.h"
+#include "SpaceRPG.h"
+#include "BuildingPalette.h"
+#include "StartupPreloadSubsystem.h"
+#include "Engine/AssetManager.h"
+#include "Engine/GameInstance.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Resident Building Types"), STAT_ResidentBuildingTypes, STATGROUP_SpaceRPG);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Building Mesh Swap (ms)"), STAT_BuildingMeshSwap, STATGROUP_SpaceRPG);
+
+void UBuildingStreamingSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	//The palette itself is small, only the meshes it points to are streamed
+	if (!defaultPalette.IsNull())
+	{
+		UStartupPreloadSubsystem* preload = Cast<UStartupPreloadSubsystem>(Collection.InitializeDependency(UStartupPreloadSubsystem::StaticClass()));
+		preload->Preload(defaultPalette.ToSoftObjectPath(), FStreamableDelegate::CreateWeakLambda(this, [this]()
+		{
+			SetPalette(defaultPalette.Get());
+		}));
+	}
+}
+
+void UBuildingStreamingSubsystem::Deinitialize()
+{
+	for (auto& pair : typeHandles)
+	{
+		if (pair.Value.IsValid())
+		{
+			pair.Value->ReleaseHandle();
+		}
+	}
+	typeHandles.Empty();
+	pendingRequests.Empty();
+	activeTypes.Empty();
+
+	Super::Deinitialize();
+}
+
+UBuildingStreamingSubsystem* UBuildingStreamingSubsystem::Get(const UObject* worldContextObject)
+{
+	UWorld* world = worldContextObject ? worldContextObject->GetWorld() : nullptr;
+	UGameInstance* gameInstance = world ? world->GetGameInstance() : nullptr;
+	return gameInstance ? gameInstance->GetSubsystem<UBuildingStreamingSubsystem>() : nullptr;
+}
+
+void UBuildingStreamingSubsystem::SetPalette(UBuildingPalette* newPalette)
+{
+	if (palette == newPalette)
+	{
+		return;
+	}
+
+	//Type ids are only meaningful within a palette, so drop everything from the old one
+	for (auto& pair : typeHandles)
+	{
+		if (pair.Value.IsValid())
+		{
+			pair.Value->ReleaseHandle();
+		}
+	}
+	typeHandles.Empty();
+	pendingRequests.Empty();
+	activeTypes.Empty();
+
+	palette = newPalette;
+}
+
+void UBuildingStreamingSubsystem::SetActiveBuildTypes(const TArray<int32>& typeIds)
+{
+	if (palette == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("BuildingStreamingSubsystem::Cannot set active build types, no palette has been set."))
+		return;
+	}
+
+	activeTypes.Empty(typeIds.Num());
+	for (int32 typeId : typeIds)
+	{
+		if (palette->IsValidType(typeId))
+		{
+			activeTypes.Add(typeId);
+		}
+	}
+
+	EvictUnusedTypes();
+
+	//Preload every active type in the background
+	for (int32 typeId : activeTypes)
+	{
+		LoadType(typeId);
+	}
+
+	SET_DWORD_STAT(STAT_ResidentBuildingTypes, typeHandles.Num());
+}
+
+UStaticMesh* UBuildingStreamingSubsystem::GetResidentMesh(int32 typeId) const
+{
+	if (palette == nullptr || !palette->IsValidType(typeId))
+	{
+		return nullptr;
+	}
+
+	return palette->buildingTypes[typeId].buildingMesh.Get();
+}
+
+UStaticMesh* UBuildingStreamingSubsystem::LoadMeshSynchronous(int32 typeId)
+{
+	if (palette == nullptr || !palette->IsValidType(typeId))
+	{
+		return nullptr;
+	}
+
+	UStaticMesh* mesh = GetResidentMesh(typeId);
+	if (mesh == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("BuildingStreamingSubsystem::Building type %d was not preloaded, loading synchronously."), typeId)
+		mesh = palette->buildingTypes[typeId].buildingMesh.LoadSynchronous();
+	}
+	return mesh;
+}
+
+void UBuildingStreamingSubsystem::RequestMesh(int32 typeId, FOnBuildingMeshResident onResident)
+{
+	if (palette == nullptr || !palette->IsValidType(typeId))
+	{
+		UE_LOG(LogTemp, Error, TEXT("BuildingStreamingSubsystem::Requested invalid building type %d."), typeId)
+		return;
+	}
+
+	UStaticMesh* mesh = GetResidentMesh(typeId);
+	if (mesh != nullptr)
+	{
+		onResident.ExecuteIfBound(mesh);
+		return;
+	}
+
+	TSharedPtr<FStreamableHandle> handle = LoadType(typeId);
+	if (!handle.IsValid())
+	{
+		return;
+	}
+
+	//Every caller for a type that is still loading waits on the one completion bound when its load started
+	if (handle->HasLoadCompleted())
+	{
+		mesh = GetResidentMesh(typeId);
+		if (mesh != nullptr)
+		{
+			onResident.ExecuteIfBound(mesh);
+		}
+	}
+	else
+	{
+		pendingRequests.FindOrAdd(typeId).Add(MoveTemp(onResident));
+	}
+}
+
+void UBuildingStreamingSubsystem::OnTypeLoaded(int32 typeId, TWeakObjectPtr<UBuildingPalette> loadPalette)
+{
+	//Type ids are only meaningful within a palette, callers from a newer palette wait on their own load
+	if (!loadPalette.IsValid() || loadPalette.Get() != palette)
+	{
+		return;
+	}
+
+	TArray<FOnBuildingMeshResident> requests;
+	if (!pendingRequests.RemoveAndCopyValue(typeId, requests))
+	{
+		return;
+	}
+
+	//Look the mesh up again as the type may have been evicted while loading
+	UStaticMesh* loadedMesh = GetResidentMesh(typeId);
+	if (loadedMesh == nullptr)
+	{
+		return;
+	}
+
+	for (FOnBuildingMeshResident& request : requests)
+	{
+		request.ExecuteIfBound(loadedMesh);
+	}
+}
+
+void UBuildingStreamingSubsystem::RecordSwap(double requestTime, double swapStartTime)
+{
+	double now = FPlatformTime::Seconds();
+	lastSwapWaitTime = swapStartTime - requestTime;
+	lastSwapTime = now - swapStartTime;
+	maxSwapTime = FMath::Max(maxSwapTime, lastSwapTime);
+
+	SET_FLOAT_STAT(STAT_BuildingMeshSwap, lastSwapTime * 1000.0);
+}
+
+void UBuildingStreamingSubsystem::DumpStreamingReport() const
+{
+	if (palette == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("BuildingStreamingSubsystem::No palette set."))
+		return;
+	}
+
+	for (int32 i = 0; i < palette->buildingTypes.Num(); i++)
+	{
+		UStaticMesh* mesh = palette->buildingTypes[i].buildingMesh.Get();
+		if (mesh != nullptr)
+		{
+			int64 bytes = mesh->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+			UE_LOG(LogTemp, Log, TEXT("  [%d] %s: %.1f KB%s"), i, *palette->buildingTypes[i].typeName.ToString(), bytes / 1024.0f, activeTypes.Contains(i) ? TEXT(" (active)") : TEXT(""))
+		}
+	}
+
+	int32 residentCount = 0;
+	int64 totalBytes = GetResidentBytes(&residentCount);
+	UE_LOG(LogTemp, Log, TEXT("BuildingStreamingSubsystem::%d of %d building types resident, %.2f MB. Last swap waited %.2f ms and took %.3f ms, worst swap %.3f ms."),
+		residentCount, palette->buildingTypes.Num(), totalBytes / (1024.0 * 1024.0), lastSwapWaitTime * 1000.0, lastSwapTime * 1000.0, maxSwapTime * 1000.0)
+}
+
+int64 UBuildingStreamingSubsystem::GetResidentBytes(int32* outResidentCount) const
+{
+	int64 totalBytes = 0;
+	int32 residentCount = 0;
+	for (int32 i = 0; palette != nullptr && i < palette->buildingTypes.Num(); i++)
+	{
+		if (UStaticMesh* mesh = palette->buildingTypes[i].buildingMesh.Get())
+		{
+			totalBytes += mesh->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+			residentCount++;
+		}
+	}
+
+	if (outResidentCount != nullptr)
+	{
+		*outResidentCount = residentCount;
+	}
+	return totalBytes;
+}
+
+TSharedPtr<FStreamableHandle> UBuildingStreamingSubsystem::LoadType(int32 typeId)
+{
+	if (TSharedPtr<FStreamableHandle>* existing = typeHandles.Find(typeId))
+	{
+		return *existing;
+	}
+
+	FSoftObjectPath meshPath = palette->buildingTypes[typeId].buildingMesh.ToSoftObjectPath();
+	if (meshPath.IsNull())
+	{
+		UE_LOG(LogTemp, Error, TEXT("BuildingStreamingSubsystem::Building type %d has no mesh set."), typeId)
+		return nullptr;
+	}
+
+	//Handles are kept until the type is evicted, which keeps the mesh out of garbage collection. The one completion
+	//delegate answers every request made while the type loads, binding one per request would replace the earlier ones
+	TWeakObjectPtr<UBuildingPalette> loadPalette = palette;
+	FStreamableDelegate onLoaded = FStreamableDelegate::CreateWeakLambda(this, [this, typeId, loadPalette]()
+	{
+		OnTypeLoaded(typeId, loadPalette);
+	});
+	TSharedPtr<FStreamableHandle> handle = UAssetManager::GetStreamableManager().RequestAsyncLoad(meshPath, onLoaded, FStreamableManager::AsyncLoadHighPriority, true);
+	typeHandles.Add(typeId, handle);
+
+	SET_DWORD_STAT(STAT_ResidentBuildingTypes, typeHandles.Num());
+	return handle;
+}
+
+void UBuildingStreamingSubsystem::EvictUnusedTypes()
+{
+	for (auto it = typeHandles.CreateIterator(); it; ++it)
+	{
+		if (!activeTypes.Contains(it.Key()))
+		{
+			//Placed buildings still reference their mesh, so only types nothing uses get collected
+			if (it.Value().IsValid())
+			{
+				it.Value()->ReleaseHandle();
+			}
+			pendingRequests.Remove(it.Key());
+			it.RemoveCurrent();
+		}
+	}
+}
+
+static FAutoConsoleCommandWithWorld BuildingStreamingReportCommand(
+	TEXT("SpaceRPG.BuildingStreamingReport"),
+	TEXT("Logs the resident building types, their memory and the mesh swap hitch times."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+	{
+		if (UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(world))
+		{
+			streaming->DumpStreamingReport();
+		}
+	}));
@@ -0,0 +1,85 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Engine/StreamableManager.h"
+#include "BuildingStreamingSubsystem.generated.h"
+
+DECLARE_DELEGATE_OneParam(FOnBuildingMeshResident, class UStaticMesh*);
+
+//Streams building meshes in and out of memory so only the active build palette is resident
+UCLASS(Config = Game)
+class SPACERPG_API UBuildingStreamingSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//Helper to find the subsystem from any world context object
+	static UBuildingStreamingSubsystem* Get(const UObject* worldContextObject);
+
+	//Sets the palette describing every building type in the game
+	UFUNCTION(BlueprintCallable, Category = Building)
+	void SetPalette(class UBuildingPalette* newPalette);
+
+	UFUNCTION(BlueprintPure, Category = Building)
+	class UBuildingPalette* GetPalette() const { return palette; }
+
+	//Sets the building types the player can currently select, preloading them and evicting the rest
+	UFUNCTION(BlueprintCallable, Category = Building)
+	void SetActiveBuildTypes(const TArray<int32>& typeIds);
+
+	//Returns the mesh for a building type if it is already resident, otherwise nullptr
+	UFUNCTION(BlueprintPure, Category = Building)
+	class UStaticMesh* GetResidentMesh(int32 typeId) const;
+
+	//Returns the mesh for a building type, loading it synchronously if it is not resident
+	class UStaticMesh* LoadMeshSynchronous(int32 typeId);
+
+	//Calls the delegate once the mesh for the building type is resident, immediately if it already is
+	void RequestMesh(int32 typeId, FOnBuildingMeshResident onResident);
+
+	//Records the time between requesting a mesh and it being swapped in
+	void RecordSwap(double requestTime, double swapStartTime);
+
+	//Logs resident building types, their memory and the swap hitch times
+	void DumpStreamingReport() const;
+
+	//Memory of the resident building meshes in bytes, and how many types are resident
+	int64 GetResidentBytes(int32* outResidentCount = nullptr) const;
+
+private:
+	//Palette loaded on startup, set in DefaultGame.ini
+	UPROPERTY(Config)
+	TSoftObjectPtr<class UBuildingPalette> defaultPalette;
+
+	UPROPERTY()
+	class UBuildingPalette* palette;
+
+	//Keeps a building type loaded for as long as it is in the map
+	TMap<int32, TSharedPtr<FStreamableHandle>> typeHandles;
+
+	//Callers waiting on a building type that is still loading, answered together when the load completes
+	TMap<int32, TArray<FOnBuildingMeshResident>> pendingRequests;
+
+	//Building types currently in the active build palette
+	TSet<int32> activeTypes;
+
+	//Hitch tracking for mesh swaps, in seconds
+	double lastSwapWaitTime = 0.0;
+	double lastSwapTime = 0.0;
+	double maxSwapTime = 0.0;
+
+	//Starts loading a building type if it is not already loaded or loading
+	TSharedPtr<FStreamableHandle> LoadType(int32 typeId);
+
+	//Answers every caller waiting on the building type once its load completes
+	void OnTypeLoaded(int32 typeId, TWeakObjectPtr<class UBuildingPalette> loadPalette);
+
+	//Releases the handles for building types that are no longer in use so they can be garbage collected
+	void EvictUnusedTypes();
+};
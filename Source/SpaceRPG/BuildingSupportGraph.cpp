@@ -0,0 +1,282 @@
+// Copyright SpaceRPG 2020
+
+#include "BuildingSupportGraph.h"
+
+int32 FBuildingSupportGraph::AddNode(const FIntVector& cell, bool bIsFoundation, TArrayView<const FIntVector> socketCells)
+{
+	if (nodesByCell.Contains(cell))
+	{
+		return INDEX_NONE;
+	}
+
+	//Every node in the graph is supported, so a node is supported if it is a foundation or touches any node
+	TArray<int32, TInlineAllocator<6>> neighbours;
+	for (const FIntVector& socketCell : socketCells)
+	{
+		int32 neighbour = FindNode(socketCell);
+		if (neighbour != INDEX_NONE)
+		{
+			neighbours.AddUnique(neighbour);
+		}
+	}
+
+	if (!bIsFoundation && neighbours.Num() == 0)
+	{
+		return INDEX_NONE;
+	}
+
+	int32 node = freeNodes.Num() > 0 ? freeNodes.Pop(false) : nodes.AddDefaulted();
+	FNode& newNode = nodes[node];
+	newNode.cell = cell;
+	newNode.neighbours = neighbours;
+	newNode.searchStamp = 0;
+	newNode.deferredStamp = 0;
+	newNode.bAlive = true;
+	newNode.bIsFoundation = bIsFoundation;
+
+	for (int32 neighbour : neighbours)
+	{
+		nodes[neighbour].neighbours.AddUnique(node);
+	}
+
+	nodesByCell.Add(cell, node);
+
+	//The running deferred search has already expanded its nodes, so a piece joining them is added to its frontier
+	if (bDeferredSearchActive)
+	{
+		for (int32 neighbour : neighbours)
+		{
+			if (nodes[neighbour].deferredStamp == deferredStamp)
+			{
+				nodes[node].deferredStamp = deferredStamp;
+				deferredHeap.HeapPush(node, [this](int32 a, int32 b) { return nodes[a].cell.Z < nodes[b].cell.Z; });
+				break;
+			}
+		}
+	}
+	return node;
+}
+
+void FBuildingSupportGraph::RemoveNode(int32 node, TArray<int32>& outCollapsed)
+{
+	if (!IsValidNode(node))
+	{
+		return;
+	}
+
+	TArray<int32, TInlineAllocator<6>> neighbours = nodes[node].neighbours;
+	for (int32 neighbour : neighbours)
+	{
+		nodes[neighbour].neighbours.RemoveSingleSwap(node, false);
+	}
+	FreeNode(node);
+
+	//Nodes left behind by an earlier search in this removal are supported, unsupported ones have been removed
+	firstRemovalStamp = currentStamp + 1;
+	for (int32 neighbour : neighbours)
+	{
+		if (!IsValidNode(neighbour) || nodes[neighbour].searchStamp >= firstRemovalStamp)
+		{
+			continue;
+		}
+
+		currentStamp++;
+		ESearchResult result = SearchForSupport(neighbour, searchBudget);
+		if (result == ESearchResult::Unsupported)
+		{
+			CollapseVisited(outCollapsed);
+		}
+		else if (result == ESearchResult::OutOfBudget)
+		{
+			//Assume the piece is still supported until the deferred search finishes
+			deferredNodes.Add(neighbour);
+		}
+	}
+}
+
+void FBuildingSupportGraph::ProcessDeferred(int32 maxVisits, TArray<int32>& outCollapsed)
+{
+	while ((bDeferredSearchActive || deferredNodes.Num() > 0) && maxVisits > 0)
+	{
+		if (!bDeferredSearchActive)
+		{
+			int32 node = deferredNodes.Pop(false);
+			if (!IsValidNode(node))
+			{
+				continue;
+			}
+
+			deferredStamp++;
+			deferredHeap.Reset();
+			deferredVisited.Reset();
+			nodes[node].deferredStamp = deferredStamp;
+			deferredHeap.Add(node);
+			bDeferredSearchActive = true;
+		}
+
+		ESearchResult result = ContinueDeferredSearch(maxVisits);
+		if (result == ESearchResult::OutOfBudget)
+		{
+			//Picked up where it left off with next frame's budget
+			break;
+		}
+
+		bDeferredSearchActive = false;
+		if (result == ESearchResult::Unsupported)
+		{
+			CollapseDeferredVisited(outCollapsed);
+		}
+	}
+}
+
+int32 FBuildingSupportGraph::FindNode(const FIntVector& cell) const
+{
+	const int32* node = nodesByCell.Find(cell);
+	return node ? *node : INDEX_NONE;
+}
+
+SIZE_T FBuildingSupportGraph::GetAllocatedSize() const
+{
+	SIZE_T size = nodes.GetAllocatedSize() + freeNodes.GetAllocatedSize() + nodesByCell.GetAllocatedSize() + deferredNodes.GetAllocatedSize()
+		+ searchHeap.GetAllocatedSize() + searchVisited.GetAllocatedSize() + deferredHeap.GetAllocatedSize() + deferredVisited.GetAllocatedSize();
+	for (const FNode& node : nodes)
+	{
+		size += node.neighbours.GetAllocatedSize();
+	}
+	return size;
+}
+
+void FBuildingSupportGraph::Reset()
+{
+	nodes.Reset();
+	freeNodes.Reset();
+	nodesByCell.Reset();
+	deferredNodes.Reset();
+	deferredHeap.Reset();
+	deferredVisited.Reset();
+	bDeferredSearchActive = false;
+	deferredStamp = 0;
+	currentStamp = 0;
+	firstRemovalStamp = 1;
+}
+
+FBuildingSupportGraph::ESearchResult FBuildingSupportGraph::SearchForSupport(int32 start, int32 budget)
+{
+	//Foundations are at the bottom of a structure, so expanding the lowest nodes first usually reaches one quickly
+	auto lowerCell = [this](int32 a, int32 b) { return nodes[a].cell.Z < nodes[b].cell.Z; };
+
+	searchHeap.Reset();
+	searchVisited.Reset();
+
+	nodes[start].searchStamp = currentStamp;
+	searchHeap.HeapPush(start, lowerCell);
+
+	while (searchHeap.Num() > 0)
+	{
+		int32 node;
+		searchHeap.HeapPop(node, lowerCell, false);
+		searchVisited.Add(node);
+
+		if (nodes[node].bIsFoundation)
+		{
+			return ESearchResult::Supported;
+		}
+		if (searchVisited.Num() >= budget)
+		{
+			return ESearchResult::OutOfBudget;
+		}
+
+		for (int32 neighbour : nodes[node].neighbours)
+		{
+			FNode& neighbourNode = nodes[neighbour];
+			if (neighbourNode.searchStamp == currentStamp)
+			{
+				continue;
+			}
+			if (neighbourNode.searchStamp >= firstRemovalStamp)
+			{
+				return ESearchResult::Supported;
+			}
+			neighbourNode.searchStamp = currentStamp;
+			searchHeap.HeapPush(neighbour, lowerCell);
+		}
+	}
+
+	return ESearchResult::Unsupported;
+}
+
+FBuildingSupportGraph::ESearchResult FBuildingSupportGraph::ContinueDeferredSearch(int32& maxVisits)
+{
+	auto lowerCell = [this](int32 a, int32 b) { return nodes[a].cell.Z < nodes[b].cell.Z; };
+
+	while (deferredHeap.Num() > 0)
+	{
+		if (maxVisits <= 0)
+		{
+			return ESearchResult::OutOfBudget;
+		}
+
+		int32 node;
+		deferredHeap.HeapPop(node, lowerCell, false);
+
+		//Pieces removed since they were reached, or removed and reused by a new piece, are no longer part of the search
+		if (!IsValidNode(node) || nodes[node].deferredStamp != deferredStamp)
+		{
+			continue;
+		}
+		deferredVisited.Add(node);
+		maxVisits--;
+
+		if (nodes[node].bIsFoundation)
+		{
+			return ESearchResult::Supported;
+		}
+
+		for (int32 neighbour : nodes[node].neighbours)
+		{
+			FNode& neighbourNode = nodes[neighbour];
+			if (neighbourNode.deferredStamp != deferredStamp)
+			{
+				neighbourNode.deferredStamp = deferredStamp;
+				deferredHeap.HeapPush(neighbour, lowerCell);
+			}
+		}
+	}
+
+	//Edges are only ever removed from reached nodes, and pieces joining them were added to the search,
+	//so none of the nodes it reached can reach a foundation
+	return ESearchResult::Unsupported;
+}
+
+void FBuildingSupportGraph::CollapseVisited(TArray<int32>& outCollapsed)
+{
+	//The search visited the whole unsupported component, so there are no edges leaving it
+	for (int32 node : searchVisited)
+	{
+		outCollapsed.Add(node);
+		FreeNode(node);
+	}
+}
+
+void FBuildingSupportGraph::CollapseDeferredVisited(TArray<int32>& outCollapsed)
+{
+	for (int32 node : deferredVisited)
+	{
+		//Visited nodes may have collapsed through other removals while the search was spread over frames
+		if (IsValidNode(node) && nodes[node].deferredStamp == deferredStamp)
+		{
+			outCollapsed.Add(node);
+			FreeNode(node);
+		}
+	}
+	deferredVisited.Reset();
+}
+
+void FBuildingSupportGraph::FreeNode(int32 node)
+{
+	FNode& freedNode = nodes[node];
+	nodesByCell.Remove(freedNode.cell);
+	freedNode.neighbours.Reset();
+	freedNode.bAlive = false;
+	freeNodes.Add(node);
+}
@@ -0,0 +1,94 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Graph of placed buildings connected through their snap sockets, keeping every node connected to a foundation
+//Removing a node only searches the pieces around it, bounded by searchBudget, instead of re-walking the city
+class SPACERPG_API FBuildingSupportGraph
+{
+public:
+	//Maximum nodes visited by a single search before it is deferred to ProcessDeferred
+	int32 searchBudget = 4096;
+
+	//Adds a node connected to any nodes at its socket cells, returns INDEX_NONE if it would have no support
+	int32 AddNode(const FIntVector& cell, bool bIsFoundation, TArrayView<const FIntVector> socketCells);
+
+	//Removes a node, adding any nodes that lost their support to outCollapsed and removing them too
+	void RemoveNode(int32 node, TArray<int32>& outCollapsed);
+
+	//Carries on with searches that ran out of budget, with up to maxVisits nodes visited in total. A search that needs
+	//more than one call keeps its frontier and visited nodes until the next call, so every search finishes eventually
+	void ProcessDeferred(int32 maxVisits, TArray<int32>& outCollapsed);
+
+	//Returns the node at the cell, or INDEX_NONE
+	int32 FindNode(const FIntVector& cell) const;
+
+	FORCEINLINE bool IsValidNode(int32 node) const { return nodes.IsValidIndex(node) && nodes[node].bAlive; }
+	FORCEINLINE const FIntVector& GetCell(int32 node) const { return nodes[node].cell; }
+	FORCEINLINE TArrayView<const int32> GetNeighbours(int32 node) const { return nodes[node].neighbours; }
+	FORCEINLINE int32 GetNumNodes() const { return nodesByCell.Num(); }
+	FORCEINLINE int32 GetNumDeferred() const { return deferredNodes.Num() + (bDeferredSearchActive ? 1 : 0); }
+
+	//Memory held by the nodes and search scratch arrays
+	SIZE_T GetAllocatedSize() const;
+
+	void Reset();
+
+private:
+	struct FNode
+	{
+		FIntVector cell;
+		TArray<int32, TInlineAllocator<6>> neighbours;
+
+		//Stamp of the last search that visited the node
+		uint32 searchStamp = 0;
+
+		//Stamp of the last deferred search that reached the node, kept apart as deferred searches span frames
+		uint32 deferredStamp = 0;
+
+		bool bAlive = false;
+		bool bIsFoundation = false;
+	};
+
+	enum class ESearchResult : uint8
+	{
+		Supported,
+		Unsupported,
+		OutOfBudget
+	};
+
+	TArray<FNode> nodes;
+	TArray<int32> freeNodes;
+	TMap<FIntVector, int32> nodesByCell;
+
+	//Nodes whose searches ran out of budget and still need checking
+	TArray<int32> deferredNodes;
+
+	//Deferred search carried over between calls to ProcessDeferred
+	bool bDeferredSearchActive = false;
+	uint32 deferredStamp = 0;
+	TArray<int32> deferredHeap;
+	TArray<int32> deferredVisited;
+
+	//Each search has its own stamp, searches from the same removal have stamps from firstRemovalStamp onwards
+	uint32 currentStamp = 0;
+	uint32 firstRemovalStamp = 1;
+
+	//Scratch arrays reused between searches
+	TArray<int32> searchHeap;
+	TArray<int32> searchVisited;
+
+	//Searches from the node for a foundation, lowest cells first, visiting at most budget nodes
+	ESearchResult SearchForSupport(int32 start, int32 budget);
+
+	//Carries the deferred search on until it finds a foundation, runs out of nodes or has visited maxVisits more nodes
+	ESearchResult ContinueDeferredSearch(int32& maxVisits);
+
+	//Removes every node visited by the last search and adds them to outCollapsed
+	void CollapseVisited(TArray<int32>& outCollapsed);
+	void CollapseDeferredVisited(TArray<int32>& outCollapsed);
+
+	void FreeNode(int32 node);
+};
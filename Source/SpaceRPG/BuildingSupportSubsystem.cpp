@@ -0,0 +1,286 @@
+// Copyright SpaceRPG 2020
+
+#include "BuildingSupportSubsystem.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
+#include "Building.h"
+#include "BuildingCollisionSubsystem.h"
+#include "BuildingCommandLog.h"
+#include "BuildingRegistry.h"
+#include "BuildingGrid.h"
+#include "DistrictShardSubsystem.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Building Support Update"), STAT_BuildingSupportUpdate, STATGROUP_SpaceRPG);
+
+void UBuildingSupportSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	UBuildingRegistry* registry = Cast<UBuildingRegistry>(Collection.InitializeDependency(UBuildingRegistry::StaticClass()));
+	if (registry != nullptr)
+	{
+		buildingAddedHandle = registry->OnBuildingAdded.AddUObject(this, &UBuildingSupportSubsystem::OnBuildingAdded);
+		buildingRemovedHandle = registry->OnBuildingRemoved.AddUObject(this, &UBuildingSupportSubsystem::OnBuildingRemoved);
+	}
+
+	UBuildingCommandLog* commandLog = Cast<UBuildingCommandLog>(Collection.InitializeDependency(UBuildingCommandLog::StaticClass()));
+	if (commandLog != nullptr)
+	{
+		commandsAppliedHandle = commandLog->OnCommandsApplied.AddUObject(this, &UBuildingSupportSubsystem::OnCommandsApplied);
+	}
+}
+
+void UBuildingSupportSubsystem::Deinitialize()
+{
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->OnBuildingAdded.Remove(buildingAddedHandle);
+		registry->OnBuildingRemoved.Remove(buildingRemovedHandle);
+	}
+	if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+	{
+		commandLog->OnCommandsApplied.Remove(commandsAppliedHandle);
+	}
+
+	supportGraph.Reset();
+	nodeBuildings.Empty();
+	pendingCollapsed.Empty();
+	pendingAdded.Empty();
+
+	Super::Deinitialize();
+}
+
+void UBuildingSupportSubsystem::Tick(float DeltaTime)
+{
+	SPACERPG_LLM_SCOPE(Simulation);
+
+	SCOPE_CYCLE_COUNTER(STAT_BuildingSupportUpdate);
+
+	//Buildings spawned outside the command log, such as by Blueprints, are checked a frame after they spawn
+	FlushAddedBuildings();
+
+	//Finish searches that ran out of budget during removals
+	if (supportGraph.GetNumDeferred() > 0)
+	{
+		TArray<int32> collapsedNodes;
+		supportGraph.ProcessDeferred(deferredVisitsPerFrame, collapsedNodes);
+		QueueCollapsed(collapsedNodes);
+	}
+
+	if (pendingCollapsed.Num() == 0)
+	{
+		return;
+	}
+
+	//Report everything that collapsed this frame as one batch
+	TArray<ABuilding*> collapsedBuildings;
+	collapsedBuildings.Reserve(pendingCollapsed.Num());
+	for (const TWeakObjectPtr<ABuilding>& building : pendingCollapsed)
+	{
+		//Skip pieces held up again by a later batch
+		if (building.IsValid() && !IsInGraph(building.Get()))
+		{
+			collapsedBuildings.AddUnique(building.Get());
+		}
+	}
+	pendingCollapsed.Reset();
+
+	OnStructureCollapsed.Broadcast(collapsedBuildings);
+
+	//Demolish the collapsed buildings as one undoable batch on the server. Only buildings this server simulates are
+	//demolished, a shard never sends the owner of another district a demolish worked out from its partial view of it
+	UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>();
+	UDistrictShardSubsystem* shards = GetWorld()->GetSubsystem<UDistrictShardSubsystem>();
+	if (bDemolishCollapsedBuildings && commandLog != nullptr && GetWorld()->GetNetMode() != NM_Client)
+	{
+		commandLog->BeginBatch();
+		for (ABuilding* building : collapsedBuildings)
+		{
+			if (!UDistrictShardSubsystem::IsGhost(building) && (shards == nullptr || shards->OwnsCell(building->gridCell)))
+			{
+				commandLog->DemolishBuilding(building);
+			}
+		}
+		commandLog->EndBatch();
+	}
+}
+
+ETickableTickType UBuildingSupportSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UBuildingSupportSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBuildingSupportSubsystem, STATGROUP_Tickables);
+}
+
+void UBuildingSupportSubsystem::OnBuildingAdded(ABuilding* building)
+{
+	//Batches spawn in no particular order, so a piece can spawn before the piece it rests on
+	pendingAdded.Add(building);
+}
+
+void UBuildingSupportSubsystem::OnCommandsApplied(const TArray<FBuildingCommandRecord>& records)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BuildingSupportUpdate);
+
+	FlushAddedBuildings();
+}
+
+void UBuildingSupportSubsystem::FlushAddedBuildings()
+{
+	if (pendingAdded.Num() == 0)
+	{
+		return;
+	}
+
+	SPACERPG_LLM_SCOPE(Simulation);
+
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	TArray<ABuilding*> addQueue;
+	addQueue.Reserve(pendingAdded.Num());
+	for (const TWeakObjectPtr<ABuilding>& building : pendingAdded)
+	{
+		//Skip buildings removed again before the check
+		ABuilding* addedBuilding = building.Get();
+		if (addedBuilding != nullptr && registry != nullptr && registry->FindBuilding(addedBuilding->gridCell) == addedBuilding)
+		{
+			addQueue.AddUnique(addedBuilding);
+		}
+	}
+	pendingAdded.Reset();
+
+	//Lowest first, so most pieces find what holds them up already in the graph
+	addQueue.Sort([](const ABuilding& a, const ABuilding& b) { return a.gridCell.Z < b.gridCell.Z; });
+
+	//Pieces with nothing holding them up yet, by the cells of their sockets
+	TMultiMap<FIntVector, ABuilding*> waitingPieces;
+	TArray<ABuilding*> retried;
+	for (int32 i = 0; i < addQueue.Num(); i++)
+	{
+		ABuilding* building = addQueue[i];
+		if (!TryAddNode(building))
+		{
+			TArray<FIntVector, TInlineAllocator<6>> socketCells;
+			building->GetSocketCells(socketCells);
+			for (const FIntVector& cell : socketCells)
+			{
+				waitingPieces.Add(cell, building);
+			}
+			continue;
+		}
+
+		//Try the pieces waiting on this one again
+		retried.Reset();
+		waitingPieces.MultiFind(building->gridCell, retried);
+		if (retried.Num() > 0)
+		{
+			waitingPieces.Remove(building->gridCell);
+			addQueue.Append(retried);
+		}
+	}
+
+	//Placed with nothing holding them up
+	for (const TPair<FIntVector, ABuilding*>& waiting : waitingPieces)
+	{
+		if (supportGraph.FindNode(waiting.Value->gridCell) == INDEX_NONE)
+		{
+			pendingCollapsed.AddUnique(waiting.Value);
+		}
+	}
+}
+
+bool UBuildingSupportSubsystem::TryAddNode(ABuilding* building)
+{
+	//Already added through a piece it was waiting on
+	int32 node = supportGraph.FindNode(building->gridCell);
+	if (node != INDEX_NONE)
+	{
+		return nodeBuildings[node] == building;
+	}
+
+	TArray<FIntVector, TInlineAllocator<6>> socketCells;
+	building->GetSocketCells(socketCells);
+
+	//Ghosts are checked by the shard that owns them, here they hold up the pieces resting on them like the ground
+	bool bFoundation = UDistrictShardSubsystem::IsGhost(building) || IsFoundation(building);
+	node = supportGraph.AddNode(building->gridCell, bFoundation, socketCells);
+	if (node == INDEX_NONE)
+	{
+		return false;
+	}
+
+	if (node >= nodeBuildings.Num())
+	{
+		nodeBuildings.SetNum(node + 1);
+	}
+	nodeBuildings[node] = building;
+	return true;
+}
+
+void UBuildingSupportSubsystem::OnBuildingRemoved(ABuilding* building)
+{
+	SCOPE_CYCLE_COUNTER(STAT_BuildingSupportUpdate);
+
+	//Buildings that already collapsed are no longer in the graph
+	int32 node = supportGraph.FindNode(building->gridCell);
+	if (node == INDEX_NONE || nodeBuildings[node] != building)
+	{
+		return;
+	}
+
+	TArray<int32> collapsedNodes;
+	supportGraph.RemoveNode(node, collapsedNodes);
+	nodeBuildings[node].Reset();
+
+	QueueCollapsed(collapsedNodes);
+}
+
+bool UBuildingSupportSubsystem::IsFoundation(const ABuilding* building) const
+{
+	//Resting on another building means it is not a foundation
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	FVector location = building->GetActorLocation();
+	FIntVector below = building->gridCell - FIntVector(0, 0, building->footprintCells.Z * 2);
+	if (registry != nullptr && registry->FindBuilding(below) != nullptr)
+	{
+		return false;
+	}
+
+	//Otherwise check for ground just below the building's base
+	FHitResult hit;
+	FCollisionQueryParams traceParams;
+	traceParams.AddIgnoredActor(building);
+
+	//Merged chunk collision belongs to no building, and buildings below were already checked through the registry
+	if (UBuildingCollisionSubsystem* collision = GetWorld()->GetSubsystem<UBuildingCollisionSubsystem>())
+	{
+		collision->AddIgnoredChunks(traceParams);
+	}
+	FVector traceStart = location + FVector(0.0f, 0.0f, 1.0f);
+	FVector traceEnd = location - FVector(0.0f, 0.0f, FBuildingGrid::CellSize * 0.5f);
+	if (GetWorld()->LineTraceSingleByChannel(hit, traceStart, traceEnd, ECC_Visibility, traceParams))
+	{
+		return Cast<ABuilding>(hit.GetActor()) == nullptr;
+	}
+	return false;
+}
+
+bool UBuildingSupportSubsystem::IsInGraph(const ABuilding* building) const
+{
+	int32 node = supportGraph.FindNode(building->gridCell);
+	return node != INDEX_NONE && nodeBuildings[node] == building;
+}
+
+void UBuildingSupportSubsystem::QueueCollapsed(const TArray<int32>& collapsedNodes)
+{
+	for (int32 node : collapsedNodes)
+	{
+		//Pieces are checked again with the next added buildings before they count as collapsed, a batch that turns or
+		//replaces the piece they rest on adds it back straight after
+		pendingAdded.Add(nodeBuildings[node]);
+		nodeBuildings[node].Reset();
+	}
+}
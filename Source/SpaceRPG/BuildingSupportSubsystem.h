@@ -0,0 +1,79 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "BuildingSupportGraph.h"
+#include "BuildingSupportSubsystem.generated.h"
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnStructureCollapsed, const TArray<class ABuilding*>&, collapsedBuildings);
+
+//Keeps track of which placed buildings are still supported by the ground through their snap sockets
+UCLASS(Config = Game)
+class SPACERPG_API UBuildingSupportSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	//Called once per frame with every building that lost its support that frame
+	UPROPERTY(BlueprintAssignable, Category = Building)
+	FOnStructureCollapsed OnStructureCollapsed;
+
+	//Returns whether the building rests on the ground rather than on another building
+	bool IsFoundation(const class ABuilding* building) const;
+
+	//Returns whether the building is held up in the support graph
+	bool IsInGraph(const class ABuilding* building) const;
+
+	FORCEINLINE const FBuildingSupportGraph& GetSupportGraph() const { return supportGraph; }
+
+	//Memory held by the support graph and the node buildings
+	SIZE_T GetAllocatedSize() const { return supportGraph.GetAllocatedSize() + nodeBuildings.GetAllocatedSize() + pendingCollapsed.GetAllocatedSize() + pendingAdded.GetAllocatedSize(); }
+
+private:
+	//Whether collapsed buildings are demolished through the command log
+	UPROPERTY(Config)
+	bool bDemolishCollapsedBuildings = true;
+
+	//Nodes visited per frame finishing searches that ran out of budget
+	UPROPERTY(Config)
+	int32 deferredVisitsPerFrame = 16384;
+
+	FBuildingSupportGraph supportGraph;
+
+	//Building for each node in the graph
+	TArray<TWeakObjectPtr<class ABuilding>> nodeBuildings;
+
+	//Buildings that lost support this frame
+	TArray<TWeakObjectPtr<class ABuilding>> pendingCollapsed;
+
+	//Buildings added since the last batch was applied, checked for support once the whole batch has spawned
+	TArray<TWeakObjectPtr<class ABuilding>> pendingAdded;
+
+	FDelegateHandle buildingAddedHandle;
+	FDelegateHandle buildingRemovedHandle;
+	FDelegateHandle commandsAppliedHandle;
+
+	void OnBuildingAdded(class ABuilding* building);
+	void OnBuildingRemoved(class ABuilding* building);
+	void OnCommandsApplied(const TArray<struct FBuildingCommandRecord>& records);
+
+	//Adds the pending buildings to the graph, pieces are retried as the pieces they rest on are added so spawn order does not matter
+	void FlushAddedBuildings();
+
+	//Adds the building to the graph, returns false if nothing holds it up
+	bool TryAddNode(class ABuilding* building);
+
+	void QueueCollapsed(const TArray<int32>& collapsedNodes);
+};
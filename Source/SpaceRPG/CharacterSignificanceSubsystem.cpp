@@ -0,0 +1,248 @@
+// Copyright SpaceRPG 2020
+
+#include "CharacterSignificanceSubsystem.h"
+#include "SpaceRPG.h"
+#include "Engine/World.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/PlayerController.h"
+
+DECLARE_CYCLE_STAT(TEXT("Character Significance Update"), STAT_CharacterSignificanceUpdate, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Characters High Significance"), STAT_CharactersHigh, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Characters Medium Significance"), STAT_CharactersMedium, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Characters Low Significance"), STAT_CharactersLow, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Characters Hidden"), STAT_CharactersHidden, STATGROUP_SpaceRPG);
+
+void UCharacterSignificanceSubsystem::Deinitialize()
+{
+	characters.Empty();
+
+	Super::Deinitialize();
+}
+
+void UCharacterSignificanceSubsystem::Tick(float DeltaTime)
+{
+	SET_DWORD_STAT(STAT_CharactersHigh, GetNumCharacters(ECharacterSignificance::High));
+	SET_DWORD_STAT(STAT_CharactersMedium, GetNumCharacters(ECharacterSignificance::Medium));
+	SET_DWORD_STAT(STAT_CharactersLow, GetNumCharacters(ECharacterSignificance::Low));
+	SET_DWORD_STAT(STAT_CharactersHidden, GetNumCharacters(ECharacterSignificance::Hidden));
+
+	timeSinceUpdate += DeltaTime;
+	if (!bEnableSignificance || timeSinceUpdate < updateInterval)
+	{
+		return;
+	}
+	timeSinceUpdate = 0.0f;
+
+	TArray<FSignificanceViewer> viewers;
+	GatherViewers(viewers);
+	UpdateSignificance(viewers);
+}
+
+ETickableTickType UCharacterSignificanceSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UCharacterSignificanceSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCharacterSignificanceSubsystem, STATGROUP_Tickables);
+}
+
+void UCharacterSignificanceSubsystem::RegisterCharacter(ACharacter* character)
+{
+	if (character == nullptr || characters.ContainsByPredicate([character](const FCharacterState& state) { return state.character == character; }))
+	{
+		return;
+	}
+
+	//Remember the character's own settings so high significance can restore them
+	FCharacterState& state = characters.AddDefaulted_GetRef();
+	state.character = character;
+	state.actorTickInterval = character->GetActorTickInterval();
+
+	if (UCharacterMovementComponent* movement = character->GetCharacterMovement())
+	{
+		state.movementTickInterval = movement->GetComponentTickInterval();
+		state.bAlwaysCheckFloor = movement->bAlwaysCheckFloor;
+		state.bUseFlatBaseForFloorChecks = movement->bUseFlatBaseForFloorChecks;
+		state.bEnablePhysicsInteraction = movement->bEnablePhysicsInteraction;
+		state.smoothingMode = movement->NetworkSmoothingMode;
+	}
+
+	if (USkeletalMeshComponent* mesh = character->GetMesh())
+	{
+		state.meshTickInterval = mesh->GetComponentTickInterval();
+		state.animTickOption = mesh->VisibilityBasedAnimTickOption;
+		state.bEnableUpdateRateOptimizations = mesh->bEnableUpdateRateOptimizations;
+	}
+}
+
+void UCharacterSignificanceSubsystem::UnregisterCharacter(ACharacter* character)
+{
+	characters.RemoveAllSwap([character](const FCharacterState& state) { return !state.character.IsValid() || state.character == character; });
+}
+
+void UCharacterSignificanceSubsystem::UpdateSignificance(TArrayView<const FSignificanceViewer> viewers)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CharacterSignificanceUpdate);
+
+	//Without anyone watching there is nothing to score against, so keep the last significance
+	if (viewers.Num() == 0)
+	{
+		return;
+	}
+
+	const float cosViewAngle = FMath::Cos(FMath::DegreesToRadians(viewAngle * 0.5f));
+	const float mediumDistanceSquared = FMath::Square(mediumDistance);
+	const float lowDistanceSquared = FMath::Square(lowDistance);
+	const float hiddenDistanceSquared = FMath::Square(hiddenDistance);
+	const float outOfViewScaleSquared = FMath::Square(outOfViewDistanceScale);
+
+	for (FCharacterState& state : characters)
+	{
+		ACharacter* character = state.character.Get();
+		if (character == nullptr)
+		{
+			continue;
+		}
+
+		//The characters players on this machine control are never throttled
+		if (character->IsLocallyControlled())
+		{
+			ApplySignificance(state, ECharacterSignificance::High);
+			continue;
+		}
+
+		//Score by the closest viewer, counting characters out of view as further away
+		FVector location = character->GetActorLocation();
+		float closestDistanceSquared = MAX_flt;
+		for (const FSignificanceViewer& viewer : viewers)
+		{
+			FVector offset = location - viewer.location;
+			float distanceSquared = offset.SizeSquared();
+			bool bInView = FVector::DotProduct(offset, viewer.direction) >= cosViewAngle * FMath::Sqrt(distanceSquared);
+			closestDistanceSquared = FMath::Min(closestDistanceSquared, bInView ? distanceSquared : distanceSquared * outOfViewScaleSquared);
+		}
+
+		ECharacterSignificance significance = ECharacterSignificance::High;
+		if (closestDistanceSquared > hiddenDistanceSquared)
+		{
+			significance = ECharacterSignificance::Hidden;
+		}
+		else if (closestDistanceSquared > lowDistanceSquared)
+		{
+			significance = ECharacterSignificance::Low;
+		}
+		else if (closestDistanceSquared > mediumDistanceSquared)
+		{
+			significance = ECharacterSignificance::Medium;
+		}
+		ApplySignificance(state, significance);
+	}
+}
+
+void UCharacterSignificanceSubsystem::SetSignificanceEnabled(bool bEnabled)
+{
+	bEnableSignificance = bEnabled;
+	if (!bEnableSignificance)
+	{
+		for (FCharacterState& state : characters)
+		{
+			ApplySignificance(state, ECharacterSignificance::High);
+		}
+	}
+}
+
+ECharacterSignificance UCharacterSignificanceSubsystem::GetSignificance(ACharacter* character) const
+{
+	const FCharacterState* state = characters.FindByPredicate([character](const FCharacterState& characterState) { return characterState.character == character; });
+	return state ? state->significance : ECharacterSignificance::High;
+}
+
+int32 UCharacterSignificanceSubsystem::GetNumCharacters(ECharacterSignificance significance) const
+{
+	int32 count = 0;
+	for (const FCharacterState& state : characters)
+	{
+		count += state.significance == significance ? 1 : 0;
+	}
+	return count;
+}
+
+void UCharacterSignificanceSubsystem::ApplySignificance(FCharacterState& state, ECharacterSignificance significance) const
+{
+	ACharacter* character = state.character.Get();
+	if (character == nullptr || state.significance == significance)
+	{
+		return;
+	}
+	state.significance = significance;
+
+	UCharacterMovementComponent* movement = character->GetCharacterMovement();
+	USkeletalMeshComponent* mesh = character->GetMesh();
+
+	if (significance == ECharacterSignificance::High)
+	{
+		character->SetActorTickInterval(state.actorTickInterval);
+		if (movement != nullptr)
+		{
+			movement->SetComponentTickInterval(state.movementTickInterval);
+			movement->bAlwaysCheckFloor = state.bAlwaysCheckFloor;
+			movement->bUseFlatBaseForFloorChecks = state.bUseFlatBaseForFloorChecks;
+			movement->bEnablePhysicsInteraction = state.bEnablePhysicsInteraction;
+			movement->NetworkSmoothingMode = state.smoothingMode;
+		}
+		if (mesh != nullptr)
+		{
+			mesh->SetComponentTickInterval(state.meshTickInterval);
+			mesh->VisibilityBasedAnimTickOption = state.animTickOption;
+			mesh->bEnableUpdateRateOptimizations = state.bEnableUpdateRateOptimizations;
+		}
+		return;
+	}
+
+	float tickInterval = significance == ECharacterSignificance::Medium ? mediumTickInterval
+		: (significance == ECharacterSignificance::Low ? lowTickInterval : hiddenTickInterval);
+	bool bSimpleMovement = significance != ECharacterSignificance::Medium;
+
+	character->SetActorTickInterval(FMath::Max(state.actorTickInterval, tickInterval));
+	if (movement != nullptr)
+	{
+		movement->SetComponentTickInterval(FMath::Max(state.movementTickInterval, tickInterval));
+
+		//Simpler movement: flat floor checks, no floor checks while standing still and no pushing physics objects
+		movement->bAlwaysCheckFloor = bSimpleMovement ? false : state.bAlwaysCheckFloor;
+		movement->bUseFlatBaseForFloorChecks = bSimpleMovement ? true : state.bUseFlatBaseForFloorChecks;
+		movement->bEnablePhysicsInteraction = bSimpleMovement ? false : state.bEnablePhysicsInteraction;
+
+		//Remote characters far away snap to their replicated position instead of smoothing towards it
+		movement->NetworkSmoothingMode = significance == ECharacterSignificance::Hidden ? ENetworkSmoothingMode::Disabled
+			: (bSimpleMovement ? ENetworkSmoothingMode::Linear : state.smoothingMode);
+	}
+	if (mesh != nullptr)
+	{
+		//Update rate optimisation lowers the animation rate further with screen size
+		mesh->bEnableUpdateRateOptimizations = true;
+		mesh->VisibilityBasedAnimTickOption = bSimpleMovement ? EVisibilityBasedAnimTickOption::OnlyTickMontagesWhenNotRendered : state.animTickOption;
+		mesh->SetComponentTickInterval(significance == ECharacterSignificance::Hidden ? FMath::Max(state.meshTickInterval, tickInterval) : state.meshTickInterval);
+	}
+}
+
+void UCharacterSignificanceSubsystem::GatherViewers(TArray<FSignificanceViewer>& outViewers) const
+{
+	//The server scores against every player's view, clients only have their own
+	for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it)
+	{
+		APlayerController* playerController = it->Get();
+		if (playerController == nullptr || playerController->GetPawnOrSpectator() == nullptr)
+		{
+			continue;
+		}
+
+		FVector location;
+		FRotator rotation;
+		playerController->GetPlayerViewPoint(location, rotation);
+		outViewers.Add({ location, rotation.Vector() });
+	}
+	outViewers.Append(extraViewers);
+}
@@ -0,0 +1,128 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "CharacterSignificanceSubsystem.generated.h"
+
+//How much work a character is given, from full rate down to barely updated
+UENUM(BlueprintType)
+enum class ECharacterSignificance : uint8
+{
+	High,
+	Medium,
+	Low,
+	Hidden
+};
+
+//A point of view characters are scored against
+struct FSignificanceViewer
+{
+	FVector location;
+	FVector direction;
+};
+
+//Scores characters by distance and visibility to the viewers and throttles the tick, movement and animation of
+//characters that matter little. Characters controlled on this machine always stay at full rate
+UCLASS(Config = Game)
+class SPACERPG_API UCharacterSignificanceSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	//Called by characters as they begin and end play
+	void RegisterCharacter(class ACharacter* character);
+	void UnregisterCharacter(class ACharacter* character);
+
+	//Scores every character against the viewers and applies the settings of any that changed significance
+	void UpdateSignificance(TArrayView<const FSignificanceViewer> viewers);
+
+	//Views scored alongside the players' views, such as spectator cameras or a benchmark's viewer
+	void SetExtraViewers(TArrayView<const FSignificanceViewer> viewers) { extraViewers = TArray<FSignificanceViewer>(viewers.GetData(), viewers.Num()); }
+
+	//Turns throttling on and off, turning it off restores every character's settings
+	UFUNCTION(BlueprintCallable, Category = Significance)
+	void SetSignificanceEnabled(bool bEnabled);
+
+	UFUNCTION(BlueprintPure, Category = Significance)
+	ECharacterSignificance GetSignificance(class ACharacter* character) const;
+
+	//Number of registered characters at a significance
+	int32 GetNumCharacters(ECharacterSignificance significance) const;
+
+private:
+	UPROPERTY(Config)
+	bool bEnableSignificance = true;
+
+	//Seconds between significance updates
+	UPROPERTY(Config)
+	float updateInterval = 0.25f;
+
+	//Distances characters drop to each level at while in view
+	UPROPERTY(Config)
+	float mediumDistance = 1500.0f;
+
+	UPROPERTY(Config)
+	float lowDistance = 4000.0f;
+
+	UPROPERTY(Config)
+	float hiddenDistance = 10000.0f;
+
+	//Distances are multiplied by this for characters outside every viewer's field of view
+	UPROPERTY(Config)
+	float outOfViewDistanceScale = 3.0f;
+
+	//Field of view used for the visibility test, with margin for turning
+	UPROPERTY(Config)
+	float viewAngle = 110.0f;
+
+	//Tick intervals at medium, low and hidden significance
+	UPROPERTY(Config)
+	float mediumTickInterval = 1.0f / 30.0f;
+
+	UPROPERTY(Config)
+	float lowTickInterval = 0.1f;
+
+	UPROPERTY(Config)
+	float hiddenTickInterval = 0.5f;
+
+	//Settings a character started with, restored at high significance
+	struct FCharacterState
+	{
+		TWeakObjectPtr<class ACharacter> character;
+		ECharacterSignificance significance = ECharacterSignificance::High;
+
+		float actorTickInterval = 0.0f;
+		float movementTickInterval = 0.0f;
+		float meshTickInterval = 0.0f;
+		EVisibilityBasedAnimTickOption animTickOption = EVisibilityBasedAnimTickOption::AlwaysTickPose;
+		bool bEnableUpdateRateOptimizations = false;
+		bool bAlwaysCheckFloor = true;
+		bool bUseFlatBaseForFloorChecks = false;
+		bool bEnablePhysicsInteraction = true;
+		ENetworkSmoothingMode smoothingMode = ENetworkSmoothingMode::Exponential;
+	};
+
+	TArray<FCharacterState> characters;
+	TArray<FSignificanceViewer> extraViewers;
+
+	float timeSinceUpdate = 0.0f;
+
+	//Applies the settings for the state's significance to its character
+	void ApplySignificance(FCharacterState& state, ECharacterSignificance significance) const;
+
+	//Gathers the view point of every player controller in the world
+	void GatherViewers(TArray<FSignificanceViewer>& outViewers) const;
+};
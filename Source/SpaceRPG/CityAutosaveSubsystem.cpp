@@ -0,0 +1,525 @@
+// Copyright SpaceRPG 2020
+
+#include "CityAutosaveSubsystem.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
+#include "Building.h"
+#include "BuildingRegistry.h"
+#include "DistrictShardSubsystem.h"
+#include "TimeController.h"
+#include "Async/Async.h"
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Compression.h"
+#include "Misc/Crc.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DECLARE_CYCLE_STAT(TEXT("City Autosave Snapshot"), STAT_CityAutosaveSnapshot, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("City Autosave Dirty Chunks"), STAT_CityAutosaveDirtyChunks, STATGROUP_SpaceRPG);
+
+//Header written before every journal frame
+struct FJournalFrameHeader
+{
+	static constexpr uint32 Magic = 0x434A4E4C;
+
+	//Largest frame read back, the uncompressed size is only trusted up to this before allocating for it
+	static constexpr uint32 MaxUncompressedSize = 256 * 1024 * 1024;
+
+	uint32 magic = Magic;
+	uint32 compressedSize = 0;
+	uint32 uncompressedSize = 0;
+	uint32 crc = 0;
+
+	//Checksum over both sizes and the compressed data, so a torn or corrupt header can't pass for a frame
+	uint32 ComputeCrc(const uint8* compressedData) const
+	{
+		uint32 sizes[2] = { compressedSize, uncompressedSize };
+		return FCrc::MemCrc32(compressedData, compressedSize, FCrc::MemCrc32(sizes, sizeof(sizes)));
+	}
+};
+
+static void SerializeFrame(FArchive& Ar, FCitySaveFrame& frame)
+{
+	uint8 bHasTime = frame.bHasTime ? 1 : 0;
+	Ar << bHasTime;
+	frame.bHasTime = bHasTime != 0;
+	if (frame.bHasTime)
+	{
+		Ar << frame.clockwork << frame.day << frame.month << frame.year;
+	}
+
+	int32 numChunks = frame.chunks.Num();
+	Ar << numChunks;
+	if (Ar.IsLoading())
+	{
+		frame.chunks.SetNum(FMath::Max(numChunks, 0));
+	}
+
+	for (FCityChunkSave& chunk : frame.chunks)
+	{
+		int32 numBuildings = chunk.buildings.Num();
+		Ar << chunk.chunk.X << chunk.chunk.Y << numBuildings;
+		if (Ar.IsLoading())
+		{
+			if (Ar.IsError() || numBuildings < 0)
+			{
+				return;
+			}
+			chunk.buildings.SetNum(numBuildings);
+		}
+
+		for (FBuildingCommandRecord& record : chunk.buildings)
+		{
+			Ar << record;
+		}
+	}
+}
+
+//Writes a frame to the journal and flushes it to disk before it counts as saved
+static bool WriteJournalFrame(IPlatformFile& platformFile, const FString& path, const FCitySaveFrame& frame, bool bAppend)
+{
+	TArray<uint8> frameData;
+	FMemoryWriter writer(frameData);
+	SerializeFrame(writer, const_cast<FCitySaveFrame&>(frame));
+
+	//Frames past the size the reader accepts would read back as the end of the journal
+	if ((uint32)frameData.Num() > FJournalFrameHeader::MaxUncompressedSize)
+	{
+		UE_LOG(LogTemp, Error, TEXT("CityAutosaveSubsystem::A frame of %d bytes is too large to journal."), frameData.Num())
+		return false;
+	}
+
+	FJournalFrameHeader header;
+	header.uncompressedSize = frameData.Num();
+
+	int32 compressedSize = FCompression::CompressMemoryBound(NAME_Zlib, frameData.Num());
+	TArray<uint8> output;
+	output.SetNumUninitialized(sizeof(FJournalFrameHeader) + compressedSize);
+	if (!FCompression::CompressMemory(NAME_Zlib, output.GetData() + sizeof(FJournalFrameHeader), compressedSize, frameData.GetData(), frameData.Num()))
+	{
+		return false;
+	}
+
+	header.compressedSize = compressedSize;
+	header.crc = header.ComputeCrc(output.GetData() + sizeof(FJournalFrameHeader));
+	FMemory::Memcpy(output.GetData(), &header, sizeof(FJournalFrameHeader));
+
+	TUniquePtr<IFileHandle> file(platformFile.OpenWrite(*path, bAppend));
+	if (!file.IsValid() || !file->Write(output.GetData(), sizeof(FJournalFrameHeader) + compressedSize))
+	{
+		return false;
+	}
+	return file->Flush(true);
+}
+
+//Replaces the journal with a single frame holding the whole state, written beside it and then moved over it
+static bool ReplaceJournal(IPlatformFile& platformFile, const FString& path, const FCitySaveFrame& state)
+{
+	FString compactPath = path + TEXT(".tmp");
+	if (!WriteJournalFrame(platformFile, compactPath, state, false))
+	{
+		UE_LOG(LogTemp, Error, TEXT("CityAutosaveSubsystem::Failed to write compacted journal to %s."), *compactPath)
+		return false;
+	}
+
+	//Rename replaces the journal in one step where the platform allows it, the loader falls back to the copy otherwise
+	if (!platformFile.MoveFile(*path, *compactPath))
+	{
+		platformFile.DeleteFile(*path);
+		return platformFile.MoveFile(*path, *compactPath);
+	}
+	return true;
+}
+
+//Folds a frame into a state read from the journal, the frame's chunks replace the state's
+static void FoldFrame(FCitySaveFrame& state, const FCitySaveFrame& frame)
+{
+	if (frame.bHasTime)
+	{
+		state.bHasTime = true;
+		state.clockwork = frame.clockwork;
+		state.day = frame.day;
+		state.month = frame.month;
+		state.year = frame.year;
+	}
+
+	TMap<FIntPoint, int32> chunkIndices;
+	for (int32 i = 0; i < state.chunks.Num(); i++)
+	{
+		chunkIndices.Add(state.chunks[i].chunk, i);
+	}
+	for (const FCityChunkSave& chunk : frame.chunks)
+	{
+		if (const int32* index = chunkIndices.Find(chunk.chunk))
+		{
+			state.chunks[*index].buildings = chunk.buildings;
+		}
+		else
+		{
+			chunkIndices.Add(chunk.chunk, state.chunks.Add(chunk));
+		}
+	}
+
+	state.chunks.RemoveAll([](const FCityChunkSave& chunk) { return chunk.buildings.Num() == 0; });
+}
+
+void UCityAutosaveSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	UBuildingRegistry* registry = Cast<UBuildingRegistry>(Collection.InitializeDependency(UBuildingRegistry::StaticClass()));
+	if (registry != nullptr)
+	{
+		buildingAddedHandle = registry->OnBuildingAdded.AddUObject(this, &UCityAutosaveSubsystem::OnBuildingAdded);
+		buildingRemovedHandle = registry->OnBuildingRemoved.AddUObject(this, &UCityAutosaveSubsystem::OnBuildingRemoved);
+	}
+
+	UBuildingCommandLog* commandLog = Cast<UBuildingCommandLog>(Collection.InitializeDependency(UBuildingCommandLog::StaticClass()));
+	if (commandLog != nullptr)
+	{
+		commandsAppliedHandle = commandLog->OnCommandsApplied.AddUObject(this, &UCityAutosaveSubsystem::OnCommandsApplied);
+	}
+}
+
+void UCityAutosaveSubsystem::Deinitialize()
+{
+	//Let the last save finish so the journal is never left with a frame half written on a clean exit
+	if (saveTask.IsValid())
+	{
+		saveTask.Wait();
+	}
+
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->OnBuildingAdded.Remove(buildingAddedHandle);
+		registry->OnBuildingRemoved.Remove(buildingRemovedHandle);
+	}
+	if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+	{
+		commandLog->OnCommandsApplied.Remove(commandsAppliedHandle);
+	}
+
+	chunkBuildings.Empty();
+	dirtyChunks.Empty();
+
+	Super::Deinitialize();
+}
+
+void UCityAutosaveSubsystem::Tick(float DeltaTime)
+{
+	//Only the server owns the city
+	if (autosaveInterval <= 0.0f || GetWorld()->GetNetMode() == NM_Client || !GetWorld()->HasBegunPlay())
+	{
+		return;
+	}
+
+	timeSinceSave += DeltaTime;
+	if (timeSinceSave >= autosaveInterval && SaveNow())
+	{
+		timeSinceSave = 0.0f;
+	}
+}
+
+ETickableTickType UCityAutosaveSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UCityAutosaveSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCityAutosaveSubsystem, STATGROUP_Tickables);
+}
+
+FString UCityAutosaveSubsystem::GetJournalPath() const
+{
+	return FPaths::ProjectSavedDir() / TEXT("Autosave") / journalName;
+}
+
+bool UCityAutosaveSubsystem::SaveNow()
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	if (saveTask.IsValid() && !saveTask.IsReady())
+	{
+		return false;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_CityAutosaveSnapshot);
+	SET_DWORD_STAT(STAT_CityAutosaveDirtyChunks, dirtyChunks.Num());
+
+	//Copy only what changed, the background thread never touches game state
+	FCitySaveFrame frame;
+	for (TActorIterator<ATimeController> it(GetWorld()); it; ++it)
+	{
+		it->GetClockState(frame.clockwork, frame.day, frame.month, frame.year);
+		frame.bHasTime = true;
+		break;
+	}
+
+	frame.chunks.Reserve(dirtyChunks.Num());
+	for (const FIntPoint& chunk : dirtyChunks)
+	{
+		FCityChunkSave& chunkSave = frame.chunks.AddDefaulted_GetRef();
+		chunkSave.chunk = chunk;
+		if (const TMap<FIntVector, FBuildingCommandRecord>* buildings = chunkBuildings.Find(chunk))
+		{
+			buildings->GenerateValueArray(chunkSave.buildings);
+		}
+	}
+	dirtyChunks.Reset();
+
+	framesInJournal++;
+	bool bCompact = framesInJournal >= framesBeforeCompaction || !bJournalRecovered;
+	if (bCompact)
+	{
+		framesInJournal = 1;
+		bJournalRecovered = true;
+	}
+
+	FString path = GetJournalPath();
+	saveTask = Async(EAsyncExecution::ThreadPool, [path, frame = MoveTemp(frame), bCompact]()
+	{
+		WriteFrame(path, frame, bCompact);
+	});
+	return true;
+}
+
+bool UCityAutosaveSubsystem::LoadAutosave()
+{
+	FCitySaveFrame state;
+	int32 numFrames = 0;
+	FString path = GetJournalPath();
+
+	//Frames saved from now on are appended after the last complete frame
+	bool bRecovered = RecoverJournal(path, state, numFrames);
+	bJournalRecovered = true;
+	if (!bRecovered)
+	{
+		return false;
+	}
+
+	TArray<FBuildingCommandRecord> records;
+	for (const FCityChunkSave& chunk : state.chunks)
+	{
+		records.Append(chunk.buildings);
+	}
+
+	//Loaded buildings are already in the journal, so they don't need saving again
+	bLoading = true;
+	if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+	{
+		commandLog->ApplyRecords(records);
+	}
+	bLoading = false;
+
+	if (state.bHasTime)
+	{
+		for (TActorIterator<ATimeController> it(GetWorld()); it; ++it)
+		{
+			it->SetClockState(state.clockwork, state.day, state.month, state.year);
+		}
+	}
+
+	framesInJournal = numFrames;
+	UE_LOG(LogTemp, Log, TEXT("CityAutosaveSubsystem::Loaded %d buildings from %d journal frames."), records.Num(), numFrames)
+	return true;
+}
+
+bool UCityAutosaveSubsystem::ReadJournal(const FString& path, FCitySaveFrame& outState, int32& outNumFrames, int64* outValidBytes)
+{
+	TArray<uint8> journal;
+	if (!FFileHelper::LoadFileToArray(journal, *path, FILEREAD_Silent))
+	{
+		return false;
+	}
+
+	TMap<FIntPoint, TArray<FBuildingCommandRecord>> latestChunks;
+	outNumFrames = 0;
+
+	int64 offset = 0;
+	while (offset + (int64)sizeof(FJournalFrameHeader) <= journal.Num())
+	{
+		FJournalFrameHeader header;
+		FMemory::Memcpy(&header, journal.GetData() + offset, sizeof(FJournalFrameHeader));
+		const uint8* compressedData = journal.GetData() + offset + sizeof(FJournalFrameHeader);
+
+		//A frame cut short or corrupted by a crash ends the journal, everything before it is consistent
+		if (header.magic != FJournalFrameHeader::Magic
+			|| offset + (int64)sizeof(FJournalFrameHeader) + header.compressedSize > journal.Num()
+			|| header.uncompressedSize > FJournalFrameHeader::MaxUncompressedSize
+			|| header.ComputeCrc(compressedData) != header.crc)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("CityAutosaveSubsystem::Journal %s has an incomplete frame at byte %lld, ignoring it."), *path, offset)
+			break;
+		}
+
+		TArray<uint8> frameData;
+		frameData.SetNumUninitialized(header.uncompressedSize);
+		if (!FCompression::UncompressMemory(NAME_Zlib, frameData.GetData(), header.uncompressedSize, compressedData, header.compressedSize))
+		{
+			break;
+		}
+
+		FCitySaveFrame frame;
+		FMemoryReader reader(frameData);
+		SerializeFrame(reader, frame);
+		if (reader.IsError())
+		{
+			break;
+		}
+
+		//Each frame holds the whole content of its chunks, so later frames replace earlier ones
+		if (frame.bHasTime)
+		{
+			outState.bHasTime = true;
+			outState.clockwork = frame.clockwork;
+			outState.day = frame.day;
+			outState.month = frame.month;
+			outState.year = frame.year;
+		}
+		for (FCityChunkSave& chunk : frame.chunks)
+		{
+			latestChunks.Add(chunk.chunk, MoveTemp(chunk.buildings));
+		}
+
+		outNumFrames++;
+		offset += sizeof(FJournalFrameHeader) + header.compressedSize;
+	}
+
+	if (outValidBytes != nullptr)
+	{
+		*outValidBytes = offset;
+	}
+
+	outState.chunks.Reset(latestChunks.Num());
+	for (auto& pair : latestChunks)
+	{
+		if (pair.Value.Num() > 0)
+		{
+			FCityChunkSave& chunk = outState.chunks.AddDefaulted_GetRef();
+			chunk.chunk = pair.Key;
+			chunk.buildings = MoveTemp(pair.Value);
+		}
+	}
+	return outNumFrames > 0;
+}
+
+bool UCityAutosaveSubsystem::RecoverJournal(const FString& path, FCitySaveFrame& outState, int32& outNumFrames)
+{
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	//A crash between compaction steps can leave only the compacted copy behind
+	FString compactPath = path + TEXT(".tmp");
+	if (!platformFile.FileExists(*path) && platformFile.FileExists(*compactPath))
+	{
+		platformFile.MoveFile(*path, *compactPath);
+	}
+
+	int64 validBytes = 0;
+	outNumFrames = 0;
+	bool bRead = ReadJournal(path, outState, outNumFrames, &validBytes);
+
+	//Frames appended after a torn frame would never be read again, so cut the journal back to its last complete frame
+	int64 fileSize = platformFile.FileSize(*path);
+	if (fileSize > validBytes)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("CityAutosaveSubsystem::Cutting journal %s back from %lld to %lld bytes."), *path, fileSize, validBytes)
+		if (outNumFrames > 0)
+		{
+			ReplaceJournal(platformFile, path, outState);
+			outNumFrames = 1;
+		}
+		else
+		{
+			platformFile.DeleteFile(*path);
+		}
+	}
+	return bRead;
+}
+
+void UCityAutosaveSubsystem::WriteFrame(const FString& path, const FCitySaveFrame& frame, bool bCompact)
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	platformFile.CreateDirectoryTree(*FPaths::GetPath(path));
+
+	if (!bCompact)
+	{
+		if (WriteJournalFrame(platformFile, path, frame, true))
+		{
+			return;
+		}
+
+		//What was written of the frame would hide every later frame, so the journal is rewritten without it
+		UE_LOG(LogTemp, Error, TEXT("CityAutosaveSubsystem::Failed to write journal frame to %s, compacting the journal instead."), *path)
+	}
+
+	//Fold the journal and the new frame into a single frame
+	FCitySaveFrame state;
+	int32 numFrames;
+	if (!ReadJournal(path, state, numFrames))
+	{
+		ReadJournal(path + TEXT(".tmp"), state, numFrames);
+	}
+	FoldFrame(state, frame);
+	ReplaceJournal(platformFile, path, state);
+}
+
+void UCityAutosaveSubsystem::OnBuildingAdded(ABuilding* building)
+{
+	//Ghosts are saved by the shard that owns them
+	if (UDistrictShardSubsystem::IsGhost(building))
+	{
+		return;
+	}
+	UpdateCell(building->gridCell);
+}
+
+void UCityAutosaveSubsystem::OnBuildingRemoved(ABuilding* building)
+{
+	FIntPoint chunk = GetChunk(building->gridCell);
+	if (TMap<FIntVector, FBuildingCommandRecord>* buildings = chunkBuildings.Find(chunk))
+	{
+		buildings->Remove(building->gridCell);
+	}
+	if (!bLoading)
+	{
+		dirtyChunks.Add(chunk);
+	}
+}
+
+void UCityAutosaveSubsystem::OnCommandsApplied(const TArray<FBuildingCommandRecord>& records)
+{
+	//Rotations don't go through the registry, so refresh every cell the batch touched
+	for (const FBuildingCommandRecord& record : records)
+	{
+		if (record.GetCommand() == EBuildingCommand::Rotate)
+		{
+			UpdateCell(record.GetCell());
+		}
+	}
+}
+
+void UCityAutosaveSubsystem::UpdateCell(const FIntVector& cell)
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	ABuilding* building = registry ? registry->FindBuilding(cell) : nullptr;
+	if (building == nullptr)
+	{
+		return;
+	}
+
+	FIntPoint chunk = GetChunk(cell);
+	chunkBuildings.FindOrAdd(chunk).Add(cell, FBuildingCommandRecord::Make(EBuildingCommand::Place, cell, building->buildingType, FBuildingCommandRecord::EncodeYaw(building->GetActorRotation().Yaw)));
+	if (!bLoading)
+	{
+		dirtyChunks.Add(chunk);
+	}
+}
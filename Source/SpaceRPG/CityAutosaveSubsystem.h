@@ -0,0 +1,118 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "Async/Future.h"
+#include "BuildingCommandLog.h"
+#include "CityAutosaveSubsystem.generated.h"
+
+//Saved state of one world chunk, a column of chunkSize x chunkSize cells
+struct FCityChunkSave
+{
+	FIntPoint chunk;
+	TArray<FBuildingCommandRecord> buildings;
+};
+
+//Everything written in one journal frame
+struct FCitySaveFrame
+{
+	float clockwork = 0.0f;
+	int32 day = 1;
+	int32 month = 1;
+	int32 year = 1;
+	bool bHasTime = false;
+
+	TArray<FCityChunkSave> chunks;
+};
+
+//Autosaves the city incrementally: only chunks changed since the last save are copied on the game thread,
+//and are then compressed and appended to a journal on a background thread
+UCLASS(Config = Game)
+class SPACERPG_API UCityAutosaveSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	//Copies the dirty chunks and starts writing them in the background, returns false if a save is still running
+	UFUNCTION(BlueprintCallable, Category = Autosave)
+	bool SaveNow();
+
+	//Loads the last consistent state from the journal into the world, called when play starts
+	UFUNCTION(BlueprintCallable, Category = Autosave)
+	bool LoadAutosave();
+
+	//Reads every complete frame of a journal and folds them into the latest state, ignoring a torn final frame
+	//outValidBytes is set to the end of the last complete frame
+	static bool ReadJournal(const FString& path, FCitySaveFrame& outState, int32& outNumFrames, int64* outValidBytes = nullptr);
+
+	//Reads the journal like ReadJournal, then rewrites it without a torn final frame so later frames are appended after the
+	//last complete one. Falls back to the compacted copy a crash during compaction can leave behind
+	static bool RecoverJournal(const FString& path, FCitySaveFrame& outState, int32& outNumFrames);
+
+	//Background work, appends a frame and compacts the journal when it has grown or the append failed
+	static void WriteFrame(const FString& path, const FCitySaveFrame& frame, bool bCompact);
+
+	FString GetJournalPath() const;
+
+private:
+	//Seconds between autosaves, 0 disables autosave
+	UPROPERTY(Config)
+	float autosaveInterval = 60.0f;
+
+	//Cells along each side of a chunk
+	UPROPERTY(Config)
+	int32 chunkSize = 16;
+
+	//Frames appended before the journal is compacted into a single frame
+	UPROPERTY(Config)
+	int32 framesBeforeCompaction = 64;
+
+	//Journal file name inside the saved directory
+	UPROPERTY(Config)
+	FString journalName = TEXT("City.journal");
+
+	//Building records of every chunk, kept up to date so dirty chunks can be copied without touching actors
+	TMap<FIntPoint, TMap<FIntVector, FBuildingCommandRecord>> chunkBuildings;
+	TSet<FIntPoint> dirtyChunks;
+
+	float timeSinceSave = 0.0f;
+	int32 framesInJournal = 0;
+	bool bLoading = false;
+
+	//Whether the journal was recovered this session, the first save compacts it otherwise in case its last frame is torn
+	bool bJournalRecovered = false;
+
+	//The save running in the background, only one runs at a time so journal writes stay ordered
+	TFuture<void> saveTask;
+
+	FDelegateHandle buildingAddedHandle;
+	FDelegateHandle buildingRemovedHandle;
+	FDelegateHandle commandsAppliedHandle;
+
+	//Floor division so negative cells fall into the chunk below zero
+	FORCEINLINE FIntPoint GetChunk(const FIntVector& cell) const
+	{
+		return FIntPoint(
+			cell.X >= 0 ? cell.X / chunkSize : (cell.X - chunkSize + 1) / chunkSize,
+			cell.Y >= 0 ? cell.Y / chunkSize : (cell.Y - chunkSize + 1) / chunkSize);
+	}
+
+	void OnBuildingAdded(class ABuilding* building);
+	void OnBuildingRemoved(class ABuilding* building);
+	void OnCommandsApplied(const TArray<FBuildingCommandRecord>& records);
+
+	//Refreshes the saved record of a cell from the registry
+	void UpdateCell(const FIntVector& cell);
+};
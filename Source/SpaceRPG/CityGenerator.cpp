@@ -0,0 +1,233 @@
+// Copyright SpaceRPG 2020
+
+#include "CityGenerator.h"
+#include "BuildingPalette.h"
+#include "SpaceRPGMemory.h"
+#include "Async/ParallelFor.h"
+#include "Misc/Crc.h"
+
+//Names of the corridor pieces in the building palette
+static const FName CorridorPieceName(TEXT("Corridor1"));
+static const FName CornerPieceName(TEXT("Corridor1_Corner"));
+static const FName CrossPieceName(TEXT("Corridor1_Cross"));
+static const FName TeePieceName(TEXT("Corridor1_T"));
+
+//Neighbour bits of a road piece, ordered so rotating a piece 90 degrees rotates its bits left by one
+static constexpr uint8 NeighbourPosX = 1;
+static constexpr uint8 NeighbourPosY = 2;
+static constexpr uint8 NeighbourNegX = 4;
+static constexpr uint8 NeighbourNegY = 8;
+
+//Neighbours each piece connects at zero yaw: straight along X, corner from +X to +Y, tee closed towards -Y
+static constexpr uint8 CorridorNeighbours = NeighbourPosX | NeighbourNegX;
+static constexpr uint8 CornerNeighbours = NeighbourPosX | NeighbourPosY;
+static constexpr uint8 TeeNeighbours = NeighbourPosX | NeighbourPosY | NeighbourNegX;
+
+//Returns how many quarter turns bring the piece's neighbours onto the wanted ones, or INDEX_NONE
+static int32 FindQuarterTurns(uint8 pieceNeighbours, uint8 neighbours)
+{
+	for (int32 turns = 0; turns < 4; turns++)
+	{
+		if (pieceNeighbours == neighbours)
+		{
+			return turns;
+		}
+		pieceNeighbours = ((pieceNeighbours << 1) | (pieceNeighbours >> 3)) & 0x0F;
+	}
+	return INDEX_NONE;
+}
+
+bool FCityGeneratorSettings::ResolvePieces(const UBuildingPalette* palette)
+{
+	if (palette == nullptr)
+	{
+		return false;
+	}
+
+	corridorType = palette->FindBuildingType(CorridorPieceName);
+	cornerType = palette->FindBuildingType(CornerPieceName);
+	crossType = palette->FindBuildingType(CrossPieceName);
+	teeType = palette->FindBuildingType(TeePieceName);
+	return corridorType != INDEX_NONE && cornerType != INDEX_NONE && crossType != INDEX_NONE && teeType != INDEX_NONE;
+}
+
+FCityGenerator::FCityGenerator(const FCityGeneratorSettings& inSettings)
+	: settings(inSettings)
+{
+	//Street plans are stored as 64 bit masks
+	settings.chunkPieces = FMath::Clamp(settings.chunkPieces, 2, 64);
+	settings.pieceCells = FMath::Max(settings.pieceCells, 1);
+	settings.chunksX = FMath::Max(settings.chunksX, 0);
+	settings.chunksY = FMath::Max(settings.chunksY, 0);
+}
+
+void FCityGenerator::Generate(TArray<FGeneratedCityChunk>& outChunks, int32 numLanes) const
+{
+	int32 numChunks = settings.chunksX * settings.chunksY;
+	numLanes = FMath::Clamp(numLanes, 1, FMath::Max(numChunks, 1));
+
+	outChunks.Reset();
+	outChunks.SetNum(numChunks);
+
+	//Lanes take contiguous runs of chunks and each chunk only writes its own entry
+	ParallelFor(numLanes, [this, numChunks, numLanes, &outChunks](int32 lane)
+	{
+		//Lanes run on worker threads, which don't inherit the caller's tag
+		SPACERPG_LLM_SCOPE(CityData);
+
+		int32 first = (int32)((int64)numChunks * lane / numLanes);
+		int32 last = (int32)((int64)numChunks * (lane + 1) / numLanes);
+		for (int32 index = first; index < last; index++)
+		{
+			GenerateChunk(FIntPoint(index % settings.chunksX, index / settings.chunksX), outChunks[index]);
+		}
+	}, numLanes == 1);
+}
+
+void FCityGenerator::GenerateChunk(const FIntPoint& chunk, FGeneratedCityChunk& outChunk) const
+{
+	const int32 numPieces = settings.chunkPieces;
+
+	//Plans of this chunk and its four neighbours, pieces on the edge need to know which streets continue across it
+	FChunkPlan plans[3][3];
+	for (int32 y = -1; y <= 1; y++)
+	{
+		for (int32 x = -1; x <= 1; x++)
+		{
+			if (x == 0 || y == 0)
+			{
+				plans[y + 1][x + 1] = PlanChunk(chunk + FIntPoint(x, y));
+			}
+		}
+	}
+
+	const int32 cityPiecesX = settings.chunksX * numPieces;
+	const int32 cityPiecesY = settings.chunksY * numPieces;
+	const FIntPoint chunkPiece = chunk * numPieces;
+
+	auto isRoad = [&](int32 localX, int32 localY)
+	{
+		int32 pieceX = chunkPiece.X + localX;
+		int32 pieceY = chunkPiece.Y + localY;
+		if (pieceX < 0 || pieceY < 0 || pieceX >= cityPiecesX || pieceY >= cityPiecesY)
+		{
+			return false;
+		}
+
+		int32 offsetX = localX < 0 ? -1 : (localX >= numPieces ? 1 : 0);
+		int32 offsetY = localY < 0 ? -1 : (localY >= numPieces ? 1 : 0);
+		const FChunkPlan& plan = plans[offsetY + 1][offsetX + 1];
+		localX -= offsetX * numPieces;
+		localY -= offsetY * numPieces;
+		return ((plan.streetRows >> localY) & 1) != 0 || ((plan.streetColumns >> localX) & 1) != 0;
+	};
+
+	outChunk.chunk = chunk;
+	outChunk.district = plans[1][1].district;
+	outChunk.buildings.Reset();
+	outChunk.buildings.Reserve(numPieces * 4);
+
+	for (int32 y = 0; y < numPieces; y++)
+	{
+		for (int32 x = 0; x < numPieces; x++)
+		{
+			if (!isRoad(x, y))
+			{
+				continue;
+			}
+
+			uint8 neighbours = (isRoad(x + 1, y) ? NeighbourPosX : 0)
+				| (isRoad(x, y + 1) ? NeighbourPosY : 0)
+				| (isRoad(x - 1, y) ? NeighbourNegX : 0)
+				| (isRoad(x, y - 1) ? NeighbourNegY : 0);
+
+			int32 pieceType;
+			int32 turns;
+			switch (FMath::CountBits(neighbours))
+			{
+			case 4:
+				pieceType = settings.crossType;
+				turns = 0;
+				break;
+			case 3:
+				pieceType = settings.teeType;
+				turns = FindQuarterTurns(TeeNeighbours, neighbours);
+				break;
+			case 2:
+				turns = FindQuarterTurns(CornerNeighbours, neighbours);
+				pieceType = settings.cornerType;
+				if (turns == INDEX_NONE)
+				{
+					pieceType = settings.corridorType;
+					turns = FindQuarterTurns(CorridorNeighbours, neighbours);
+				}
+				break;
+			default:
+				//Dead ends at the edge of the city keep running along their street
+				pieceType = settings.corridorType;
+				turns = (neighbours & (NeighbourPosY | NeighbourNegY)) != 0 ? 1 : 0;
+				break;
+			}
+
+			FIntVector cell = settings.originCell + FIntVector((chunkPiece.X + x) * settings.pieceCells, (chunkPiece.Y + y) * settings.pieceCells, 0);
+			outChunk.buildings.Add(FBuildingCommandRecord::Make(EBuildingCommand::Place, cell, FMath::Max(pieceType, 0), (uint8)(turns * 64)));
+		}
+	}
+}
+
+uint32 FCityGenerator::HashChunks(const TArray<FGeneratedCityChunk>& chunks)
+{
+	uint32 hash = 0;
+	for (const FGeneratedCityChunk& chunk : chunks)
+	{
+		hash = FCrc::MemCrc32(chunk.buildings.GetData(), chunk.buildings.Num() * sizeof(FBuildingCommandRecord), hash);
+	}
+	return hash;
+}
+
+FCityGenerator::FChunkPlan FCityGenerator::PlanChunk(const FIntPoint& chunk) const
+{
+	FChunkPlan plan;
+	if (chunk.X < 0 || chunk.Y < 0 || chunk.X >= settings.chunksX || chunk.Y >= settings.chunksY)
+	{
+		return plan;
+	}
+
+	FRandomStream random(HashCombine(GetTypeHash(settings.seed), GetTypeHash(chunk)));
+
+	//Dense districts are rare, open ones only keep the arterials
+	float roll = random.GetFraction();
+	plan.district = roll < 0.15f ? ECityDistrict::Dense : (roll < 0.55f ? ECityDistrict::Residential : (roll < 0.8f ? ECityDistrict::Industrial : ECityDistrict::Open));
+
+	switch (plan.district)
+	{
+	case ECityDistrict::Dense:
+		plan.streetRows = PlanStreetLines(random, settings.chunkPieces, 2, 3);
+		plan.streetColumns = PlanStreetLines(random, settings.chunkPieces, 2, 3);
+		break;
+	case ECityDistrict::Residential:
+		plan.streetRows = PlanStreetLines(random, settings.chunkPieces, 3, 5);
+		plan.streetColumns = PlanStreetLines(random, settings.chunkPieces, 3, 5);
+		break;
+	case ECityDistrict::Industrial:
+		plan.streetRows = PlanStreetLines(random, settings.chunkPieces, 5, 8);
+		plan.streetColumns = PlanStreetLines(random, settings.chunkPieces, 5, 8);
+		break;
+	default:
+		break;
+	}
+	return plan;
+}
+
+uint64 FCityGenerator::PlanStreetLines(FRandomStream& random, int32 numPieces, int32 minBlock, int32 maxBlock)
+{
+	//Line 0 is the arterial, the last line stays empty so streets don't run right beside the next chunk's arterial
+	uint64 lines = 1;
+	int32 line = random.RandRange(minBlock, maxBlock);
+	while (line < numPieces - 1)
+	{
+		lines |= (uint64)1 << line;
+		line += random.RandRange(minBlock, maxBlock);
+	}
+	return lines;
+}
@@ -0,0 +1,89 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BuildingCommandLog.h"
+
+//Kinds of district a chunk can be, each with its own street density
+enum class ECityDistrict : uint8
+{
+	Dense,
+	Residential,
+	Industrial,
+	Open,
+	Count
+};
+
+//Settings for one generated city
+struct SPACERPG_API FCityGeneratorSettings
+{
+	int32 seed = 0;
+
+	//Chunks generated along each axis, starting at chunk 0, 0
+	int32 chunksX = 8;
+	int32 chunksY = 8;
+
+	//Corridor pieces along each side of a chunk, at most 64
+	int32 chunkPieces = 16;
+
+	//Grid cells between the centres of neighbouring pieces
+	int32 pieceCells = 4;
+
+	//Cell of the corner of chunk 0, 0
+	FIntVector originCell = FIntVector::ZeroValue;
+
+	//Palette ids of the corridor pieces
+	int32 corridorType = INDEX_NONE;
+	int32 cornerType = INDEX_NONE;
+	int32 crossType = INDEX_NONE;
+	int32 teeType = INDEX_NONE;
+
+	//Finds the corridor pieces in the palette by name, returns false if any is missing
+	bool ResolvePieces(const class UBuildingPalette* palette);
+};
+
+//Buildings generated for one chunk, as place records ready for the command log
+struct FGeneratedCityChunk
+{
+	FIntPoint chunk;
+	ECityDistrict district = ECityDistrict::Open;
+	TArray<FBuildingCommandRecord> buildings;
+};
+
+//Lays out districts and corridor networks from a seed. Every chunk is generated from its own random stream and only
+//reads the street plans of its neighbours, so chunks generate independently and the result does not depend on threading
+class SPACERPG_API FCityGenerator
+{
+public:
+	FCityGenerator(const FCityGeneratorSettings& inSettings);
+
+	//Generates every chunk split across the given number of parallel lanes, chunks are returned in row order
+	void Generate(TArray<FGeneratedCityChunk>& outChunks, int32 numLanes) const;
+
+	//Generates a single chunk
+	void GenerateChunk(const FIntPoint& chunk, FGeneratedCityChunk& outChunk) const;
+
+	//Hash of generated chunks, equal for equal cities
+	static uint32 HashChunks(const TArray<FGeneratedCityChunk>& chunks);
+
+	FORCEINLINE const FCityGeneratorSettings& GetSettings() const { return settings; }
+
+private:
+	//Streets of a chunk as bit masks, a set bit in streetRows means a street runs along X at that local row.
+	//Row and column 0 are always set, they are the arterials shared along chunk edges
+	struct FChunkPlan
+	{
+		ECityDistrict district = ECityDistrict::Open;
+		uint64 streetRows = 1;
+		uint64 streetColumns = 1;
+	};
+
+	FCityGeneratorSettings settings;
+
+	//Plans the district and streets of a chunk, a pure function of the seed and chunk
+	FChunkPlan PlanChunk(const FIntPoint& chunk) const;
+
+	//Picks the random lines of a chunk side for the district's block size
+	static uint64 PlanStreetLines(FRandomStream& random, int32 numPieces, int32 minBlock, int32 maxBlock);
+};
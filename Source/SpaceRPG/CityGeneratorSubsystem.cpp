@@ -0,0 +1,134 @@
+// Copyright SpaceRPG 2020
+
+#include "CityGeneratorSubsystem.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
+#include "BuildingCommandLog.h"
+#include "BuildingStreamingSubsystem.h"
+#include "Async/Async.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("City Generator Commit"), STAT_CityGeneratorCommit, STATGROUP_SpaceRPG);
+
+void UCityGeneratorSubsystem::Deinitialize()
+{
+	if (generateTask.IsValid())
+	{
+		generateTask.Wait();
+	}
+	generatedChunks.Empty();
+
+	Super::Deinitialize();
+}
+
+void UCityGeneratorSubsystem::Tick(float DeltaTime)
+{
+	if (!bIsGenerating || !generateTask.IsReady())
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_CityGeneratorCommit);
+
+	UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>();
+	if (commandLog == nullptr)
+	{
+		bIsGenerating = false;
+		return;
+	}
+
+	//Spawn one slice of the city as a single batch so every listener sees it together
+	TArray<FBuildingCommandRecord> batch;
+	batch.Reserve(buildingsPerTick);
+	while (commitChunk < generatedChunks.Num() && batch.Num() < buildingsPerTick)
+	{
+		const TArray<FBuildingCommandRecord>& buildings = generatedChunks[commitChunk].buildings;
+		int32 count = FMath::Min(buildings.Num() - commitBuilding, buildingsPerTick - batch.Num());
+		batch.Append(buildings.GetData() + commitBuilding, count);
+		commitBuilding += count;
+
+		if (commitBuilding >= buildings.Num())
+		{
+			commitChunk++;
+			commitBuilding = 0;
+		}
+	}
+
+	commandLog->ApplyRecords(batch);
+	numCommitted += batch.Num();
+
+	if (commitChunk >= generatedChunks.Num())
+	{
+		UE_LOG(LogTemp, Log, TEXT("CityGeneratorSubsystem::Committed %d buildings in %d chunks after %.2f seconds."),
+			numCommitted, generatedChunks.Num(), FPlatformTime::Seconds() - generationStartTime)
+		generatedChunks.Empty();
+		bIsGenerating = false;
+	}
+}
+
+ETickableTickType UCityGeneratorSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UCityGeneratorSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCityGeneratorSubsystem, STATGROUP_Tickables);
+}
+
+bool UCityGeneratorSubsystem::GenerateCity(int32 seed, int32 chunksX, int32 chunksY)
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	//Only the server places buildings, clients receive the city through snapshots
+	if (bIsGenerating || GetWorld()->GetNetMode() == NM_Client)
+	{
+		return false;
+	}
+
+	UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(this);
+	FCityGeneratorSettings settings;
+	if (!settings.ResolvePieces(streaming ? streaming->GetPalette() : nullptr))
+	{
+		UE_LOG(LogTemp, Error, TEXT("CityGeneratorSubsystem::The building palette is missing a corridor piece."))
+		return false;
+	}
+
+	settings.seed = seed;
+	settings.chunksX = chunksX;
+	settings.chunksY = chunksY;
+	settings.chunkPieces = chunkPieces;
+	settings.pieceCells = pieceCells;
+
+	int32 numLanes = generationLanes > 0 ? generationLanes : FTaskGraphInterface::Get().GetNumWorkerThreads();
+
+	bIsGenerating = true;
+	generationStartTime = FPlatformTime::Seconds();
+	commitChunk = 0;
+	commitBuilding = 0;
+	numCommitted = 0;
+
+	generateTask = Async(EAsyncExecution::ThreadPool, [this, settings, numLanes]()
+	{
+		SPACERPG_LLM_SCOPE(CityData);
+		FCityGenerator(settings).Generate(generatedChunks, numLanes);
+	});
+	return true;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GenerateCityCommand(
+	TEXT("SpaceRPG.GenerateCity"),
+	TEXT("Generates a procedural city. Arguments: seed chunksX chunksY"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+	{
+		int32 seed = args.Num() > 0 ? FCString::Atoi(*args[0]) : 0;
+		int32 chunksX = args.Num() > 1 ? FCString::Atoi(*args[1]) : 4;
+		int32 chunksY = args.Num() > 2 ? FCString::Atoi(*args[2]) : chunksX;
+
+		if (UCityGeneratorSubsystem* generator = world ? world->GetSubsystem<UCityGeneratorSubsystem>() : nullptr)
+		{
+			generator->GenerateCity(seed, chunksX, chunksY);
+		}
+	}));
@@ -0,0 +1,63 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "Async/Future.h"
+#include "CityGenerator.h"
+#include "CityGeneratorSubsystem.generated.h"
+
+//Generates procedural cities on worker threads and commits them to the world a slice at a time
+UCLASS(Config = Game)
+class SPACERPG_API UCityGeneratorSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	//Starts generating a city of chunksX x chunksY chunks from the seed, returns false if one is already being generated
+	UFUNCTION(BlueprintCallable, Category = CityGenerator)
+	bool GenerateCity(int32 seed, int32 chunksX, int32 chunksY);
+
+	//Whether a city is still being generated or committed
+	UFUNCTION(BlueprintPure, Category = CityGenerator)
+	bool IsGenerating() const { return bIsGenerating; }
+
+private:
+	//Corridor pieces along each side of a chunk
+	UPROPERTY(Config)
+	int32 chunkPieces = 16;
+
+	//Grid cells between the centres of neighbouring pieces
+	UPROPERTY(Config)
+	int32 pieceCells = 4;
+
+	//Parallel lanes used for generation, 0 uses one per worker thread
+	UPROPERTY(Config)
+	int32 generationLanes = 0;
+
+	//Buildings spawned per frame while committing
+	UPROPERTY(Config)
+	int32 buildingsPerTick = 1000;
+
+	bool bIsGenerating = false;
+	double generationStartTime = 0.0;
+
+	//Generation running on worker threads, generatedChunks is only read once it is ready
+	TFuture<void> generateTask;
+	TArray<FGeneratedCityChunk> generatedChunks;
+
+	//Position of the next building to commit
+	int32 commitChunk = 0;
+	int32 commitBuilding = 0;
+	int32 numCommitted = 0;
+};
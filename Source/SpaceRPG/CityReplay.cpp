@@ -0,0 +1,189 @@
+// Copyright SpaceRPG 2020
+
+#include "CityReplay.h"
+#include "CitySnapshot.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+//Smallest encoded record, used to reject record counts the remaining data cannot hold
+static constexpr int32 MinRecordSize = 6;
+
+FCityReplayWriter::FCityReplayWriter()
+{
+	FMemoryWriter writer(data);
+	uint32 magic = Magic;
+	uint16 version = Version;
+	writer << magic << version;
+}
+
+void FCityReplayWriter::WriteEventHeader(FArchive& writer, ECityReplayEvent type, double time)
+{
+	//Times only move forward, so the delta from the previous event stays small
+	uint64 timeMs = FMath::Max<uint64>((uint64)FMath::Max(time * 1000.0, 0.0), lastTimeMs);
+	uint32 deltaMs = (uint32)FMath::Min<uint64>(timeMs - lastTimeMs, MAX_uint32);
+	lastTimeMs += deltaMs;
+
+	uint8 typeByte = (uint8)type;
+	writer << typeByte;
+	writer.SerializeIntPacked(deltaMs);
+	numEvents++;
+}
+
+void FCityReplayWriter::WriteCommands(double time, const TArray<FBuildingCommandRecord>& records)
+{
+	if (records.Num() == 0)
+	{
+		return;
+	}
+
+	FMemoryWriter writer(data, false, true);
+	WriteEventHeader(writer, ECityReplayEvent::Commands, time);
+
+	uint32 numRecords = records.Num();
+	writer.SerializeIntPacked(numRecords);
+	for (const FBuildingCommandRecord& record : records)
+	{
+		FIntVector cell = record.GetCell();
+		uint32 deltaX = FCitySnapshot::ZigZagEncode(cell.X - previousCell.X);
+		uint32 deltaY = FCitySnapshot::ZigZagEncode(cell.Y - previousCell.Y);
+		uint32 deltaZ = FCitySnapshot::ZigZagEncode(cell.Z - previousCell.Z);
+		uint32 buildingType = record.buildingType;
+		uint8 rotation = record.rotation;
+		uint8 flags = record.flags;
+
+		writer << flags;
+		writer.SerializeIntPacked(deltaX);
+		writer.SerializeIntPacked(deltaY);
+		writer.SerializeIntPacked(deltaZ);
+		writer.SerializeIntPacked(buildingType);
+		writer << rotation;
+
+		previousCell = cell;
+	}
+}
+
+void FCityReplayWriter::WriteTimeRate(double time, float timeRate)
+{
+	FMemoryWriter writer(data, false, true);
+	WriteEventHeader(writer, ECityReplayEvent::TimeRate, time);
+	writer << timeRate;
+}
+
+void FCityReplayWriter::WriteClock(double time, float clockwork, int32 day, int32 month, int32 year)
+{
+	FMemoryWriter writer(data, false, true);
+	WriteEventHeader(writer, ECityReplayEvent::Clock, time);
+
+	uint32 packedDay = FMath::Max(day, 0);
+	uint32 packedMonth = FMath::Max(month, 0);
+	uint32 packedYear = FMath::Max(year, 0);
+	writer << clockwork;
+	writer.SerializeIntPacked(packedDay);
+	writer.SerializeIntPacked(packedMonth);
+	writer.SerializeIntPacked(packedYear);
+}
+
+void FCityReplayWriter::TakeData(TArray<uint8>& outData)
+{
+	outData = MoveTemp(data);
+	data.Reset();
+}
+
+FCityReplayReader::FCityReplayReader(const TArray<uint8>& inData)
+	: data(inData)
+{
+	FMemoryReader reader(data);
+	uint32 magic = 0;
+	uint16 version = 0;
+	reader << magic << version;
+
+	bValid = !reader.IsError() && magic == FCityReplayWriter::Magic && version == FCityReplayWriter::Version;
+	offset = reader.Tell();
+}
+
+bool FCityReplayReader::ReadEvent(FCityReplayEvent& outEvent)
+{
+	if (!bValid || bError || offset >= data.Num())
+	{
+		return false;
+	}
+
+	FMemoryReader reader(data);
+	reader.Seek(offset);
+
+	uint8 typeByte = 0;
+	uint32 deltaMs = 0;
+	reader << typeByte;
+	reader.SerializeIntPacked(deltaMs);
+
+	outEvent.type = (ECityReplayEvent)typeByte;
+	outEvent.time = (timeMs + deltaMs) / 1000.0;
+	outEvent.records.Reset();
+
+	switch (outEvent.type)
+	{
+	case ECityReplayEvent::Commands:
+	{
+		uint32 numRecords = 0;
+		reader.SerializeIntPacked(numRecords);
+		if (reader.IsError() || numRecords > (uint32)((data.Num() - reader.Tell()) / MinRecordSize))
+		{
+			bError = true;
+			return false;
+		}
+
+		//Cells are only committed once the whole event has been read
+		FIntVector cell = previousCell;
+		outEvent.records.Reserve(numRecords);
+		for (uint32 i = 0; i < numRecords && !reader.IsError(); i++)
+		{
+			uint32 deltaX, deltaY, deltaZ, buildingType;
+			uint8 flags, rotation;
+			reader << flags;
+			reader.SerializeIntPacked(deltaX);
+			reader.SerializeIntPacked(deltaY);
+			reader.SerializeIntPacked(deltaZ);
+			reader.SerializeIntPacked(buildingType);
+			reader << rotation;
+
+			cell += FIntVector(FCitySnapshot::ZigZagDecode(deltaX), FCitySnapshot::ZigZagDecode(deltaY), FCitySnapshot::ZigZagDecode(deltaZ));
+			FBuildingCommandRecord& record = outEvent.records.Add_GetRef(FBuildingCommandRecord::Make((EBuildingCommand)(flags & FBuildingCommandRecord::CommandMask), cell, buildingType, rotation));
+			record.flags = flags;
+		}
+		if (!reader.IsError())
+		{
+			previousCell = cell;
+		}
+		break;
+	}
+	case ECityReplayEvent::TimeRate:
+		reader << outEvent.timeRate;
+		break;
+	case ECityReplayEvent::Clock:
+	{
+		uint32 packedDay = 0, packedMonth = 0, packedYear = 0;
+		reader << outEvent.clockwork;
+		reader.SerializeIntPacked(packedDay);
+		reader.SerializeIntPacked(packedMonth);
+		reader.SerializeIntPacked(packedYear);
+		outEvent.day = packedDay;
+		outEvent.month = packedMonth;
+		outEvent.year = packedYear;
+		break;
+	}
+	default:
+		bError = true;
+		return false;
+	}
+
+	//A recording cut off by a crash ends on a partial event, everything before it is still usable
+	if (reader.IsError())
+	{
+		bError = true;
+		return false;
+	}
+
+	timeMs += deltaMs;
+	offset = reader.Tell();
+	return true;
+}
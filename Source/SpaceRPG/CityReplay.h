@@ -0,0 +1,89 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BuildingCommandLog.h"
+
+//Kinds of event stored in a city replay
+enum class ECityReplayEvent : uint8
+{
+	//A batch of building records as applied by the command log
+	Commands = 0,
+	//A change of the time controller's game speed
+	TimeRate = 1,
+	//The clock and calendar, written every game hour
+	Clock = 2
+};
+
+//One decoded replay event, only the fields of its type are set
+struct FCityReplayEvent
+{
+	ECityReplayEvent type = ECityReplayEvent::Commands;
+
+	//Seconds since the recording started
+	double time = 0.0;
+
+	TArray<FBuildingCommandRecord> records;
+
+	float timeRate = 1.0f;
+
+	float clockwork = 0.0f;
+	int32 day = 1;
+	int32 month = 1;
+	int32 year = 1;
+};
+
+//Appends replay events to a byte buffer that can be flushed to a file as it grows.
+//Each event is its type, the milliseconds since the previous event and its payload, all packed,
+//with building cells delta encoded against the previous record like city snapshots
+class SPACERPG_API FCityReplayWriter
+{
+public:
+	static constexpr uint32 Magic = 0x43525059;
+	static constexpr uint16 Version = 1;
+
+	FCityReplayWriter();
+
+	void WriteCommands(double time, const TArray<FBuildingCommandRecord>& records);
+	void WriteTimeRate(double time, float timeRate);
+	void WriteClock(double time, float clockwork, int32 day, int32 month, int32 year);
+
+	//Moves the bytes written since the last call into outData, for appending to a file
+	void TakeData(TArray<uint8>& outData);
+
+	FORCEINLINE int32 GetNumPendingBytes() const { return data.Num(); }
+	FORCEINLINE int32 GetNumEvents() const { return numEvents; }
+
+private:
+	TArray<uint8> data;
+	uint64 lastTimeMs = 0;
+	FIntVector previousCell = FIntVector::ZeroValue;
+	int32 numEvents = 0;
+
+	void WriteEventHeader(FArchive& writer, ECityReplayEvent type, double time);
+};
+
+//Reads the events of a replay written by FCityReplayWriter in order
+class SPACERPG_API FCityReplayReader
+{
+public:
+	explicit FCityReplayReader(const TArray<uint8>& inData);
+
+	//Whether the data starts with a replay header of a known version
+	FORCEINLINE bool IsValid() const { return bValid; }
+
+	//Whether reading stopped at a truncated or corrupt event rather than the end of the data
+	FORCEINLINE bool IsError() const { return bError; }
+
+	//Reads the next event, returns false at the end of the replay or at a bad event
+	bool ReadEvent(FCityReplayEvent& outEvent);
+
+private:
+	const TArray<uint8>& data;
+	int64 offset = 0;
+	uint64 timeMs = 0;
+	FIntVector previousCell = FIntVector::ZeroValue;
+	bool bValid = false;
+	bool bError = false;
+};
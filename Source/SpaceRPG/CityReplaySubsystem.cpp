@@ -0,0 +1,402 @@
+// Copyright SpaceRPG 2020
+
+#include "CityReplaySubsystem.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
+#include "Building.h"
+#include "BuildingRegistry.h"
+#include "DistrictShardSubsystem.h"
+#include "TimeController.h"
+#include "Async/Async.h"
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DECLARE_CYCLE_STAT(TEXT("City Replay Play"), STAT_CityReplayPlay, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("City Replay Events Recorded"), STAT_CityReplayEventsRecorded, STATGROUP_SpaceRPG);
+
+void UCityReplaySubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	UBuildingRegistry* registry = Cast<UBuildingRegistry>(Collection.InitializeDependency(UBuildingRegistry::StaticClass()));
+	if (registry != nullptr)
+	{
+		buildingAddedHandle = registry->OnBuildingAdded.AddUObject(this, &UCityReplaySubsystem::OnBuildingAdded);
+		buildingRemovedHandle = registry->OnBuildingRemoved.AddUObject(this, &UCityReplaySubsystem::OnBuildingRemoved);
+	}
+
+	UBuildingCommandLog* commandLog = Cast<UBuildingCommandLog>(Collection.InitializeDependency(UBuildingCommandLog::StaticClass()));
+	if (commandLog != nullptr)
+	{
+		commandsAppliedHandle = commandLog->OnCommandsApplied.AddUObject(this, &UCityReplaySubsystem::OnCommandsApplied);
+	}
+
+	hourChangedHandle = ATimeController::OnHourChangedEvent.AddUObject(this, &UCityReplaySubsystem::OnHourChanged);
+}
+
+void UCityReplaySubsystem::Deinitialize()
+{
+	StopRecording();
+
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->OnBuildingAdded.Remove(buildingAddedHandle);
+		registry->OnBuildingRemoved.Remove(buildingRemovedHandle);
+	}
+	if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+	{
+		commandLog->OnCommandsApplied.Remove(commandsAppliedHandle);
+	}
+	ATimeController::OnHourChangedEvent.Remove(hourChangedHandle);
+
+	Super::Deinitialize();
+}
+
+void UCityReplaySubsystem::Tick(float DeltaTime)
+{
+	//Report a failed background write as soon as it is done
+	if (flushTask.IsValid() && flushTask.IsReady())
+	{
+		WaitForFlush();
+	}
+
+	if (!writer.IsValid())
+	{
+		return;
+	}
+
+	//Buildings spawned and destroyed outside the command log this frame
+	WritePendingRecords();
+
+	//Game speed is a plain property, so changes are picked up by polling
+	if (ATimeController* controller = FindTimeController())
+	{
+		if (controller->gameSpeedMultiplier != lastTimeRate)
+		{
+			lastTimeRate = controller->gameSpeedMultiplier;
+			writer->WriteTimeRate(GetRecordingTime(), lastTimeRate);
+		}
+	}
+
+	timeSinceFlush += DeltaTime;
+	if (timeSinceFlush >= flushInterval)
+	{
+		FlushRecording();
+	}
+}
+
+ETickableTickType UCityReplaySubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UCityReplaySubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCityReplaySubsystem, STATGROUP_Tickables);
+}
+
+FString UCityReplaySubsystem::GetReplayPath() const
+{
+	return FPaths::ProjectSavedDir() / TEXT("Replays") / replayName;
+}
+
+bool UCityReplaySubsystem::StartRecording()
+{
+	//Only the server sees every player's operations
+	if (writer.IsValid() || GetWorld()->GetNetMode() == NM_Client)
+	{
+		return false;
+	}
+
+	FString path = GetReplayPath();
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	platformFile.CreateDirectoryTree(*FPaths::GetPath(path));
+	platformFile.DeleteFile(*path);
+
+	writer = MakeUnique<FCityReplayWriter>();
+	pendingRecords.Reset();
+	recordStartTime = FPlatformTime::Seconds();
+	timeSinceFlush = 0.0f;
+
+	//The clock and the city as they are now, so the replay does not depend on the world it is played into
+	if (ATimeController* controller = FindTimeController())
+	{
+		float clockwork;
+		int32 day, month, year;
+		controller->GetClockState(clockwork, day, month, year);
+		writer->WriteClock(0.0, clockwork, day, month, year);
+
+		lastTimeRate = controller->gameSpeedMultiplier;
+		writer->WriteTimeRate(0.0, lastTimeRate);
+	}
+
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		TArray<FBuildingCommandRecord> records;
+		records.Reserve(registry->GetNumBuildings());
+		for (const auto& pair : registry->GetBuildings())
+		{
+			if (ABuilding* building = pair.Value)
+			{
+				records.Add(FBuildingCommandRecord::Make(EBuildingCommand::Place, pair.Key, building->buildingType, FBuildingCommandRecord::EncodeYaw(building->GetActorRotation().Yaw)));
+			}
+		}
+		if (records.Num() > 0)
+		{
+			records.Last().flags |= FBuildingCommandRecord::BatchEndFlag;
+			writer->WriteCommands(0.0, records);
+		}
+	}
+
+	FlushRecording();
+	UE_LOG(LogTemp, Log, TEXT("CityReplaySubsystem::Recording to %s."), *path)
+	return true;
+}
+
+void UCityReplaySubsystem::StopRecording()
+{
+	if (writer.IsValid())
+	{
+		//The flush running now has to finish before the rest can be appended after it
+		WritePendingRecords();
+		WaitForFlush();
+		FlushRecording();
+		WaitForFlush();
+	}
+
+	if (writer.IsValid())
+	{
+		UE_LOG(LogTemp, Log, TEXT("CityReplaySubsystem::Recorded %d events."), writer->GetNumEvents())
+		writer.Reset();
+	}
+}
+
+void UCityReplaySubsystem::FlushRecording()
+{
+	timeSinceFlush = 0.0f;
+	if (!writer.IsValid() || writer->GetNumPendingBytes() == 0 || (flushTask.IsValid() && !flushTask.IsReady()))
+	{
+		return;
+	}
+	WaitForFlush();
+
+	TArray<uint8> data;
+	writer->TakeData(data);
+
+	//Appends stay in order as only one runs at a time
+	FString path = GetReplayPath();
+	flushTask = Async(EAsyncExecution::ThreadPool, [path, data = MoveTemp(data)]()
+	{
+		IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+		TUniquePtr<IFileHandle> file(platformFile.OpenWrite(*path, true));
+		return file.IsValid() && file->Write(data.GetData(), data.Num());
+	});
+}
+
+void UCityReplaySubsystem::WaitForFlush()
+{
+	if (!flushTask.IsValid())
+	{
+		return;
+	}
+
+	bool bWritten = flushTask.Get();
+	flushTask.Reset();
+	if (!bWritten && writer.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("CityReplaySubsystem::Failed to write to %s, recording stopped."), *GetReplayPath())
+		writer.Reset();
+	}
+}
+
+void UCityReplaySubsystem::WritePendingRecords()
+{
+	if (pendingRecords.Num() == 0)
+	{
+		return;
+	}
+
+	if (writer.IsValid())
+	{
+		pendingRecords.Last().flags |= FBuildingCommandRecord::BatchEndFlag;
+		writer->WriteCommands(GetRecordingTime(), pendingRecords);
+		INC_DWORD_STAT(STAT_CityReplayEventsRecorded);
+	}
+	pendingRecords.Reset();
+}
+
+bool UCityReplaySubsystem::PlayReplay(const TArray<uint8>& data, int32& outNumOperations, double& outRecordedSeconds)
+{
+	SCOPE_CYCLE_COUNTER(STAT_CityReplayPlay);
+
+	outNumOperations = 0;
+	outRecordedSeconds = 0.0;
+
+	FCityReplayReader reader(data);
+	if (!reader.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("CityReplaySubsystem::Data is not a city replay."))
+		return false;
+	}
+
+	bPlaying = true;
+	FCityReplayEvent replayEvent;
+	while (reader.ReadEvent(replayEvent))
+	{
+		ApplyEvent(replayEvent);
+		outNumOperations += replayEvent.type == ECityReplayEvent::Commands ? replayEvent.records.Num() : 1;
+		outRecordedSeconds = replayEvent.time;
+	}
+	bPlaying = false;
+
+	if (reader.IsError())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("CityReplaySubsystem::Replay ends with a bad event after %.1f seconds."), outRecordedSeconds)
+		return false;
+	}
+	return true;
+}
+
+void UCityReplaySubsystem::ApplyEvent(const FCityReplayEvent& replayEvent)
+{
+	switch (replayEvent.type)
+	{
+	case ECityReplayEvent::Commands:
+		if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+		{
+			commandLog->ApplyRecords(replayEvent.records);
+		}
+		break;
+	case ECityReplayEvent::TimeRate:
+		if (ATimeController* controller = FindTimeController())
+		{
+			controller->gameSpeedMultiplier = replayEvent.timeRate;
+		}
+		break;
+	case ECityReplayEvent::Clock:
+		if (ATimeController* controller = FindTimeController())
+		{
+			float clockwork;
+			int32 day, month, year;
+			controller->GetClockState(clockwork, day, month, year);
+			controller->SetClockState(replayEvent.clockwork, replayEvent.day, replayEvent.month, replayEvent.year);
+
+			//Clock events are written as hours pass, so the hourly systems run as they did when recorded
+			ATimeController::OnHourChangedEvent.Broadcast(controller);
+			if (day != replayEvent.day || month != replayEvent.month || year != replayEvent.year)
+			{
+				ATimeController::OnDayChangedEvent.Broadcast(controller);
+			}
+		}
+		break;
+	}
+}
+
+ATimeController* UCityReplaySubsystem::FindTimeController()
+{
+	if (!timeController.IsValid())
+	{
+		TActorIterator<ATimeController> it(GetWorld());
+		timeController = it ? *it : nullptr;
+	}
+	return timeController.Get();
+}
+
+void UCityReplaySubsystem::OnBuildingAdded(ABuilding* building)
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	//Ghosts are recorded by the shard that owns them
+	if (writer.IsValid() && !bPlaying && !UDistrictShardSubsystem::IsGhost(building))
+	{
+		pendingRecords.Add(FBuildingCommandRecord::Make(EBuildingCommand::Place, building->gridCell, building->buildingType, FBuildingCommandRecord::EncodeYaw(building->GetActorRotation().Yaw)));
+	}
+}
+
+void UCityReplaySubsystem::OnBuildingRemoved(ABuilding* building)
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	if (writer.IsValid() && !bPlaying && !UDistrictShardSubsystem::IsGhost(building))
+	{
+		pendingRecords.Add(FBuildingCommandRecord::Make(EBuildingCommand::Demolish, building->gridCell, building->buildingType, 0));
+	}
+}
+
+void UCityReplaySubsystem::OnCommandsApplied(const TArray<FBuildingCommandRecord>& records)
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	if (!writer.IsValid() || bPlaying)
+	{
+		return;
+	}
+
+	//Rotations don't go through the registry, so the rotated buildings are placed again as they are now,
+	//which replays as a rotation in place
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	for (const FBuildingCommandRecord& record : records)
+	{
+		ABuilding* building = record.GetCommand() == EBuildingCommand::Rotate && registry ? registry->FindBuilding(record.GetCell()) : nullptr;
+		if (building != nullptr && !UDistrictShardSubsystem::IsGhost(building))
+		{
+			pendingRecords.Add(FBuildingCommandRecord::Make(EBuildingCommand::Place, record.GetCell(), building->buildingType, FBuildingCommandRecord::EncodeYaw(building->GetActorRotation().Yaw)));
+		}
+	}
+
+	//The whole command batch is written as one replay batch
+	WritePendingRecords();
+}
+
+void UCityReplaySubsystem::OnHourChanged(ATimeController* changedController)
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	//The event is shared by every world
+	if (!writer.IsValid() || bPlaying || changedController->GetWorld() != GetWorld())
+	{
+		return;
+	}
+
+	//Building changes made earlier in the frame go first
+	WritePendingRecords();
+
+	float clockwork;
+	int32 day, month, year;
+	changedController->GetClockState(clockwork, day, month, year);
+	writer->WriteClock(GetRecordingTime(), clockwork, day, month, year);
+	INC_DWORD_STAT(STAT_CityReplayEventsRecorded);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs PlayReplayCommand(
+	TEXT("SpaceRPG.PlayReplay"),
+	TEXT("Applies a city replay to the world as fast as possible. Arguments: path"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+	{
+		UCityReplaySubsystem* replay = world ? world->GetSubsystem<UCityReplaySubsystem>() : nullptr;
+		if (replay == nullptr)
+		{
+			return;
+		}
+
+		FString path = args.Num() > 0 ? args[0] : replay->GetReplayPath();
+		TArray<uint8> data;
+		if (!FFileHelper::LoadFileToArray(data, *path))
+		{
+			UE_LOG(LogTemp, Error, TEXT("CityReplaySubsystem::Could not read %s."), *path)
+			return;
+		}
+
+		int32 numOperations;
+		double recordedSeconds;
+		double startTime = FPlatformTime::Seconds();
+		replay->PlayReplay(data, numOperations, recordedSeconds);
+		double seconds = FPlatformTime::Seconds() - startTime;
+
+		UE_LOG(LogTemp, Display, TEXT("CityReplaySubsystem::Replayed %d operations covering %.1f seconds in %.3f seconds, %.0f operations per second."),
+			numOperations, recordedSeconds, seconds, numOperations / FMath::Max(seconds, 1e-6))
+	}));
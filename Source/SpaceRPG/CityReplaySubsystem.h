@@ -0,0 +1,105 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "Async/Future.h"
+#include "CityReplay.h"
+#include "CityReplaySubsystem.generated.h"
+
+//Records what players do to the city on the server, and replays recordings into a fresh world as fast as possible
+UCLASS(Config = Game)
+class SPACERPG_API UCityReplaySubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	//Starts a new recording, beginning with the current city and clock so it replays into an empty world
+	UFUNCTION(BlueprintCallable, Category = Replay)
+	bool StartRecording();
+
+	//Writes what is left of the recording and closes it
+	UFUNCTION(BlueprintCallable, Category = Replay)
+	void StopRecording();
+
+	UFUNCTION(BlueprintPure, Category = Replay)
+	bool IsRecording() const { return writer.IsValid(); }
+
+	//Whether the server should record from the start of play
+	FORCEINLINE bool ShouldRecordOnStart() const { return bRecordOnStart; }
+
+	//Applies every event of a replay back to back, without waiting for the recorded times,
+	//returns false if the data is not a replay or stops at a bad event
+	bool PlayReplay(const TArray<uint8>& data, int32& outNumOperations, double& outRecordedSeconds);
+
+	//Applies a single replay event to the world
+	void ApplyEvent(const FCityReplayEvent& replayEvent);
+
+	FString GetReplayPath() const;
+
+private:
+	//Whether the server records from the start of play
+	UPROPERTY(Config)
+	bool bRecordOnStart = false;
+
+	//Seconds between appending the recording to the file
+	UPROPERTY(Config)
+	float flushInterval = 10.0f;
+
+	//Replay file name inside the saved directory
+	UPROPERTY(Config)
+	FString replayName = TEXT("City.replay");
+
+	TUniquePtr<FCityReplayWriter> writer;
+	double recordStartTime = 0.0;
+	float timeSinceFlush = 0.0f;
+	float lastTimeRate = 1.0f;
+
+	//Set while a replay is applied so it is not recorded again
+	bool bPlaying = false;
+
+	//Buildings placed and demolished since the last command batch, written as one batch. Buildings placed by
+	//Blueprints never go through the command log, so the registry is recorded rather than the command log
+	TArray<FBuildingCommandRecord> pendingRecords;
+
+	//Write of the last flush running in the background, returns false if it failed
+	TFuture<bool> flushTask;
+
+	TWeakObjectPtr<class ATimeController> timeController;
+
+	FDelegateHandle buildingAddedHandle;
+	FDelegateHandle buildingRemovedHandle;
+	FDelegateHandle commandsAppliedHandle;
+	FDelegateHandle hourChangedHandle;
+
+	FORCEINLINE double GetRecordingTime() const { return FPlatformTime::Seconds() - recordStartTime; }
+
+	//Returns the world's time controller, or nullptr if it has none
+	class ATimeController* FindTimeController();
+
+	//Appends the events written since the last flush to the replay file on a background thread,
+	//events stay in the writer until the next flush while a write is still running
+	void FlushRecording();
+
+	//Waits for the running flush, stopping the recording if it failed
+	void WaitForFlush();
+
+	//Writes the pending registry changes as one command batch
+	void WritePendingRecords();
+
+	void OnBuildingAdded(class ABuilding* building);
+	void OnBuildingRemoved(class ABuilding* building);
+	void OnCommandsApplied(const TArray<FBuildingCommandRecord>& records);
+	void OnHourChanged(class ATimeController* changedController);
+};
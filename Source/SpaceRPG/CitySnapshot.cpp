@@ -0,0 +1,227 @@
+// Copyright SpaceRPG 2020
+
+#include "CitySnapshot.h"
+#include "Building.h"
+#include "BuildingPalette.h"
+#include "BuildingRegistry.h"
+#include "Misc/Compression.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+//Moves a record onto the local palette, returns false for a place of a type the local palette lacks. Rotations carry no
+//type and untyped buildings need no remapping
+static bool RemapRecordType(FBuildingCommandRecord& record, const TArray<int32>& typeRemap)
+{
+	int32 senderType = record.GetBuildingType();
+	if (record.GetCommand() == EBuildingCommand::Rotate || senderType == INDEX_NONE)
+	{
+		return true;
+	}
+
+	int32 localType = typeRemap.IsValidIndex(senderType) ? typeRemap[senderType] : INDEX_NONE;
+	if (localType == INDEX_NONE && record.GetCommand() == EBuildingCommand::Place)
+	{
+		UE_LOG(LogTemp, Error, TEXT("CitySnapshot::Skipping building at %s, its type %d is not in the local palette."), *record.GetCell().ToString(), senderType)
+		return false;
+	}
+
+	//A demolish only needs its cell, unknown types are left untyped
+	record.buildingType = localType == INDEX_NONE ? FBuildingCommandRecord::UntypedBuilding : (uint16)localType;
+	return true;
+}
+
+void FCitySnapshot::Encode(const UBuildingRegistry* registry, const UBuildingPalette* palette, TArray<uint8>& outData)
+{
+	//Sorting by cell makes consecutive cells close together, so the deltas are mostly tiny
+	TArray<FBuildingCommandRecord> records;
+	records.Reserve(registry->GetNumBuildings());
+	for (const auto& pair : registry->GetBuildings())
+	{
+		//Buildings that replicate as actors, such as ones spawned by Blueprints, reach clients on their own
+		ABuilding* building = pair.Value;
+		if (building != nullptr && !building->GetIsReplicated())
+		{
+			records.Add(FBuildingCommandRecord::Make(EBuildingCommand::Place, pair.Key, building->buildingType, FBuildingCommandRecord::EncodeYaw(building->GetActorRotation().Yaw)));
+		}
+	}
+	records.Sort([](const FBuildingCommandRecord& a, const FBuildingCommandRecord& b)
+	{
+		if (a.cellZ != b.cellZ) return a.cellZ < b.cellZ;
+		if (a.cellY != b.cellY) return a.cellY < b.cellY;
+		return a.cellX < b.cellX;
+	});
+
+	TArray<uint8> rawData;
+	FMemoryWriter writer(rawData);
+
+	uint32 magic = Magic;
+	uint16 version = Version;
+	writer << magic << version;
+
+	//Palette of type names so clients with a differently ordered palette still resolve the right types
+	int32 numTypes = palette ? palette->buildingTypes.Num() : 0;
+	writer << numTypes;
+	for (int32 i = 0; i < numTypes; i++)
+	{
+		FName typeName = palette->buildingTypes[i].typeName;
+		writer << typeName;
+	}
+
+	int32 numRecords = records.Num();
+	writer << numRecords;
+
+	FIntVector previousCell = FIntVector::ZeroValue;
+	for (const FBuildingCommandRecord& record : records)
+	{
+		FIntVector cell = record.GetCell();
+		uint32 deltaX = ZigZagEncode(cell.X - previousCell.X);
+		uint32 deltaY = ZigZagEncode(cell.Y - previousCell.Y);
+		uint32 deltaZ = ZigZagEncode(cell.Z - previousCell.Z);
+		uint32 buildingType = record.buildingType;
+		uint8 rotation = record.rotation;
+		uint8 state = 0;
+
+		writer.SerializeIntPacked(deltaX);
+		writer.SerializeIntPacked(deltaY);
+		writer.SerializeIntPacked(deltaZ);
+		writer.SerializeIntPacked(buildingType);
+		writer << rotation << state;
+
+		previousCell = cell;
+	}
+
+	//Compressed data is prefixed with its uncompressed size
+	int32 uncompressedSize = rawData.Num();
+	int32 compressedSize = FCompression::CompressMemoryBound(NAME_Zlib, uncompressedSize);
+	outData.SetNumUninitialized(sizeof(int32) + compressedSize);
+	FMemory::Memcpy(outData.GetData(), &uncompressedSize, sizeof(int32));
+
+	if (!FCompression::CompressMemory(NAME_Zlib, outData.GetData() + sizeof(int32), compressedSize, rawData.GetData(), uncompressedSize))
+	{
+		UE_LOG(LogTemp, Error, TEXT("CitySnapshot::Failed to compress a snapshot of %d buildings."), numRecords)
+		outData.Reset();
+		return;
+	}
+	outData.SetNum(sizeof(int32) + compressedSize, false);
+}
+
+bool FCitySnapshot::Decode(const TArray<uint8>& data, const UBuildingPalette* palette, TArray<FBuildingCommandRecord>& outRecords, TArray<int32>& outTypeRemap)
+{
+	if (data.Num() < (int32)sizeof(int32))
+	{
+		return false;
+	}
+
+	int32 uncompressedSize;
+	FMemory::Memcpy(&uncompressedSize, data.GetData(), sizeof(int32));
+	if (uncompressedSize < 0 || uncompressedSize > MaxUncompressedSize)
+	{
+		UE_LOG(LogTemp, Error, TEXT("CitySnapshot::Snapshot reports an invalid size of %d bytes."), uncompressedSize)
+		return false;
+	}
+
+	TArray<uint8> rawData;
+	rawData.SetNumUninitialized(uncompressedSize);
+	if (!FCompression::UncompressMemory(NAME_Zlib, rawData.GetData(), uncompressedSize, data.GetData() + sizeof(int32), data.Num() - sizeof(int32)))
+	{
+		UE_LOG(LogTemp, Error, TEXT("CitySnapshot::Failed to decompress snapshot."))
+		return false;
+	}
+
+	FMemoryReader reader(rawData);
+
+	uint32 magic;
+	uint16 version;
+	reader << magic << version;
+	if (magic != Magic || version != Version)
+	{
+		UE_LOG(LogTemp, Error, TEXT("CitySnapshot::Snapshot has an unknown format."))
+		return false;
+	}
+
+	//Map the sender's type ids onto the local palette
+	int32 numTypes;
+	reader << numTypes;
+	if (reader.IsError() || numTypes < 0 || numTypes > FBuildingCommandRecord::UntypedBuilding)
+	{
+		return false;
+	}
+
+	outTypeRemap.Reset(numTypes);
+	for (int32 i = 0; i < numTypes && !reader.IsError(); i++)
+	{
+		FName typeName;
+		reader << typeName;
+		int32 localType = palette ? palette->FindBuildingType(typeName) : INDEX_NONE;
+		if (localType == INDEX_NONE)
+		{
+			UE_LOG(LogTemp, Error, TEXT("CitySnapshot::Building type %s is not in the local palette."), *typeName.ToString())
+		}
+		outTypeRemap.Add(localType);
+	}
+
+	int32 numRecords;
+	reader << numRecords;
+	if (reader.IsError() || numRecords < 0)
+	{
+		return false;
+	}
+
+	outRecords.Reset(numRecords);
+	FIntVector cell = FIntVector::ZeroValue;
+	for (int32 i = 0; i < numRecords && !reader.IsError(); i++)
+	{
+		uint32 deltaX, deltaY, deltaZ, buildingType;
+		uint8 rotation, state;
+		reader.SerializeIntPacked(deltaX);
+		reader.SerializeIntPacked(deltaY);
+		reader.SerializeIntPacked(deltaZ);
+		reader.SerializeIntPacked(buildingType);
+		reader << rotation << state;
+
+		cell += FIntVector(ZigZagDecode(deltaX), ZigZagDecode(deltaY), ZigZagDecode(deltaZ));
+		FBuildingCommandRecord record = FBuildingCommandRecord::Make(EBuildingCommand::Place, cell, 0, rotation);
+		record.buildingType = (uint16)buildingType;
+		if (RemapRecordType(record, outTypeRemap))
+		{
+			outRecords.Add(record);
+		}
+	}
+
+	return !reader.IsError();
+}
+
+void FCitySnapshot::EncodeRecords(const TArray<FBuildingCommandRecord>& records, TArray<uint8>& outData)
+{
+	FMemoryWriter writer(outData);
+	int32 numRecords = records.Num();
+	writer << numRecords;
+	for (FBuildingCommandRecord record : records)
+	{
+		writer << record;
+	}
+}
+
+bool FCitySnapshot::DecodeRecords(const TArray<uint8>& data, const TArray<int32>& typeRemap, TArray<FBuildingCommandRecord>& outRecords)
+{
+	FMemoryReader reader(data);
+	int32 numRecords;
+	reader << numRecords;
+	if (reader.IsError() || numRecords < 0 || numRecords > data.Num())
+	{
+		return false;
+	}
+
+	//Deltas carry the sender's type ids, the same as the snapshot before them
+	outRecords.Reset(numRecords);
+	for (int32 i = 0; i < numRecords && !reader.IsError(); i++)
+	{
+		FBuildingCommandRecord record;
+		reader << record;
+		if (RemapRecordType(record, typeRemap))
+		{
+			outRecords.Add(record);
+		}
+	}
+	return !reader.IsError();
+}
@@ -0,0 +1,39 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BuildingCommandLog.h"
+
+//Compact, compressed encoding of every placed building, used to send the whole city to joining clients
+struct SPACERPG_API FCitySnapshot
+{
+	static constexpr uint32 Magic = 0x43495459;
+	static constexpr uint16 Version = 1;
+
+	//Largest snapshot a client will accept
+	static constexpr int32 MaxUncompressedSize = 256 * 1024 * 1024;
+
+	//Encodes the buildings in the registry that don't replicate as actors, sorted by cell and delta encoded before compression
+	static void Encode(const class UBuildingRegistry* registry, const class UBuildingPalette* palette, TArray<uint8>& outData);
+
+	//Decodes a snapshot into place records, remapping building types by name onto the local palette. The remap from the
+	//sender's type ids to local ones is kept for decoding the deltas that follow, INDEX_NONE for types the palette lacks
+	static bool Decode(const TArray<uint8>& data, const class UBuildingPalette* palette, TArray<FBuildingCommandRecord>& outRecords, TArray<int32>& outTypeRemap);
+
+	//Plain serialization of a batch of records, used for deltas after the snapshot. Decoding remaps types with the
+	//snapshot's remap and skips places of types the local palette lacks
+	static void EncodeRecords(const TArray<FBuildingCommandRecord>& records, TArray<uint8>& outData);
+	static bool DecodeRecords(const TArray<uint8>& data, const TArray<int32>& typeRemap, TArray<FBuildingCommandRecord>& outRecords);
+
+	//Zigzag encoding keeps small negative deltas small when written as packed ints
+	static FORCEINLINE uint32 ZigZagEncode(int32 value)
+	{
+		return ((uint32)value << 1) ^ (uint32)(value >> 31);
+	}
+
+	static FORCEINLINE int32 ZigZagDecode(uint32 value)
+	{
+		return (int32)(value >> 1) ^ -(int32)(value & 1);
+	}
+};
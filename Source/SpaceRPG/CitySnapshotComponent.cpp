@@ -0,0 +1,194 @@
+// Copyright SpaceRPG 2020
+
+#include "CitySnapshotComponent.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
+#include "CitySnapshot.h"
+#include "BuildingRegistry.h"
+#include "BuildingStreamingSubsystem.h"
+#include "Engine/ActorChannel.h"
+#include "Engine/NetConnection.h"
+#include "Engine/World.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("City Snapshot Bytes Sent"), STAT_CitySnapshotBytesSent, STATGROUP_SpaceRPG);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("City Delta Bytes Sent"), STAT_CityDeltaBytesSent, STATGROUP_SpaceRPG);
+
+UCitySnapshotComponent::UCitySnapshotComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+	SetIsReplicatedByDefault(true);
+}
+
+void UCitySnapshotComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	joinStartTime = FPlatformTime::Seconds();
+}
+
+void UCitySnapshotComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+	{
+		commandLog->OnCommandsApplied.Remove(commandsAppliedHandle);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UCitySnapshotComponent::BeginSnapshot()
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>();
+	if (registry == nullptr || commandLog == nullptr || !commandLog->ShouldReplicateThroughSnapshots())
+	{
+		return;
+	}
+
+	UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(this);
+	FCitySnapshot::Encode(registry, streaming ? streaming->GetPalette() : nullptr, snapshotData);
+
+	numChunks = FMath::Max(1, FMath::DivideAndRoundUp(snapshotData.Num(), chunkSize));
+	nextChunk = 0;
+	bStreaming = true;
+	heldDeltas.Reset();
+
+	//Every change from now on is sent as a delta after the snapshot
+	commandsAppliedHandle = commandLog->OnCommandsApplied.AddUObject(this, &UCitySnapshotComponent::OnCommandsApplied);
+
+	UE_LOG(LogTemp, Log, TEXT("CitySnapshotComponent::Streaming %d buildings to %s as %d bytes in %d chunks."), registry->GetNumBuildings(), *GetOwner()->GetName(), snapshotData.Num(), numChunks)
+	SetComponentTickEnabled(true);
+}
+
+void UCitySnapshotComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (!bStreaming)
+	{
+		SetComponentTickEnabled(false);
+		return;
+	}
+
+	for (int32 i = 0; i < chunksPerTick && nextChunk < numChunks && CanSendChunk(); i++, nextChunk++)
+	{
+		int32 offset = nextChunk * chunkSize;
+		int32 size = FMath::Min(chunkSize, snapshotData.Num() - offset);
+		TArray<uint8> chunk(snapshotData.GetData() + offset, FMath::Max(size, 0));
+
+		ClientReceiveSnapshotChunk(nextChunk, numChunks, chunk);
+		INC_DWORD_STAT_BY(STAT_CitySnapshotBytesSent, chunk.Num());
+	}
+
+	if (nextChunk >= numChunks)
+	{
+		bStreaming = false;
+		snapshotData.Empty();
+
+		if (heldDeltas.Num() > 0)
+		{
+			SendDeltas(heldDeltas);
+			heldDeltas.Empty();
+		}
+	}
+}
+
+bool UCitySnapshotComponent::CanSendChunk() const
+{
+	//Local players have no connection and receive chunks straight away
+	UNetConnection* connection = GetOwner()->GetNetConnection();
+	if (connection == nullptr)
+	{
+		return true;
+	}
+
+	//Wait for the connection to drain when its send buffer is saturated
+	if (!connection->IsNetReady(false))
+	{
+		return false;
+	}
+
+	UActorChannel* channel = connection->FindActorChannelRef(GetOwner());
+	return channel == nullptr || channel->NumOutRec < maxReliableBacklog;
+}
+
+void UCitySnapshotComponent::OnCommandsApplied(const TArray<FBuildingCommandRecord>& records)
+{
+	if (bStreaming)
+	{
+		heldDeltas.Append(records);
+	}
+	else
+	{
+		SendDeltas(records);
+	}
+}
+
+void UCitySnapshotComponent::SendDeltas(const TArray<FBuildingCommandRecord>& records)
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	TArray<uint8> deltas;
+	FCitySnapshot::EncodeRecords(records, deltas);
+	ClientReceiveDeltas(deltas);
+	INC_DWORD_STAT_BY(STAT_CityDeltaBytesSent, deltas.Num());
+}
+
+void UCitySnapshotComponent::ClientReceiveSnapshotChunk_Implementation(int32 chunkIndex, int32 totalChunks, const TArray<uint8>& chunk)
+{
+	SPACERPG_LLM_SCOPE(CityData);
+
+	//Reliable RPCs arrive in order, so chunks can simply be appended
+	if (chunkIndex != receivedChunks)
+	{
+		UE_LOG(LogTemp, Error, TEXT("CitySnapshotComponent::Received chunk %d when expecting chunk %d."), chunkIndex, receivedChunks)
+		return;
+	}
+
+	receivedData.Append(chunk);
+	receivedChunks++;
+
+	if (receivedChunks < totalChunks)
+	{
+		return;
+	}
+
+	UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(this);
+	TArray<FBuildingCommandRecord> records;
+	if (!FCitySnapshot::Decode(receivedData, streaming ? streaming->GetPalette() : nullptr, records, typeRemap))
+	{
+		UE_LOG(LogTemp, Error, TEXT("CitySnapshotComponent::Could not decode the city snapshot."))
+		return;
+	}
+
+	double decodeTime = FPlatformTime::Seconds();
+	if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+	{
+		commandLog->ApplyRecords(records);
+	}
+
+	double now = FPlatformTime::Seconds();
+	UE_LOG(LogTemp, Log, TEXT("CitySnapshotComponent::Loaded %d buildings from %d bytes, %.1f ms after joining, %.1f ms to build."),
+		records.Num(), receivedData.Num(), (now - joinStartTime) * 1000.0, (now - decodeTime) * 1000.0)
+
+	receivedData.Empty();
+	bCityLoaded = true;
+}
+
+void UCitySnapshotComponent::ClientReceiveDeltas_Implementation(const TArray<uint8>& deltas)
+{
+	TArray<FBuildingCommandRecord> records;
+	if (!FCitySnapshot::DecodeRecords(deltas, typeRemap, records))
+	{
+		UE_LOG(LogTemp, Error, TEXT("CitySnapshotComponent::Could not decode building deltas."))
+		return;
+	}
+
+	if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+	{
+		commandLog->ApplyRecords(records);
+	}
+}
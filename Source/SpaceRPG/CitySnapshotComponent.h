@@ -0,0 +1,76 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "BuildingCommandLog.h"
+#include "CitySnapshotComponent.generated.h"
+
+//Added to each player controller on the server, streams the city to the client when it joins and then sends building deltas
+UCLASS(Config = Game)
+class SPACERPG_API UCitySnapshotComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UCitySnapshotComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	//Takes a snapshot of the city and starts streaming it, called by the game mode on login
+	void BeginSnapshot();
+
+	//Whether the client has the whole city
+	UFUNCTION(BlueprintPure, Category = Building)
+	bool IsCityLoaded() const { return bCityLoaded; }
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	//Size of each snapshot chunk in bytes
+	UPROPERTY(Config)
+	int32 chunkSize = 16 * 1024;
+
+	//Most chunks sent per server tick
+	UPROPERTY(Config)
+	int32 chunksPerTick = 4;
+
+	//Unacknowledged reliable bunches on the owner's channel past which no more chunks are sent, a chunk is split into
+	//several bunches and the reliable buffer only holds RELIABLE_BUFFER of them before the connection is closed
+	UPROPERTY(Config)
+	int32 maxReliableBacklog = 64;
+
+	//Server side stream state
+	TArray<uint8> snapshotData;
+	int32 nextChunk = 0;
+	int32 numChunks = 0;
+	bool bStreaming = false;
+
+	//Deltas made while the snapshot streams are held back so they arrive after it
+	TArray<FBuildingCommandRecord> heldDeltas;
+	FDelegateHandle commandsAppliedHandle;
+
+	//Client side receive state
+	TArray<uint8> receivedData;
+	int32 receivedChunks = 0;
+	double joinStartTime = 0.0;
+	bool bCityLoaded = false;
+
+	//Server building type ids to local ones, read from the snapshot's palette and used for every delta after it
+	TArray<int32> typeRemap;
+
+	UFUNCTION(Client, Reliable)
+	void ClientReceiveSnapshotChunk(int32 chunkIndex, int32 totalChunks, const TArray<uint8>& chunk);
+
+	UFUNCTION(Client, Reliable)
+	void ClientReceiveDeltas(const TArray<uint8>& deltas);
+
+	//Whether the owner's connection has room for another reliable chunk
+	bool CanSendChunk() const;
+
+	void OnCommandsApplied(const TArray<FBuildingCommandRecord>& records);
+	void SendDeltas(const TArray<FBuildingCommandRecord>& records);
+};
@@ -0,0 +1,129 @@
+// Copyright SpaceRPG 2020
+
+#include "DistrictCoordinator.h"
+#include "Misc/DateTime.h"
+
+FDistrictCoordinator::FDistrictCoordinator(const FDistrictMap& inMap)
+	: map(inMap)
+{
+	shardAddresses.SetNum(map.GetNumDistricts());
+}
+
+void FDistrictCoordinator::HandleMessage(int32 fromShard, const FDistrictMessage& message, FSendFunction send)
+{
+	if (!shardAddresses.IsValidIndex(fromShard))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("DistrictCoordinator::Message from unknown shard %d ignored."), fromShard)
+		return;
+	}
+
+	switch (message.type)
+	{
+	case EDistrictMessage::Hello:
+	{
+		shardAddresses[fromShard] = message.address;
+
+		//The first shard to arrive sets the clock, normally the one that loaded the city's autosave
+		if (!epoch.IsSet())
+		{
+			epoch = message.epoch.IsSet() ? message.epoch : FClockEpoch();
+			if (!epoch.IsSet())
+			{
+				epoch.utcTicks = FDateTime::UtcNow().GetTicks();
+			}
+		}
+
+		FDistrictMessage welcome;
+		welcome.type = EDistrictMessage::Welcome;
+		welcome.shard = fromShard;
+		welcome.map = map;
+		welcome.epoch = epoch;
+		send(fromShard, welcome);
+
+		//Each pair of connected shards swaps the ghosts of the border band they share
+		FDistrictMessage joined;
+		joined.type = EDistrictMessage::ShardJoined;
+		for (int32 shard = 0; shard < shardAddresses.Num(); shard++)
+		{
+			if (shard != fromShard && IsConnected(shard))
+			{
+				joined.shard = fromShard;
+				send(shard, joined);
+				joined.shard = shard;
+				send(fromShard, joined);
+			}
+		}
+
+		UE_LOG(LogTemp, Log, TEXT("DistrictCoordinator::Shard %d joined at %s."), fromShard, *message.address)
+		break;
+	}
+	case EDistrictMessage::TimeRate:
+	{
+		epoch = epoch.Rebase(FDateTime::UtcNow().GetTicks(), message.timeRate);
+
+		FDistrictMessage epochMessage;
+		epochMessage.type = EDistrictMessage::Epoch;
+		epochMessage.epoch = epoch;
+		for (int32 shard = 0; shard < shardAddresses.Num(); shard++)
+		{
+			if (IsConnected(shard))
+			{
+				send(shard, epochMessage);
+			}
+		}
+		break;
+	}
+	case EDistrictMessage::Commands:
+	case EDistrictMessage::Ghosts:
+	case EDistrictMessage::GhostReconcile:
+	{
+		//Operations for a shard that is down are lost, its district cannot change until it is back
+		if (!IsConnected(message.shard))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("DistrictCoordinator::Dropped %d records for shard %d, which is not connected."), message.records.Num(), message.shard)
+			break;
+		}
+
+		FDistrictMessage routed = message;
+		routed.shard = fromShard;
+		send(message.shard, routed);
+		numMessagesRouted++;
+		break;
+	}
+	case EDistrictMessage::Handoff:
+	{
+		//The player stays where they are, the shard asks again if they are still across the border
+		if (!IsConnected(message.shard))
+		{
+			break;
+		}
+
+		//The target hears first, so it knows where to spawn the player by the time they connect
+		FDistrictMessage expect = message;
+		expect.type = EDistrictMessage::HandoffExpect;
+		expect.shard = fromShard;
+		send(message.shard, expect);
+
+		FDistrictMessage ready;
+		ready.type = EDistrictMessage::HandoffReady;
+		ready.shard = message.shard;
+		ready.handoff.token = message.handoff.token;
+		ready.address = shardAddresses[message.shard];
+		send(fromShard, ready);
+		numHandoffs++;
+		break;
+	}
+	default:
+		UE_LOG(LogTemp, Warning, TEXT("DistrictCoordinator::Unexpected message %d from shard %d."), (int32)message.type, fromShard)
+		break;
+	}
+}
+
+void FDistrictCoordinator::RemoveShard(int32 shard)
+{
+	if (shardAddresses.IsValidIndex(shard))
+	{
+		shardAddresses[shard].Empty();
+		UE_LOG(LogTemp, Log, TEXT("DistrictCoordinator::Shard %d left."), shard)
+	}
+}
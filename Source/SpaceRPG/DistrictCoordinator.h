@@ -0,0 +1,40 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DistrictProtocol.h"
+
+//Routes messages between district shards: building operations and border ghosts go to the owning or neighbouring shard,
+//players crossing a border are handed to the shard they cross into, and the clock epoch is kept and rebased here so
+//every shard runs the same clock. It holds no city state of its own, so it stays small however large the city gets
+class SPACERPG_API FDistrictCoordinator
+{
+public:
+	typedef TFunctionRef<void(int32 toShard, const FDistrictMessage& message)> FSendFunction;
+
+	explicit FDistrictCoordinator(const FDistrictMap& inMap);
+
+	//Handles a message from a shard, sending whatever it causes through send
+	void HandleMessage(int32 fromShard, const FDistrictMessage& message, FSendFunction send);
+
+	//Forgets a shard whose connection closed
+	void RemoveShard(int32 shard);
+
+	FORCEINLINE const FDistrictMap& GetMap() const { return map; }
+	FORCEINLINE const FClockEpoch& GetEpoch() const { return epoch; }
+	FORCEINLINE int32 GetNumMessagesRouted() const { return numMessagesRouted; }
+	FORCEINLINE int32 GetNumHandoffs() const { return numHandoffs; }
+
+private:
+	FDistrictMap map;
+	FClockEpoch epoch;
+
+	//Game address of every connected shard, empty for shards that are not connected
+	TArray<FString> shardAddresses;
+
+	int32 numMessagesRouted = 0;
+	int32 numHandoffs = 0;
+
+	FORCEINLINE bool IsConnected(int32 shard) const { return shardAddresses.IsValidIndex(shard) && !shardAddresses[shard].IsEmpty(); }
+};
@@ -0,0 +1,85 @@
+// Copyright SpaceRPG 2020
+
+#include "DistrictMap.h"
+
+FDistrictMap::FDistrictMap()
+	: minCell(-DefaultCityExtentCells, -DefaultCityExtentCells)
+	, maxCell(DefaultCityExtentCells, DefaultCityExtentCells)
+{
+	UpdateLayout();
+}
+
+FDistrictMap::FDistrictMap(int32 inNumDistricts, const FIntPoint& inMinCell, const FIntPoint& inMaxCell, int32 inBorderCells)
+	: numDistricts(inNumDistricts)
+	, minCell(inMinCell)
+	, maxCell(inMaxCell)
+	, borderCells(inBorderCells)
+{
+	UpdateLayout();
+}
+
+void FDistrictMap::UpdateLayout()
+{
+	numDistricts = FMath::Max(numDistricts, 1);
+	borderCells = FMath::Max(borderCells, 0);
+	maxCell.X = FMath::Max(maxCell.X, minCell.X + 1);
+	maxCell.Y = FMath::Max(maxCell.Y, minCell.Y + 1);
+
+	//The largest divisor no bigger than the square root gives the fewest border cells
+	rows = 1;
+	for (int32 divisor = 1; divisor * divisor <= numDistricts; divisor++)
+	{
+		if (numDistricts % divisor == 0)
+		{
+			rows = divisor;
+		}
+	}
+	columns = numDistricts / rows;
+}
+
+int32 FDistrictMap::GetDistrict(int32 cellX, int32 cellY) const
+{
+	int32 column = (int32)(((int64)cellX - minCell.X) * columns / ((int64)maxCell.X - minCell.X));
+	int32 row = (int32)(((int64)cellY - minCell.Y) * rows / ((int64)maxCell.Y - minCell.Y));
+
+	//Cells below the minimum divide towards zero, the clamp still puts them in the first column or row
+	return FMath::Clamp(row, 0, rows - 1) * columns + FMath::Clamp(column, 0, columns - 1);
+}
+
+void FDistrictMap::GetBorderDistricts(const FIntVector& cell, TArray<int32, TInlineAllocator<4>>& outDistricts) const
+{
+	outDistricts.Reset();
+	if (numDistricts == 1 || borderCells == 0)
+	{
+		return;
+	}
+
+	//Districts are far wider than the border, so the corners and edges of the band find every neighbour
+	int32 district = GetDistrict(cell);
+	for (int32 offsetY = -borderCells; offsetY <= borderCells; offsetY += borderCells)
+	{
+		for (int32 offsetX = -borderCells; offsetX <= borderCells; offsetX += borderCells)
+		{
+			int32 neighbour = GetDistrict(cell.X + offsetX, cell.Y + offsetY);
+			if (neighbour != district)
+			{
+				outDistricts.AddUnique(neighbour);
+			}
+		}
+	}
+}
+
+bool FDistrictMap::IsInsideDistrict(const FIntVector& cell, int32 district, int32 margin) const
+{
+	for (int32 offsetY = -margin; offsetY <= margin; offsetY += FMath::Max(margin, 1))
+	{
+		for (int32 offsetX = -margin; offsetX <= margin; offsetX += FMath::Max(margin, 1))
+		{
+			if (GetDistrict(cell.X + offsetX, cell.Y + offsetY) != district)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
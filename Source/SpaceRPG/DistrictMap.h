@@ -0,0 +1,54 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Splits the city's building grid into one rectangular district per shard server, laid out in columns and rows.
+//Cells within borderCells of another district are mirrored to it as ghosts, so both sides of a border see the same buildings
+class SPACERPG_API FDistrictMap
+{
+public:
+	//Default city bounds in cells, centred on the origin
+	static constexpr int32 DefaultCityExtentCells = 1024;
+	static constexpr int32 DefaultBorderCells = 4;
+
+	FDistrictMap();
+	FDistrictMap(int32 inNumDistricts, const FIntPoint& inMinCell, const FIntPoint& inMaxCell, int32 inBorderCells);
+
+	FORCEINLINE int32 GetNumDistricts() const { return numDistricts; }
+	FORCEINLINE int32 GetBorderCells() const { return borderCells; }
+
+	//District owning the cell, cells outside the city bounds belong to the nearest district
+	int32 GetDistrict(int32 cellX, int32 cellY) const;
+	FORCEINLINE int32 GetDistrict(const FIntVector& cell) const { return GetDistrict(cell.X, cell.Y); }
+
+	//Other districts within borderCells of the cell, which keep a ghost of the cell's building
+	void GetBorderDistricts(const FIntVector& cell, TArray<int32, TInlineAllocator<4>>& outDistricts) const;
+
+	//Whether every cell within margin cells of the cell belongs to the district
+	bool IsInsideDistrict(const FIntVector& cell, int32 district, int32 margin) const;
+
+	friend FArchive& operator<<(FArchive& Ar, FDistrictMap& map)
+	{
+		Ar << map.numDistricts << map.minCell << map.maxCell << map.borderCells;
+		if (Ar.IsLoading())
+		{
+			map.UpdateLayout();
+		}
+		return Ar;
+	}
+
+private:
+	int32 numDistricts = 1;
+	FIntPoint minCell;
+	FIntPoint maxCell;
+	int32 borderCells = DefaultBorderCells;
+
+	//Districts across and down the city
+	int32 columns = 1;
+	int32 rows = 1;
+
+	//Picks the most square grid of districts that uses all of them
+	void UpdateLayout();
+};
@@ -0,0 +1,178 @@
+// Copyright SpaceRPG 2020
+
+#include "DistrictProtocol.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "Common/TcpSocketBuilder.h"
+#include "Interfaces/IPv4/IPv4Endpoint.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+//Largest message accepted, anything bigger is a corrupt stream
+static constexpr int32 MaxMessageBytes = 64 * 1024 * 1024;
+
+FArchive& operator<<(FArchive& Ar, FDistrictMessage& message)
+{
+	uint8 type = (uint8)message.type;
+	Ar << type << message.shard;
+	message.type = (EDistrictMessage)type;
+
+	switch (message.type)
+	{
+	case EDistrictMessage::Hello:
+		Ar << message.address << message.epoch;
+		break;
+	case EDistrictMessage::Welcome:
+		Ar << message.map << message.epoch;
+		break;
+	case EDistrictMessage::Epoch:
+		Ar << message.epoch;
+		break;
+	case EDistrictMessage::TimeRate:
+		Ar << message.timeRate;
+		break;
+	case EDistrictMessage::Commands:
+	case EDistrictMessage::Ghosts:
+	case EDistrictMessage::GhostReconcile:
+		Ar << message.records;
+		break;
+	case EDistrictMessage::ShardJoined:
+		break;
+	case EDistrictMessage::Handoff:
+	case EDistrictMessage::HandoffExpect:
+		Ar << message.handoff;
+		break;
+	case EDistrictMessage::HandoffReady:
+		Ar << message.handoff.token << message.address;
+		break;
+	default:
+		Ar.SetError();
+		break;
+	}
+	return Ar;
+}
+
+FDistrictConnection::FDistrictConnection(FSocket* inSocket)
+	: socket(inSocket)
+{
+	socket->SetNonBlocking(true);
+	socket->SetNoDelay(true);
+}
+
+FDistrictConnection::~FDistrictConnection()
+{
+	socket->Close();
+	ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(socket);
+}
+
+TUniquePtr<FDistrictConnection> FDistrictConnection::Connect(const FString& address)
+{
+	FIPv4Endpoint endpoint;
+	if (!FIPv4Endpoint::Parse(address, endpoint))
+	{
+		UE_LOG(LogTemp, Error, TEXT("DistrictConnection::%s is not a host:port address."), *address)
+		return nullptr;
+	}
+
+	//Connecting blocks, which over loopback only takes as long as the refusal when nothing is listening
+	FSocket* socket = FTcpSocketBuilder(TEXT("DistrictConnection")).Build();
+	if (socket == nullptr)
+	{
+		return nullptr;
+	}
+	if (!socket->Connect(*endpoint.ToInternetAddr()))
+	{
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(socket);
+		return nullptr;
+	}
+	return MakeUnique<FDistrictConnection>(socket);
+}
+
+void FDistrictConnection::Encode(const FDistrictMessage& message, TArray<uint8>& outData)
+{
+	int32 start = outData.Num();
+	int32 length = 0;
+
+	FMemoryWriter writer(outData, false, true);
+	writer.Seek(start);
+	writer << length << const_cast<FDistrictMessage&>(message);
+
+	//Patch in the length now that the message is written
+	length = outData.Num() - start - sizeof(int32);
+	writer.Seek(start);
+	writer << length;
+}
+
+void FDistrictConnection::Send(const FDistrictMessage& message)
+{
+	int32 previousSize = sendBuffer.Num();
+	Encode(message, sendBuffer);
+	numBytesSent += sendBuffer.Num() - previousSize;
+}
+
+bool FDistrictConnection::Update(TArray<FDistrictMessage>& outMessages)
+{
+	if (bClosed)
+	{
+		return false;
+	}
+
+	//The socket takes what it can, the rest waits for the next update
+	if (sendBuffer.Num() > 0)
+	{
+		int32 bytesSent = 0;
+		if (!socket->Send(sendBuffer.GetData(), sendBuffer.Num(), bytesSent))
+		{
+			bClosed = true;
+			return false;
+		}
+		sendBuffer.RemoveAt(0, bytesSent, false);
+	}
+
+	//Stream sockets report a closed peer as a failed receive, and no data yet as a successful empty one
+	uint8 buffer[16384];
+	int32 bytesRead = 0;
+	bool bReceived;
+	while ((bReceived = socket->Recv(buffer, sizeof(buffer), bytesRead)) && bytesRead > 0)
+	{
+		receiveBuffer.Append(buffer, bytesRead);
+	}
+	if (!bReceived)
+	{
+		bClosed = true;
+	}
+
+	int32 offset = 0;
+	while (receiveBuffer.Num() - offset >= (int32)sizeof(int32))
+	{
+		int32 length;
+		FMemory::Memcpy(&length, receiveBuffer.GetData() + offset, sizeof(int32));
+		if (length < 0 || length > MaxMessageBytes)
+		{
+			UE_LOG(LogTemp, Error, TEXT("DistrictConnection::Received a message of %d bytes, closing the connection."), length)
+			bClosed = true;
+			break;
+		}
+		if (receiveBuffer.Num() - offset - (int32)sizeof(int32) < length)
+		{
+			break;
+		}
+
+		FMemoryReader reader(receiveBuffer);
+		reader.Seek(offset + sizeof(int32));
+		reader.SetLimitSize(offset + sizeof(int32) + length);
+		FDistrictMessage& message = outMessages.AddDefaulted_GetRef();
+		reader << message;
+		if (reader.IsError())
+		{
+			UE_LOG(LogTemp, Error, TEXT("DistrictConnection::Received a corrupt message, closing the connection."))
+			outMessages.Pop();
+			bClosed = true;
+			break;
+		}
+		offset += sizeof(int32) + length;
+	}
+	receiveBuffer.RemoveAt(0, offset, false);
+
+	return !bClosed;
+}
@@ -0,0 +1,103 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BuildingCommandLog.h"
+#include "DistrictMap.h"
+#include "TimeController.h"
+
+//Kinds of message between district shards and the coordinator
+enum class EDistrictMessage : uint8
+{
+	//Shard to coordinator on connecting: its index, game address and its own clock as a proposed epoch
+	Hello = 0,
+	//Coordinator to a shard that said hello: the district layout and the clock epoch
+	Welcome = 1,
+	//Coordinator to every shard: a new clock epoch
+	Epoch = 2,
+	//Shard to coordinator: the game speed was changed on the shard
+	TimeRate = 3,
+	//Building operations for cells in another shard's district, routed to the owner
+	Commands = 4,
+	//Buildings applied in a border band, routed to the neighbouring shard as ghosts
+	Ghosts = 5,
+	//Coordinator to a shard: another shard is connected and needs the ghosts of the border band they share
+	ShardJoined = 6,
+	//Shard to coordinator: a player crossed into another shard's district
+	Handoff = 7,
+	//Coordinator to the shard a player is crossing into: where to spawn the player when they arrive
+	HandoffExpect = 8,
+	//Coordinator to the shard a player is leaving: the address the player travels to
+	HandoffReady = 9,
+	//Every building in a border band, routed to the neighbouring shard to replace all the ghosts it holds of the sender's
+	//district, so ghosts of buildings demolished while the two were apart are removed
+	GhostReconcile = 10
+};
+
+//Player moving between shards
+struct FDistrictHandoff
+{
+	//Passed on the travel URL so the receiving shard can match the player to the handoff
+	FString token;
+	FVector location = FVector::ZeroVector;
+	FRotator rotation = FRotator::ZeroRotator;
+
+	friend FArchive& operator<<(FArchive& Ar, FDistrictHandoff& handoff)
+	{
+		Ar << handoff.token << handoff.location << handoff.rotation;
+		return Ar;
+	}
+};
+
+//One message, only the fields of its type are sent
+struct SPACERPG_API FDistrictMessage
+{
+	EDistrictMessage type = EDistrictMessage::Hello;
+
+	//Shard the message is from when sent to the coordinator, and the shard it concerns when routed
+	int32 shard = INDEX_NONE;
+
+	//Hello: the shard's game address, HandoffReady: the address to travel to
+	FString address;
+
+	FDistrictMap map;
+	FClockEpoch epoch;
+	float timeRate = 1.0f;
+	TArray<FBuildingCommandRecord> records;
+	FDistrictHandoff handoff;
+
+	friend FArchive& operator<<(FArchive& Ar, FDistrictMessage& message);
+};
+
+//Length prefixed messages over a non-blocking TCP socket
+class SPACERPG_API FDistrictConnection
+{
+public:
+	//Takes ownership of a connected socket
+	explicit FDistrictConnection(class FSocket* inSocket);
+	~FDistrictConnection();
+
+	//Connects to host:port, returns nullptr if nothing is listening
+	static TUniquePtr<FDistrictConnection> Connect(const FString& address);
+
+	//Queues a message, it is sent by the next Update
+	void Send(const FDistrictMessage& message);
+
+	//Sends queued bytes and reads every complete message, returns false once the connection has closed.
+	//Messages that arrived before the connection closed are still read
+	bool Update(TArray<FDistrictMessage>& outMessages);
+
+	//Bytes queued by Send so far
+	FORCEINLINE int64 GetNumBytesSent() const { return numBytesSent; }
+
+	//Encodes a message as it is sent, with its length prefix
+	static void Encode(const FDistrictMessage& message, TArray<uint8>& outData);
+
+private:
+	class FSocket* socket;
+	TArray<uint8> sendBuffer;
+	TArray<uint8> receiveBuffer;
+	int64 numBytesSent = 0;
+	bool bClosed = false;
+};
@@ -0,0 +1,471 @@
+// Copyright SpaceRPG 2020
+
+#include "DistrictShardSubsystem.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
+#include "Building.h"
+#include "BuildingRegistry.h"
+#include "TimeController.h"
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "Misc/Guid.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("District Ghost Buildings"), STAT_DistrictGhostBuildings, STATGROUP_SpaceRPG);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("District Commands Routed"), STAT_DistrictCommandsRouted, STATGROUP_SpaceRPG);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("District Player Handoffs"), STAT_DistrictHandoffs, STATGROUP_SpaceRPG);
+
+void UDistrictShardSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	Collection.InitializeDependency(UBuildingRegistry::StaticClass());
+	UBuildingCommandLog* commandLog = Cast<UBuildingCommandLog>(Collection.InitializeDependency(UBuildingCommandLog::StaticClass()));
+
+	if (!GetWorld()->IsGameWorld() || commandLog == nullptr
+		|| !FParse::Value(FCommandLine::Get(), TEXT("DistrictShard="), shardIndex)
+		|| !FParse::Value(FCommandLine::Get(), TEXT("DistrictCoordinator="), coordinatorAddress))
+	{
+		shardIndex = INDEX_NONE;
+		return;
+	}
+	FParse::Value(FCommandLine::Get(), TEXT("DistrictHost="), shardHost);
+
+	commandLog->RouteCommand.BindUObject(this, &UDistrictShardSubsystem::RouteCommand);
+	commandsAppliedHandle = commandLog->OnCommandsApplied.AddUObject(this, &UDistrictShardSubsystem::OnCommandsApplied);
+}
+
+void UDistrictShardSubsystem::Deinitialize()
+{
+	if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+	{
+		if (IsSharded())
+		{
+			commandLog->RouteCommand.Unbind();
+		}
+		commandLog->OnCommandsApplied.Remove(commandsAppliedHandle);
+	}
+
+	connection.Reset();
+	ghostCells.Empty();
+
+	Super::Deinitialize();
+}
+
+void UDistrictShardSubsystem::Tick(float DeltaTime)
+{
+	if (!IsSharded())
+	{
+		return;
+	}
+
+	SPACERPG_LLM_SCOPE(CityData);
+
+	//Wait for play to start, so the clock proposed to the coordinator is the one loaded from the autosave
+	if (!connection.IsValid())
+	{
+		timeSinceConnect += DeltaTime;
+		if (timeSinceConnect >= reconnectInterval && GetWorld()->HasBegunPlay())
+		{
+			timeSinceConnect = 0.0f;
+			Connect();
+		}
+		return;
+	}
+
+	FlushPending();
+
+	TArray<FDistrictMessage> messages;
+	bool bOpen = connection->Update(messages);
+	for (const FDistrictMessage& message : messages)
+	{
+		HandleMessage(message);
+	}
+
+	//Operations keep being routed while the coordinator is away, and are sent once it is back
+	if (!bOpen)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("DistrictShardSubsystem::Lost the coordinator at %s, reconnecting."), *coordinatorAddress)
+		connection.Reset();
+		return;
+	}
+
+	if (bWelcomed)
+	{
+		CheckTimeRate();
+
+		timeSinceHandoffCheck += DeltaTime;
+		if (timeSinceHandoffCheck >= handoffCheckInterval)
+		{
+			timeSinceHandoffCheck = 0.0f;
+			CheckHandoffs();
+		}
+	}
+}
+
+ETickableTickType UDistrictShardSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UDistrictShardSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UDistrictShardSubsystem, STATGROUP_Tickables);
+}
+
+bool UDistrictShardSubsystem::IsGhost(const ABuilding* building)
+{
+	UWorld* world = building ? building->GetWorld() : nullptr;
+	UDistrictShardSubsystem* shards = world ? world->GetSubsystem<UDistrictShardSubsystem>() : nullptr;
+	return shards != nullptr && shards->ghostCells.Contains(building->gridCell);
+}
+
+bool UDistrictShardSubsystem::OwnsCell(const FIntVector& cell) const
+{
+	return !IsSharded() || !bWelcomed || districtMap.GetDistrict(cell) == shardIndex;
+}
+
+void UDistrictShardSubsystem::ClaimHandoff(APlayerController* controller, const FString& token)
+{
+	FExpectedHandoff expected;
+	if (expectedHandoffs.RemoveAndCopyValue(token, expected))
+	{
+		handoffSpawns.Add(controller, expected.transform);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Warning, TEXT("DistrictShardSubsystem::Player arrived with unknown handoff %s, spawning them normally."), *token)
+	}
+}
+
+bool UDistrictShardSubsystem::TakeHandoffSpawn(AController* controller, FTransform& outTransform)
+{
+	return handoffSpawns.RemoveAndCopyValue(controller, outTransform);
+}
+
+void UDistrictShardSubsystem::Connect()
+{
+	connection = FDistrictConnection::Connect(coordinatorAddress);
+	if (!connection.IsValid())
+	{
+		UE_LOG(LogTemp, Log, TEXT("DistrictShardSubsystem::Could not reach the coordinator at %s, retrying."), *coordinatorAddress)
+		return;
+	}
+
+	FDistrictMessage hello;
+	hello.type = EDistrictMessage::Hello;
+	hello.shard = shardIndex;
+	hello.address = FString::Printf(TEXT("%s:%d"), *shardHost, GetWorld()->URL.Port);
+
+	//The coordinator only takes the proposal if it has no clock yet
+	if (ATimeController* controller = FindTimeController())
+	{
+		hello.epoch = controller->GetClockEpoch().IsSet() ? controller->GetClockEpoch() : controller->MakeClockEpoch();
+	}
+	connection->Send(hello);
+}
+
+void UDistrictShardSubsystem::HandleMessage(const FDistrictMessage& message)
+{
+	switch (message.type)
+	{
+	case EDistrictMessage::Welcome:
+		districtMap = message.map;
+		bWelcomed = true;
+		UE_LOG(LogTemp, Log, TEXT("DistrictShardSubsystem::Running district %d of %d."), shardIndex, districtMap.GetNumDistricts())
+
+		//The welcome carries the epoch as well
+		ApplyEpoch(message.epoch);
+		break;
+	case EDistrictMessage::Epoch:
+		ApplyEpoch(message.epoch);
+		break;
+	case EDistrictMessage::Commands:
+		if (UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>())
+		{
+			commandLog->SubmitRecords(message.records);
+		}
+		break;
+	case EDistrictMessage::Ghosts:
+		ApplyGhosts(message.records);
+		break;
+	case EDistrictMessage::GhostReconcile:
+		ReconcileGhosts(message.shard, message.records);
+		break;
+	case EDistrictMessage::ShardJoined:
+		SendBorderGhosts(message.shard);
+		break;
+	case EDistrictMessage::HandoffExpect:
+		expectedHandoffs.Add(message.handoff.token, { FTransform(message.handoff.rotation, message.handoff.location), FPlatformTime::Seconds() });
+		break;
+	case EDistrictMessage::HandoffReady:
+		if (FOutgoingHandoff* outgoing = outgoingHandoffs.Find(message.handoff.token))
+		{
+			if (APlayerController* controller = outgoing->controller.Get())
+			{
+				controller->ClientTravel(message.address + TEXT("?DistrictHandoff=") + message.handoff.token, TRAVEL_Absolute);
+			}
+		}
+		break;
+	default:
+		UE_LOG(LogTemp, Warning, TEXT("DistrictShardSubsystem::Unexpected message %d from the coordinator."), (int32)message.type)
+		break;
+	}
+}
+
+void UDistrictShardSubsystem::ApplyEpoch(const FClockEpoch& epoch)
+{
+	if (ATimeController* controller = FindTimeController())
+	{
+		controller->SetClockEpoch(epoch);
+	}
+	requestedTimeRate = epoch.timeRate;
+}
+
+void UDistrictShardSubsystem::FlushPending()
+{
+	auto flush = [this](TMap<int32, TArray<FBuildingCommandRecord>>& pending, EDistrictMessage type)
+	{
+		for (auto& pair : pending)
+		{
+			if (pair.Value.Num() == 0)
+			{
+				continue;
+			}
+
+			FDistrictMessage message;
+			message.type = type;
+			message.shard = pair.Key;
+			message.records = MoveTemp(pair.Value);
+			message.records.Last().flags |= FBuildingCommandRecord::BatchEndFlag;
+			connection->Send(message);
+		}
+		pending.Reset();
+	};
+
+	flush(pendingCommands, EDistrictMessage::Commands);
+	flush(pendingGhosts, EDistrictMessage::Ghosts);
+}
+
+void UDistrictShardSubsystem::SendBorderGhosts(int32 toShard)
+{
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	if (registry == nullptr)
+	{
+		return;
+	}
+
+	//Sent even when empty, as the neighbour may still hold ghosts of buildings demolished while the two were apart
+	TArray<int32, TInlineAllocator<4>> neighbours;
+	FDistrictMessage message;
+	message.type = EDistrictMessage::GhostReconcile;
+	message.shard = toShard;
+	for (const auto& pair : registry->GetBuildings())
+	{
+		if (pair.Value == nullptr || ghostCells.Contains(pair.Key) || districtMap.GetDistrict(pair.Key) != shardIndex)
+		{
+			continue;
+		}
+
+		districtMap.GetBorderDistricts(pair.Key, neighbours);
+		if (neighbours.Contains(toShard))
+		{
+			message.records.Add(FBuildingCommandRecord::Make(EBuildingCommand::Place, pair.Key, pair.Value->buildingType, FBuildingCommandRecord::EncodeYaw(pair.Value->GetActorRotation().Yaw)));
+		}
+	}
+
+	if (message.records.Num() > 0)
+	{
+		message.records.Last().flags |= FBuildingCommandRecord::BatchEndFlag;
+	}
+	connection->Send(message);
+}
+
+void UDistrictShardSubsystem::ApplyGhosts(const TArray<FBuildingCommandRecord>& records)
+{
+	UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>();
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	if (commandLog == nullptr || registry == nullptr)
+	{
+		return;
+	}
+
+	//Cells are marked before the buildings spawn, so systems that skip ghosts see them as ghosts from the start
+	for (const FBuildingCommandRecord& record : records)
+	{
+		ghostCells.Add(record.GetCell());
+	}
+
+	bApplyingGhosts = true;
+	commandLog->ApplyRecords(records);
+	bApplyingGhosts = false;
+
+	for (const FBuildingCommandRecord& record : records)
+	{
+		if (registry->FindBuilding(record.GetCell()) == nullptr)
+		{
+			ghostCells.Remove(record.GetCell());
+		}
+	}
+	SET_DWORD_STAT(STAT_DistrictGhostBuildings, ghostCells.Num());
+}
+
+void UDistrictShardSubsystem::ReconcileGhosts(int32 fromShard, const TArray<FBuildingCommandRecord>& records)
+{
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	if (registry == nullptr)
+	{
+		return;
+	}
+
+	TSet<FIntVector> reconciledCells;
+	reconciledCells.Reserve(records.Num());
+	for (const FBuildingCommandRecord& record : records)
+	{
+		reconciledCells.Add(record.GetCell());
+	}
+
+	//Ghosts of the sender's district missing from its border band were demolished while the two shards were apart
+	TArray<FBuildingCommandRecord> reconciled = records;
+	for (const FIntVector& cell : ghostCells)
+	{
+		ABuilding* ghost = registry->FindBuilding(cell);
+		if (ghost != nullptr && districtMap.GetDistrict(cell) == fromShard && !reconciledCells.Contains(cell))
+		{
+			reconciled.Add(FBuildingCommandRecord::Make(EBuildingCommand::Demolish, cell, ghost->buildingType, 0));
+		}
+	}
+
+	if (reconciled.Num() > 0)
+	{
+		ApplyGhosts(reconciled);
+	}
+	UE_LOG(LogTemp, Log, TEXT("DistrictShardSubsystem::Reconciled %d ghosts of district %d, %d removed."), records.Num(), fromShard, reconciled.Num() - records.Num())
+}
+
+void UDistrictShardSubsystem::CheckTimeRate()
+{
+	//The clock keeps the epoch's rate until the coordinator rebases it, so every shard changes speed at the same moment
+	ATimeController* controller = FindTimeController();
+	if (controller != nullptr && controller->GetClockEpoch().IsSet() && controller->gameSpeedMultiplier != requestedTimeRate)
+	{
+		requestedTimeRate = controller->gameSpeedMultiplier;
+
+		FDistrictMessage message;
+		message.type = EDistrictMessage::TimeRate;
+		message.shard = shardIndex;
+		message.timeRate = requestedTimeRate;
+		connection->Send(message);
+	}
+}
+
+void UDistrictShardSubsystem::CheckHandoffs()
+{
+	double now = FPlatformTime::Seconds();
+	for (auto it = outgoingHandoffs.CreateIterator(); it; ++it)
+	{
+		if (!it.Value().controller.IsValid() || now - it.Value().time > handoffTimeout)
+		{
+			it.RemoveCurrent();
+		}
+	}
+	for (auto it = expectedHandoffs.CreateIterator(); it; ++it)
+	{
+		if (now - it.Value().time > handoffTimeout)
+		{
+			it.RemoveCurrent();
+		}
+	}
+
+	for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it)
+	{
+		APlayerController* controller = it->Get();
+		APawn* pawn = controller ? controller->GetPawn() : nullptr;
+		if (pawn == nullptr || controller->IsLocalController())
+		{
+			continue;
+		}
+
+		FIntVector cell = UBuildingRegistry::WorldToCell(pawn->GetActorLocation());
+		int32 district = districtMap.GetDistrict(cell);
+		if (district == shardIndex || !districtMap.IsInsideDistrict(cell, district, handoffMarginCells))
+		{
+			continue;
+		}
+
+		bool bAlreadyLeaving = false;
+		for (const auto& pair : outgoingHandoffs)
+		{
+			bAlreadyLeaving |= pair.Value.controller == controller;
+		}
+		if (bAlreadyLeaving)
+		{
+			continue;
+		}
+
+		FDistrictMessage message;
+		message.type = EDistrictMessage::Handoff;
+		message.shard = district;
+		message.handoff.token = FGuid::NewGuid().ToString();
+		message.handoff.location = pawn->GetActorLocation();
+		message.handoff.rotation = controller->GetControlRotation();
+		connection->Send(message);
+
+		outgoingHandoffs.Add(message.handoff.token, { controller, now });
+		INC_DWORD_STAT(STAT_DistrictHandoffs);
+	}
+}
+
+ATimeController* UDistrictShardSubsystem::FindTimeController()
+{
+	if (!timeController.IsValid())
+	{
+		TActorIterator<ATimeController> it(GetWorld());
+		timeController = it ? *it : nullptr;
+	}
+	return timeController.Get();
+}
+
+bool UDistrictShardSubsystem::RouteCommand(const FBuildingCommandRecord& record)
+{
+	if (!bWelcomed)
+	{
+		return false;
+	}
+
+	int32 owner = districtMap.GetDistrict(record.GetCell());
+	if (owner == shardIndex)
+	{
+		return false;
+	}
+
+	pendingCommands.FindOrAdd(owner).Add(record);
+	INC_DWORD_STAT(STAT_DistrictCommandsRouted);
+	return true;
+}
+
+void UDistrictShardSubsystem::OnCommandsApplied(const TArray<FBuildingCommandRecord>& records)
+{
+	if (!bWelcomed || bApplyingGhosts)
+	{
+		return;
+	}
+
+	TArray<int32, TInlineAllocator<4>> neighbours;
+	for (const FBuildingCommandRecord& record : records)
+	{
+		if (districtMap.GetDistrict(record.GetCell()) != shardIndex)
+		{
+			continue;
+		}
+
+		districtMap.GetBorderDistricts(record.GetCell(), neighbours);
+		for (int32 neighbour : neighbours)
+		{
+			FBuildingCommandRecord ghost = record;
+			ghost.flags &= FBuildingCommandRecord::CommandMask;
+			pendingGhosts.FindOrAdd(neighbour).Add(ghost);
+		}
+	}
+}
@@ -0,0 +1,137 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "DistrictProtocol.h"
+#include "DistrictShardSubsystem.generated.h"
+
+//Runs a dedicated server as the shard of one district of the city, started with
+//-DistrictShard=<index> -DistrictCoordinator=<host:port> [-DistrictHost=<address players connect to>].
+//The shard only simulates buildings in its own district: operations on other districts' cells are routed to their owner
+//through the coordinator, and buildings within the border band of a neighbour are mirrored to it as ghosts. Ghosts take
+//part in collision like any building and hold up the shard's own buildings like the ground, but support checks, the economy,
+//utility networks and autosave leave them to their owner.
+//Players that walk well into another district are handed to its shard, and the clock follows the coordinator's epoch
+UCLASS(Config = Game)
+class SPACERPG_API UDistrictShardSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	//Whether this server is a shard of a larger city
+	FORCEINLINE bool IsSharded() const { return shardIndex != INDEX_NONE; }
+
+	//Whether the building is a ghost of a neighbouring shard's building
+	static bool IsGhost(const class ABuilding* building);
+
+	//Whether the cell is simulated by this server, operations on other cells are routed to their owner
+	bool OwnsCell(const FIntVector& cell) const;
+
+	//Matches a player joining with ?DistrictHandoff=<token> to the handoff that sent them
+	void ClaimHandoff(class APlayerController* controller, const FString& token);
+
+	//Where a handed off player should spawn, returns false for players that joined normally
+	bool TakeHandoffSpawn(class AController* controller, FTransform& outTransform);
+
+private:
+	//Seconds between attempts to reach the coordinator
+	UPROPERTY(Config)
+	float reconnectInterval = 2.0f;
+
+	//Seconds between checks for players crossing into another district
+	UPROPERTY(Config)
+	float handoffCheckInterval = 0.25f;
+
+	//Cells a player has to be inside another district before they are handed to its shard, so walking along a border doesn't bounce them
+	UPROPERTY(Config)
+	int32 handoffMarginCells = 3;
+
+	//Seconds a handoff is kept waiting for its player
+	UPROPERTY(Config)
+	float handoffTimeout = 30.0f;
+
+	int32 shardIndex = INDEX_NONE;
+	FString coordinatorAddress;
+
+	//Host players connect to, the shard's address is this and its game port
+	FString shardHost = TEXT("127.0.0.1");
+
+	TUniquePtr<FDistrictConnection> connection;
+	float timeSinceConnect = 0.0f;
+	float timeSinceHandoffCheck = 0.0f;
+
+	//Layout received from the coordinator, nothing is routed until it has arrived
+	FDistrictMap districtMap;
+	bool bWelcomed = false;
+
+	//Speed last requested from the coordinator, so a change is only sent once
+	float requestedTimeRate = 0.0f;
+
+	//Cells holding ghosts of neighbouring shards' buildings
+	TSet<FIntVector> ghostCells;
+
+	//Set while applying ghosts, so they are not mirrored back
+	bool bApplyingGhosts = false;
+
+	//Records waiting to be sent, by the shard they are for
+	TMap<int32, TArray<FBuildingCommandRecord>> pendingCommands;
+	TMap<int32, TArray<FBuildingCommandRecord>> pendingGhosts;
+
+	//Players this shard has asked to hand off, by token
+	struct FOutgoingHandoff
+	{
+		TWeakObjectPtr<class APlayerController> controller;
+		double time = 0.0;
+	};
+	TMap<FString, FOutgoingHandoff> outgoingHandoffs;
+
+	//Players expected from other shards, by token, and the spawns of those that have arrived
+	struct FExpectedHandoff
+	{
+		FTransform transform;
+		double time = 0.0;
+	};
+	TMap<FString, FExpectedHandoff> expectedHandoffs;
+	TMap<TWeakObjectPtr<class AController>, FTransform> handoffSpawns;
+
+	FDelegateHandle commandsAppliedHandle;
+
+	void Connect();
+	void HandleMessage(const FDistrictMessage& message);
+
+	//Sets the shared clock from the coordinator's epoch
+	void ApplyEpoch(const struct FClockEpoch& epoch);
+
+	//Sends the records and ghosts gathered this frame, one batch per shard
+	void FlushPending();
+
+	//Sends the ghosts of every owned building in the border band of a shard, replacing every ghost it holds of this district
+	void SendBorderGhosts(int32 toShard);
+
+	//Applies ghost records from a neighbouring shard to the world
+	void ApplyGhosts(const TArray<FBuildingCommandRecord>& records);
+
+	//Applies a neighbour's whole border band, removing its ghosts that are no longer there
+	void ReconcileGhosts(int32 fromShard, const TArray<FBuildingCommandRecord>& records);
+
+	void CheckTimeRate();
+	void CheckHandoffs();
+
+	TWeakObjectPtr<class ATimeController> timeController;
+	class ATimeController* FindTimeController();
+
+	bool RouteCommand(const FBuildingCommandRecord& record);
+	void OnCommandsApplied(const TArray<FBuildingCommandRecord>& records);
+};
@@ -0,0 +1,164 @@
+// Copyright SpaceRPG 2020
+
+#include "EconomyStore.h"
+#include "Math/VectorRegister.h"
+
+//Buildings updated per vector register
+static constexpr int32 EconomyLanes = 4;
+
+FEconomyStore::FEconomyStore(int32 inNumResources)
+{
+	Reset(inNumResources);
+}
+
+int32 FEconomyStore::AddBuilding()
+{
+	int32 index = numBuildings++;
+
+	//Grow every array by a whole vector so the padding lanes stay zero
+	if (resources.Num() > 0 && index >= resources[0].stored.Num())
+	{
+		for (FResourceArrays& arrays : resources)
+		{
+			arrays.production.AddZeroed(EconomyLanes);
+			arrays.consumption.AddZeroed(EconomyLanes);
+			arrays.capacity.AddZeroed(EconomyLanes);
+			arrays.stored.AddZeroed(EconomyLanes);
+			arrays.satisfaction.AddZeroed(EconomyLanes);
+		}
+	}
+
+	int32 building;
+	if (freeHandles.Num() > 0)
+	{
+		building = freeHandles.Pop(false);
+		handleToIndex[building] = index;
+	}
+	else
+	{
+		building = handleToIndex.Add(index);
+	}
+
+	if (index >= indexToHandle.Num())
+	{
+		indexToHandle.AddUninitialized(index - indexToHandle.Num() + 1);
+	}
+	indexToHandle[index] = building;
+
+	for (FResourceArrays& arrays : resources)
+	{
+		arrays.satisfaction[index] = 1.0f;
+	}
+	return building;
+}
+
+void FEconomyStore::RemoveBuilding(int32 building)
+{
+	if (!IsValidBuilding(building))
+	{
+		return;
+	}
+
+	int32 index = handleToIndex[building];
+	int32 lastIndex = --numBuildings;
+
+	for (FResourceArrays& arrays : resources)
+	{
+		arrays.production[index] = arrays.production[lastIndex];
+		arrays.consumption[index] = arrays.consumption[lastIndex];
+		arrays.capacity[index] = arrays.capacity[lastIndex];
+		arrays.stored[index] = arrays.stored[lastIndex];
+		arrays.satisfaction[index] = arrays.satisfaction[lastIndex];
+
+		arrays.production[lastIndex] = 0.0f;
+		arrays.consumption[lastIndex] = 0.0f;
+		arrays.capacity[lastIndex] = 0.0f;
+		arrays.stored[lastIndex] = 0.0f;
+		arrays.satisfaction[lastIndex] = 0.0f;
+	}
+
+	int32 movedBuilding = indexToHandle[lastIndex];
+	indexToHandle[index] = movedBuilding;
+	handleToIndex[movedBuilding] = index;
+
+	handleToIndex[building] = INDEX_NONE;
+	freeHandles.Add(building);
+}
+
+void FEconomyStore::SetProduction(int32 building, int32 resource, float value)
+{
+	resources[resource].production[handleToIndex[building]] = FMath::Max(value, 0.0f);
+}
+
+void FEconomyStore::SetConsumption(int32 building, int32 resource, float value)
+{
+	resources[resource].consumption[handleToIndex[building]] = FMath::Max(value, 0.0f);
+}
+
+void FEconomyStore::SetCapacity(int32 building, int32 resource, float value)
+{
+	int32 index = handleToIndex[building];
+	FResourceArrays& arrays = resources[resource];
+	arrays.capacity[index] = FMath::Max(value, 0.0f);
+	arrays.stored[index] = FMath::Min(arrays.stored[index], arrays.capacity[index]);
+}
+
+void FEconomyStore::AdvanceHour()
+{
+	for (int32 resource = 0; resource < resources.Num(); resource++)
+	{
+		AdvanceResource(resource);
+	}
+}
+
+void FEconomyStore::AdvanceResource(int32 resource)
+{
+	FResourceArrays& arrays = resources[resource];
+	const float* production = arrays.production.GetData();
+	const float* consumption = arrays.consumption.GetData();
+	const float* capacity = arrays.capacity.GetData();
+	float* stored = arrays.stored.GetData();
+	float* satisfaction = arrays.satisfaction.GetData();
+
+	//Padding lanes hold zeros, so running whole vectors past the last building is harmless
+	const VectorRegister zero = VectorZero();
+	const VectorRegister one = VectorOne();
+	const VectorRegister smallNumber = VectorSetFloat1(SMALL_NUMBER);
+	const int32 numValues = Align(numBuildings, EconomyLanes);
+
+	for (int32 i = 0; i < numValues; i += EconomyLanes)
+	{
+		VectorRegister produced = VectorLoadAligned(production + i);
+		VectorRegister consumed = VectorLoadAligned(consumption + i);
+		VectorRegister available = VectorAdd(VectorLoadAligned(stored + i), produced);
+
+		//Satisfaction is how much of the consumption the store and this hour's production can cover, buildings that
+		//consume nothing are fully satisfied
+		VectorRegister ratio = VectorMultiply(available, VectorReciprocalAccurate(VectorMax(consumed, smallNumber)));
+		VectorStoreAligned(VectorSelect(VectorCompareGT(consumed, zero), VectorMin(ratio, one), one), satisfaction + i);
+
+		VectorRegister remaining = VectorMax(VectorSubtract(available, consumed), zero);
+		VectorStoreAligned(VectorMin(remaining, VectorLoadAligned(capacity + i)), stored + i);
+	}
+}
+
+SIZE_T FEconomyStore::GetAllocatedSize() const
+{
+	SIZE_T size = resources.GetAllocatedSize() + handleToIndex.GetAllocatedSize() + indexToHandle.GetAllocatedSize() + freeHandles.GetAllocatedSize();
+	for (const FResourceArrays& arrays : resources)
+	{
+		size += arrays.production.GetAllocatedSize() + arrays.consumption.GetAllocatedSize() + arrays.capacity.GetAllocatedSize()
+			+ arrays.stored.GetAllocatedSize() + arrays.satisfaction.GetAllocatedSize();
+	}
+	return size;
+}
+
+void FEconomyStore::Reset(int32 inNumResources)
+{
+	resources.Reset();
+	resources.SetNum(FMath::Max(inNumResources, 0));
+	numBuildings = 0;
+	handleToIndex.Reset();
+	indexToHandle.Reset();
+	freeHandles.Reset();
+}
@@ -0,0 +1,68 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Resource state of every building with an economy, one structure of arrays per resource type
+//Values for a resource sit in contiguous 16 byte aligned arrays indexed by dense building index, padded to a multiple of
+//four so the hourly update runs four buildings per vector. Handles stay stable while removals swap the last building in
+class SPACERPG_API FEconomyStore
+{
+public:
+	explicit FEconomyStore(int32 inNumResources = 0);
+
+	//Adds a building with no production, consumption or storage, returns its handle
+	int32 AddBuilding();
+
+	//Removes a building in constant time by moving the last building into its slot
+	void RemoveBuilding(int32 building);
+
+	FORCEINLINE bool IsValidBuilding(int32 building) const { return handleToIndex.IsValidIndex(building) && handleToIndex[building] != INDEX_NONE; }
+
+	//Amounts produced and consumed per game hour, and the most that can be stored
+	void SetProduction(int32 building, int32 resource, float value);
+	void SetConsumption(int32 building, int32 resource, float value);
+	void SetCapacity(int32 building, int32 resource, float value);
+
+	FORCEINLINE float GetStored(int32 building, int32 resource) const { return resources[resource].stored[handleToIndex[building]]; }
+
+	//Fraction of the building's consumption met at the last hour, from 0 to 1
+	FORCEINLINE float GetSatisfaction(int32 building, int32 resource) const { return resources[resource].satisfaction[handleToIndex[building]]; }
+
+	//Advances every resource by one game hour
+	void AdvanceHour();
+
+	//Advances a single resource by one game hour, so an hour can be split over several frames
+	void AdvanceResource(int32 resource);
+
+	FORCEINLINE int32 GetNumBuildings() const { return numBuildings; }
+	FORCEINLINE int32 GetNumResources() const { return resources.Num(); }
+
+	//Memory held by the resource arrays
+	SIZE_T GetAllocatedSize() const;
+
+	//Removes every building and sets the number of resource types
+	void Reset(int32 inNumResources);
+
+private:
+	typedef TArray<float, TAlignedHeapAllocator<16>> FResourceValues;
+
+	struct FResourceArrays
+	{
+		FResourceValues production;
+		FResourceValues consumption;
+		FResourceValues capacity;
+		FResourceValues stored;
+		FResourceValues satisfaction;
+	};
+
+	TArray<FResourceArrays> resources;
+
+	int32 numBuildings = 0;
+
+	//Dense index of each handle and handle of each dense index
+	TArray<int32> handleToIndex;
+	TArray<int32> indexToHandle;
+	TArray<int32> freeHandles;
+};
@@ -0,0 +1,161 @@
+// Copyright SpaceRPG 2020
+
+#include "EconomySubsystem.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
+#include "Building.h"
+#include "BuildingPalette.h"
+#include "BuildingRegistry.h"
+#include "BuildingStreamingSubsystem.h"
+#include "DistrictShardSubsystem.h"
+#include "SimulationScheduler.h"
+#include "TimeController.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Economy Update"), STAT_EconomyUpdate, STATGROUP_SpaceRPG);
+DECLARE_MEMORY_STAT(TEXT("Economy Store"), STAT_EconomyStoreMemory, STATGROUP_SpaceRPG);
+
+void UEconomySubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	SPACERPG_LLM_SCOPE(Economy);
+
+	Super::Initialize(Collection);
+
+	store.Reset(resourceNames.Num());
+
+	UBuildingRegistry* registry = Cast<UBuildingRegistry>(Collection.InitializeDependency(UBuildingRegistry::StaticClass()));
+	if (registry != nullptr)
+	{
+		buildingAddedHandle = registry->OnBuildingAdded.AddUObject(this, &UEconomySubsystem::OnBuildingAdded);
+		buildingRemovedHandle = registry->OnBuildingRemoved.AddUObject(this, &UEconomySubsystem::OnBuildingRemoved);
+	}
+
+	Collection.InitializeDependency(USimulationScheduler::StaticClass());
+	hourChangedHandle = ATimeController::OnHourChangedEvent.AddUObject(this, &UEconomySubsystem::OnHourChanged);
+}
+
+void UEconomySubsystem::Deinitialize()
+{
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->OnBuildingAdded.Remove(buildingAddedHandle);
+		registry->OnBuildingRemoved.Remove(buildingRemovedHandle);
+	}
+	ATimeController::OnHourChangedEvent.Remove(hourChangedHandle);
+	if (USimulationScheduler* scheduler = GetWorld()->GetSubsystem<USimulationScheduler>())
+	{
+		scheduler->CancelJobs(this);
+	}
+
+	store.Reset(0);
+	buildingHandles.Empty();
+
+	Super::Deinitialize();
+}
+
+float UEconomySubsystem::GetStored(ABuilding* building, FName resource) const
+{
+	const int32* handle = buildingHandles.Find(building);
+	int32 resourceIndex = FindResource(resource);
+	return handle && resourceIndex != INDEX_NONE ? store.GetStored(*handle, resourceIndex) : 0.0f;
+}
+
+float UEconomySubsystem::GetSatisfaction(ABuilding* building, FName resource) const
+{
+	const int32* handle = buildingHandles.Find(building);
+	int32 resourceIndex = FindResource(resource);
+	return handle && resourceIndex != INDEX_NONE ? store.GetSatisfaction(*handle, resourceIndex) : 0.0f;
+}
+
+void UEconomySubsystem::OnBuildingAdded(ABuilding* building)
+{
+	SPACERPG_LLM_SCOPE(Economy);
+
+	//Ghosts are simulated by the shard that owns them
+	if (UDistrictShardSubsystem::IsGhost(building))
+	{
+		return;
+	}
+
+	//Only buildings whose type takes part in the economy get a slot
+	UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(this);
+	UBuildingPalette* palette = streaming ? streaming->GetPalette() : nullptr;
+	if (palette == nullptr || !palette->IsValidType(building->buildingType) || palette->buildingTypes[building->buildingType].resources.Num() == 0)
+	{
+		return;
+	}
+
+	int32 handle = store.AddBuilding();
+	for (const FBuildingResource& resource : palette->buildingTypes[building->buildingType].resources)
+	{
+		int32 resourceIndex = FindResource(resource.resource);
+		if (resourceIndex == INDEX_NONE)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("EconomySubsystem::Unknown resource %s."), *resource.resource.ToString())
+			continue;
+		}
+
+		store.SetProduction(handle, resourceIndex, resource.production);
+		store.SetConsumption(handle, resourceIndex, resource.consumption);
+		store.SetCapacity(handle, resourceIndex, resource.capacity);
+	}
+	buildingHandles.Add(building, handle);
+
+	SET_MEMORY_STAT(STAT_EconomyStoreMemory, store.GetAllocatedSize());
+}
+
+void UEconomySubsystem::OnBuildingRemoved(ABuilding* building)
+{
+	int32 handle;
+	if (buildingHandles.RemoveAndCopyValue(building, handle))
+	{
+		store.RemoveBuilding(handle);
+	}
+}
+
+void UEconomySubsystem::OnHourChanged(ATimeController* timeController)
+{
+	//The event is shared by every world
+	if (timeController->GetWorld() != GetWorld() || store.GetNumResources() == 0)
+	{
+		return;
+	}
+
+	USimulationScheduler* scheduler = GetWorld()->GetSubsystem<USimulationScheduler>();
+	if (scheduler == nullptr)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_EconomyUpdate);
+		store.AdvanceHour();
+		return;
+	}
+
+	//Hours that start before the last one finished are queued on the running job
+	pendingHours++;
+	if (scheduler->IsJobPending(updateJob))
+	{
+		return;
+	}
+
+	//Resources advance independently, so each hour is split between frames one resource at a time
+	nextResource = 0;
+	updateJob = scheduler->QueueJob(this, TEXT("Economy"), ESimulationJobPriority::Normal, [this](double deadline)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_EconomyUpdate);
+
+		while (pendingHours > 0)
+		{
+			store.AdvanceResource(nextResource++);
+			if (nextResource >= store.GetNumResources())
+			{
+				nextResource = 0;
+				pendingHours--;
+			}
+
+			if (FPlatformTime::Seconds() >= deadline)
+			{
+				break;
+			}
+		}
+		return pendingHours == 0;
+	}, updateDeadline);
+}
@@ -0,0 +1,59 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "EconomyStore.h"
+#include "EconomySubsystem.generated.h"
+
+//Runs the production, consumption and storage of placed buildings, advancing the economy on each game hour
+UCLASS(Config = Game)
+class SPACERPG_API UEconomySubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//Amount of the resource stored in the building
+	UFUNCTION(BlueprintPure, Category = Economy)
+	float GetStored(class ABuilding* building, FName resource) const;
+
+	//Fraction of the building's consumption of the resource met at the last hour
+	UFUNCTION(BlueprintPure, Category = Economy)
+	float GetSatisfaction(class ABuilding* building, FName resource) const;
+
+	//Returns the index of a resource, or INDEX_NONE
+	FORCEINLINE int32 FindResource(FName resource) const { return resourceNames.IndexOfByKey(resource); }
+
+	FORCEINLINE const FEconomyStore& GetStore() const { return store; }
+
+private:
+	//Every resource in the economy, a resource's index in the list is its id
+	UPROPERTY(Config)
+	TArray<FName> resourceNames;
+
+	//Seconds an hour of the economy should finish within
+	UPROPERTY(Config)
+	float updateDeadline = 0.5f;
+
+	FEconomyStore store;
+
+	//Economy handle for each building
+	TMap<TWeakObjectPtr<class ABuilding>, int32> buildingHandles;
+
+	//Resource the scheduled hour update continues from, hours still to run and the job running them
+	int32 nextResource = 0;
+	int32 pendingHours = 0;
+	int32 updateJob = INDEX_NONE;
+
+	FDelegateHandle buildingAddedHandle;
+	FDelegateHandle buildingRemovedHandle;
+	FDelegateHandle hourChangedHandle;
+
+	void OnBuildingAdded(class ABuilding* building);
+	void OnBuildingRemoved(class ABuilding* building);
+	void OnHourChanged(class ATimeController* timeController);
+};
@@ -0,0 +1,137 @@
+// Copyright SpaceRPG 2020
+
+#include "EnvironmentModel.h"
+
+//Odds of clear, cloudy, rain and storm in each season as cumulative thresholds, rain falls as snow in winter
+static const float WeatherOdds[4][3] =
+{
+	{ 0.35f, 0.65f, 0.92f },
+	{ 0.55f, 0.80f, 0.92f },
+	{ 0.30f, 0.60f, 0.90f },
+	{ 0.30f, 0.60f, 0.93f }
+};
+
+//Mean temperature and the swing either side of it over the year, in degrees Celsius
+static constexpr float MeanTemperature = 11.0f;
+static constexpr float TemperatureSwing = 12.0f;
+
+//Axial tilt of the planet in degrees
+static constexpr float AxialTilt = 23.44f;
+
+int32 FEnvironmentModel::GetDayNumber(int32 day, int32 month, int32 year)
+{
+	//Count years from March so the leap day is the last day of the counted year
+	if (month <= 2)
+	{
+		year--;
+	}
+	int32 era = (year >= 0 ? year : year - 399) / 400;
+	int32 yearOfEra = year - era * 400;
+	int32 dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	int32 dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+
+	//Day 0 is the 1st of January of year 1, which is 306 days into the era's counted year 0
+	return era * 146097 + dayOfEra - 306;
+}
+
+ESeason FEnvironmentModel::GetSeason(int32 dayOfYear, int32 daysInYear)
+{
+	//Seasons turn near the equinoxes and solstices, on the 20th of March, June, September and December
+	float yearFraction = (float)dayOfYear / daysInYear;
+	if (yearFraction < 78.0f / 365.0f)
+	{
+		return ESeason::Winter;
+	}
+	if (yearFraction < 171.0f / 365.0f)
+	{
+		return ESeason::Spring;
+	}
+	if (yearFraction < 265.0f / 365.0f)
+	{
+		return ESeason::Summer;
+	}
+	if (yearFraction < 354.0f / 365.0f)
+	{
+		return ESeason::Autumn;
+	}
+	return ESeason::Winter;
+}
+
+float FEnvironmentModel::GetDayLength(int32 dayOfYear, int32 daysInYear, float latitude)
+{
+	//Declination is lowest at the December solstice, ten days before the year starts
+	float declination = FMath::DegreesToRadians(-AxialTilt) * FMath::Cos(2.0f * PI * (dayOfYear + 10) / daysInYear);
+	float hourAngleCos = -FMath::Tan(FMath::DegreesToRadians(latitude)) * FMath::Tan(declination);
+
+	//Past the polar circles the sun stays up or down all day
+	return 24.0f / PI * FMath::Acos(FMath::Clamp(hourAngleCos, -1.0f, 1.0f));
+}
+
+FEnvironmentState FEnvironmentModel::Evaluate(int32 day, int32 month, int32 year, int32 seed, float latitude)
+{
+	FEnvironmentState state;
+
+	int32 dayNumber = GetDayNumber(day, month, year);
+	int32 daysInYear = GetDayNumber(1, 1, year + 1) - GetDayNumber(1, 1, year);
+	state.dayOfYear = dayNumber - GetDayNumber(1, 1, year);
+	state.season = GetSeason(state.dayOfYear, daysInYear);
+
+	state.dayLength = GetDayLength(state.dayOfYear, daysInYear, latitude);
+	state.sunrise = 12.0f - state.dayLength * 0.5f;
+	state.sunset = 12.0f + state.dayLength * 0.5f;
+
+	//Weather comes in spells of a few days, and cloud cover blends between the spell's and the next one's
+	int32 spell = dayNumber >= 0 ? dayNumber / SpellLength : (dayNumber - SpellLength + 1) / SpellLength;
+	float spellAlpha = (float)(dayNumber - spell * SpellLength) / SpellLength;
+	state.weather = GetSpellWeather(seed, spell, state.season);
+
+	static const float WeatherCloudCover[] = { 0.1f, 0.6f, 0.85f, 1.0f, 0.9f };
+	float cloudCover = WeatherCloudCover[(int32)state.weather];
+	float nextCloudCover = WeatherCloudCover[(int32)GetSpellWeather(seed, spell + 1, state.season)];
+	state.cloudCover = FMath::Clamp(FMath::Lerp(cloudCover, nextCloudCover, spellAlpha * spellAlpha) + (HashFraction(seed ^ 0x5bd1e995, dayNumber) - 0.5f) * 0.2f, 0.0f, 1.0f);
+
+	//Temperature follows the sun a month behind, cooled by cloud and varied a little each day
+	float seasonal = -FMath::Cos(2.0f * PI * (state.dayOfYear - 20) / daysInYear);
+	state.temperature = MeanTemperature + TemperatureSwing * seasonal - state.cloudCover * 3.0f + (HashFraction(seed ^ 0x27d4eb2f, dayNumber) - 0.5f) * 6.0f;
+	if (state.weather == EWeatherType::Rain && state.temperature < 1.0f)
+	{
+		state.weather = EWeatherType::Snow;
+	}
+	return state;
+}
+
+uint32 FEnvironmentModel::Hash(int32 seed, int32 index)
+{
+	//Murmur3 finaliser over both values
+	uint32 hash = (uint32)seed * 0x9E3779B1u ^ (uint32)index;
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35u;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+float FEnvironmentModel::HashFraction(int32 seed, int32 index)
+{
+	return (Hash(seed, index) >> 8) * (1.0f / 16777216.0f);
+}
+
+EWeatherType FEnvironmentModel::GetSpellWeather(int32 seed, int32 spell, ESeason season)
+{
+	const float* odds = WeatherOdds[(int32)season];
+	float roll = HashFraction(seed, spell);
+	if (roll < odds[0])
+	{
+		return EWeatherType::Clear;
+	}
+	if (roll < odds[1])
+	{
+		return EWeatherType::Cloudy;
+	}
+	if (roll < odds[2])
+	{
+		return season == ESeason::Winter ? EWeatherType::Snow : EWeatherType::Rain;
+	}
+	return EWeatherType::Storm;
+}
@@ -0,0 +1,90 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "EnvironmentModel.generated.h"
+
+UENUM(BlueprintType)
+enum class ESeason : uint8
+{
+	Spring,
+	Summer,
+	Autumn,
+	Winter
+};
+
+UENUM(BlueprintType)
+enum class EWeatherType : uint8
+{
+	Clear,
+	Cloudy,
+	Rain,
+	Storm,
+	Snow
+};
+
+//Season, daylight and weather for a date
+USTRUCT(BlueprintType)
+struct SPACERPG_API FEnvironmentState
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = Environment)
+	ESeason season = ESeason::Spring;
+
+	//Day of the year, starting at 0 on the 1st of January
+	UPROPERTY(BlueprintReadOnly, Category = Environment)
+	int32 dayOfYear = 0;
+
+	//Hours of daylight, and the hours the sun rises and sets at
+	UPROPERTY(BlueprintReadOnly, Category = Environment)
+	float dayLength = 12.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = Environment)
+	float sunrise = 6.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = Environment)
+	float sunset = 18.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = Environment)
+	EWeatherType weather = EWeatherType::Clear;
+
+	//Cloud cover from 0 to 1
+	UPROPERTY(BlueprintReadOnly, Category = Environment)
+	float cloudCover = 0.0f;
+
+	//Average temperature of the day in degrees Celsius
+	UPROPERTY(BlueprintReadOnly, Category = Environment)
+	float temperature = 10.0f;
+};
+
+//Derives the environment as a pure function of the date, so any day is evaluated in constant time without
+//simulating the days before it, and clients compute the same weather as the server from the seed alone
+class SPACERPG_API FEnvironmentModel
+{
+public:
+	//Days since the 1st of January of year 1 in the Gregorian calendar, matching the calendar's leap years
+	static int32 GetDayNumber(int32 day, int32 month, int32 year);
+
+	static ESeason GetSeason(int32 dayOfYear, int32 daysInYear);
+
+	//Hours of daylight at a latitude in degrees, from the solar declination for the day
+	static float GetDayLength(int32 dayOfYear, int32 daysInYear, float latitude);
+
+	//Evaluates everything for a date
+	static FEnvironmentState Evaluate(int32 day, int32 month, int32 year, int32 seed, float latitude);
+
+private:
+	//Days a spell of weather lasts
+	static constexpr int32 SpellLength = 3;
+
+	//Well mixed hash of a seed and index, the same on every platform
+	static uint32 Hash(int32 seed, int32 index);
+
+	//Hash mapped to [0, 1)
+	static float HashFraction(int32 seed, int32 index);
+
+	//Picks the weather of a spell from the season's odds
+	static EWeatherType GetSpellWeather(int32 seed, int32 spell, ESeason season);
+};
@@ -0,0 +1,192 @@
+// Copyright SpaceRPG 2020
+
+#include "LoadTestBotComponent.h"
+#include "BuildingCommandLog.h"
+#include "BuildingPalette.h"
+#include "BuildingPreview.h"
+#include "BuildingPreviewPool.h"
+#include "BuildingStreamingSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "Net/UnrealNetwork.h"
+
+ULoadTestBotComponent::ULoadTestBotComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+	SetIsReplicatedByDefault(true);
+}
+
+void ULoadTestBotComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ULoadTestBotComponent, behaviour);
+	DOREPLIFETIME(ULoadTestBotComponent, seed);
+}
+
+void ULoadTestBotComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	//The bot only drives the player on the client that owns it, the server just serves its requests
+	APlayerController* controller = Cast<APlayerController>(GetOwner());
+	if (controller != nullptr && controller->IsLocalController() && GetNetMode() == NM_Client)
+	{
+		random.Initialize(seed);
+		walkYaw = random.FRandRange(0.0f, 360.0f);
+		SetComponentTickEnabled(true);
+	}
+}
+
+void ULoadTestBotComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	EndBuilding();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ULoadTestBotComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	APlayerController* controller = Cast<APlayerController>(GetOwner());
+	APawn* pawn = controller ? controller->GetPawn() : nullptr;
+	if (pawn == nullptr)
+	{
+		return;
+	}
+
+	if (!bHasStart)
+	{
+		startLocation = pawn->GetActorLocation();
+		bHasStart = true;
+	}
+
+	phaseTime += DeltaTime;
+	switch (phase)
+	{
+	case EBotPhase::Walking:
+		TickWalking(controller, pawn, DeltaTime);
+		if (phaseTime >= walkSeconds && behaviour == ELoadTestBotBehaviour::Builder)
+		{
+			BeginBuilding(pawn);
+		}
+		break;
+	case EBotPhase::Building:
+		TickBuilding(controller, pawn, DeltaTime);
+		if (phaseTime >= buildSeconds)
+		{
+			EndBuilding();
+		}
+		break;
+	}
+}
+
+void ULoadTestBotComponent::TickWalking(APlayerController* controller, APawn* pawn, float deltaTime)
+{
+	timeSinceTurn += deltaTime;
+	if (timeSinceTurn >= turnInterval)
+	{
+		timeSinceTurn = 0.0f;
+
+		//Head back towards the start once the bot has wandered too far, so bots stay around the city
+		FVector toStart = startLocation - pawn->GetActorLocation();
+		if (toStart.Size2D() > walkRadius)
+		{
+			walkYaw = toStart.Rotation().Yaw + random.FRandRange(-30.0f, 30.0f);
+		}
+		else
+		{
+			walkYaw += random.FRandRange(-90.0f, 90.0f);
+		}
+	}
+
+	//Movement input is predicted on the client and sent to the server like a player's
+	FRotator walkRotation(0.0f, walkYaw, 0.0f);
+	controller->SetControlRotation(walkRotation);
+	pawn->AddMovementInput(walkRotation.Vector(), 1.0f);
+}
+
+void ULoadTestBotComponent::TickBuilding(APlayerController* controller, APawn* pawn, float deltaTime)
+{
+	if (preview == nullptr)
+	{
+		return;
+	}
+
+	//Look down at the city from above the character, sweeping from side to side
+	sweepAngle += sweepDegreesPerSecond * deltaTime;
+	FRotator viewRotation(-35.0f, walkYaw + FMath::Sin(FMath::DegreesToRadians(sweepAngle)) * 60.0f, 0.0f);
+	FVector viewLocation = pawn->GetActorLocation() + FVector(0.0f, 0.0f, 600.0f);
+	controller->SetControlRotation(viewRotation);
+	preview->UpdatePlacement(viewLocation, viewRotation.Vector());
+
+	timeSincePlace += deltaTime;
+	if (timeSincePlace >= placeInterval && preview->IsPlacementValid())
+	{
+		timeSincePlace = 0.0f;
+		ServerPlaceBuilding(buildingType, preview->GetActorLocation(), preview->GetActorRotation().Yaw);
+	}
+}
+
+void ULoadTestBotComponent::BeginBuilding(APawn* pawn)
+{
+	UBuildingPreviewPool* pool = GetWorld()->GetSubsystem<UBuildingPreviewPool>();
+	if (pool == nullptr)
+	{
+		return;
+	}
+
+	UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(this);
+	UBuildingPalette* palette = streaming ? streaming->GetPalette() : nullptr;
+	buildingType = palette && palette->buildingTypes.Num() > 0 ? random.RandRange(0, palette->buildingTypes.Num() - 1) : 0;
+
+	//The preview is driven by the bot rather than following a player camera, so it has no owning player
+	UClass* loadedPreviewClass = previewClass.IsNull() ? nullptr : previewClass.LoadSynchronous();
+	preview = pool->AcquirePreview(loadedPreviewClass ? loadedPreviewClass : ABuildingPreview::StaticClass(), nullptr, buildingType);
+
+	phase = EBotPhase::Building;
+	phaseTime = 0.0f;
+	timeSincePlace = 0.0f;
+	sweepAngle = 0.0f;
+}
+
+void ULoadTestBotComponent::EndBuilding()
+{
+	if (preview != nullptr)
+	{
+		if (UBuildingPreviewPool* pool = GetWorld()->GetSubsystem<UBuildingPreviewPool>())
+		{
+			pool->ReleasePreview(preview);
+		}
+		preview = nullptr;
+	}
+
+	phase = EBotPhase::Walking;
+	phaseTime = 0.0f;
+}
+
+bool ULoadTestBotComponent::ServerPlaceBuilding_Validate(int32 newBuildingType, FVector_NetQuantize location, float yaw)
+{
+	return newBuildingType >= 0 && newBuildingType < FBuildingCommandRecord::UntypedBuilding
+		&& FMath::IsFinite(yaw) && !location.ContainsNaN() && location.GetAbsMax() < HALF_WORLD_MAX;
+}
+
+void ULoadTestBotComponent::ServerPlaceBuilding_Implementation(int32 newBuildingType, FVector_NetQuantize location, float yaw)
+{
+	//Bots place at most once per placeInterval, anything faster is dropped
+	float now = GetWorld()->GetTimeSeconds();
+	if (numPlaced > 0 && now - lastServerPlaceTime < placeInterval * 0.5f)
+	{
+		return;
+	}
+	lastServerPlaceTime = now;
+
+	UBuildingCommandLog* commandLog = GetWorld()->GetSubsystem<UBuildingCommandLog>();
+	if (commandLog != nullptr && commandLog->PlaceBuilding(newBuildingType, location, yaw))
+	{
+		numPlaced++;
+	}
+}
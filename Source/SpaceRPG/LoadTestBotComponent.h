@@ -0,0 +1,107 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "LoadTestBotComponent.generated.h"
+
+//Scripted behaviours a load test bot can follow
+UENUM()
+enum class ELoadTestBotBehaviour : uint8
+{
+	//Only walks the character around
+	Walker,
+	//Walks, then opens a build preview, sweeps it across the city and places pieces, over and over
+	Builder
+};
+
+//Added by a server running a load test with -LoadTestReport to the controllers of clients that join with ?LoadTestBot, never in
+//shipping builds. Drives the player on the owning client through the same input, preview and placement paths a real player uses
+UCLASS(Config = Game)
+class SPACERPG_API ULoadTestBotComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	ULoadTestBotComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	//Set by the server before the component replicates
+	UPROPERTY(Replicated)
+	ELoadTestBotBehaviour behaviour = ELoadTestBotBehaviour::Builder;
+
+	UPROPERTY(Replicated)
+	int32 seed = 0;
+
+	//Number of pieces the server has placed for this bot
+	FORCEINLINE int32 GetNumPlaced() const { return numPlaced; }
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	//Seconds spent walking and building in each cycle
+	UPROPERTY(Config)
+	float walkSeconds = 10.0f;
+
+	UPROPERTY(Config)
+	float buildSeconds = 10.0f;
+
+	//Seconds between picking a new walking direction
+	UPROPERTY(Config)
+	float turnInterval = 2.0f;
+
+	//Distance from the start the bot wanders before heading back
+	UPROPERTY(Config)
+	float walkRadius = 3000.0f;
+
+	//Seconds between placement attempts while building
+	UPROPERTY(Config)
+	float placeInterval = 1.0f;
+
+	//Speed the preview view sweeps across the city
+	UPROPERTY(Config)
+	float sweepDegreesPerSecond = 45.0f;
+
+	//Preview spawned while building, the native preview is used if unset
+	UPROPERTY(Config)
+	TSoftClassPtr<class ABuildingPreview> previewClass;
+
+	UPROPERTY()
+	class ABuildingPreview* preview;
+
+	enum class EBotPhase : uint8
+	{
+		Walking,
+		Building
+	};
+
+	FRandomStream random;
+	EBotPhase phase = EBotPhase::Walking;
+	float phaseTime = 0.0f;
+	float timeSinceTurn = 0.0f;
+	float timeSincePlace = 0.0f;
+	float walkYaw = 0.0f;
+	float sweepAngle = 0.0f;
+	int32 buildingType = 0;
+	FVector startLocation = FVector::ZeroVector;
+	bool bHasStart = false;
+	int32 numPlaced = 0;
+
+	//Server time of the last placement the server accepted
+	float lastServerPlaceTime = 0.0f;
+
+	void TickWalking(class APlayerController* controller, class APawn* pawn, float deltaTime);
+	void TickBuilding(class APlayerController* controller, class APawn* pawn, float deltaTime);
+
+	void BeginBuilding(class APawn* pawn);
+	void EndBuilding();
+
+	//Placement goes through the server's command log, exactly as a player's would
+	UFUNCTION(Server, Reliable, WithValidation)
+	void ServerPlaceBuilding(int32 newBuildingType, FVector_NetQuantize location, float yaw);
+};
@@ -0,0 +1,225 @@
+// Copyright SpaceRPG 2020
+
+#include "LoadTestMetricsSubsystem.h"
+#include "BuildingRegistry.h"
+#include "LoadTestBotComponent.h"
+#include "Engine/Channel.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/NetworkObjectList.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/FileHelper.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+void ULoadTestMetricsSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	Collection.InitializeDependency(UBuildingRegistry::StaticClass());
+
+	if (!GetWorld()->IsGameWorld() || !FParse::Value(FCommandLine::Get(), TEXT("LoadTestReport="), reportPath))
+	{
+		return;
+	}
+	FParse::Value(FCommandLine::Get(), TEXT("LoadTestDuration="), duration);
+
+	tickStartHandle = FWorldDelegates::OnWorldTickStart.AddUObject(this, &ULoadTestMetricsSubsystem::OnWorldTickStart);
+	endFrameHandle = FCoreDelegates::OnEndFrame.AddUObject(this, &ULoadTestMetricsSubsystem::OnEndFrame);
+}
+
+void ULoadTestMetricsSubsystem::Deinitialize()
+{
+	if (IsCollecting() && !bReportWritten)
+	{
+		WriteReport();
+	}
+
+	FWorldDelegates::OnWorldTickStart.Remove(tickStartHandle);
+	FCoreDelegates::OnEndFrame.Remove(endFrameHandle);
+
+	Super::Deinitialize();
+}
+
+void ULoadTestMetricsSubsystem::Tick(float DeltaTime)
+{
+	//Only the server sees every connection
+	ENetMode netMode = GetWorld()->GetNetMode();
+	if (!IsCollecting() || !bBotJoined || bReportWritten || netMode == NM_Client || netMode == NM_Standalone)
+	{
+		return;
+	}
+
+	elapsed += DeltaTime;
+	timeSinceSample += DeltaTime;
+	if (timeSinceSample >= 1.0f)
+	{
+		timeSinceSample = 0.0f;
+		SampleConnections();
+	}
+
+	if (duration > 0.0f && elapsed >= duration)
+	{
+		bReportWritten = WriteReport();
+		FPlatformMisc::RequestExit(false);
+	}
+}
+
+ETickableTickType ULoadTestMetricsSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId ULoadTestMetricsSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(ULoadTestMetricsSubsystem, STATGROUP_Tickables);
+}
+
+void ULoadTestMetricsSubsystem::OnBotJoined()
+{
+	if (IsCollecting() && !bBotJoined)
+	{
+		UE_LOG(LogTemp, Log, TEXT("LoadTestMetricsSubsystem::First bot joined, measuring for %.0f seconds."), duration)
+		bBotJoined = true;
+	}
+}
+
+void ULoadTestMetricsSubsystem::OnWorldTickStart(UWorld* world, ELevelTick tickType, float deltaSeconds)
+{
+	if (world == GetWorld() && bBotJoined)
+	{
+		tickStartTime = FPlatformTime::Seconds();
+	}
+}
+
+void ULoadTestMetricsSubsystem::OnEndFrame()
+{
+	//The frame ends after replication has been sent, but before the server sleeps until its next tick
+	if (tickStartTime > 0.0 && !bReportWritten)
+	{
+		tickTimes.Add((float)((FPlatformTime::Seconds() - tickStartTime) * 1000.0));
+		tickStartTime = 0.0;
+	}
+}
+
+void ULoadTestMetricsSubsystem::SampleConnections()
+{
+	UNetDriver* netDriver = GetWorld()->GetNetDriver();
+	if (netDriver == nullptr)
+	{
+		return;
+	}
+
+	int32 numConnections = 0;
+	for (UNetConnection* connection : netDriver->ClientConnections)
+	{
+		if (connection == nullptr || connection->State == USOCK_Closed)
+		{
+			continue;
+		}
+		numConnections++;
+
+		//Reliable bunches sent but not yet acknowledged, summed over the connection's channels
+		int32 reliableQueue = 0;
+		for (UChannel* channel : connection->OpenChannels)
+		{
+			reliableQueue += channel ? channel->NumOutRec : 0;
+		}
+
+		FLoadTestConnectionStats& stats = connections.FindOrAdd(connection->LowLevelGetRemoteAddress(true));
+		stats.numSamples++;
+		stats.totalOutBytesPerSecond += connection->OutBytesPerSecond;
+		stats.totalInBytesPerSecond += connection->InBytesPerSecond;
+		stats.totalQueuedBits += connection->QueuedBits;
+		stats.totalReliableQueue += reliableQueue;
+		stats.totalPing += connection->AvgLag * 1000.0;
+		stats.peakOutBytesPerSecond = FMath::Max(stats.peakOutBytesPerSecond, connection->OutBytesPerSecond);
+		stats.peakInBytesPerSecond = FMath::Max(stats.peakInBytesPerSecond, connection->InBytesPerSecond);
+		stats.peakQueuedBits = FMath::Max(stats.peakQueuedBits, connection->QueuedBits);
+		stats.peakReliableQueue = FMath::Max(stats.peakReliableQueue, reliableQueue);
+	}
+
+	peakConnections = FMath::Max(peakConnections, numConnections);
+	peakNetworkObjects = FMath::Max(peakNetworkObjects, netDriver->GetNetworkObjectList().GetActiveObjects().Num());
+}
+
+bool ULoadTestMetricsSubsystem::WriteReport() const
+{
+	TSharedRef<FJsonObject> report = MakeShared<FJsonObject>();
+	report->SetNumberField(TEXT("seconds"), elapsed);
+	report->SetNumberField(TEXT("ticks"), tickTimes.Num());
+	report->SetNumberField(TEXT("peakConnections"), peakConnections);
+	report->SetNumberField(TEXT("peakNetworkObjects"), peakNetworkObjects);
+
+	//Tick time distribution
+	TArray<float> sortedTicks = tickTimes;
+	sortedTicks.Sort();
+	auto percentile = [&sortedTicks](float fraction)
+	{
+		return sortedTicks.Num() > 0 ? sortedTicks[FMath::Min((int32)(fraction * sortedTicks.Num()), sortedTicks.Num() - 1)] : 0.0f;
+	};
+	double totalTickMs = 0.0;
+	for (float tickMs : sortedTicks)
+	{
+		totalTickMs += tickMs;
+	}
+	report->SetNumberField(TEXT("tickAverageMs"), sortedTicks.Num() > 0 ? totalTickMs / sortedTicks.Num() : 0.0);
+	report->SetNumberField(TEXT("tickP50Ms"), percentile(0.5f));
+	report->SetNumberField(TEXT("tickP95Ms"), percentile(0.95f));
+	report->SetNumberField(TEXT("tickP99Ms"), percentile(0.99f));
+	report->SetNumberField(TEXT("tickMaxMs"), sortedTicks.Num() > 0 ? sortedTicks.Last() : 0.0f);
+
+	//What the bots did to the city
+	int32 numBots = 0;
+	int32 numPlaced = 0;
+	for (FConstPlayerControllerIterator it = GetWorld()->GetPlayerControllerIterator(); it; ++it)
+	{
+		ULoadTestBotComponent* bot = it->IsValid() ? (*it)->FindComponentByClass<ULoadTestBotComponent>() : nullptr;
+		if (bot != nullptr)
+		{
+			numBots++;
+			numPlaced += bot->GetNumPlaced();
+		}
+	}
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	report->SetNumberField(TEXT("bots"), numBots);
+	report->SetNumberField(TEXT("placements"), numPlaced);
+	report->SetNumberField(TEXT("buildings"), registry ? registry->GetNumBuildings() : 0);
+
+	TArray<TSharedPtr<FJsonValue>> connectionValues;
+	for (const auto& pair : connections)
+	{
+		const FLoadTestConnectionStats& stats = pair.Value;
+		double numSamples = FMath::Max(stats.numSamples, 1);
+
+		TSharedRef<FJsonObject> connectionObject = MakeShared<FJsonObject>();
+		connectionObject->SetStringField(TEXT("address"), pair.Key);
+		connectionObject->SetNumberField(TEXT("samples"), stats.numSamples);
+		connectionObject->SetNumberField(TEXT("outBytesPerSecond"), stats.totalOutBytesPerSecond / numSamples);
+		connectionObject->SetNumberField(TEXT("peakOutBytesPerSecond"), stats.peakOutBytesPerSecond);
+		connectionObject->SetNumberField(TEXT("inBytesPerSecond"), stats.totalInBytesPerSecond / numSamples);
+		connectionObject->SetNumberField(TEXT("peakInBytesPerSecond"), stats.peakInBytesPerSecond);
+		connectionObject->SetNumberField(TEXT("queuedBits"), stats.totalQueuedBits / numSamples);
+		connectionObject->SetNumberField(TEXT("peakQueuedBits"), stats.peakQueuedBits);
+		connectionObject->SetNumberField(TEXT("reliableQueue"), stats.totalReliableQueue / numSamples);
+		connectionObject->SetNumberField(TEXT("peakReliableQueue"), stats.peakReliableQueue);
+		connectionObject->SetNumberField(TEXT("pingMs"), stats.totalPing / numSamples);
+		connectionValues.Add(MakeShared<FJsonValueObject>(connectionObject));
+	}
+	report->SetArrayField(TEXT("connections"), connectionValues);
+
+	FString reportString;
+	TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&reportString);
+	FJsonSerializer::Serialize(report, writer);
+	if (!FFileHelper::SaveStringToFile(reportString, *reportPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("LoadTestMetricsSubsystem::Could not write report to %s."), *reportPath)
+		return false;
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("LoadTestMetricsSubsystem::Report of %d ticks and %d connections written to %s."), tickTimes.Num(), connections.Num(), *reportPath)
+	return true;
+}
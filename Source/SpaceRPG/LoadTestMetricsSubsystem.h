@@ -0,0 +1,80 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "LoadTestMetricsSubsystem.generated.h"
+
+//Samples of one client connection over a load test
+struct FLoadTestConnectionStats
+{
+	int32 numSamples = 0;
+
+	double totalOutBytesPerSecond = 0.0;
+	double totalInBytesPerSecond = 0.0;
+	double totalQueuedBits = 0.0;
+	double totalReliableQueue = 0.0;
+	double totalPing = 0.0;
+
+	int32 peakOutBytesPerSecond = 0;
+	int32 peakInBytesPerSecond = 0;
+	int32 peakQueuedBits = 0;
+	int32 peakReliableQueue = 0;
+};
+
+//Collects server tick times and per connection bandwidth and replication queues while the server runs a load test,
+//enabled with -LoadTestReport=<path> and writing the report -LoadTestDuration= seconds after the first bot joins or on shutdown
+UCLASS()
+class SPACERPG_API ULoadTestMetricsSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	FORCEINLINE bool IsCollecting() const { return !reportPath.IsEmpty(); }
+
+	//Starts the measurement when the first load test bot joins, so server startup and map loading are left out
+	void OnBotJoined();
+
+	//Writes the report of everything collected so far
+	bool WriteReport() const;
+
+private:
+	FString reportPath;
+
+	//Seconds to run before writing the report and shutting down, 0 runs until the server exits
+	float duration = 0.0f;
+
+	float elapsed = 0.0f;
+	float timeSinceSample = 0.0f;
+	bool bBotJoined = false;
+	bool bReportWritten = false;
+
+	//Milliseconds of game thread work in each server tick, from world tick start to the end of the frame
+	TArray<float> tickTimes;
+	double tickStartTime = 0.0;
+
+	//Connections by remote address, kept after they close
+	TMap<FString, FLoadTestConnectionStats> connections;
+	int32 peakConnections = 0;
+	int32 peakNetworkObjects = 0;
+
+	FDelegateHandle tickStartHandle;
+	FDelegateHandle endFrameHandle;
+
+	void OnWorldTickStart(UWorld* world, ELevelTick tickType, float deltaSeconds);
+	void OnEndFrame();
+
+	//Samples every connection of the net driver, called once per second to match the connections' stat period
+	void SampleConnections();
+};
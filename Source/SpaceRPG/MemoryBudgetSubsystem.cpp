@@ -0,0 +1,273 @@
+// Copyright SpaceRPG 2020
+
+#include "MemoryBudgetSubsystem.h"
+#include "SpaceRPG.h"
+#include "Building.h"
+#include "BuildingCollisionSubsystem.h"
+#include "BuildingPreview.h"
+#include "BuildingRegistry.h"
+#include "BuildingSupportSubsystem.h"
+#include "EconomySubsystem.h"
+#include "TimeController.h"
+#include "UtilityNetworkSubsystem.h"
+#include "WorldSnapshotSubsystem.h"
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_MEMORY_STAT(TEXT("Buildings Memory"), STAT_SpaceRPGBuildingsMemory, STATGROUP_SpaceRPG);
+DECLARE_MEMORY_STAT(TEXT("Previews Memory"), STAT_SpaceRPGPreviewsMemory, STATGROUP_SpaceRPG);
+DECLARE_MEMORY_STAT(TEXT("Time Memory"), STAT_SpaceRPGTimeMemory, STATGROUP_SpaceRPG);
+DECLARE_MEMORY_STAT(TEXT("Simulation Memory"), STAT_SpaceRPGSimulationMemory, STATGROUP_SpaceRPG);
+DECLARE_MEMORY_STAT(TEXT("Economy Memory"), STAT_SpaceRPGEconomyMemory, STATGROUP_SpaceRPG);
+DECLARE_MEMORY_STAT(TEXT("Collision Memory"), STAT_SpaceRPGCollisionMemory, STATGROUP_SpaceRPG);
+DECLARE_MEMORY_STAT(TEXT("CityData Memory"), STAT_SpaceRPGCityDataMemory, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Memory Bytes Per Building"), STAT_SpaceRPGBytesPerBuilding, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Memory Budgets Exceeded"), STAT_SpaceRPGBudgetsExceeded, STATGROUP_SpaceRPG);
+
+//Buildings sampled when estimating the memory of every building
+static constexpr int32 BuildingSampleCount = 64;
+
+//Estimated memory of an actor and its components, their objects and whatever they report as their own resources
+static int64 EstimateActorBytes(const AActor* actor)
+{
+	int64 bytes = actor->GetClass()->GetStructureSize() + actor->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+	for (UActorComponent* component : actor->GetComponents())
+	{
+		if (component != nullptr)
+		{
+			bytes += component->GetClass()->GetStructureSize() + component->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+		}
+	}
+	return bytes;
+}
+
+void UMemoryBudgetSubsystem::Tick(float DeltaTime)
+{
+	timeSinceCheck += DeltaTime;
+	timeSinceLog += DeltaTime;
+
+	bool bCheck = checkInterval > 0.0f && timeSinceCheck >= checkInterval;
+	bool bLog = logInterval > 0.0f && timeSinceLog >= logInterval;
+	if (!bCheck && !bLog)
+	{
+		return;
+	}
+
+	TArray<int64> tagBytes;
+	GatherTagBytes(tagBytes);
+
+	if (bCheck)
+	{
+		timeSinceCheck = 0.0f;
+		CheckBudgets(tagBytes);
+	}
+	if (bLog)
+	{
+		timeSinceLog = 0.0f;
+		LogPerThousandBuildings(tagBytes);
+	}
+}
+
+ETickableTickType UMemoryBudgetSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UMemoryBudgetSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UMemoryBudgetSubsystem, STATGROUP_Tickables);
+}
+
+bool UMemoryBudgetSubsystem::GatherTagBytes(TArray<int64>& outBytes) const
+{
+	outBytes.Init(0, NumSpaceRPGMemoryTags);
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	if (FLowLevelMemTracker::IsEnabled())
+	{
+		for (int32 i = 0; i < NumSpaceRPGMemoryTags; i++)
+		{
+			outBytes[i] = FLowLevelMemTracker::Get().GetTagAmountForTracker(ELLMTracker::Default, ToLLMTag((ESpaceRPGMemoryTag)i));
+		}
+		return true;
+	}
+#endif
+
+	UWorld* world = GetWorld();
+
+	//Buildings are alike, so a sample of them is scaled up rather than walking every component of a large city
+	if (UBuildingRegistry* registry = world->GetSubsystem<UBuildingRegistry>())
+	{
+		int64 sampleBytes = 0;
+		int32 numSampled = 0;
+		for (const auto& pair : registry->GetBuildings())
+		{
+			if (pair.Value != nullptr)
+			{
+				sampleBytes += EstimateActorBytes(pair.Value);
+				if (++numSampled == BuildingSampleCount)
+				{
+					break;
+				}
+			}
+		}
+
+		int64& bytes = outBytes[(int32)ESpaceRPGMemoryTag::Buildings];
+		bytes = registry->GetBuildings().GetAllocatedSize();
+		if (numSampled > 0)
+		{
+			bytes += sampleBytes * registry->GetNumBuildings() / numSampled;
+		}
+	}
+
+	for (TActorIterator<ABuildingPreview> it(world); it; ++it)
+	{
+		outBytes[(int32)ESpaceRPGMemoryTag::Previews] += EstimateActorBytes(*it);
+	}
+
+	for (TActorIterator<ATimeController> it(world); it; ++it)
+	{
+		outBytes[(int32)ESpaceRPGMemoryTag::Time] += EstimateActorBytes(*it)
+			+ it->gameTime.GetAllocatedSize() + it->gameDate.GetAllocatedSize() + it->net_GameDate.GetAllocatedSize();
+	}
+
+	if (UUtilityNetworkSubsystem* utilityNetworks = world->GetSubsystem<UUtilityNetworkSubsystem>())
+	{
+		outBytes[(int32)ESpaceRPGMemoryTag::Simulation] += utilityNetworks->GetAllocatedSize();
+	}
+	if (UBuildingSupportSubsystem* support = world->GetSubsystem<UBuildingSupportSubsystem>())
+	{
+		outBytes[(int32)ESpaceRPGMemoryTag::Simulation] += support->GetAllocatedSize();
+	}
+	if (UWorldSnapshotSubsystem* snapshots = world->GetSubsystem<UWorldSnapshotSubsystem>())
+	{
+		outBytes[(int32)ESpaceRPGMemoryTag::Simulation] += snapshots->GetAllocatedSize();
+	}
+
+	if (UEconomySubsystem* economy = world->GetSubsystem<UEconomySubsystem>())
+	{
+		outBytes[(int32)ESpaceRPGMemoryTag::Economy] = economy->GetStore().GetAllocatedSize();
+	}
+
+	if (UBuildingCollisionSubsystem* collision = world->GetSubsystem<UBuildingCollisionSubsystem>())
+	{
+		outBytes[(int32)ESpaceRPGMemoryTag::Collision] = collision->GetAllocatedSize();
+	}
+
+	//City data is transient and only measured by the low level memory tracker
+	return false;
+}
+
+int64 UMemoryBudgetSubsystem::GetBudgetBytes(ESpaceRPGMemoryTag tag) const
+{
+	FName tagName(GetSpaceRPGMemoryTagName(tag));
+	const FSpaceRPGMemoryBudget* budget = budgets.FindByPredicate([tagName](const FSpaceRPGMemoryBudget& candidate)
+	{
+		return candidate.tag == tagName;
+	});
+	return budget ? (int64)(budget->budgetMB * 1024.0 * 1024.0) : 0;
+}
+
+int32 UMemoryBudgetSubsystem::GetNumBuildings() const
+{
+	UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>();
+	return registry ? registry->GetNumBuildings() : 0;
+}
+
+void UMemoryBudgetSubsystem::CheckBudgets(const TArray<int64>& tagBytes)
+{
+#if STATS
+	const FName statNames[NumSpaceRPGMemoryTags] =
+	{
+		GET_STATFNAME(STAT_SpaceRPGBuildingsMemory),
+		GET_STATFNAME(STAT_SpaceRPGPreviewsMemory),
+		GET_STATFNAME(STAT_SpaceRPGTimeMemory),
+		GET_STATFNAME(STAT_SpaceRPGSimulationMemory),
+		GET_STATFNAME(STAT_SpaceRPGEconomyMemory),
+		GET_STATFNAME(STAT_SpaceRPGCollisionMemory),
+		GET_STATFNAME(STAT_SpaceRPGCityDataMemory)
+	};
+	for (int32 i = 0; i < NumSpaceRPGMemoryTags; i++)
+	{
+		SET_MEMORY_STAT_FName(statNames[i], tagBytes[i]);
+	}
+#endif
+
+	int32 numBuildings = GetNumBuildings();
+	SET_DWORD_STAT(STAT_SpaceRPGBytesPerBuilding, numBuildings > 0 ? tagBytes[(int32)ESpaceRPGMemoryTag::Buildings] / numBuildings : 0);
+
+	if (overBudget.Num() != NumSpaceRPGMemoryTags)
+	{
+		overBudget.Init(false, NumSpaceRPGMemoryTags);
+	}
+
+	numOverBudget = 0;
+	for (int32 i = 0; i < NumSpaceRPGMemoryTags; i++)
+	{
+		ESpaceRPGMemoryTag tag = (ESpaceRPGMemoryTag)i;
+		int64 budgetBytes = GetBudgetBytes(tag);
+		bool bOver = budgetBytes > 0 && tagBytes[i] > budgetBytes;
+		numOverBudget += bOver ? 1 : 0;
+
+		//Budgets are soft, crossing one only warns
+		if (bOver && !overBudget[i])
+		{
+			UE_LOG(LogTemp, Warning, TEXT("MemoryBudgetSubsystem::%s is over budget, %.1f MB of %.1f MB with %d buildings."),
+				GetSpaceRPGMemoryTagName(tag), tagBytes[i] / (1024.0 * 1024.0), budgetBytes / (1024.0 * 1024.0), numBuildings)
+		}
+		else if (!bOver && overBudget[i])
+		{
+			UE_LOG(LogTemp, Log, TEXT("MemoryBudgetSubsystem::%s is back within budget."), GetSpaceRPGMemoryTagName(tag))
+		}
+		overBudget[i] = bOver;
+	}
+	SET_DWORD_STAT(STAT_SpaceRPGBudgetsExceeded, numOverBudget);
+}
+
+void UMemoryBudgetSubsystem::LogPerThousandBuildings(const TArray<int64>& tagBytes) const
+{
+	int32 numBuildings = GetNumBuildings();
+	double thousands = FMath::Max(numBuildings, 1) / 1000.0;
+
+	FString line;
+	for (int32 i = 0; i < NumSpaceRPGMemoryTags; i++)
+	{
+		line += FString::Printf(TEXT(" %s=%.2f"), GetSpaceRPGMemoryTagName((ESpaceRPGMemoryTag)i), tagBytes[i] / (1024.0 * 1024.0) / thousands);
+	}
+	UE_LOG(LogTemp, Log, TEXT("MemoryBudgetSubsystem::MB per 1000 buildings with %d buildings:%s"), numBuildings, *line)
+}
+
+void UMemoryBudgetSubsystem::DumpMemory() const
+{
+	TArray<int64> tagBytes;
+	bool bFromLLM = GatherTagBytes(tagBytes);
+	int32 numBuildings = GetNumBuildings();
+
+	UE_LOG(LogTemp, Display, TEXT("MemoryBudgetSubsystem::Memory of %d buildings, %s:"), numBuildings, bFromLLM ? TEXT("from the low level memory tracker") : TEXT("estimated, run with -llm for tracked totals"))
+
+	int64 totalBytes = 0;
+	for (int32 i = 0; i < NumSpaceRPGMemoryTags; i++)
+	{
+		ESpaceRPGMemoryTag tag = (ESpaceRPGMemoryTag)i;
+		int64 budgetBytes = GetBudgetBytes(tag);
+		totalBytes += tagBytes[i];
+
+		UE_LOG(LogTemp, Display, TEXT("  %-10s %10.2f MB %10lld bytes per building %s"),
+			GetSpaceRPGMemoryTagName(tag), tagBytes[i] / (1024.0 * 1024.0), numBuildings > 0 ? tagBytes[i] / numBuildings : 0,
+			budgetBytes > 0 ? *FString::Printf(TEXT("budget %.1f MB%s"), budgetBytes / (1024.0 * 1024.0), tagBytes[i] > budgetBytes ? TEXT(" OVER") : TEXT("")) : TEXT(""))
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("  %-10s %10.2f MB %10lld bytes per building"), TEXT("Total"), totalBytes / (1024.0 * 1024.0), numBuildings > 0 ? totalBytes / numBuildings : 0)
+}
+
+static FAutoConsoleCommandWithWorld DumpMemoryCommand(
+	TEXT("SpaceRPG.DumpMemory"),
+	TEXT("Logs the memory of each SpaceRPG memory tag, in total and per building"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+	{
+		if (UMemoryBudgetSubsystem* memoryBudget = world ? world->GetSubsystem<UMemoryBudgetSubsystem>() : nullptr)
+		{
+			memoryBudget->DumpMemory();
+		}
+	}));
@@ -0,0 +1,76 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "SpaceRPGMemory.h"
+#include "MemoryBudgetSubsystem.generated.h"
+
+//Soft limit on the memory of one of the module's memory tags
+USTRUCT()
+struct FSpaceRPGMemoryBudget
+{
+	GENERATED_BODY()
+
+	//Tag name as listed by SpaceRPG.DumpMemory
+	UPROPERTY()
+	FName tag;
+
+	UPROPERTY()
+	float budgetMB = 0.0f;
+};
+
+//Measures the memory of the module's memory tags, warns when a tag goes over its budget and dumps the totals on request.
+//Tags are read from the low level memory tracker when it runs (-llm), otherwise they are estimated from the module's
+//own objects and containers so headless servers can still be tracked. Budgets are set in DefaultGame.ini:
+//+budgets=(tag=Buildings,budgetMB=512)
+UCLASS(Config = Game)
+class SPACERPG_API UMemoryBudgetSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	//Bytes held by each tag, returns whether they came from the low level memory tracker rather than estimates
+	bool GatherTagBytes(TArray<int64>& outBytes) const;
+
+	//Logs the bytes of every tag, in total and per building
+	void DumpMemory() const;
+
+	//Number of tags currently over budget
+	FORCEINLINE int32 GetNumOverBudget() const { return numOverBudget; }
+
+private:
+	UPROPERTY(Config)
+	TArray<FSpaceRPGMemoryBudget> budgets;
+
+	//Seconds between budget checks
+	UPROPERTY(Config)
+	float checkInterval = 5.0f;
+
+	//Seconds between logging memory per 1,000 buildings for tracking over time, 0 disables it
+	UPROPERTY(Config)
+	float logInterval = 0.0f;
+
+	float timeSinceCheck = 0.0f;
+	float timeSinceLog = 0.0f;
+
+	//Tags that were over budget at the last check, so each crossing is only logged once
+	TBitArray<> overBudget;
+	int32 numOverBudget = 0;
+
+	//Returns the budget of the tag in bytes, or 0 if it has none
+	int64 GetBudgetBytes(ESpaceRPGMemoryTag tag) const;
+
+	int32 GetNumBuildings() const;
+
+	void CheckBudgets(const TArray<int64>& tagBytes);
+	void LogPerThousandBuildings(const TArray<int64>& tagBytes) const;
+};
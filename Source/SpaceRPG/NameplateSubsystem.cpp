@@ -0,0 +1,381 @@
+// Copyright SpaceRPG 2020
+
+#include "NameplateSubsystem.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGCharacter.h"
+#include "NameplateWidget.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/WidgetComponent.h"
+#include "Engine/GameViewportClient.h"
+#include "Engine/LocalPlayer.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "CoreGlobals.h"
+#include "SceneView.h"
+
+DECLARE_CYCLE_STAT(TEXT("Nameplate Selection"), STAT_NameplateSelection, STATGROUP_SpaceRPG);
+DECLARE_CYCLE_STAT(TEXT("Nameplate Placement"), STAT_NameplatePlacement, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Nameplates Visible"), STAT_NameplatesVisible, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Nameplate Candidates"), STAT_NameplateCandidates, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Nameplate Widgets"), STAT_NameplateWidgets, STATGROUP_SpaceRPG);
+
+FNameplateView FNameplateView::Make(const FVector& location, const FRotator& rotation, float fov, const FIntRect& viewRect)
+{
+	//The same view and projection a local player builds, with the engine's axes swapped to the renderer's
+	FMatrix viewMatrix = FTranslationMatrix(-location) * FInverseRotationMatrix(rotation) * FMatrix(
+		FPlane(0.0f, 0.0f, 1.0f, 0.0f),
+		FPlane(1.0f, 0.0f, 0.0f, 0.0f),
+		FPlane(0.0f, 1.0f, 0.0f, 0.0f),
+		FPlane(0.0f, 0.0f, 0.0f, 1.0f));
+	FMatrix projectionMatrix = FReversedZPerspectiveMatrix(FMath::DegreesToRadians(fov * 0.5f), viewRect.Width(), viewRect.Height(), GNearClippingPlane);
+
+	FNameplateView view;
+	view.location = location;
+	view.viewProjection = viewMatrix * projectionMatrix;
+	view.viewRect = viewRect;
+	return view;
+}
+
+void UNameplateSubsystem::Deinitialize()
+{
+	for (UNameplateWidget* widget : widgets)
+	{
+		if (widget != nullptr)
+		{
+			widget->RemoveFromParent();
+		}
+	}
+	widgets.Empty();
+	widgetCharacters.Empty();
+	characters.Empty();
+
+	Super::Deinitialize();
+}
+
+void UNameplateSubsystem::Tick(float DeltaTime)
+{
+	//Servers have nobody to show names to
+	if (!bEnableNameplates || GetWorld()->IsNetMode(NM_DedicatedServer))
+	{
+		return;
+	}
+
+	FNameplateView view;
+	if (GetLocalPlayerView(view))
+	{
+		UpdateNameplates(view, DeltaTime);
+	}
+}
+
+ETickableTickType UNameplateSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UNameplateSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UNameplateSubsystem, STATGROUP_Tickables);
+}
+
+void UNameplateSubsystem::RegisterCharacter(ASpaceRPGCharacter* character)
+{
+	if (character == nullptr)
+	{
+		return;
+	}
+	characters.AddUnique(character);
+
+	//A nameplate widget component on the character would draw a second label, and cost a widget of its own
+	if (bHideCharacterWidgetComponents)
+	{
+		TInlineComponentArray<UWidgetComponent*> widgetComponents(character);
+		for (UWidgetComponent* component : widgetComponents)
+		{
+			UClass* widgetClass = component->GetWidgetClass();
+			if (widgetClass != nullptr && widgetClass->GetName().Contains(TEXT("NamePlate")))
+			{
+				component->SetVisibility(false);
+				component->SetComponentTickEnabled(false);
+			}
+		}
+	}
+}
+
+void UNameplateSubsystem::UnregisterCharacter(ASpaceRPGCharacter* character)
+{
+	characters.RemoveAllSwap([character](const TWeakObjectPtr<ASpaceRPGCharacter>& other) { return !other.IsValid() || other.Get() == character; });
+
+	for (int32 i = 0; i < widgets.Num(); i++)
+	{
+		if (widgetCharacters[i].Get() == character)
+		{
+			ReleaseWidget(i);
+		}
+	}
+}
+
+void UNameplateSubsystem::UpdateNameplates(const FNameplateView& view, float deltaTime)
+{
+	timeSinceSelection += deltaTime;
+	if (timeSinceSelection >= selectionInterval)
+	{
+		timeSinceSelection = 0.0f;
+		SelectCharacters(view);
+	}
+	PlaceNameplates(view);
+
+	SET_DWORD_STAT(STAT_NameplatesVisible, numVisible);
+	SET_DWORD_STAT(STAT_NameplateWidgets, widgets.Num());
+}
+
+void UNameplateSubsystem::SetLimits(int32 inMaxNameplates, float inMaxDistance)
+{
+	maxNameplates = FMath::Max(inMaxNameplates, 0);
+	maxDistance = inMaxDistance;
+	timeSinceSelection = MAX_flt;
+}
+
+void UNameplateSubsystem::SetNameplatesEnabled(bool bEnabled)
+{
+	bEnableNameplates = bEnabled;
+	timeSinceSelection = MAX_flt;
+	if (!bEnableNameplates)
+	{
+		for (int32 i = 0; i < widgets.Num(); i++)
+		{
+			ReleaseWidget(i);
+		}
+		numVisible = 0;
+	}
+}
+
+void UNameplateSubsystem::GetVisibleWidgets(TArray<UNameplateWidget*>& outWidgets) const
+{
+	for (UNameplateWidget* widget : widgets)
+	{
+		if (widget != nullptr && widget->GetVisibility() != ESlateVisibility::Collapsed)
+		{
+			outWidgets.Add(widget);
+		}
+	}
+}
+
+void UNameplateSubsystem::SelectCharacters(const FNameplateView& view)
+{
+	SCOPE_CYCLE_COUNTER(STAT_NameplateSelection);
+
+	const float maxDistanceSquared = FMath::Square(maxDistance);
+	candidates.Reset();
+	for (const TWeakObjectPtr<ASpaceRPGCharacter>& weakCharacter : characters)
+	{
+		//Players don't see a label over their own head
+		ASpaceRPGCharacter* character = weakCharacter.Get();
+		if (character == nullptr || character->IsHidden() || character->IsLocallyControlled())
+		{
+			continue;
+		}
+
+		//Most of a crowd is out of range, which is cheaper to find than whether it is on screen
+		FVector location = GetNameplateLocation(character);
+		float distanceSquared = FVector::DistSquared(location, view.location);
+		FVector2D screenLocation;
+		if (distanceSquared > maxDistanceSquared || !view.Project(location, screenLocation) || character->GetNameplateText().IsEmpty())
+		{
+			continue;
+		}
+		candidates.Add({ character, distanceSquared });
+	}
+	SET_DWORD_STAT(STAT_NameplateCandidates, candidates.Num());
+
+	candidates.Sort([](const FNameplateCandidate& a, const FNameplateCandidate& b) { return a.distanceSquared < b.distanceSquared; });
+	const int32 numSelected = FMath::Min(candidates.Num(), maxNameplates);
+
+	//Characters still among the closest keep their widget, so their text isn't set again
+	for (int32 i = 0; i < widgets.Num(); i++)
+	{
+		ASpaceRPGCharacter* character = widgetCharacters[i].Get();
+		bool bKept = false;
+		for (int32 c = 0; c < numSelected && !bKept; c++)
+		{
+			bKept = character != nullptr && candidates[c].character == character;
+		}
+
+		if (!bKept)
+		{
+			ReleaseWidget(i);
+		}
+	}
+
+	//Newly picked characters take a free widget, the pool only grows while it is smaller than the limit
+	int32 freeIndex = 0;
+	for (int32 c = 0; c < numSelected; c++)
+	{
+		ASpaceRPGCharacter* character = candidates[c].character;
+		if (widgetCharacters.ContainsByPredicate([character](const TWeakObjectPtr<ASpaceRPGCharacter>& other) { return other.Get() == character; }))
+		{
+			continue;
+		}
+
+		while (freeIndex < widgets.Num() && widgetCharacters[freeIndex].IsValid())
+		{
+			freeIndex++;
+		}
+		if (freeIndex == widgets.Num())
+		{
+			UNameplateWidget* widget = CreateNameplateWidget();
+			if (widget == nullptr)
+			{
+				return;
+			}
+			widgets.Add(widget);
+			widgetCharacters.AddDefaulted();
+		}
+
+		widgetCharacters[freeIndex] = character;
+		widgets[freeIndex]->SetNameplateText(character->GetNameplateText());
+		numAssignments++;
+	}
+}
+
+void UNameplateSubsystem::PlaceNameplates(const FNameplateView& view)
+{
+	SCOPE_CYCLE_COUNTER(STAT_NameplatePlacement);
+
+	const float fadeDistance = maxDistance * fadeStart;
+	const float fadeLength = FMath::Max(maxDistance - fadeDistance, 1.0f);
+	numVisible = 0;
+
+	for (int32 i = 0; i < widgets.Num(); i++)
+	{
+		ASpaceRPGCharacter* character = widgetCharacters[i].Get();
+		if (character == nullptr)
+		{
+			ReleaseWidget(i);
+			continue;
+		}
+
+		//A character can leave the screen between picks, its widget waits hidden until the next pick
+		UNameplateWidget* widget = widgets[i];
+		FVector location = GetNameplateLocation(character);
+		FVector2D screenLocation;
+		if (!view.Project(location, screenLocation))
+		{
+			widget->SetVisibility(ESlateVisibility::Collapsed);
+			continue;
+		}
+
+		widget->SetPositionInViewport(screenLocation);
+
+		//Opacity invalidates the widget, so it is only set when it changes enough to see
+		float opacity = 1.0f - FMath::Clamp((FVector::Dist(location, view.location) - fadeDistance) / fadeLength, 0.0f, 1.0f);
+		if (!FMath::IsNearlyEqual(widget->GetRenderOpacity(), opacity, 0.02f))
+		{
+			widget->SetRenderOpacity(opacity);
+		}
+
+		if (widget->GetVisibility() != ESlateVisibility::HitTestInvisible)
+		{
+			widget->SetVisibility(ESlateVisibility::HitTestInvisible);
+		}
+		numVisible++;
+	}
+}
+
+void UNameplateSubsystem::ReleaseWidget(int32 index)
+{
+	widgetCharacters[index].Reset();
+	if (widgets[index] != nullptr && widgets[index]->GetVisibility() != ESlateVisibility::Collapsed)
+	{
+		widgets[index]->SetVisibility(ESlateVisibility::Collapsed);
+	}
+}
+
+UNameplateWidget* UNameplateSubsystem::CreateNameplateWidget()
+{
+	if (loadedClass == nullptr)
+	{
+		loadedClass = nameplateClass.LoadSynchronous();
+		if (loadedClass == nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("NameplateSubsystem::Could not load %s as a nameplate widget, using plain text nameplates."), *nameplateClass.ToString())
+			loadedClass = UNameplateWidget::StaticClass();
+		}
+	}
+
+	UNameplateWidget* widget = CreateWidget<UNameplateWidget>(GetWorld(), loadedClass);
+	if (widget == nullptr)
+	{
+		return nullptr;
+	}
+
+	//Nameplates sit centred above the point they are placed at, under the rest of the interface
+	widget->SetAlignmentInViewport(FVector2D(0.5f, 1.0f));
+	widget->SetVisibility(ESlateVisibility::Collapsed);
+
+	//Without a game viewport, as in the benchmark, widgets are placed but never drawn
+	if (GetWorld()->GetGameViewport() != nullptr)
+	{
+		widget->AddToViewport(-10);
+	}
+	return widget;
+}
+
+FVector UNameplateSubsystem::GetNameplateLocation(const ASpaceRPGCharacter* character) const
+{
+	return character->GetActorLocation() + FVector(0.0f, 0.0f, character->GetCapsuleComponent()->GetScaledCapsuleHalfHeight() + heightOffset);
+}
+
+bool UNameplateSubsystem::GetLocalPlayerView(FNameplateView& outView) const
+{
+	APlayerController* controller = GetWorld()->GetFirstPlayerController();
+	ULocalPlayer* localPlayer = controller ? controller->GetLocalPlayer() : nullptr;
+	if (localPlayer == nullptr || localPlayer->ViewportClient == nullptr || localPlayer->ViewportClient->Viewport == nullptr)
+	{
+		return false;
+	}
+
+	FSceneViewProjectionData projectionData;
+	if (!localPlayer->GetProjectionData(localPlayer->ViewportClient->Viewport, eSSP_FULL, projectionData))
+	{
+		return false;
+	}
+
+	outView.location = projectionData.ViewOrigin;
+	outView.viewProjection = projectionData.ComputeViewProjectionMatrix();
+	outView.viewRect = projectionData.GetConstrainedViewRect();
+	return true;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs SpawnNamedCrowdCommand(
+	TEXT("SpaceRPG.SpawnNamedCrowd"),
+	TEXT("Spawns named characters in front of the local player, to measure nameplates with stat SpaceRPG and stat Slate. Arguments: count"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& args, UWorld* world)
+	{
+		APlayerController* controller = world ? world->GetFirstPlayerController() : nullptr;
+		ASpaceRPGCharacter* pawn = controller ? Cast<ASpaceRPGCharacter>(controller->GetPawn()) : nullptr;
+		if (pawn == nullptr)
+		{
+			return;
+		}
+
+		const int32 count = args.Num() > 0 ? FMath::Max(FCString::Atoi(*args[0]), 0) : 500;
+		const int32 gridSize = FMath::Max(FMath::CeilToInt(FMath::Sqrt((float)count)), 1);
+		const float spacing = 150.0f;
+
+		FActorSpawnParameters spawnParams;
+		spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		FRotator facing(0.0f, pawn->GetActorRotation().Yaw, 0.0f);
+		FVector origin = pawn->GetActorLocation() + facing.Vector() * 300.0f;
+		for (int32 i = 0; i < count; i++)
+		{
+			FVector offset((i / gridSize) * spacing, (i % gridSize - gridSize / 2) * spacing, 0.0f);
+			ASpaceRPGCharacter* character = world->SpawnActor<ASpaceRPGCharacter>(pawn->GetClass(), FTransform(facing, origin + facing.RotateVector(offset)), spawnParams);
+			if (character != nullptr)
+			{
+				character->ResidentName = FText::Format(NSLOCTEXT("Nameplate", "ResidentName", "Resident {0}"), i + 1);
+			}
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("NameplateSubsystem::Spawned %d named characters."), count)
+	}));
@@ -0,0 +1,147 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "NameplateSubsystem.generated.h"
+
+//The view nameplates are placed for, projecting with one matrix for every character
+struct SPACERPG_API FNameplateView
+{
+	FVector location = FVector::ZeroVector;
+	FMatrix viewProjection = FMatrix::Identity;
+	FIntRect viewRect;
+
+	//Builds the view of a camera, for views that don't come from a local player
+	static FNameplateView Make(const FVector& location, const FRotator& rotation, float fov, const FIntRect& viewRect);
+
+	//Projects to viewport pixels, returns false for points behind the camera or off screen
+	FORCEINLINE bool Project(const FVector& worldLocation, FVector2D& outScreenLocation) const
+	{
+		FPlane clip = viewProjection.TransformFVector4(FVector4(worldLocation, 1.0f));
+		if (clip.W <= 0.0f)
+		{
+			return false;
+		}
+
+		float x = clip.X / clip.W;
+		float y = clip.Y / clip.W;
+		if (FMath::Abs(x) > 1.0f || FMath::Abs(y) > 1.0f)
+		{
+			return false;
+		}
+
+		outScreenLocation.X = viewRect.Min.X + (0.5f + x * 0.5f) * viewRect.Width();
+		outScreenLocation.Y = viewRect.Min.Y + (0.5f - y * 0.5f) * viewRect.Height();
+		return true;
+	}
+};
+
+//Shows the names of characters near the local player with a small pool of widgets instead of a widget per character.
+//A few times a second the closest named characters on screen are picked and given a widget, characters keeping theirs
+//across picks, and every frame only the picked characters are projected and their widgets moved. Characters beyond
+//the nameplate distance are never projected at all
+UCLASS(Config = Game)
+class SPACERPG_API UNameplateSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	//Called by characters as they begin and end play
+	void RegisterCharacter(class ASpaceRPGCharacter* character);
+	void UnregisterCharacter(class ASpaceRPGCharacter* character);
+
+	//Picks characters when due and places their nameplates for the view
+	void UpdateNameplates(const FNameplateView& view, float deltaTime);
+
+	//Overrides the configured limits, a benchmark uses this to compare against a widget for every character
+	void SetLimits(int32 inMaxNameplates, float inMaxDistance);
+
+	UFUNCTION(BlueprintCallable, Category = Nameplate)
+	void SetNameplatesEnabled(bool bEnabled);
+
+	FORCEINLINE int32 GetNumVisibleNameplates() const { return numVisible; }
+	FORCEINLINE int32 GetNumWidgets() const { return widgets.Num(); }
+	FORCEINLINE int32 GetNumAssignments() const { return numAssignments; }
+
+	//Widgets showing a nameplate, for measuring their layout cost
+	void GetVisibleWidgets(TArray<class UNameplateWidget*>& outWidgets) const;
+
+private:
+	UPROPERTY(Config)
+	bool bEnableNameplates = true;
+
+	//Widget class of a nameplate, falls back to a plain text label if it cannot be loaded
+	UPROPERTY(Config)
+	TSoftClassPtr<class UNameplateWidget> nameplateClass = TSoftClassPtr<UNameplateWidget>(FSoftObjectPath(TEXT("/Game/Blueprints/UI/NamePlate.NamePlate_C")));
+
+	//Most nameplates shown at once, which is also the most widgets ever created
+	UPROPERTY(Config)
+	int32 maxNameplates = 24;
+
+	//Characters further than this from the camera have no nameplate
+	UPROPERTY(Config)
+	float maxDistance = 2500.0f;
+
+	//Fraction of the distance after which nameplates fade out
+	UPROPERTY(Config)
+	float fadeStart = 0.8f;
+
+	//Seconds between picking which characters have nameplates, positions are updated every frame
+	UPROPERTY(Config)
+	float selectionInterval = 0.1f;
+
+	//Height of the nameplate above the top of the capsule
+	UPROPERTY(Config)
+	float heightOffset = 30.0f;
+
+	//Hides widget components with a nameplate widget on characters, which this replaces
+	UPROPERTY(Config)
+	bool bHideCharacterWidgetComponents = true;
+
+	UPROPERTY(Transient)
+	TArray<class UNameplateWidget*> widgets;
+
+	//Character each widget shows, in step with the widgets
+	TArray<TWeakObjectPtr<class ASpaceRPGCharacter>> widgetCharacters;
+
+	TArray<TWeakObjectPtr<class ASpaceRPGCharacter>> characters;
+
+	//A character close enough and on screen, kept between picks so the array doesn't reallocate
+	struct FNameplateCandidate
+	{
+		class ASpaceRPGCharacter* character;
+		float distanceSquared;
+	};
+	TArray<FNameplateCandidate> candidates;
+
+	UClass* loadedClass = nullptr;
+	float timeSinceSelection = MAX_flt;
+	int32 numVisible = 0;
+	int32 numAssignments = 0;
+
+	//Gives the closest candidates a widget, keeping the widgets of those that already have one
+	void SelectCharacters(const FNameplateView& view);
+
+	//Projects the characters with widgets and moves their widgets
+	void PlaceNameplates(const FNameplateView& view);
+
+	//Hides the widget and frees it for another character
+	void ReleaseWidget(int32 index);
+
+	class UNameplateWidget* CreateNameplateWidget();
+	FVector GetNameplateLocation(const class ASpaceRPGCharacter* character) const;
+
+	//Builds the view of the first local player, returns false without a viewport
+	bool GetLocalPlayerView(FNameplateView& outView) const;
+};
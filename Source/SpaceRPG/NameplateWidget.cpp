@@ -0,0 +1,30 @@
+// Copyright SpaceRPG 2020
+
+#include "NameplateWidget.h"
+#include "Blueprint/WidgetTree.h"
+#include "Components/TextBlock.h"
+
+void UNameplateWidget::SetNameplateText(const FText& text)
+{
+	nameplateText = text;
+	if (nameText != nullptr)
+	{
+		nameText->SetText(text);
+	}
+	OnNameplateTextChanged(text);
+}
+
+TSharedRef<SWidget> UNameplateWidget::RebuildWidget()
+{
+	//Without a designed layout the nameplate is just its text
+	if (WidgetTree != nullptr && WidgetTree->RootWidget == nullptr)
+	{
+		nameText = WidgetTree->ConstructWidget<UTextBlock>(UTextBlock::StaticClass(), TEXT("nameText"));
+		nameText->SetText(nameplateText);
+		nameText->SetJustification(ETextJustify::Center);
+		nameText->SetShadowOffset(FVector2D(1.0f, 1.0f));
+		nameText->SetShadowColorAndOpacity(FLinearColor(0.0f, 0.0f, 0.0f, 0.75f));
+		WidgetTree->RootWidget = nameText;
+	}
+	return Super::RebuildWidget();
+}
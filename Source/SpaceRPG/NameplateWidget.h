@@ -0,0 +1,33 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Blueprint/UserWidget.h"
+#include "NameplateWidget.generated.h"
+
+//Label the nameplate subsystem shows over a character. Blueprints deriving from it lay out their own design with a text
+//block named nameText, or react to OnNameplateTextChanged. Without a designed layout it builds a single text block
+UCLASS()
+class SPACERPG_API UNameplateWidget : public UUserWidget
+{
+	GENERATED_BODY()
+
+public:
+	//Called as the widget is assigned to a character, not every frame
+	void SetNameplateText(const FText& text);
+
+	FORCEINLINE const FText& GetNameplateText() const { return nameplateText; }
+
+protected:
+	virtual TSharedRef<SWidget> RebuildWidget() override;
+
+	UFUNCTION(BlueprintImplementableEvent, Category = Nameplate)
+	void OnNameplateTextChanged(const FText& text);
+
+	UPROPERTY(BlueprintReadOnly, Category = Nameplate, meta = (BindWidgetOptional))
+	class UTextBlock* nameText = nullptr;
+
+private:
+	FText nameplateText;
+};
@@ -0,0 +1,234 @@
+// Copyright SpaceRPG 2020
+
+#include "SimulationScheduler.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Scheduler Frame"), STAT_SchedulerFrame, STATGROUP_SimulationScheduler);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Pending Jobs"), STAT_SchedulerPendingJobs, STATGROUP_SimulationScheduler);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Running Parallel Jobs"), STAT_SchedulerRunningJobs, STATGROUP_SimulationScheduler);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Jobs Finished"), STAT_SchedulerFinishedJobs, STATGROUP_SimulationScheduler);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Deadline Misses"), STAT_SchedulerDeadlineMisses, STATGROUP_SimulationScheduler);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Frame Work (ms)"), STAT_SchedulerFrameWork, STATGROUP_SimulationScheduler);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Worst Latency (ms)"), STAT_SchedulerWorstLatency, STATGROUP_SimulationScheduler);
+
+void USimulationScheduler::Deinitialize()
+{
+	//Parallel work may still be reading the systems that queued it
+	for (FSimulationJob& job : parallelJobs)
+	{
+		if (job.task.IsValid())
+		{
+			FTaskGraphInterface::Get().WaitUntilTaskCompletes(job.task);
+		}
+	}
+
+	parallelJobs.Empty();
+	for (TArray<FSimulationJob>& queue : jobQueues)
+	{
+		queue.Empty();
+	}
+
+	Super::Deinitialize();
+}
+
+void USimulationScheduler::Tick(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SchedulerFrame);
+
+	double frameStart = FPlatformTime::Seconds();
+	double budgetEnd = frameStart + frameBudgetMs / 1000.0;
+	int32 numFinished = 0;
+	int32 numRunning = 0;
+
+	//Launch waiting parallel jobs and complete the ones that have finished. Finished jobs complete in queue order, but a job
+	//can complete before one queued ahead of it that is still running
+	for (int32 i = 0; i < parallelJobs.Num();)
+	{
+		FSimulationJob& job = parallelJobs[i];
+		if (!job.task.IsValid())
+		{
+			if (!job.owner.IsValid())
+			{
+				parallelJobs.RemoveAt(i);
+				continue;
+			}
+
+			job.task = FFunctionGraphTask::CreateAndDispatchWhenReady(MoveTemp(job.parallelWork), TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask);
+		}
+
+		if (!job.task->IsComplete())
+		{
+			numRunning++;
+			i++;
+			continue;
+		}
+
+		//Completions can queue and cancel jobs, so the job is taken out of the array before it completes
+		FSimulationJob finishedJob = MoveTemp(job);
+		parallelJobs.RemoveAt(i);
+		if (finishedJob.owner.IsValid() && finishedJob.onComplete)
+		{
+			finishedJob.onComplete();
+		}
+		FinishJob(finishedJob, FPlatformTime::Seconds());
+		numFinished++;
+	}
+
+	//Step jobs by priority until the budget runs out, the first step always runs so work can't starve
+	bool bRanStep = false;
+	bool bOutOfBudget = false;
+	for (int32 priority = 0; priority < (int32)ESimulationJobPriority::Count && !bOutOfBudget; priority++)
+	{
+		TArray<FSimulationJob>& queue = jobQueues[priority];
+		while (queue.Num() > 0)
+		{
+			if (bRanStep && FPlatformTime::Seconds() >= budgetEnd)
+			{
+				bOutOfBudget = true;
+				break;
+			}
+
+			if (!queue[0].owner.IsValid())
+			{
+				queue.RemoveAt(0);
+				continue;
+			}
+
+			//Steps can queue and cancel jobs, which moves the queue, so the step runs from a local and the job is
+			//found again by id afterwards
+			int32 jobId = queue[0].id;
+			TFunction<bool(double)> step = MoveTemp(queue[0].step);
+			bRanStep = true;
+			bool bDone = step(budgetEnd);
+
+			int32 jobIndex = queue.IndexOfByPredicate([jobId](const FSimulationJob& job) { return job.id == jobId; });
+			if (jobIndex == INDEX_NONE)
+			{
+				//Cancelled by its own step
+				continue;
+			}
+
+			if (!bDone)
+			{
+				//The job stopped at the deadline, so the budget is spent
+				queue[jobIndex].step = MoveTemp(step);
+				bOutOfBudget = true;
+				break;
+			}
+
+			FinishJob(queue[jobIndex], FPlatformTime::Seconds());
+			queue.RemoveAt(jobIndex);
+			numFinished++;
+		}
+	}
+
+	SET_DWORD_STAT(STAT_SchedulerPendingJobs, GetNumPendingJobs());
+	SET_DWORD_STAT(STAT_SchedulerRunningJobs, numRunning);
+	SET_DWORD_STAT(STAT_SchedulerFinishedJobs, numFinished);
+	SET_FLOAT_STAT(STAT_SchedulerFrameWork, (FPlatformTime::Seconds() - frameStart) * 1000.0);
+	SET_FLOAT_STAT(STAT_SchedulerWorstLatency, worstLatency * 1000.0f);
+}
+
+ETickableTickType USimulationScheduler::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId USimulationScheduler::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USimulationScheduler, STATGROUP_Tickables);
+}
+
+int32 USimulationScheduler::QueueJob(const UObject* owner, FName name, ESimulationJobPriority priority, TFunction<bool(double)> step, float deadlineSeconds)
+{
+	SPACERPG_LLM_SCOPE(Simulation);
+
+	FSimulationJob& job = jobQueues[FMath::Clamp((int32)priority, 0, (int32)ESimulationJobPriority::Count - 1)].AddDefaulted_GetRef();
+	job.id = nextJobId++;
+	job.name = name;
+	job.owner = owner;
+	job.step = MoveTemp(step);
+	job.queueTime = FPlatformTime::Seconds();
+	job.deadline = job.queueTime + deadlineSeconds;
+	return job.id;
+}
+
+int32 USimulationScheduler::QueueParallelJob(const UObject* owner, FName name, ESimulationJobPriority priority, TFunction<void()> work, TFunction<void()> onComplete, float deadlineSeconds)
+{
+	SPACERPG_LLM_SCOPE(Simulation);
+
+	//Parallel jobs launch as soon as the scheduler ticks, whatever their priority
+	FSimulationJob& job = parallelJobs.AddDefaulted_GetRef();
+	job.id = nextJobId++;
+	job.name = name;
+	job.owner = owner;
+	job.parallelWork = MoveTemp(work);
+	job.onComplete = MoveTemp(onComplete);
+	job.queueTime = FPlatformTime::Seconds();
+	job.deadline = job.queueTime + deadlineSeconds;
+	return job.id;
+}
+
+bool USimulationScheduler::IsJobPending(int32 jobId) const
+{
+	auto hasJob = [jobId](const FSimulationJob& job) { return job.id == jobId; };
+	for (const TArray<FSimulationJob>& queue : jobQueues)
+	{
+		if (queue.ContainsByPredicate(hasJob))
+		{
+			return true;
+		}
+	}
+	return parallelJobs.ContainsByPredicate(hasJob);
+}
+
+void USimulationScheduler::CancelJobs(const UObject* owner)
+{
+	for (TArray<FSimulationJob>& queue : jobQueues)
+	{
+		queue.RemoveAll([owner](const FSimulationJob& job) { return job.owner.Get() == owner; });
+	}
+
+	for (int32 i = parallelJobs.Num() - 1; i >= 0; i--)
+	{
+		FSimulationJob& job = parallelJobs[i];
+		if (job.owner.Get() != owner)
+		{
+			continue;
+		}
+
+		//The owner may free what the work reads once it is cancelled, so running work is waited on
+		if (job.task.IsValid())
+		{
+			FTaskGraphInterface::Get().WaitUntilTaskCompletes(job.task);
+		}
+		parallelJobs.RemoveAt(i);
+	}
+}
+
+int32 USimulationScheduler::GetNumPendingJobs() const
+{
+	int32 numPending = parallelJobs.Num();
+	for (const TArray<FSimulationJob>& queue : jobQueues)
+	{
+		numPending += queue.Num();
+	}
+	return numPending;
+}
+
+void USimulationScheduler::FinishJob(const FSimulationJob& job, double now)
+{
+	float latency = (float)(now - job.queueTime);
+	totalLatency += latency;
+	worstLatency = FMath::Max(worstLatency, latency);
+	numFinishedJobs++;
+
+	if (now > job.deadline)
+	{
+		numDeadlineMisses++;
+		INC_DWORD_STAT(STAT_SchedulerDeadlineMisses);
+		UE_LOG(LogTemp, Verbose, TEXT("SimulationScheduler::Job %s missed its deadline by %.2f ms."), *job.name.ToString(), (now - job.deadline) * 1000.0)
+	}
+}
@@ -0,0 +1,101 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "SimulationScheduler.generated.h"
+
+//Order jobs are run in when the frame budget can't fit them all
+enum class ESimulationJobPriority : uint8
+{
+	High,
+	Normal,
+	Low,
+	Count
+};
+
+//Runs simulation work within a per frame time budget, so work started on a game hour is spread over the following frames
+//Step jobs run on the game thread a slice at a time, parallel jobs run on the task graph and finish on the game thread
+UCLASS(Config = Game)
+class SPACERPG_API USimulationScheduler : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	//Queues a job run a step at a time on the game thread. The step is given the platform time it should stop by
+	//and returns true once the job is done. Every job needs an owner and is dropped if it is destroyed. Returns the job id
+	int32 QueueJob(const UObject* owner, FName name, ESimulationJobPriority priority, TFunction<bool(double)> step, float deadlineSeconds);
+
+	//Queues work for the task graph, onComplete runs on the game thread once it is done. The work must not touch UObjects
+	int32 QueueParallelJob(const UObject* owner, FName name, ESimulationJobPriority priority, TFunction<void()> work, TFunction<void()> onComplete, float deadlineSeconds);
+
+	//Whether the job is still queued or running
+	bool IsJobPending(int32 jobId) const;
+
+	//Drops every job of the owner, waiting for parallel work already running so nothing reads the owner afterwards.
+	//The completions of cancelled jobs never run
+	void CancelJobs(const UObject* owner);
+
+	UFUNCTION(BlueprintPure, Category = Scheduler)
+	int32 GetNumPendingJobs() const;
+
+	//Jobs that finished after their deadline since play started
+	UFUNCTION(BlueprintPure, Category = Scheduler)
+	int32 GetNumDeadlineMisses() const { return numDeadlineMisses; }
+
+	//Longest and average time from queueing a job to it finishing, in seconds
+	UFUNCTION(BlueprintPure, Category = Scheduler)
+	float GetWorstLatency() const { return worstLatency; }
+
+	UFUNCTION(BlueprintPure, Category = Scheduler)
+	float GetAverageLatency() const { return numFinishedJobs > 0 ? totalLatency / numFinishedJobs : 0.0f; }
+
+private:
+	//Game thread time given to jobs each frame, at least one step still runs if a single step is over budget
+	UPROPERTY(Config)
+	float frameBudgetMs = 2.0f;
+
+	struct FSimulationJob
+	{
+		int32 id = INDEX_NONE;
+		FName name;
+		TWeakObjectPtr<const UObject> owner;
+
+		TFunction<bool(double)> step;
+		TFunction<void()> parallelWork;
+		TFunction<void()> onComplete;
+
+		//Platform times the job was queued and should be done by
+		double queueTime = 0.0;
+		double deadline = 0.0;
+
+		//Task of a parallel job once it has been launched
+		FGraphEventRef task;
+	};
+
+	//Step jobs in queue order for each priority
+	TArray<FSimulationJob> jobQueues[(int32)ESimulationJobPriority::Count];
+
+	//Parallel jobs waiting to launch or running, in the order they were queued
+	TArray<FSimulationJob> parallelJobs;
+
+	int32 nextJobId = 0;
+	int32 numDeadlineMisses = 0;
+	int32 numFinishedJobs = 0;
+	double totalLatency = 0.0;
+	float worstLatency = 0.0f;
+
+	//Records the latency and deadline of a job that just finished
+	void FinishJob(const FSimulationJob& job, double now);
+};
@@ -1,7 +1,16 @@
 // Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
 
 #include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
 #include "Modules/ModuleManager.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, SpaceRPG, "SpaceRPG" );
- 
\ No newline at end of file
+class FSpaceRPGModule : public FDefaultGameModuleImpl
+{
+public:
+	virtual void StartupModule() override
+	{
+		RegisterSpaceRPGMemoryTags();
+	}
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FSpaceRPGModule, SpaceRPG, "SpaceRPG" );
@@ -3,3 +3,9 @@
 #pragma once
 
 #include "CoreMinimal.h"
+
+//Stat group shared by the gameplay systems of the module
+DECLARE_STATS_GROUP(TEXT("SpaceRPG"), STATGROUP_SpaceRPG, STATCAT_Advanced);
+
+//Stat group of the simulation scheduler, shown with stat SimulationScheduler
+DECLARE_STATS_GROUP(TEXT("SimulationScheduler"), STATGROUP_SimulationScheduler, STATCAT_Advanced);
@@ -0,0 +1,2027 @@
+// Copyright SpaceRPG 2020
+
+#include "SpaceRPGBenchCommandlet.h"
+#include "Building.h"
+#include "BuildingPreview.h"
+#include "BuildingPreviewPool.h"
+#include "BuildingStreamingSubsystem.h"
+#include "BuildingPalette.h"
+#include "BuildingCommandLog.h"
+#include "BuildingRegistry.h"
+#include "BuildingGrid.h"
+#include "TimeController.h"
+#include "BuildingSupportGraph.h"
+#include "BuildingSupportSubsystem.h"
+#include "UtilityNetwork.h"
+#include "CityGenerator.h"
+#include "EconomyStore.h"
+#include "BuildingCollisionSubsystem.h"
+#include "CharacterSignificanceSubsystem.h"
+#include "SpaceRPGCharacter.h"
+#include "NameplateSubsystem.h"
+#include "NameplateWidget.h"
+#include "EnvironmentModel.h"
+#include "CityReplaySubsystem.h"
+#include "CityAutosaveSubsystem.h"
+#include "DistrictCoordinator.h"
+#include "WorldSnapshot.h"
+#include "WorldSnapshotSubsystem.h"
+#include "Kismet/KismetMathLibrary.h"
+#include "Framework/Application/SlateApplication.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "Engine/Engine.h"
+#include "EngineDefines.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/GameInstance.h"
+#include "Tickable.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/MemoryBase.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "UObject/Package.h"
+#include "UObject/UObjectArray.h"
+
+//Blueprint classes used when present so the benchmark matches the game, the native classes are used otherwise
+static const TCHAR* BenchBuildingClassPath = TEXT("/Game/Blueprints/Building/BP_Building.BP_Building_C");
+static const TCHAR* BenchPreviewClassPath = TEXT("/Game/Blueprints/Building/BP_BuildingPreview.BP_BuildingPreview_C");
+static const TCHAR* BenchTimeControllerClassPath = TEXT("/Game/Blueprints/World/BP_TimeController.BP_TimeController_C");
+static const TCHAR* BenchCharacterClassPath = TEXT("/Game/ThirdPersonCPP/Blueprints/ThirdPersonCharacter.ThirdPersonCharacter_C");
+
+//Returns the blueprint class at the path, or the native class if it cannot be loaded
+template<typename T>
+static UClass* LoadBenchClass(const TCHAR* path)
+{
+	UClass* loadedClass = LoadClass<T>(nullptr, path);
+	if (loadedClass == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SpaceRPGBench::Could not load %s, using %s instead."), path, *T::StaticClass()->GetName())
+		return T::StaticClass();
+	}
+	return loadedClass;
+}
+
+//Total allocator calls so far, only counted outside shipping builds
+static uint64 GetTotalAllocations()
+{
+#if !UE_BUILD_SHIPPING
+	return FMalloc::TotalMallocCalls + FMalloc::TotalReallocCalls;
+#else
+	return 0;
+#endif
+}
+
+USpaceRPGBenchCommandlet::USpaceRPGBenchCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 USpaceRPGBenchCommandlet::Main(const FString& Params)
+{
+	FParse::Value(*Params, TEXT("buildings="), numBuildings);
+	FParse::Value(*Params, TEXT("sweeps="), numSweeps);
+	FParse::Value(*Params, TEXT("spacing="), buildingSpacing);
+
+	if (!CreateWorld(Params))
+	{
+		return 1;
+	}
+
+	BenchBuildingSpawn();
+	BenchPreviewSweep();
+	BenchPreviewPool();
+	BenchBuildingStreaming();
+	BenchTimeControllerYear();
+	BenchCommandLogUndo();
+	BenchCommandLogRotate();
+	BenchSupportGraph();
+	BenchUtilityNetworks();
+	BenchCityGenerator();
+	BenchEconomyHour();
+	BenchBuildingCollision();
+	BenchCharacterSignificance();
+	BenchNameplates();
+	BenchEnvironmentModel();
+	BenchWorldSnapshot();
+	BenchBuildingGrid();
+	BenchAutosaveRecovery();
+
+	DestroyWorld();
+
+	//Replays need an empty world of their own
+	if (!CreateWorld(Params))
+	{
+		return 1;
+	}
+	BenchReplay(Params);
+	DestroyWorld();
+
+	//Every shard of the district benchmark runs in a world of its own
+	BenchDistrictShards(Params);
+
+	bool bPassed = WriteReport(Params);
+
+	//Correctness checks report an errors metric, any of them failing fails the run just as a timing regression does
+	int32 totalErrors = 0;
+	for (const FBenchPhase& phase : phases)
+	{
+		if (const double* phaseErrors = phase.metrics.Find(TEXT("errors")))
+		{
+			totalErrors += FMath::RoundToInt(*phaseErrors);
+		}
+	}
+	if (totalErrors > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::%d correctness checks failed."), totalErrors)
+	}
+
+	return bPassed && totalErrors == 0 ? 0 : 1;
+}
+
+USpaceRPGBenchCommandlet::FBenchPhase& USpaceRPGBenchCommandlet::RunPhase(const FString& name, int32 iterations, TFunctionRef<void()> body)
+{
+	FBenchPhase phase;
+	phase.name = name;
+	phase.iterations = FMath::Max(iterations, 1);
+
+	int64 memoryBefore = FPlatformMemory::GetStats().UsedPhysical;
+	uint64 allocationsBefore = GetTotalAllocations();
+	double startTime = FPlatformTime::Seconds();
+
+	body();
+
+	phase.seconds = FPlatformTime::Seconds() - startTime;
+	phase.allocations = GetTotalAllocations() - allocationsBefore;
+	phase.memoryAfter = FPlatformMemory::GetStats().UsedPhysical;
+	phase.memoryDelta = phase.memoryAfter - memoryBefore;
+
+	UE_LOG(LogTemp, Display, TEXT("SpaceRPGBench::%s: %.3f ms total, %.3f us per iteration, %llu allocations, %.2f MB memory delta"),
+		*phase.name, phase.seconds * 1000.0, phase.seconds * 1000000.0 / phase.iterations, phase.allocations, phase.memoryDelta / (1024.0 * 1024.0))
+
+	return phases.Add_GetRef(phase);
+}
+
+bool USpaceRPGBenchCommandlet::CreateWorld(const FString& params)
+{
+	gameInstance = NewObject<UGameInstance>(GEngine);
+	gameInstance->AddToRoot();
+	gameInstance->InitializeStandalone();
+
+	FWorldContext* worldContext = gameInstance->GetWorldContext();
+	world = gameInstance->GetWorld();
+
+	//Swap the dummy world for the test map if one was given
+	FString mapName;
+	if (FParse::Value(*params, TEXT("map="), mapName))
+	{
+		UPackage* mapPackage = LoadPackage(nullptr, *mapName, LOAD_None);
+		UWorld* mapWorld = mapPackage ? UWorld::FindWorldInPackage(mapPackage) : nullptr;
+		if (mapWorld == nullptr)
+		{
+			UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Could not load map %s."), *mapName)
+			return false;
+		}
+
+		mapWorld->WorldType = EWorldType::Game;
+		mapWorld->AddToRoot();
+		mapWorld->SetGameInstance(gameInstance);
+		if (!mapWorld->bIsWorldInitialized)
+		{
+			mapWorld->InitWorld(UWorld::InitializationValues().AllowAudioPlayback(false).CreatePhysicsScene(true));
+		}
+		worldContext->SetCurrentWorld(mapWorld);
+		world = mapWorld;
+	}
+
+	if (world == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Could not create a world."))
+		return false;
+	}
+
+	//Maps bring their own ground, the empty world needs one for buildings to stand on
+	if (mapName.IsEmpty())
+	{
+		SpawnGround();
+	}
+
+	FURL url;
+	world->SetGameMode(url);
+	world->InitializeActorsForPlay(url);
+
+	//Nothing ticks the async loader here, so the startup preload is finished before play begins
+	FlushAsyncLoading();
+	world->BeginPlay();
+	return true;
+}
+
+void USpaceRPGBenchCommandlet::SpawnGround()
+{
+	UStaticMesh* cubeMesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	if (cubeMesh == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SpaceRPGBench::Could not load the ground mesh, buildings will have no foundation."))
+		return;
+	}
+
+	//The engine cube is 100 units across with its pivot in the centre, so sink it to put its top at zero
+	int32 gridSize = FMath::CeilToInt(FMath::Sqrt((float)numBuildings));
+	float groundScale = (gridSize + 64) * buildingSpacing / 100.0f;
+	FTransform groundTransform(FRotator::ZeroRotator, FVector(0.0f, 0.0f, -50.0f), FVector(groundScale, groundScale, 1.0f));
+
+	AStaticMeshActor* ground = world->SpawnActor<AStaticMeshActor>(AStaticMeshActor::StaticClass(), groundTransform);
+	if (ground != nullptr)
+	{
+		ground->GetStaticMeshComponent()->SetStaticMesh(cubeMesh);
+	}
+}
+
+void USpaceRPGBenchCommandlet::DestroyWorld()
+{
+	if (world != nullptr)
+	{
+		GEngine->DestroyWorldContext(world);
+		world->DestroyWorld(false);
+		world->RemoveFromRoot();
+		world = nullptr;
+	}
+	if (gameInstance != nullptr)
+	{
+		gameInstance->Shutdown();
+		gameInstance->RemoveFromRoot();
+		gameInstance = nullptr;
+	}
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+}
+
+//Places numBuildings buildings in a square grid, measuring spawn and BeginPlay
+void USpaceRPGBenchCommandlet::BenchBuildingSpawn()
+{
+	UClass* buildingClass = LoadBenchClass<ABuilding>(BenchBuildingClassPath);
+	int32 gridSize = FMath::CeilToInt(FMath::Sqrt((float)numBuildings));
+
+	FActorSpawnParameters spawnParams;
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	RunPhase(TEXT("building_spawn"), numBuildings, [&]()
+	{
+		for (int32 i = 0; i < numBuildings; i++)
+		{
+			FVector location((i % gridSize) * buildingSpacing, (i / gridSize) * buildingSpacing, 0.0f);
+			world->SpawnActor<ABuilding>(buildingClass, FTransform(location), spawnParams);
+		}
+	});
+}
+
+//Moves a scripted cursor across the grid, measuring the preview's traces and snapping
+void USpaceRPGBenchCommandlet::BenchPreviewSweep()
+{
+	UClass* previewClass = LoadBenchClass<ABuildingPreview>(BenchPreviewClassPath);
+	UClass* buildingClass = LoadBenchClass<ABuilding>(BenchBuildingClassPath);
+
+	FActorSpawnParameters spawnParams;
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	ABuildingPreview* preview = world->SpawnActor<ABuildingPreview>(previewClass, FTransform::Identity, spawnParams);
+	if (preview == nullptr)
+	{
+		return;
+	}
+
+	//Use the mesh of a placed building so the overlap box has a real size
+	ABuilding* buildingDefaults = buildingClass->GetDefaultObject<ABuilding>();
+	UStaticMeshComponent* buildingMeshComponent = buildingDefaults ? buildingDefaults->FindComponentByClass<UStaticMeshComponent>() : nullptr;
+	if (buildingMeshComponent != nullptr && buildingMeshComponent->GetStaticMesh() != nullptr)
+	{
+		preview->Reconfigure(buildingMeshComponent->GetStaticMesh());
+	}
+
+	//Build the merged collision of the buildings just spawned, the world has not ticked since
+	if (UBuildingCollisionSubsystem* collision = world->GetSubsystem<UBuildingCollisionSubsystem>())
+	{
+		collision->FlushDirtyChunks();
+	}
+
+	int32 gridSize = FMath::CeilToInt(FMath::Sqrt((float)numBuildings));
+	float gridExtent = gridSize * buildingSpacing;
+	int32 validCount = 0;
+
+	RunPhase(TEXT("preview_sweep"), numSweeps, [&]()
+	{
+		for (int32 i = 0; i < numSweeps; i++)
+		{
+			//Walk the cursor back and forth across the grid, looking down at an angle from above
+			float alpha = (float)i / numSweeps;
+			FVector cameraLocation(FMath::Frac(alpha * 7.0f) * gridExtent, alpha * gridExtent, 600.0f);
+			FVector cameraDirection = FVector(1.0f, 0.3f, -1.0f).GetSafeNormal();
+
+			preview->UpdatePlacement(cameraLocation, cameraDirection);
+			validCount += preview->IsPlacementValid() ? 1 : 0;
+		}
+	});
+
+	UE_LOG(LogTemp, Display, TEXT("SpaceRPGBench::Preview placement was valid for %d of %d samples."), validCount, numSweeps)
+	preview->Destroy();
+}
+
+//Cycles a pooled preview through up to 50 building types 10,000 times, returning it to the pool and taking it out again
+//every cycle. After garbage collection no actors, components or other objects may have been created, and memory must stay flat
+void USpaceRPGBenchCommandlet::BenchPreviewPool()
+{
+	const int32 numCycles = 10000;
+	const int32 maxTypes = 50;
+
+	//A leak this small a cycle would already add up to 640 KB
+	const int64 maxBytesPerCycle = 64;
+
+	UBuildingPreviewPool* pool = world->GetSubsystem<UBuildingPreviewPool>();
+	UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(world);
+	UClass* previewClass = LoadBenchClass<ABuildingPreview>(BenchPreviewClassPath);
+	if (pool == nullptr)
+	{
+		return;
+	}
+
+	//Meshes are made resident first so every swap reconfigures straight away
+	TArray<int32> types;
+	UBuildingPalette* palette = streaming ? streaming->GetPalette() : nullptr;
+	for (int32 type = 0; palette != nullptr && type < palette->buildingTypes.Num() && types.Num() < maxTypes; type++)
+	{
+		if (streaming->LoadMeshSynchronous(type) != nullptr)
+		{
+			types.Add(type);
+		}
+	}
+
+	//Without a palette the preview is cycled through the engine's basic shapes instead
+	TArray<UStaticMesh*> meshes;
+	if (types.Num() == 0)
+	{
+		const TCHAR* shapePaths[] = {
+			TEXT("/Engine/BasicShapes/Cube.Cube"),
+			TEXT("/Engine/BasicShapes/Sphere.Sphere"),
+			TEXT("/Engine/BasicShapes/Cylinder.Cylinder"),
+			TEXT("/Engine/BasicShapes/Cone.Cone"),
+			TEXT("/Engine/BasicShapes/Plane.Plane")
+		};
+		for (const TCHAR* shapePath : shapePaths)
+		{
+			if (UStaticMesh* mesh = LoadObject<UStaticMesh>(nullptr, shapePath))
+			{
+				meshes.Add(mesh);
+			}
+		}
+	}
+
+	int32 numMeshes = types.Num() > 0 ? types.Num() : meshes.Num();
+	if (numMeshes == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SpaceRPGBench::No building types or meshes to cycle the preview through."))
+		return;
+	}
+
+	ABuildingPreview* preview = pool->AcquirePreview(previewClass, nullptr, types.Num() > 0 ? types[0] : INDEX_NONE);
+	if (preview == nullptr)
+	{
+		return;
+	}
+
+	auto cyclePreview = [&](int32 cycle)
+	{
+		pool->ReleasePreview(preview);
+		preview = pool->AcquirePreview(previewClass, nullptr, types.Num() > 0 ? types[cycle % numMeshes] : INDEX_NONE);
+		if (meshes.Num() > 0)
+		{
+			preview->Reconfigure(meshes[cycle % numMeshes]);
+		}
+	};
+
+	//One pass over every mesh first, so the render and physics state of each has been created once
+	for (int32 cycle = 0; cycle < numMeshes; cycle++)
+	{
+		cyclePreview(cycle);
+	}
+
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	int32 spawnedBefore = pool->GetNumSpawned();
+	int32 componentsBefore = preview->GetComponents().Num();
+	int32 objectsBefore = GUObjectArray.GetObjectArrayNumMinusAvailable();
+	int64 memoryBefore = FPlatformMemory::GetStats().UsedPhysical;
+
+	FBenchPhase& phase = RunPhase(TEXT("preview_pool_cycle_10k"), numCycles, [&]()
+	{
+		for (int32 cycle = 0; cycle < numCycles; cycle++)
+		{
+			cyclePreview(cycle);
+		}
+	});
+
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	int32 spawned = pool->GetNumSpawned() - spawnedBefore;
+	int32 leakedComponents = preview->GetComponents().Num() - componentsBefore;
+	int32 leakedObjects = GUObjectArray.GetObjectArrayNumMinusAvailable() - objectsBefore;
+	int64 memoryGrowth = FPlatformMemory::GetStats().UsedPhysical - memoryBefore;
+
+	int32 errors = (spawned != 0 ? 1 : 0) + (leakedComponents != 0 ? 1 : 0) + (leakedObjects > 0 ? 1 : 0) + (memoryGrowth > maxBytesPerCycle * numCycles ? 1 : 0);
+	if (errors > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Preview pool leaked over %d cycles: %d actors spawned, %d components, %d objects, %.2f MB."),
+			numCycles, spawned, leakedComponents, leakedObjects, memoryGrowth / (1024.0 * 1024.0))
+	}
+
+	phase.metrics.Add(TEXT("meshes"), numMeshes);
+	phase.metrics.Add(TEXT("spawned"), spawned);
+	phase.metrics.Add(TEXT("leakedComponents"), leakedComponents);
+	phase.metrics.Add(TEXT("leakedObjects"), leakedObjects);
+	phase.metrics.Add(TEXT("memoryGrowthBytes"), (double)memoryGrowth);
+	phase.metrics.Add(TEXT("errors"), errors);
+
+	pool->ReleasePreview(preview);
+}
+
+//Streams up to 200 building types in from cold one after another, asking for each type twice while it loads so both
+//callers have to be answered. Reports the resident memory afterwards and the worst time from request to resident mesh
+void USpaceRPGBenchCommandlet::BenchBuildingStreaming()
+{
+	const int32 maxTypes = 200;
+
+	UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(world);
+	UBuildingPalette* palette = streaming ? streaming->GetPalette() : nullptr;
+	if (palette == nullptr || palette->buildingTypes.Num() == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SpaceRPGBench::No building palette to stream types from."))
+		return;
+	}
+
+	//Start cold, nothing active and nothing left over from earlier phases
+	streaming->SetActiveBuildTypes(TArray<int32>());
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+
+	int32 numTypes = FMath::Min(maxTypes, palette->buildingTypes.Num());
+	int32 expectedCallbacks = 0;
+	int32 callbacks = 0;
+	double worstSwapTime = 0.0;
+
+	FBenchPhase& phase = RunPhase(TEXT("building_streaming_200_types"), numTypes, [&]()
+	{
+		for (int32 type = 0; type < numTypes; type++)
+		{
+			if (palette->buildingTypes[type].buildingMesh.IsNull())
+			{
+				continue;
+			}
+			expectedCallbacks += 2;
+
+			double requestTime = FPlatformTime::Seconds();
+			for (int32 request = 0; request < 2; request++)
+			{
+				streaming->RequestMesh(type, FOnBuildingMeshResident::CreateLambda([&callbacks](UStaticMesh* mesh)
+				{
+					callbacks++;
+				}));
+			}
+
+			//Nothing ticks the loader or the streamable manager's delayed completions here, so both are driven by hand
+			FlushAsyncLoading();
+			FTickableGameObject::TickObjects(world, LEVELTICK_All, false, 0.0f);
+			worstSwapTime = FMath::Max(worstSwapTime, FPlatformTime::Seconds() - requestTime);
+		}
+	});
+
+	int32 residentTypes = 0;
+	int64 residentBytes = streaming->GetResidentBytes(&residentTypes);
+
+	int32 errors = callbacks != expectedCallbacks ? 1 : 0;
+	if (errors > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Building streaming answered %d of %d mesh requests."), callbacks, expectedCallbacks)
+	}
+
+	phase.metrics.Add(TEXT("types"), numTypes);
+	phase.metrics.Add(TEXT("residentTypes"), residentTypes);
+	phase.metrics.Add(TEXT("residentBytes"), (double)residentBytes);
+	phase.metrics.Add(TEXT("worstSwapMs"), worstSwapTime * 1000.0);
+	phase.metrics.Add(TEXT("callbacks"), callbacks);
+	phase.metrics.Add(TEXT("errors"), errors);
+
+	//Requested types are not active, so setting the palette's active types again evicts them
+	streaming->SetActiveBuildTypes(TArray<int32>());
+}
+
+//Fast-ticks the time controller through a simulated year, one game hour per frame
+void USpaceRPGBenchCommandlet::BenchTimeControllerYear()
+{
+	UClass* timeControllerClass = LoadBenchClass<ATimeController>(BenchTimeControllerClassPath);
+	ATimeController* timeController = world->SpawnActor<ATimeController>(timeControllerClass, FTransform::Identity);
+	if (timeController == nullptr)
+	{
+		return;
+	}
+
+	//A frame advances the clock by deltaTime / timeUnit * 0.24 * multiplier minutes
+	const float deltaTime = 1.0f / 30.0f;
+	const int32 hoursInYear = 365 * 24;
+	timeController->gameSpeedMultiplier = 60.0f / (deltaTime / 0.25f * 0.24f);
+
+	//The controller logs every hour, which would dominate the timing
+	ELogVerbosity::Type previousVerbosity = LogTemp.GetVerbosity();
+	LogTemp.SetVerbosity(ELogVerbosity::Error);
+
+	RunPhase(TEXT("time_controller_year"), hoursInYear, [&]()
+	{
+		for (int32 i = 0; i < hoursInYear; i++)
+		{
+			world->Tick(LEVELTICK_All, deltaTime);
+		}
+	});
+
+	LogTemp.SetVerbosity(previousVerbosity);
+
+	UE_LOG(LogTemp, Display, TEXT("SpaceRPGBench::Time controller reached %d / %d / %d."), timeController->gameDate[0], timeController->gameDate[1], timeController->gameDate[2])
+}
+
+//Places a 1,000 piece batch through the command log, then measures undoing and redoing it
+void USpaceRPGBenchCommandlet::BenchCommandLogUndo()
+{
+	UBuildingCommandLog* commandLog = world->GetSubsystem<UBuildingCommandLog>();
+	UBuildingRegistry* registry = world->GetSubsystem<UBuildingRegistry>();
+	if (commandLog == nullptr || registry == nullptr)
+	{
+		return;
+	}
+
+	//Place the batch away from the spawn grid so the cells are free
+	const int32 batchSize = 1000;
+	commandLog->BeginBatch();
+	for (int32 i = 0; i < batchSize; i++)
+	{
+		FVector location((i % 32) * UBuildingRegistry::CellSize, -(1 + i / 32) * UBuildingRegistry::CellSize, 0.0f);
+		commandLog->PlaceBuilding(0, location, 0.0f);
+	}
+	commandLog->EndBatch();
+
+	int32 placedCount = registry->GetNumBuildings();
+
+	RunPhase(TEXT("command_log_undo_1000"), batchSize, [&]()
+	{
+		commandLog->Undo();
+	});
+
+	RunPhase(TEXT("command_log_redo_1000"), batchSize, [&]()
+	{
+		commandLog->Redo();
+	});
+
+	UE_LOG(LogTemp, Display, TEXT("SpaceRPGBench::Command log batch left %d buildings, %d after redo."), placedCount, registry->GetNumBuildings())
+}
+
+//Turns a piece twice as long as it is wide through the command log, with one piece resting on it and one against its long
+//end, then checks the registry, the footprint and the support edges all follow the turn
+void USpaceRPGBenchCommandlet::BenchCommandLogRotate()
+{
+	UBuildingCommandLog* commandLog = world->GetSubsystem<UBuildingCommandLog>();
+	UBuildingRegistry* registry = world->GetSubsystem<UBuildingRegistry>();
+	UBuildingSupportSubsystem* support = world->GetSubsystem<UBuildingSupportSubsystem>();
+	if (commandLog == nullptr || registry == nullptr || support == nullptr)
+	{
+		return;
+	}
+
+	UClass* buildingClass = LoadBenchClass<ABuilding>(BenchBuildingClassPath);
+	FActorSpawnParameters spawnParams;
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	//Past the command log batch, so the cells are free
+	const FIntVector cell(0, -48, 0);
+	const FVector longScale(2.0f, 1.0f, 1.0f);
+	ABuilding* longPiece = world->SpawnActor<ABuilding>(buildingClass, FTransform(FRotator::ZeroRotator, FBuildingGrid::CellToWorld(cell), longScale), spawnParams);
+	if (longPiece == nullptr)
+	{
+		return;
+	}
+
+	FIntVector footprint = longPiece->footprintCells;
+	if (footprint.X == footprint.Y)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SpaceRPGBench::The building mesh is too small to give a footprint longer than it is wide."))
+		longPiece->Destroy();
+		return;
+	}
+
+	FIntVector topCell = cell + FIntVector(0, 0, footprint.Z * 2);
+	FIntVector endCell = cell + FIntVector(footprint.X * 2, 0, 0);
+	ABuilding* topPiece = world->SpawnActor<ABuilding>(buildingClass, FTransform(FRotator::ZeroRotator, FBuildingGrid::CellToWorld(topCell), longScale), spawnParams);
+	ABuilding* endPiece = world->SpawnActor<ABuilding>(buildingClass, FTransform(FRotator::ZeroRotator, FBuildingGrid::CellToWorld(endCell), longScale), spawnParams);
+
+	//Nothing ticks the subsystems here, so they are ticked by hand to add the pieces to the support graph
+	FTickableGameObject::TickObjects(world, LEVELTICK_All, false, 0.0f);
+
+	FBenchPhase& phase = RunPhase(TEXT("command_log_rotate_footprint"), 1, [&]()
+	{
+		commandLog->RotateBuilding(longPiece, 90.0f);
+	});
+
+	//Anything the turn left without support would be demolished on this tick
+	FTickableGameObject::TickObjects(world, LEVELTICK_All, false, 0.0f);
+
+	int32 errors = 0;
+	errors += registry->FindBuilding(cell) == longPiece && longPiece->gridCell == cell ? 0 : 1;
+	errors += longPiece->footprintCells == FBuildingGrid::RotateExtent(footprint, 1) ? 0 : 1;
+	errors += registry->FindBuilding(topCell) == topPiece && registry->FindBuilding(endCell) == endPiece ? 0 : 1;
+	errors += support->IsInGraph(longPiece) && support->IsInGraph(topPiece) && support->IsInGraph(endPiece) ? 0 : 1;
+
+	//The turned piece's edges are exactly the pieces at its turned sockets, the end it used to touch is no longer one of them
+	const FBuildingSupportGraph& supportGraph = support->GetSupportGraph();
+	int32 node = supportGraph.FindNode(cell);
+	if (node != INDEX_NONE)
+	{
+		TArray<FIntVector, TInlineAllocator<6>> socketCells;
+		longPiece->GetSocketCells(socketCells);
+
+		TArray<int32, TInlineAllocator<6>> expectedNeighbours;
+		for (const FIntVector& socketCell : socketCells)
+		{
+			int32 neighbour = supportGraph.FindNode(socketCell);
+			if (neighbour != INDEX_NONE)
+			{
+				expectedNeighbours.AddUnique(neighbour);
+			}
+		}
+
+		TArrayView<const int32> neighbours = supportGraph.GetNeighbours(node);
+		bool bEdgesMatch = neighbours.Num() == expectedNeighbours.Num();
+		for (int32 neighbour : neighbours)
+		{
+			bEdgesMatch &= expectedNeighbours.Contains(neighbour);
+		}
+		errors += bEdgesMatch ? 0 : 1;
+		errors += neighbours.Contains(supportGraph.FindNode(topCell)) && !neighbours.Contains(supportGraph.FindNode(endCell)) ? 0 : 1;
+	}
+	else
+	{
+		errors++;
+	}
+
+	if (errors > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::%d registry and support checks failed after turning a %s footprint."), errors, *footprint.ToString())
+	}
+	phase.metrics.Add(TEXT("errors"), errors);
+
+	for (ABuilding* building : { longPiece, topPiece, endPiece })
+	{
+		if (building != nullptr)
+		{
+			building->Destroy();
+		}
+	}
+}
+
+//Demolishes random pieces of a 10k piece stacked structure, measuring the support update for each removal
+void USpaceRPGBenchCommandlet::BenchSupportGraph()
+{
+	//A 10 x 10 footprint 100 levels tall, every piece connected to its six neighbours
+	const int32 footprint = 10;
+	const int32 levels = 100;
+	const int32 numRemovals = 1000;
+
+	FBuildingSupportGraph supportGraph;
+	TArray<FIntVector, TInlineAllocator<6>> socketCells;
+	for (int32 z = 0; z < levels; z++)
+	{
+		for (int32 y = 0; y < footprint; y++)
+		{
+			for (int32 x = 0; x < footprint; x++)
+			{
+				socketCells.Reset();
+				socketCells.Add(FIntVector(x + 1, y, z));
+				socketCells.Add(FIntVector(x - 1, y, z));
+				socketCells.Add(FIntVector(x, y + 1, z));
+				socketCells.Add(FIntVector(x, y - 1, z));
+				socketCells.Add(FIntVector(x, y, z + 1));
+				socketCells.Add(FIntVector(x, y, z - 1));
+				supportGraph.AddNode(FIntVector(x, y, z), z == 0, socketCells);
+			}
+		}
+	}
+
+	FRandomStream random(1234);
+	TArray<int32> collapsed;
+	double worstSeconds = 0.0;
+	int32 totalCollapsed = 0;
+
+	FBenchPhase& phase = RunPhase(TEXT("support_graph_demolish_10k"), numRemovals, [&]()
+	{
+		for (int32 i = 0; i < numRemovals; i++)
+		{
+			FIntVector cell(random.RandRange(0, footprint - 1), random.RandRange(0, footprint - 1), random.RandRange(0, levels - 1));
+			int32 node = supportGraph.FindNode(cell);
+			if (node == INDEX_NONE)
+			{
+				continue;
+			}
+
+			collapsed.Reset();
+			double startTime = FPlatformTime::Seconds();
+			supportGraph.RemoveNode(node, collapsed);
+			worstSeconds = FMath::Max(worstSeconds, FPlatformTime::Seconds() - startTime);
+			totalCollapsed += collapsed.Num();
+		}
+	});
+
+	phase.metrics.Add(TEXT("worstUpdateUs"), worstSeconds * 1000000.0);
+	phase.metrics.Add(TEXT("collapsedPieces"), totalCollapsed);
+	phase.metrics.Add(TEXT("deferredSearches"), supportGraph.GetNumDeferred());
+
+	//Cut the whole ground floor loose and finish the searches with a budget far below the structure's size, as the subsystem
+	//does over frames. The searches carry on from frame to frame, so they finish however small the budget is
+	for (int32 y = 0; y < footprint; y++)
+	{
+		for (int32 x = 0; x < footprint; x++)
+		{
+			int32 node = supportGraph.FindNode(FIntVector(x, y, 0));
+			if (node != INDEX_NONE)
+			{
+				collapsed.Reset();
+				supportGraph.RemoveNode(node, collapsed);
+				totalCollapsed += collapsed.Num();
+			}
+		}
+	}
+
+	const int32 visitsPerFrame = 256;
+	const int32 maxFrames = 100000;
+	int32 frames = 0;
+	int32 deferredCollapsed = 0;
+	FBenchPhase& drainPhase = RunPhase(TEXT("support_graph_deferred_drain"), 1, [&]()
+	{
+		while (supportGraph.GetNumDeferred() > 0 && frames < maxFrames)
+		{
+			collapsed.Reset();
+			supportGraph.ProcessDeferred(visitsPerFrame, collapsed);
+			deferredCollapsed += collapsed.Num();
+			frames++;
+		}
+	});
+
+	int32 errors = supportGraph.GetNumDeferred() > 0 ? 1 : 0;
+	if (errors > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::%d deferred support searches were still running after %d frames."), supportGraph.GetNumDeferred(), frames)
+	}
+	drainPhase.metrics.Add(TEXT("frames"), frames);
+	drainPhase.metrics.Add(TEXT("collapsedPieces"), deferredCollapsed);
+	drainPhase.metrics.Add(TEXT("errors"), errors);
+}
+
+//Solves 500 separate utility networks of 100 buildings each, in full and after an hour of demand changes
+void USpaceRPGBenchCommandlet::BenchUtilityNetworks()
+{
+	const int32 numNetworks = 500;
+	const int32 networkSide = 10;
+
+	//Lay the networks out as 10 x 10 patches with a gap between them so they stay separate
+	FUtilityNetworkSystem networkSystem;
+	TArray<int32> handles;
+	TArray<FIntVector, TInlineAllocator<6>> socketCells;
+	FRandomStream random(4321);
+	for (int32 n = 0; n < numNetworks; n++)
+	{
+		FIntVector origin((n % 25) * (networkSide + 1), (n / 25) * (networkSide + 1), 0);
+		for (int32 i = 0; i < networkSide * networkSide; i++)
+		{
+			FIntVector cell = origin + FIntVector(i % networkSide, i / networkSide, 0);
+			socketCells.Reset();
+			socketCells.Add(cell + FIntVector(1, 0, 0));
+			socketCells.Add(cell - FIntVector(1, 0, 0));
+			socketCells.Add(cell + FIntVector(0, 1, 0));
+			socketCells.Add(cell - FIntVector(0, 1, 0));
+
+			float supply[NumUtilityTypes] = { random.FRandRange(0.0f, 2.0f), random.FRandRange(0.0f, 2.0f) };
+			float demand[NumUtilityTypes] = { random.FRandRange(0.0f, 2.0f), random.FRandRange(0.0f, 2.0f) };
+			handles.Add(networkSystem.AddBuilding(cell, socketCells, supply, demand));
+		}
+	}
+
+	int32 numSolved = 0;
+	FBenchPhase& fullPhase = RunPhase(TEXT("utility_solve_all_50k"), handles.Num(), [&]()
+	{
+		numSolved = networkSystem.Solve();
+	});
+	fullPhase.metrics.Add(TEXT("networksSolved"), numSolved);
+
+	//An hour where one building in ten changes demand and a few buildings are removed, forcing their networks to be checked for splits
+	for (int32 i = 0; i < handles.Num(); i += 10)
+	{
+		networkSystem.SetDemand(handles[i], EUtilityType::Power, random.FRandRange(0.0f, 2.0f));
+	}
+	for (int32 n = 0; n < numNetworks; n += 20)
+	{
+		networkSystem.RemoveBuilding(handles[n * networkSide * networkSide + 55]);
+	}
+
+	FBenchPhase& hourPhase = RunPhase(TEXT("utility_solve_hour_50k"), handles.Num(), [&]()
+	{
+		numSolved = networkSystem.Solve();
+	});
+	hourPhase.metrics.Add(TEXT("networksSolved"), numSolved);
+	hourPhase.metrics.Add(TEXT("networks"), networkSystem.GetNumNetworks());
+}
+
+//Generates the same 16 x 16 chunk city with 1, 4 and 16 parallel lanes, which must all give the same city
+void USpaceRPGBenchCommandlet::BenchCityGenerator()
+{
+	FCityGeneratorSettings settings;
+	settings.seed = 1234;
+	settings.chunksX = 16;
+	settings.chunksY = 16;
+	settings.corridorType = 0;
+	settings.cornerType = 1;
+	settings.crossType = 2;
+	settings.teeType = 3;
+	FCityGenerator generator(settings);
+
+	uint32 singleLaneHash = 0;
+	const int32 laneCounts[] = { 1, 4, 16 };
+	for (int32 numLanes : laneCounts)
+	{
+		TArray<FGeneratedCityChunk> chunks;
+		FBenchPhase& phase = RunPhase(FString::Printf(TEXT("city_generate_%d_lanes"), numLanes), settings.chunksX * settings.chunksY, [&]()
+		{
+			generator.Generate(chunks, numLanes);
+		});
+
+		int32 numGenerated = 0;
+		for (const FGeneratedCityChunk& chunk : chunks)
+		{
+			numGenerated += chunk.buildings.Num();
+		}
+
+		uint32 hash = FCityGenerator::HashChunks(chunks);
+		if (numLanes == 1)
+		{
+			singleLaneHash = hash;
+		}
+		else if (hash != singleLaneHash)
+		{
+			UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::City generated with %d lanes differs from the single lane city."), numLanes)
+		}
+
+		phase.metrics.Add(TEXT("buildings"), numGenerated);
+		phase.metrics.Add(TEXT("buildingsPerSecond"), phase.seconds > 0.0 ? numGenerated / phase.seconds : 0.0);
+		phase.metrics.Add(TEXT("matchesSingleLane"), hash == singleLaneHash ? 1.0 : 0.0);
+		phase.metrics.Add(TEXT("errors"), hash == singleLaneHash ? 0 : 1);
+	}
+}
+
+//Advances one game hour of a 100k building economy with 32 resources, then churns a tenth of the buildings
+void USpaceRPGBenchCommandlet::BenchEconomyHour()
+{
+	const int32 numEconomyBuildings = 100000;
+	const int32 numResources = 32;
+
+	FEconomyStore store(numResources);
+	TArray<int32> handles;
+	handles.Reserve(numEconomyBuildings);
+	FRandomStream random(8765);
+	for (int32 i = 0; i < numEconomyBuildings; i++)
+	{
+		int32 handle = store.AddBuilding();
+		for (int32 resource = 0; resource < numResources; resource++)
+		{
+			store.SetProduction(handle, resource, random.FRandRange(0.0f, 10.0f));
+			store.SetConsumption(handle, resource, random.FRandRange(0.0f, 10.0f));
+			store.SetCapacity(handle, resource, random.FRandRange(0.0f, 100.0f));
+		}
+		handles.Add(handle);
+	}
+
+	FBenchPhase& hourPhase = RunPhase(TEXT("economy_hour_100k_32"), numEconomyBuildings, [&]()
+	{
+		store.AdvanceHour();
+	});
+	hourPhase.metrics.Add(TEXT("valuesPerSecond"), hourPhase.seconds > 0.0 ? (double)numEconomyBuildings * numResources / hourPhase.seconds : 0.0);
+	hourPhase.metrics.Add(TEXT("storeBytes"), (double)store.GetAllocatedSize());
+
+	//A building that consumes nothing, with nothing produced or stored, is fully satisfied
+	FEconomyStore idleStore(1);
+	int32 idleBuilding = idleStore.AddBuilding();
+	idleStore.AdvanceHour();
+	int32 errors = idleStore.GetSatisfaction(idleBuilding, 0) == 1.0f ? 0 : 1;
+	if (errors > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::A building without demand had a satisfaction of %f."), idleStore.GetSatisfaction(idleBuilding, 0))
+	}
+	hourPhase.metrics.Add(TEXT("errors"), errors);
+
+	const int32 numChurned = numEconomyBuildings / 10;
+	RunPhase(TEXT("economy_remove_add_10k"), numChurned, [&]()
+	{
+		for (int32 i = 0; i < numChurned; i++)
+		{
+			int32 slot = random.RandHelper(handles.Num());
+			store.RemoveBuilding(handles[slot]);
+			handles[slot] = store.AddBuilding();
+		}
+	});
+}
+
+//Compares each building's own mesh collision with merged chunk collision for the preview's traces, run with -buildings=20000
+void USpaceRPGBenchCommandlet::BenchBuildingCollision()
+{
+	UBuildingCollisionSubsystem* collision = world->GetSubsystem<UBuildingCollisionSubsystem>();
+	if (collision == nullptr)
+	{
+		return;
+	}
+
+	const int32 numTraces = 10000;
+	int32 gridSize = FMath::CeilToInt(FMath::Sqrt((float)numBuildings));
+	float gridExtent = gridSize * buildingSpacing;
+
+	//The line trace and sweep ABuildingPreview makes each frame, from random points over the grid
+	auto runTraces = [&](const TCHAR* phaseName)
+	{
+		FRandomStream random(2468);
+		int32 numHits = 0;
+		FCollisionShape shape = FCollisionShape::MakeBox(FVector(150.0f));
+		FBenchPhase& phase = RunPhase(phaseName, numTraces, [&]()
+		{
+			for (int32 i = 0; i < numTraces; i++)
+			{
+				FVector start(random.FRandRange(0.0f, gridExtent), random.FRandRange(0.0f, gridExtent), 2000.0f);
+				FHitResult hit;
+				if (world->LineTraceSingleByChannel(hit, start, start - FVector(0.0f, 0.0f, 4000.0f), ECC_Visibility, FCollisionQueryParams()))
+				{
+					numHits++;
+					FVector sweepStart = hit.Location + FVector(0.0f, 0.0f, 150.0f);
+					world->SweepSingleByObjectType(hit, sweepStart, sweepStart + 0.1f, FQuat::Identity, ECC_WorldDynamic, shape);
+				}
+			}
+		});
+		phase.metrics.Add(TEXT("hits"), numHits);
+		phase.metrics.Add(TEXT("collisionShapes"), collision->GetNumCollisionShapes());
+	};
+
+	bool bWasEnabled = collision->IsChunkCollisionEnabled();
+
+	RunPhase(TEXT("collision_use_mesh"), numBuildings, [&]()
+	{
+		collision->SetChunkCollisionEnabled(false);
+	});
+	runTraces(TEXT("collision_traces_mesh"));
+
+	RunPhase(TEXT("collision_use_chunks"), numBuildings, [&]()
+	{
+		collision->SetChunkCollisionEnabled(true);
+		collision->FlushDirtyChunks();
+	});
+	runTraces(TEXT("collision_traces_chunks"));
+
+	collision->SetChunkCollisionEnabled(bWasEnabled);
+}
+
+//Walks 200 characters across the grid for 300 frames at full rate, then with significance throttling from a viewer in one corner
+void USpaceRPGBenchCommandlet::BenchCharacterSignificance()
+{
+	UCharacterSignificanceSubsystem* significance = world->GetSubsystem<UCharacterSignificanceSubsystem>();
+	UClass* characterClass = LoadBenchClass<ASpaceRPGCharacter>(BenchCharacterClassPath);
+	if (significance == nullptr)
+	{
+		return;
+	}
+
+	const int32 numCharacters = 200;
+	const int32 numFrames = 300;
+	const float deltaTime = 1.0f / 60.0f;
+	int32 gridSize = FMath::CeilToInt(FMath::Sqrt((float)numBuildings));
+	float gridExtent = gridSize * buildingSpacing;
+
+	FActorSpawnParameters spawnParams;
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	//Characters stand on the buildings and move without controllers, as residents would
+	TArray<ACharacter*> benchCharacters;
+	FRandomStream random(1357);
+	for (int32 i = 0; i < numCharacters; i++)
+	{
+		FVector location(random.FRandRange(0.0f, gridExtent), random.FRandRange(0.0f, gridExtent), 1000.0f);
+		ACharacter* character = world->SpawnActor<ACharacter>(characterClass, FTransform(location), spawnParams);
+		if (character != nullptr)
+		{
+			character->GetCharacterMovement()->bRunPhysicsWithNoController = true;
+			benchCharacters.Add(character);
+		}
+	}
+
+	FSignificanceViewer viewer = { FVector(0.0f, 0.0f, 500.0f), FVector(1.0f, 1.0f, 0.0f).GetSafeNormal() };
+	significance->SetExtraViewers(MakeArrayView(&viewer, 1));
+
+	ELogVerbosity::Type previousVerbosity = LogTemp.GetVerbosity();
+	LogTemp.SetVerbosity(ELogVerbosity::Error);
+
+	auto walkCharacters = [&](const TCHAR* phaseName)
+	{
+		FBenchPhase& phase = RunPhase(phaseName, numFrames, [&]()
+		{
+			for (int32 frame = 0; frame < numFrames; frame++)
+			{
+				for (int32 i = 0; i < benchCharacters.Num(); i++)
+				{
+					float angle = (i + frame * 0.01f) * 2.3f;
+					benchCharacters[i]->AddMovementInput(FVector(FMath::Cos(angle), FMath::Sin(angle), 0.0f));
+				}
+				world->Tick(LEVELTICK_All, deltaTime);
+			}
+		});
+		phase.metrics.Add(TEXT("characters"), benchCharacters.Num());
+		phase.metrics.Add(TEXT("high"), significance->GetNumCharacters(ECharacterSignificance::High));
+		phase.metrics.Add(TEXT("medium"), significance->GetNumCharacters(ECharacterSignificance::Medium));
+		phase.metrics.Add(TEXT("low"), significance->GetNumCharacters(ECharacterSignificance::Low));
+		phase.metrics.Add(TEXT("hidden"), significance->GetNumCharacters(ECharacterSignificance::Hidden));
+	};
+
+	significance->SetSignificanceEnabled(false);
+	walkCharacters(TEXT("characters_200_full_rate"));
+
+	significance->SetSignificanceEnabled(true);
+	significance->UpdateSignificance(MakeArrayView(&viewer, 1));
+	walkCharacters(TEXT("characters_200_significance"));
+
+	LogTemp.SetVerbosity(previousVerbosity);
+	significance->SetExtraViewers(TArrayView<const FSignificanceViewer>());
+	for (ACharacter* character : benchCharacters)
+	{
+		character->Destroy();
+	}
+}
+
+//Places the nameplates of 500 named characters around a panning camera, with the pooled widgets and then with a widget
+//for every character. Layout is measured as well when Slate is running, which it normally isn't in a commandlet
+void USpaceRPGBenchCommandlet::BenchNameplates()
+{
+	UNameplateSubsystem* nameplates = world->GetSubsystem<UNameplateSubsystem>();
+	UClass* characterClass = LoadBenchClass<ASpaceRPGCharacter>(BenchCharacterClassPath);
+	if (nameplates == nullptr)
+	{
+		return;
+	}
+
+	const int32 numCharacters = 500;
+	const int32 numFrames = 600;
+	const int32 numLayoutFrames = 60;
+	const float deltaTime = 1.0f / 60.0f;
+	const float crowdRadius = 5000.0f;
+	const FIntRect viewRect(0, 0, 1920, 1080);
+	const FVector viewLocation(0.0f, 0.0f, 300.0f);
+
+	FActorSpawnParameters spawnParams;
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	//The crowd surrounds the camera, most of it further away than nameplates are shown
+	TArray<ASpaceRPGCharacter*> benchCharacters;
+	FRandomStream random(8642);
+	for (int32 i = 0; i < numCharacters; i++)
+	{
+		FVector2D offset = FVector2D(random.FRandRange(-1.0f, 1.0f), random.FRandRange(-1.0f, 1.0f)).GetSafeNormal() * crowdRadius * FMath::Sqrt(random.FRand());
+		ASpaceRPGCharacter* character = world->SpawnActor<ASpaceRPGCharacter>(characterClass, FTransform(FVector(offset, 100.0f)), spawnParams);
+		if (character != nullptr)
+		{
+			character->ResidentName = FText::Format(NSLOCTEXT("SpaceRPGBench", "ResidentName", "Resident {0}"), i + 1);
+			benchCharacters.Add(character);
+		}
+	}
+
+	ELogVerbosity::Type previousVerbosity = LogTemp.GetVerbosity();
+	LogTemp.SetVerbosity(ELogVerbosity::Error);
+
+	auto placeNameplates = [&](const TCHAR* phaseName)
+	{
+		nameplates->SetNameplatesEnabled(true);
+		int32 assignmentsBefore = nameplates->GetNumAssignments();
+		int64 numVisible = 0;
+
+		FBenchPhase& phase = RunPhase(phaseName, numFrames, [&]()
+		{
+			for (int32 frame = 0; frame < numFrames; frame++)
+			{
+				FNameplateView view = FNameplateView::Make(viewLocation, FRotator(-10.0f, frame * 0.6f, 0.0f), 90.0f, viewRect);
+				nameplates->UpdateNameplates(view, deltaTime);
+				numVisible += nameplates->GetNumVisibleNameplates();
+			}
+		});
+		phase.metrics.Add(TEXT("characters"), benchCharacters.Num());
+		phase.metrics.Add(TEXT("widgets"), nameplates->GetNumWidgets());
+		phase.metrics.Add(TEXT("meanVisible"), (double)numVisible / numFrames);
+		phase.metrics.Add(TEXT("assignments"), nameplates->GetNumAssignments() - assignmentsBefore);
+		phase.metrics.Add(TEXT("gameThreadUsPerFrame"), phase.seconds * 1000000.0 / numFrames);
+
+		//Measures the layout of the widgets left showing, after building their Slate widgets outside the timing
+		if (FSlateApplication::IsInitialized())
+		{
+			TArray<UNameplateWidget*> visibleWidgets;
+			nameplates->GetVisibleWidgets(visibleWidgets);
+			for (UNameplateWidget* widget : visibleWidgets)
+			{
+				widget->TakeWidget();
+			}
+
+			double startTime = FPlatformTime::Seconds();
+			for (int32 frame = 0; frame < numLayoutFrames; frame++)
+			{
+				for (UNameplateWidget* widget : visibleWidgets)
+				{
+					widget->TakeWidget()->SlatePrepass(1.0f);
+				}
+			}
+			phase.metrics.Add(TEXT("slatePrepassUsPerFrame"), (FPlatformTime::Seconds() - startTime) * 1000000.0 / numLayoutFrames);
+		}
+	};
+
+	placeNameplates(TEXT("nameplates_500_pooled"));
+
+	nameplates->SetLimits(numCharacters, crowdRadius * 2.0f);
+	placeNameplates(TEXT("nameplates_500_per_character"));
+
+	nameplates->SetNameplatesEnabled(false);
+	LogTemp.SetVerbosity(previousVerbosity);
+	for (ASpaceRPGCharacter* character : benchCharacters)
+	{
+		character->Destroy();
+	}
+}
+
+//Evaluates every date of 1,000 years in calendar order, checking the model against the calendar's own rollover
+void USpaceRPGBenchCommandlet::BenchEnvironmentModel()
+{
+	const int32 numYears = 1000;
+	const int32 seed = 97531;
+	int32 numDays = 0;
+	int32 numErrors = 0;
+	int32 weatherCounts[(int32)EWeatherType::Snow + 1] = {};
+
+	auto reportError = [&numErrors](const TCHAR* check, int32 day, int32 month, int32 year)
+	{
+		if (numErrors++ < 10)
+		{
+			UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Environment model failed %s on %d / %d / %d."), check, day, month, year)
+		}
+	};
+
+	FBenchPhase& phase = RunPhase(TEXT("environment_1000_years"), numYears * 365, [&]()
+	{
+		int32 previousDayNumber = FEnvironmentModel::GetDayNumber(1, 1, 1) - 1;
+		for (int32 year = 1; year <= numYears; year++)
+		{
+			for (int32 month = 1; month <= 12; month++)
+			{
+				int32 daysInMonth = UKismetMathLibrary::DaysInMonth(year, month);
+				for (int32 day = 1; day <= daysInMonth; day++)
+				{
+					FEnvironmentState state = FEnvironmentModel::Evaluate(day, month, year, seed, 45.0f);
+					numDays++;
+					weatherCounts[(int32)state.weather]++;
+
+					//Day numbers follow the calendar one day at a time
+					int32 dayNumber = FEnvironmentModel::GetDayNumber(day, month, year);
+					if (dayNumber != previousDayNumber + 1)
+					{
+						reportError(TEXT("day numbering"), day, month, year);
+					}
+					previousDayNumber = dayNumber;
+
+					if (state.dayOfYear < 0 || state.dayOfYear > 365 || (month == 1 && day == 1 && state.dayOfYear != 0))
+					{
+						reportError(TEXT("day of year"), day, month, year);
+					}
+					if (!(state.dayLength >= 0.0f && state.dayLength <= 24.0f) || !(state.cloudCover >= 0.0f && state.cloudCover <= 1.0f))
+					{
+						reportError(TEXT("daylight or cloud range"), day, month, year);
+					}
+					if ((month == 7 && state.season != ESeason::Summer) || (month == 1 && state.season != ESeason::Winter))
+					{
+						reportError(TEXT("season"), day, month, year);
+					}
+				}
+			}
+		}
+	});
+
+	//Evaluating any date on its own must give the same weather as the sweep, without the days in between
+	FRandomStream random(seed);
+	for (int32 i = 0; i < 1000; i++)
+	{
+		int32 year = random.RandRange(1, numYears);
+		int32 month = random.RandRange(1, 12);
+		int32 day = random.RandRange(1, UKismetMathLibrary::DaysInMonth(year, month));
+		FEnvironmentState first = FEnvironmentModel::Evaluate(day, month, year, seed, 45.0f);
+		FEnvironmentState second = FEnvironmentModel::Evaluate(day, month, year, seed, 45.0f);
+		if (first.weather != second.weather || first.cloudCover != second.cloudCover || first.temperature != second.temperature)
+		{
+			reportError(TEXT("determinism"), day, month, year);
+		}
+	}
+
+	phase.iterations = FMath::Max(numDays, 1);
+	phase.metrics.Add(TEXT("days"), numDays);
+	phase.metrics.Add(TEXT("errors"), numErrors);
+	phase.metrics.Add(TEXT("clearFraction"), (double)weatherCounts[(int32)EWeatherType::Clear] / FMath::Max(numDays, 1));
+	phase.metrics.Add(TEXT("snowFraction"), (double)weatherCounts[(int32)EWeatherType::Snow] / FMath::Max(numDays, 1));
+}
+
+//Publishes 50,000 buildings through a world snapshot publisher: the first layout, unchanged frames and frames with an
+//edit. Then publishes an edit every frame while task graph readers check every snapshot they acquire for torn state
+void USpaceRPGBenchCommandlet::BenchWorldSnapshot()
+{
+	const int32 numSnapshotBuildings = 50000;
+	const int32 numFrames = 1000;
+	const int32 numStressFrames = 20000;
+	const int32 gridSize = FMath::CeilToInt(FMath::Sqrt((float)numSnapshotBuildings));
+
+	//Every frame of the stress test toggles the marker cell, and the building placed there carries the frame number
+	const FIntVector markerCell(-1, -1, 0);
+
+	FWorldSnapshotPublisher publisher;
+	FWorldSnapshotTime time;
+	uint64 frameNumber = 0;
+
+	auto makeBuilding = [](const FIntVector& cell, int32 buildingType)
+	{
+		FWorldSnapshotBuilding building;
+		building.cell = cell;
+		building.buildingType = buildingType;
+		building.transform = FTransform(FVector(cell) * 100.0f);
+		building.bounds = FVector(50.0f);
+		return building;
+	};
+
+	FBenchPhase& layoutPhase = RunPhase(TEXT("world_snapshot_layout_50k"), numSnapshotBuildings, [&]()
+	{
+		for (int32 i = 0; i < numSnapshotBuildings; i++)
+		{
+			FIntVector cell(i % gridSize, i / gridSize, 0);
+			FIntVector sockets[] = { cell + FIntVector(1, 0, 0), cell + FIntVector(-1, 0, 0), cell + FIntVector(0, 1, 0), cell + FIntVector(0, -1, 0) };
+			publisher.SetBuilding(makeBuilding(cell, i % 16), sockets);
+		}
+		publisher.Publish(++frameNumber, time);
+	});
+	layoutPhase.metrics.Add(TEXT("buildings"), publisher.Acquire()->GetNumBuildings());
+	layoutPhase.metrics.Add(TEXT("snapshotBytes"), (double)publisher.GetAllocatedSize());
+
+	FBenchPhase& unchangedPhase = RunPhase(TEXT("world_snapshot_publish_50k"), numFrames, [&]()
+	{
+		for (int32 frame = 0; frame < numFrames; frame++)
+		{
+			time.worldSeconds += 1.0 / 60.0;
+			publisher.Publish(++frameNumber, time);
+		}
+	});
+	unchangedPhase.metrics.Add(TEXT("usPerPublish"), unchangedPhase.seconds * 1000000.0 / numFrames);
+
+	FBenchPhase& editPhase = RunPhase(TEXT("world_snapshot_publish_edit_50k"), numFrames, [&]()
+	{
+		for (int32 frame = 0; frame < numFrames; frame++)
+		{
+			if (frame % 2 == 0)
+			{
+				publisher.SetBuilding(makeBuilding(markerCell, frame), TArrayView<const FIntVector>());
+			}
+			else
+			{
+				publisher.RemoveBuilding(markerCell);
+			}
+			publisher.Publish(++frameNumber, time);
+		}
+	});
+	editPhase.metrics.Add(TEXT("usPerPublish"), editPhase.seconds * 1000000.0 / numFrames);
+
+	//Readers hold each snapshot for a few lookups, as a job would, and check it against what the frame published
+	const int32 numReaders = FMath::Clamp(FTaskGraphInterface::Get().GetNumWorkerThreads(), 2, 8);
+	TAtomic<bool> bStop(false);
+	TArray<int64> acquisitions;
+	TArray<int32> errors;
+	acquisitions.SetNumZeroed(numReaders);
+	errors.SetNumZeroed(numReaders);
+
+	auto readSnapshots = [&](int32 reader)
+	{
+		FRandomStream random(reader);
+		uint64 lastVersion = 0;
+		while (!bStop.Load())
+		{
+			FWorldSnapshotRef snapshot = publisher.Acquire();
+			bool bValid = snapshot->version >= lastVersion && snapshot->time.worldSeconds == (double)snapshot->frameNumber
+				&& snapshot->GetNumBuildings() == numSnapshotBuildings + (snapshot->frameNumber % 2 == 0 ? 1 : 0);
+
+			const FWorldSnapshotBuilding* marker = snapshot->FindBuilding(markerCell);
+			bValid &= (snapshot->frameNumber % 2 == 0) == (marker != nullptr) && (marker == nullptr || marker->buildingType == (int32)snapshot->frameNumber);
+
+			for (int32 i = 0; i < 16; i++)
+			{
+				FIntVector cell(random.RandHelper(gridSize), random.RandHelper(gridSize), 0);
+				const FWorldSnapshotBuilding* building = snapshot->FindBuilding(cell);
+				bValid &= building == nullptr || (building->cell == cell && snapshot->GetSocketCells(*building).Num() == 4);
+			}
+
+			lastVersion = snapshot->version;
+			acquisitions[reader]++;
+			errors[reader] += bValid ? 0 : 1;
+		}
+	};
+
+	//A skipped publish keeps its edit, so the frame number only moves on once the frame is out
+	auto publishStressFrame = [&]()
+	{
+		uint64 nextFrame = frameNumber + 1;
+		if (nextFrame % 2 == 0)
+		{
+			publisher.SetBuilding(makeBuilding(markerCell, (int32)nextFrame), TArrayView<const FIntVector>());
+		}
+		else
+		{
+			publisher.RemoveBuilding(markerCell);
+		}
+
+		time.worldSeconds = (double)nextFrame;
+		if (publisher.Publish(nextFrame, time))
+		{
+			frameNumber = nextFrame;
+		}
+	};
+
+	int32 skippedBefore = publisher.GetNumSkippedPublishes();
+	FBenchPhase& stressPhase = RunPhase(TEXT("world_snapshot_readers"), numStressFrames, [&]()
+	{
+		//Readers start on a frame published the way the stress test publishes
+		publishStressFrame();
+
+		FGraphEventArray tasks;
+		for (int32 reader = 0; reader < numReaders; reader++)
+		{
+			tasks.Add(FFunctionGraphTask::CreateAndDispatchWhenReady([&readSnapshots, reader]() { readSnapshots(reader); }, TStatId(), nullptr, ENamedThreads::AnyBackgroundThreadNormalTask));
+		}
+
+		for (int32 frame = 0; frame < numStressFrames; frame++)
+		{
+			publishStressFrame();
+		}
+
+		bStop = true;
+		FTaskGraphInterface::Get().WaitUntilTasksComplete(tasks);
+	});
+
+	int64 totalAcquisitions = 0;
+	int32 totalErrors = 0;
+	for (int32 reader = 0; reader < numReaders; reader++)
+	{
+		totalAcquisitions += acquisitions[reader];
+		totalErrors += errors[reader];
+	}
+	if (totalErrors > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::%d of %lld world snapshots read by %d readers were torn."), totalErrors, totalAcquisitions, numReaders)
+	}
+
+	stressPhase.metrics.Add(TEXT("readers"), numReaders);
+	stressPhase.metrics.Add(TEXT("acquisitions"), (double)totalAcquisitions);
+	stressPhase.metrics.Add(TEXT("errors"), totalErrors);
+	stressPhase.metrics.Add(TEXT("skippedPublishes"), publisher.GetNumSkippedPublishes() - skippedBefore);
+	stressPhase.metrics.Add(TEXT("usPerPublish"), stressPhase.seconds * 1000000.0 / numStressFrames);
+
+	//A building turned through the command log reaches the published snapshot with its new yaw and turned sockets
+	UWorldSnapshotSubsystem* snapshots = world->GetSubsystem<UWorldSnapshotSubsystem>();
+	UBuildingCommandLog* commandLog = world->GetSubsystem<UBuildingCommandLog>();
+	UBuildingRegistry* registry = world->GetSubsystem<UBuildingRegistry>();
+	const FIntVector rotateCell(0, -52, 0);
+	if (snapshots == nullptr || commandLog == nullptr || registry == nullptr || !commandLog->PlaceBuilding(0, FBuildingGrid::CellToWorld(rotateCell), 0.0f))
+	{
+		return;
+	}
+
+	ABuilding* turnedBuilding = registry->FindBuilding(rotateCell);
+	float expectedYaw = FBuildingCommandRecord::DecodeYaw(FBuildingCommandRecord::EncodeYaw(90.0f));
+	FBenchPhase& rotatePhase = RunPhase(TEXT("world_snapshot_rotate"), 1, [&]()
+	{
+		commandLog->RotateBuilding(turnedBuilding, 90.0f);
+		snapshots->PublishSnapshot();
+	});
+
+	int32 rotateErrors = 0;
+	FWorldSnapshotRef snapshot = snapshots->AcquireSnapshot();
+	const FWorldSnapshotBuilding* snapshotBuilding = snapshot.IsValid() ? snapshot->FindBuilding(rotateCell) : nullptr;
+	if (snapshotBuilding != nullptr && turnedBuilding != nullptr)
+	{
+		TArray<FIntVector, TInlineAllocator<6>> socketCells;
+		turnedBuilding->GetSocketCells(socketCells);
+		float yaw = snapshotBuilding->transform.Rotator().Yaw;
+		rotateErrors += FMath::IsNearlyEqual(FRotator::NormalizeAxis(yaw - expectedYaw), 0.0f, 0.01f) ? 0 : 1;
+		TArrayView<const FIntVector> snapshotSockets = snapshot->GetSocketCells(*snapshotBuilding);
+		bool bSocketsMatch = snapshotSockets.Num() == socketCells.Num();
+		for (int32 i = 0; bSocketsMatch && i < socketCells.Num(); i++)
+		{
+			bSocketsMatch = snapshotSockets[i] == socketCells[i];
+		}
+		rotateErrors += bSocketsMatch ? 0 : 1;
+	}
+	else
+	{
+		rotateErrors++;
+	}
+
+	if (rotateErrors > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::The world snapshot did not follow a building turned through the command log."))
+	}
+	rotatePhase.metrics.Add(TEXT("errors"), rotateErrors);
+
+	commandLog->DemolishBuilding(turnedBuilding);
+}
+
+//Converts a million locations spread over the world to cells and back, comparing with the float grid snapping the
+//building grid replaced. Then checks every cell along the world's axes converts, snaps and turns exactly
+void USpaceRPGBenchCommandlet::BenchBuildingGrid()
+{
+	const int32 numLocations = 1000000;
+	const float worldExtent = HALF_WORLD_MAX;
+	const int32 maxWorldCell = FMath::FloorToInt(worldExtent / FBuildingGrid::CellSize);
+
+	FRandomStream random(47);
+	TArray<FVector> locations;
+	locations.SetNumUninitialized(numLocations);
+	for (FVector& location : locations)
+	{
+		location = FVector(random.FRandRange(-worldExtent, worldExtent), random.FRandRange(-worldExtent, worldExtent), random.FRandRange(-worldExtent, worldExtent));
+	}
+
+	TArray<FIntVector> cells;
+	TArray<FIntVector> turnedCells;
+	TArray<FVector> snappedLocations;
+	cells.SetNumUninitialized(numLocations);
+	turnedCells.SetNumUninitialized(numLocations);
+	snappedLocations.SetNumUninitialized(numLocations);
+
+	FBenchPhase& toCellPhase = RunPhase(TEXT("grid_world_to_cell_1m"), numLocations, [&]()
+	{
+		for (int32 i = 0; i < numLocations; i++)
+		{
+			cells[i] = FBuildingGrid::WorldToCell(locations[i]);
+		}
+	});
+	toCellPhase.metrics.Add(TEXT("nsPerConversion"), toCellPhase.seconds * 1000000000.0 / numLocations);
+
+	FBenchPhase& toWorldPhase = RunPhase(TEXT("grid_cell_to_world_1m"), numLocations, [&]()
+	{
+		for (int32 i = 0; i < numLocations; i++)
+		{
+			snappedLocations[i] = FBuildingGrid::CellToWorld(cells[i]);
+		}
+	});
+	toWorldPhase.metrics.Add(TEXT("nsPerConversion"), toWorldPhase.seconds * 1000000000.0 / numLocations);
+
+	FBenchPhase& rotatePhase = RunPhase(TEXT("grid_rotate_footprint_1m"), numLocations, [&]()
+	{
+		for (int32 i = 0; i < numLocations; i++)
+		{
+			turnedCells[i] = FBuildingGrid::RotateCell(cells[i], i) + FBuildingGrid::RotateExtent(cells[i], i);
+		}
+	});
+	rotatePhase.metrics.Add(TEXT("nsPerRotation"), rotatePhase.seconds * 1000000000.0 / numLocations);
+
+	//Snapping as the preview did it, with the cell found from the snapped location as the registry did. The two only
+	//disagree on locations within float rounding of halfway between two cells
+	int32 legacyMismatches = 0;
+	FBenchPhase& legacyPhase = RunPhase(TEXT("grid_legacy_snap_1m"), numLocations, [&]()
+	{
+		for (int32 i = 0; i < numLocations; i++)
+		{
+			FVector snapped = UKismetMathLibrary::Vector_SnappedToGrid(locations[i], UBuildingRegistry::CellSize);
+			FIntVector cell(
+				FMath::FloorToInt(snapped.X / UBuildingRegistry::CellSize + 0.5f),
+				FMath::FloorToInt(snapped.Y / UBuildingRegistry::CellSize + 0.5f),
+				FMath::FloorToInt(snapped.Z / UBuildingRegistry::CellSize + 0.5f));
+			legacyMismatches += cell == cells[i] ? 0 : 1;
+		}
+	});
+	legacyPhase.metrics.Add(TEXT("nsPerConversion"), legacyPhase.seconds * 1000000000.0 / numLocations);
+	legacyPhase.metrics.Add(TEXT("legacyMismatches"), legacyMismatches);
+
+	//Every cell out to the edge of the world along the three axes, with a footprint that changes from cell to cell
+	const float innerOffset = FBuildingGrid::CellSize * 0.5f - 1.0f;
+	int32 errors = 0;
+	FBenchPhase& exactPhase = RunPhase(TEXT("grid_exactness_world_extents"), maxWorldCell * 2 + 1, [&]()
+	{
+		for (int32 c = -maxWorldCell; c <= maxWorldCell; c++)
+		{
+			FIntVector cell(c, -c, c / 4);
+			FVector location = FBuildingGrid::CellToWorld(cell);
+			bool bValid = location.X == (double)c * FBuildingGrid::CellSize && location.Y == -(double)c * FBuildingGrid::CellSize;
+			bValid &= FBuildingGrid::WorldToCell(location) == cell;
+			bValid &= FBuildingGrid::WorldToCell(location + FVector(innerOffset)) == cell && FBuildingGrid::WorldToCell(location - FVector(innerOffset)) == cell;
+			bValid &= FBuildingGrid::Snap(location + FVector(innerOffset, -innerOffset, innerOffset)) == location;
+
+			FIntVector extent(c & 7, (c >> 3) & 7, 1);
+			for (int32 turns = 0; turns < 4; turns++)
+			{
+				FIntVector turned = FBuildingGrid::RotateCell(cell, turns);
+				bValid &= FBuildingGrid::RotateCell(turned, 4 - turns) == cell;
+				bValid &= FBuildingGrid::WorldToCell(FRotator(0.0f, turns * 90.0f, 0.0f).RotateVector(location)) == turned;
+
+				FIntVector turnedExtent = FBuildingGrid::RotateCell(extent, turns);
+				bValid &= FBuildingGrid::RotateExtent(extent, turns) == FIntVector(FMath::Abs(turnedExtent.X), FMath::Abs(turnedExtent.Y), turnedExtent.Z);
+				bValid &= FBuildingGrid::TurnedExtentToCells(FBuildingGrid::CellToWorld(extent), turns * 90.0f) == FBuildingGrid::RotateExtent(extent, turns);
+			}
+
+			//Eighth turns take up the cells under the footprint turned onto its diagonal
+			float diagonal = FMath::Sqrt(2.0f) * 0.5f * (extent.X + extent.Y);
+			bValid &= FBuildingGrid::TurnedExtentToCells(FBuildingGrid::CellToWorld(extent), 45.0f) == FBuildingGrid::ExtentToCells(FVector(diagonal, diagonal, extent.Z) * FBuildingGrid::CellSize);
+			errors += bValid ? 0 : 1;
+		}
+
+		//Rotation bytes from the command log away from the 45 degree boundaries, and the same yaws wound back a full turn
+		for (int32 rotation = 0; rotation < 256; rotation++)
+		{
+			if ((rotation & 63) == 32)
+			{
+				continue;
+			}
+			float yaw = FBuildingCommandRecord::DecodeYaw((uint8)rotation);
+			int32 quarterTurns = ((rotation + 32) >> 6) & 3;
+			errors += FBuildingGrid::YawToQuarterTurns(yaw) == quarterTurns && FBuildingGrid::YawToQuarterTurns(yaw - 360.0f) == quarterTurns ? 0 : 1;
+		}
+	});
+
+	if (errors > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::%d building grid conversions out to cell %d were not exact."), errors, maxWorldCell)
+	}
+	exactPhase.metrics.Add(TEXT("maxCell"), maxWorldCell);
+	exactPhase.metrics.Add(TEXT("errors"), errors);
+}
+
+//Kills an autosave halfway through writing a journal frame, then checks loading keeps every earlier frame and the next save is read back
+void USpaceRPGBenchCommandlet::BenchAutosaveRecovery()
+{
+	const int32 numFrames = 32;
+
+	FString benchDir = FPaths::ProjectSavedDir() / TEXT("Bench");
+	FString journalPath = benchDir / TEXT("Recovery.journal");
+	FString tornPath = benchDir / TEXT("Torn.journal");
+	IFileManager::Get().Delete(*journalPath, false, false, true);
+	IFileManager::Get().Delete(*(journalPath + TEXT(".tmp")), false, false, true);
+	IFileManager::Get().Delete(*tornPath, false, false, true);
+
+	//One building in a chunk of its own per frame
+	auto makeFrame = [](int32 index)
+	{
+		FCitySaveFrame frame;
+		FCityChunkSave& chunk = frame.chunks.AddDefaulted_GetRef();
+		chunk.chunk = FIntPoint(index, 0);
+		chunk.buildings.Add(FBuildingCommandRecord::Make(EBuildingCommand::Place, FIntVector(index * 16, 0, 0), 0, 0));
+		return frame;
+	};
+
+	for (int32 i = 0; i < numFrames; i++)
+	{
+		UCityAutosaveSubsystem::WriteFrame(journalPath, makeFrame(i), false);
+	}
+
+	//The process dies with half of the next frame written
+	UCityAutosaveSubsystem::WriteFrame(tornPath, makeFrame(numFrames), false);
+	TArray<uint8> tornFrame;
+	FFileHelper::LoadFileToArray(tornFrame, *tornPath);
+	tornFrame.SetNum(tornFrame.Num() / 2);
+	FFileHelper::SaveArrayToFile(tornFrame, *journalPath, &IFileManager::Get(), FILEWRITE_Append);
+
+	int32 recoveredFrames = 0;
+	int32 recoveredChunks = 0;
+	int32 savedChunks = 0;
+	FBenchPhase& phase = RunPhase(TEXT("autosave_torn_recovery"), 1, [&]()
+	{
+		//Loading recovers the journal, then the next autosave appends to it
+		FCitySaveFrame recoveredState;
+		UCityAutosaveSubsystem::RecoverJournal(journalPath, recoveredState, recoveredFrames);
+		recoveredChunks = recoveredState.chunks.Num();
+
+		UCityAutosaveSubsystem::WriteFrame(journalPath, makeFrame(numFrames + 1), false);
+
+		FCitySaveFrame savedState;
+		int32 savedFrames = 0;
+		UCityAutosaveSubsystem::ReadJournal(journalPath, savedState, savedFrames);
+		savedChunks = savedState.chunks.Num();
+	});
+
+	int32 errors = (recoveredChunks == numFrames ? 0 : 1) + (savedChunks == numFrames + 1 ? 0 : 1);
+	if (errors > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Autosave journal recovered %d of %d chunks and read back %d of %d after the next save."), recoveredChunks, numFrames, savedChunks, numFrames + 1)
+	}
+	phase.metrics.Add(TEXT("recoveredFrames"), recoveredFrames);
+	phase.metrics.Add(TEXT("recoveredChunks"), recoveredChunks);
+	phase.metrics.Add(TEXT("chunksAfterSave"), savedChunks);
+	phase.metrics.Add(TEXT("errors"), errors);
+
+	IFileManager::Get().Delete(*journalPath, false, false, true);
+	IFileManager::Get().Delete(*tornPath, false, false, true);
+}
+
+//Applies a replay back to back into the empty world, measuring operations per second against the recorded duration
+void USpaceRPGBenchCommandlet::BenchReplay(const FString& params)
+{
+	UCityReplaySubsystem* replay = world->GetSubsystem<UCityReplaySubsystem>();
+	UBuildingRegistry* registry = world->GetSubsystem<UBuildingRegistry>();
+	if (replay == nullptr || registry == nullptr)
+	{
+		return;
+	}
+
+	UClass* timeControllerClass = LoadBenchClass<ATimeController>(BenchTimeControllerClassPath);
+	world->SpawnActor<ATimeController>(timeControllerClass, FTransform::Identity);
+
+	TArray<uint8> data;
+	int32 expectedBuildings = INDEX_NONE;
+	FString replayPath;
+	if (FParse::Value(*params, TEXT("replay="), replayPath))
+	{
+		if (!FFileHelper::LoadFileToArray(data, *replayPath))
+		{
+			UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Could not read replay %s."), *replayPath)
+			return;
+		}
+	}
+	else
+	{
+		//A day of players building in small batches, with hourly clock events and a faster afternoon
+		const int32 numBatches = 20000;
+		const double secondsInDay = 24.0 * 60.0 * 60.0;
+		const int32 areaSize = 256;
+
+		FCityReplayWriter writer;
+		FRandomStream random(4242);
+		TArray<FIntVector> occupiedCells;
+		TSet<FIntVector> occupied;
+		int32 hour = -1;
+
+		for (int32 i = 0; i < numBatches; i++)
+		{
+			double time = i * secondsInDay / numBatches;
+			int32 batchHour = (int32)(time / 3600.0);
+			if (batchHour != hour)
+			{
+				hour = batchHour;
+				writer.WriteClock(time, hour * 60.0f, 1, 1, 1);
+				if (hour == 12 || hour == 18)
+				{
+					writer.WriteTimeRate(time, hour == 12 ? 4.0f : 1.0f);
+				}
+			}
+
+			TArray<FBuildingCommandRecord> batch;
+			int32 batchSize = random.RandRange(1, 5);
+			for (int32 j = 0; j < batchSize; j++)
+			{
+				float choice = random.FRand();
+				if (choice < 0.7f || occupiedCells.Num() == 0)
+				{
+					FIntVector cell(random.RandRange(0, areaSize - 1), random.RandRange(0, areaSize - 1), 0);
+					if (!occupied.Contains(cell))
+					{
+						occupied.Add(cell);
+						occupiedCells.Add(cell);
+						batch.Add(FBuildingCommandRecord::Make(EBuildingCommand::Place, cell, 0, (uint8)(random.RandRange(0, 3) * 64)));
+					}
+				}
+				else
+				{
+					int32 index = random.RandRange(0, occupiedCells.Num() - 1);
+					FIntVector cell = occupiedCells[index];
+					if (choice < 0.9f)
+					{
+						occupied.Remove(cell);
+						occupiedCells.RemoveAtSwap(index);
+						batch.Add(FBuildingCommandRecord::Make(EBuildingCommand::Demolish, cell, 0, 0));
+					}
+					else
+					{
+						batch.Add(FBuildingCommandRecord::Make(EBuildingCommand::Rotate, cell, 0, 64));
+					}
+				}
+			}
+
+			if (batch.Num() > 0)
+			{
+				batch.Last().flags |= FBuildingCommandRecord::BatchEndFlag;
+				writer.WriteCommands(time, batch);
+			}
+		}
+
+		writer.TakeData(data);
+		expectedBuildings = occupied.Num();
+	}
+
+	int32 numOperations = 0;
+	double recordedSeconds = 0.0;
+	bool bComplete = false;
+
+	//Hourly systems log as the clock events are replayed, which would dominate the timing
+	ELogVerbosity::Type previousVerbosity = LogTemp.GetVerbosity();
+	LogTemp.SetVerbosity(ELogVerbosity::Error);
+
+	FBenchPhase& phase = RunPhase(replayPath.IsEmpty() ? TEXT("replay_day") : TEXT("replay_file"), 1, [&]()
+	{
+		bComplete = replay->PlayReplay(data, numOperations, recordedSeconds);
+	});
+
+	LogTemp.SetVerbosity(previousVerbosity);
+
+	phase.iterations = FMath::Max(numOperations, 1);
+	phase.metrics.Add(TEXT("operations"), numOperations);
+	phase.metrics.Add(TEXT("operationsPerSecond"), numOperations / FMath::Max(phase.seconds, 1e-6));
+	phase.metrics.Add(TEXT("recordedSeconds"), recordedSeconds);
+	phase.metrics.Add(TEXT("speedup"), recordedSeconds / FMath::Max(phase.seconds, 1e-6));
+	phase.metrics.Add(TEXT("bytesPerOperation"), (double)data.Num() / FMath::Max(numOperations, 1));
+
+	UE_LOG(LogTemp, Display, TEXT("SpaceRPGBench::Replayed %d operations covering %.0f seconds at %.0f operations per second, %d buildings standing."),
+		numOperations, recordedSeconds, numOperations / FMath::Max(phase.seconds, 1e-6), registry->GetNumBuildings())
+
+	int32 errors = 0;
+	if (!bComplete)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Replay stopped at a bad event."))
+		errors++;
+	}
+	if (expectedBuildings != INDEX_NONE && registry->GetNumBuildings() != expectedBuildings)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Replay left %d buildings, %d expected."), registry->GetNumBuildings(), expectedBuildings)
+		errors++;
+	}
+	phase.metrics.Add(TEXT("errors"), errors);
+}
+
+//Splits a city of numBuildings buildings and 400 residents into 1, 2 and 4 district shards and runs each shard in a world of its own.
+//Shards are separate server processes, so the city can grow until its busiest shard fills a 30 Hz tick: the capacities are the city
+//scaled to that point. Ghosts are simulated in full here, which makes the figures slightly pessimistic
+void USpaceRPGBenchCommandlet::BenchDistrictShards(const FString& params)
+{
+	const int32 shardCounts[] = { 1, 2, 4 };
+	const int32 numResidents = 400;
+	const int32 numFrames = 120;
+	const float deltaTime = 1.0f / 30.0f;
+
+	int32 gridSize = FMath::CeilToInt(FMath::Sqrt((float)numBuildings));
+	int32 spacingCells = FMath::Max(FMath::RoundToInt(buildingSpacing / UBuildingRegistry::CellSize), 1);
+	TArray<FBuildingCommandRecord> city;
+	city.Reserve(numBuildings);
+	for (int32 i = 0; i < numBuildings; i++)
+	{
+		city.Add(FBuildingCommandRecord::Make(EBuildingCommand::Place, FIntVector((i % gridSize) * spacingCells, (i / gridSize) * spacingCells, 0), 0, 0));
+	}
+
+	UClass* timeControllerClass = LoadBenchClass<ATimeController>(BenchTimeControllerClassPath);
+	UClass* characterClass = LoadBenchClass<ASpaceRPGCharacter>(BenchCharacterClassPath);
+
+	FActorSpawnParameters spawnParams;
+	spawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	for (int32 numShards : shardCounts)
+	{
+		FDistrictMap map(numShards, FIntPoint::ZeroValue, FIntPoint(gridSize * spacingCells, gridSize * spacingCells), FDistrictMap::DefaultBorderCells);
+
+		//Each shard's own buildings come first, then the ghosts its neighbours send it through the coordinator
+		TArray<TArray<FBuildingCommandRecord>> shardRecords;
+		TArray<int32> numOwned;
+		shardRecords.SetNum(numShards);
+		numOwned.SetNumZeroed(numShards);
+
+		TArray<TMap<int32, TArray<FBuildingCommandRecord>>> ghostsByShard;
+		ghostsByShard.SetNum(numShards);
+		TArray<int32, TInlineAllocator<4>> neighbours;
+		for (const FBuildingCommandRecord& record : city)
+		{
+			int32 owner = map.GetDistrict(record.GetCell());
+			shardRecords[owner].Add(record);
+			numOwned[owner]++;
+
+			map.GetBorderDistricts(record.GetCell(), neighbours);
+			for (int32 neighbour : neighbours)
+			{
+				ghostsByShard[owner].FindOrAdd(neighbour).Add(record);
+			}
+		}
+
+		FDistrictCoordinator coordinator(map);
+		int64 coordinatorBytes = 0;
+		TArray<uint8> encoded;
+		auto send = [&](int32 toShard, const FDistrictMessage& message)
+		{
+			encoded.Reset();
+			FDistrictConnection::Encode(message, encoded);
+			coordinatorBytes += encoded.Num();
+			if (message.type == EDistrictMessage::Ghosts)
+			{
+				shardRecords[toShard].Append(message.records);
+			}
+		};
+
+		for (int32 shard = 0; shard < numShards; shard++)
+		{
+			FDistrictMessage hello;
+			hello.type = EDistrictMessage::Hello;
+			hello.shard = shard;
+			hello.address = FString::Printf(TEXT("127.0.0.1:%d"), 7777 + shard);
+			coordinator.HandleMessage(shard, hello, send);
+		}
+		for (int32 shard = 0; shard < numShards; shard++)
+		{
+			for (auto& pair : ghostsByShard[shard])
+			{
+				FDistrictMessage ghosts;
+				ghosts.type = EDistrictMessage::Ghosts;
+				ghosts.shard = pair.Key;
+				ghosts.records = MoveTemp(pair.Value);
+				coordinator.HandleMessage(shard, ghosts, send);
+			}
+		}
+
+		//Hourly systems log as the clock runs, which would dominate the timing
+		ELogVerbosity::Type previousVerbosity = LogTemp.GetVerbosity();
+		LogTemp.SetVerbosity(ELogVerbosity::Error);
+
+		TArray<double> shardFrameSeconds;
+		int32 numGhosts = 0;
+		int32 numSpawnedResidents = 0;
+		FBenchPhase& phase = RunPhase(FString::Printf(TEXT("district_shards_%d"), numShards), numFrames * numShards, [&]()
+		{
+			for (int32 shard = 0; shard < numShards; shard++)
+			{
+				if (!CreateWorld(params))
+				{
+					return;
+				}
+
+				if (UBuildingCommandLog* commandLog = world->GetSubsystem<UBuildingCommandLog>())
+				{
+					commandLog->ApplyRecords(shardRecords[shard]);
+				}
+				numGhosts += shardRecords[shard].Num() - numOwned[shard];
+
+				//Roughly an hour passes every two seconds, so the hourly simulation runs during the measured frames
+				if (ATimeController* timeController = world->SpawnActor<ATimeController>(timeControllerClass, FTransform::Identity, spawnParams))
+				{
+					timeController->gameSpeedMultiplier = 30.0f;
+				}
+
+				//Residents live in the shard's own buildings and walk at full rate, as no viewer is near enough to throttle them
+				if (UCharacterSignificanceSubsystem* significance = world->GetSubsystem<UCharacterSignificanceSubsystem>())
+				{
+					significance->SetSignificanceEnabled(false);
+				}
+				TArray<ACharacter*> residents;
+				FRandomStream random(2468 + shard);
+				for (int32 i = 0; i < numResidents / numShards && numOwned[shard] > 0; i++)
+				{
+					const FBuildingCommandRecord& home = shardRecords[shard][random.RandHelper(numOwned[shard])];
+					FVector location = UBuildingRegistry::CellToWorld(home.GetCell()) + FVector(0.0f, 0.0f, 1000.0f);
+					if (ACharacter* resident = world->SpawnActor<ACharacter>(characterClass, FTransform(location), spawnParams))
+					{
+						resident->GetCharacterMovement()->bRunPhysicsWithNoController = true;
+						residents.Add(resident);
+					}
+				}
+				numSpawnedResidents += residents.Num();
+
+				//The first frame finishes spawning and is left out of the measurement
+				world->Tick(LEVELTICK_All, deltaTime);
+
+				double startTime = FPlatformTime::Seconds();
+				for (int32 frame = 0; frame < numFrames; frame++)
+				{
+					for (int32 i = 0; i < residents.Num(); i++)
+					{
+						float angle = (i + frame * 0.01f) * 2.3f;
+						residents[i]->AddMovementInput(FVector(FMath::Cos(angle), FMath::Sin(angle), 0.0f));
+					}
+					world->Tick(LEVELTICK_All, deltaTime);
+				}
+				shardFrameSeconds.Add((FPlatformTime::Seconds() - startTime) / numFrames);
+
+				DestroyWorld();
+			}
+		});
+
+		LogTemp.SetVerbosity(previousVerbosity);
+
+		double maxFrameSeconds = 0.0;
+		double totalFrameSeconds = 0.0;
+		for (double frameSeconds : shardFrameSeconds)
+		{
+			maxFrameSeconds = FMath::Max(maxFrameSeconds, frameSeconds);
+			totalFrameSeconds += frameSeconds;
+		}
+		double capacityScale = maxFrameSeconds > 0.0 ? deltaTime / maxFrameSeconds : 0.0;
+
+		phase.metrics.Add(TEXT("shards"), numShards);
+		phase.metrics.Add(TEXT("ghostBuildings"), numGhosts);
+		phase.metrics.Add(TEXT("maxShardFrameMs"), maxFrameSeconds * 1000.0);
+		phase.metrics.Add(TEXT("meanShardFrameMs"), totalFrameSeconds * 1000.0 / FMath::Max(shardFrameSeconds.Num(), 1));
+		phase.metrics.Add(TEXT("buildingCapacity"), numBuildings * capacityScale);
+		phase.metrics.Add(TEXT("residentCapacity"), numSpawnedResidents * capacityScale);
+		phase.metrics.Add(TEXT("coordinatorBytes"), (double)coordinatorBytes);
+
+		UE_LOG(LogTemp, Display, TEXT("SpaceRPGBench::%d shards: busiest shard %.2f ms per frame, capacity %.0f buildings and %.0f residents at 30 Hz, %d ghosts."),
+			numShards, maxFrameSeconds * 1000.0, numBuildings * capacityScale, numSpawnedResidents * capacityScale, numGhosts)
+	}
+}
+
+bool USpaceRPGBenchCommandlet::WriteReport(const FString& params)
+{
+	TSharedRef<FJsonObject> report = MakeShared<FJsonObject>();
+	report->SetNumberField(TEXT("buildings"), numBuildings);
+	report->SetNumberField(TEXT("sweeps"), numSweeps);
+	report->SetStringField(TEXT("platform"), FPlatformProperties::PlatformName());
+
+	TArray<TSharedPtr<FJsonValue>> phaseValues;
+	for (const FBenchPhase& phase : phases)
+	{
+		TSharedRef<FJsonObject> phaseObject = MakeShared<FJsonObject>();
+		phaseObject->SetStringField(TEXT("name"), phase.name);
+		phaseObject->SetNumberField(TEXT("iterations"), phase.iterations);
+		phaseObject->SetNumberField(TEXT("totalMs"), phase.seconds * 1000.0);
+		phaseObject->SetNumberField(TEXT("usPerIteration"), phase.seconds * 1000000.0 / phase.iterations);
+		phaseObject->SetNumberField(TEXT("allocations"), (double)phase.allocations);
+		phaseObject->SetNumberField(TEXT("memoryDeltaBytes"), (double)phase.memoryDelta);
+		phaseObject->SetNumberField(TEXT("memoryAfterBytes"), (double)phase.memoryAfter);
+		for (const auto& metric : phase.metrics)
+		{
+			phaseObject->SetNumberField(metric.Key, metric.Value);
+		}
+		phaseValues.Add(MakeShared<FJsonValueObject>(phaseObject));
+	}
+	report->SetArrayField(TEXT("phases"), phaseValues);
+
+	FString reportPath = FPaths::ProjectSavedDir() / TEXT("Bench") / TEXT("SpaceRPGBench.json");
+	FParse::Value(*params, TEXT("report="), reportPath);
+
+	FString reportString;
+	TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&reportString);
+	FJsonSerializer::Serialize(report, writer);
+	if (!FFileHelper::SaveStringToFile(reportString, *reportPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Could not write report to %s."), *reportPath)
+		return false;
+	}
+	UE_LOG(LogTemp, Display, TEXT("SpaceRPGBench::Report written to %s."), *reportPath)
+
+	//Compare against a checked in baseline if one was given
+	FString baselinePath;
+	if (!FParse::Value(*params, TEXT("baseline="), baselinePath))
+	{
+		return true;
+	}
+
+	FString baselineString;
+	TSharedPtr<FJsonObject> baseline;
+	if (!FFileHelper::LoadFileToString(baselineString, *baselinePath) || !FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(baselineString), baseline) || !baseline.IsValid())
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Could not read baseline %s."), *baselinePath)
+		return false;
+	}
+
+	//Allowed slowdown before a phase counts as a regression, 0.1 is 10%
+	float tolerance = 0.1f;
+	FParse::Value(*params, TEXT("tolerance="), tolerance);
+
+	bool bPassed = true;
+	for (const TSharedPtr<FJsonValue>& baselineValue : baseline->GetArrayField(TEXT("phases")))
+	{
+		const TSharedPtr<FJsonObject>& baselinePhase = baselineValue->AsObject();
+		FString name = baselinePhase->GetStringField(TEXT("name"));
+		double baselineUs = baselinePhase->GetNumberField(TEXT("usPerIteration"));
+
+		const FBenchPhase* phase = phases.FindByPredicate([&name](const FBenchPhase& p) { return p.name == name; });
+		if (phase == nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("SpaceRPGBench::Phase %s is in the baseline but was not run."), *name)
+			continue;
+		}
+
+		double currentUs = phase->seconds * 1000000.0 / phase->iterations;
+		if (currentUs > baselineUs * (1.0 + tolerance))
+		{
+			UE_LOG(LogTemp, Error, TEXT("SpaceRPGBench::Regression in %s: %.3f us per iteration against a baseline of %.3f us."), *name, currentUs, baselineUs)
+			bPassed = false;
+		}
+	}
+
+	return bPassed;
+}
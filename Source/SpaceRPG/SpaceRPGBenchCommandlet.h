@@ -0,0 +1,85 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SpaceRPGBenchCommandlet.generated.h"
+
+//Headless benchmark of the module's hot paths, run with:
+//UE4Editor-Cmd CityBuilderRPG -run=SpaceRPGBench -nullrhi [-map=] [-buildings=] [-sweeps=] [-replay=] [-report=] [-baseline=] [-tolerance=]
+UCLASS()
+class USpaceRPGBenchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USpaceRPGBenchCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	//Timings and memory for a single benchmark phase
+	struct FBenchPhase
+	{
+		FString name;
+		int32 iterations = 0;
+		double seconds = 0.0;
+		uint64 allocations = 0;
+		int64 memoryDelta = 0;
+		int64 memoryAfter = 0;
+
+		//Extra values reported by the phase
+		TMap<FString, double> metrics;
+	};
+
+	TArray<FBenchPhase> phases;
+
+	//World the benchmark runs in
+	class UGameInstance* gameInstance = nullptr;
+	class UWorld* world = nullptr;
+
+	//Command line settings
+	int32 numBuildings = 10000;
+	int32 numSweeps = 2000;
+	float buildingSpacing = 400.0f;
+
+	//Times the body and records it as a phase of the report, the returned phase is valid until the next phase runs
+	FBenchPhase& RunPhase(const FString& name, int32 iterations, TFunctionRef<void()> body);
+
+	//Creates the world from -map, or an empty world, and begins play
+	bool CreateWorld(const FString& params);
+	void DestroyWorld();
+
+	//Spawns a ground plane under the building grid for worlds without a map
+	void SpawnGround();
+
+	//Benchmark phases
+	void BenchBuildingSpawn();
+	void BenchPreviewSweep();
+	void BenchPreviewPool();
+	void BenchBuildingStreaming();
+	void BenchTimeControllerYear();
+	void BenchCommandLogUndo();
+	void BenchCommandLogRotate();
+	void BenchSupportGraph();
+	void BenchUtilityNetworks();
+	void BenchCityGenerator();
+	void BenchEconomyHour();
+	void BenchBuildingCollision();
+	void BenchCharacterSignificance();
+	void BenchNameplates();
+	void BenchEnvironmentModel();
+	void BenchWorldSnapshot();
+	void BenchBuildingGrid();
+	void BenchAutosaveRecovery();
+
+	//Replays -replay=, or a synthesised day of player activity, into a fresh world
+	void BenchReplay(const FString& params);
+
+	//Runs a city split into 1, 2 and 4 district shards, creating a world for every shard
+	void BenchDistrictShards(const FString& params);
+
+	//Writes the JSON report and compares it to the baseline, returns false on a regression
+	bool WriteReport(const FString& params);
+};
@@ -8,6 +8,11 @@
 #include "GameFramework/CharacterMovementComponent.h"
 #include "GameFramework/Controller.h"
 #include "GameFramework/SpringArmComponent.h"
+#include "GameFramework/PlayerState.h"
+#include "CharacterSignificanceSubsystem.h"
+#include "NameplateSubsystem.h"
+#include "StartupPreloadSubsystem.h"
+#include "Engine/World.h"
 
 //////////////////////////////////////////////////////////////////////////
 // ASpaceRPGCharacter
@@ -54,6 +59,59 @@ ASpaceRPGCharacter::ASpaceRPGCharacter()
 	// are set in the derived blueprint asset named MyCharacter (to avoid direct content references in C++)
 }
 
+void ASpaceRPGCharacter::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// characters far from every viewer get throttled by the significance subsystem
+	if (UCharacterSignificanceSubsystem* significance = GetWorld()->GetSubsystem<UCharacterSignificanceSubsystem>())
+	{
+		significance->RegisterCharacter(this);
+	}
+
+	// only a handful of the closest characters get a nameplate widget
+	if (UNameplateSubsystem* nameplates = GetWorld()->GetSubsystem<UNameplateSubsystem>())
+	{
+		nameplates->RegisterCharacter(this);
+	}
+}
+
+void ASpaceRPGCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UCharacterSignificanceSubsystem* significance = GetWorld()->GetSubsystem<UCharacterSignificanceSubsystem>())
+	{
+		significance->UnregisterCharacter(this);
+	}
+
+	if (UNameplateSubsystem* nameplates = GetWorld()->GetSubsystem<UNameplateSubsystem>())
+	{
+		nameplates->UnregisterCharacter(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ASpaceRPGCharacter::PawnClientRestart()
+{
+	Super::PawnClientRestart();
+
+	// the game is playable on this machine once the player controls their character
+	if (UStartupPreloadSubsystem* preload = UStartupPreloadSubsystem::Get(this))
+	{
+		preload->MarkPlayable(TEXT("client"));
+	}
+}
+
+FText ASpaceRPGCharacter::GetNameplateText() const
+{
+	// players are known by their player name, residents by the name they were given
+	if (const APlayerState* State = GetPlayerState())
+	{
+		return FText::FromString(State->GetPlayerName());
+	}
+	return ResidentName;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Input
 
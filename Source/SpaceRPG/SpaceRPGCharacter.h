@@ -32,6 +32,13 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
 	float BaseLookUpRate;
 
+	/** Name shown over the character while no player controls it. Residents without a name have no nameplate. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Nameplate)
+	FText ResidentName;
+
+	/** Returns the name shown over the character: the player's name, or the resident's name. */
+	FText GetNameplateText() const;
+
 protected:
 
 	/** Resets HMD orientation in VR. */
@@ -62,8 +69,14 @@ protected:
 	void TouchStopped(ETouchIndex::Type FingerIndex, FVector Location);
 
 protected:
+	// AActor interface
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	// End of AActor interface
+
 	// APawn interface
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
+	virtual void PawnClientRestart() override;
 	// End of APawn interface
 
 public:
@@ -0,0 +1,119 @@
+// Copyright SpaceRPG 2020
+
+#include "SpaceRPGCoordinatorCommandlet.h"
+#include "DistrictCoordinator.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "Common/TcpSocketBuilder.h"
+#include "Interfaces/IPv4/IPv4Endpoint.h"
+#include "HAL/PlatformProcess.h"
+
+USpaceRPGCoordinatorCommandlet::USpaceRPGCoordinatorCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 USpaceRPGCoordinatorCommandlet::Main(const FString& Params)
+{
+	int32 port = 7800;
+	int32 numShards = 4;
+	int32 cityCells = FDistrictMap::DefaultCityExtentCells;
+	int32 borderCells = FDistrictMap::DefaultBorderCells;
+	FParse::Value(*Params, TEXT("port="), port);
+	FParse::Value(*Params, TEXT("shards="), numShards);
+	FParse::Value(*Params, TEXT("cityCells="), cityCells);
+	FParse::Value(*Params, TEXT("borderCells="), borderCells);
+
+	FDistrictCoordinator coordinator(FDistrictMap(numShards, FIntPoint(-cityCells, -cityCells), FIntPoint(cityCells, cityCells), borderCells));
+
+	//Shards all run on this machine, so the coordinator only listens on loopback
+	FSocket* listenSocket = FTcpSocketBuilder(TEXT("DistrictCoordinator"))
+		.AsNonBlocking()
+		.AsReusable()
+		.BoundToEndpoint(FIPv4Endpoint(FIPv4Address(127, 0, 0, 1), port))
+		.Listening(numShards * 2)
+		.Build();
+	if (listenSocket == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("SpaceRPGCoordinator::Could not listen on port %d."), port)
+		return 1;
+	}
+	UE_LOG(LogTemp, Display, TEXT("SpaceRPGCoordinator::Waiting for %d shards on port %d."), numShards, port)
+
+	//Connections are anonymous until their hello says which shard they are
+	struct FShardConnection
+	{
+		TUniquePtr<FDistrictConnection> connection;
+		int32 shard = INDEX_NONE;
+	};
+	TArray<FShardConnection> connections;
+	TArray<FDistrictMessage> messages;
+
+	auto send = [&connections](int32 toShard, const FDistrictMessage& message)
+	{
+		for (FShardConnection& shardConnection : connections)
+		{
+			if (shardConnection.shard == toShard)
+			{
+				shardConnection.connection->Send(message);
+			}
+		}
+	};
+
+	while (!IsEngineExitRequested())
+	{
+		bool bPending = false;
+		while (listenSocket->HasPendingConnection(bPending) && bPending)
+		{
+			if (FSocket* socket = listenSocket->Accept(TEXT("DistrictShard")))
+			{
+				connections.Add({ MakeUnique<FDistrictConnection>(socket), INDEX_NONE });
+			}
+		}
+
+		for (int32 i = 0; i < connections.Num(); i++)
+		{
+			messages.Reset();
+			bool bOpen = connections[i].connection->Update(messages);
+
+			for (const FDistrictMessage& message : messages)
+			{
+				if (message.type == EDistrictMessage::Hello)
+				{
+					//A restarted shard replaces its old connection
+					for (FShardConnection& other : connections)
+					{
+						if (other.shard == message.shard)
+						{
+							other.shard = INDEX_NONE;
+						}
+					}
+					connections[i].shard = message.shard;
+				}
+				coordinator.HandleMessage(connections[i].shard, message, send);
+			}
+
+			if (!bOpen)
+			{
+				if (connections[i].shard != INDEX_NONE)
+				{
+					coordinator.RemoveShard(connections[i].shard);
+				}
+				connections.RemoveAt(i--);
+			}
+		}
+
+		//Routing is cheap, a few milliseconds of sleep keeps the coordinator off the shards' cores
+		FPlatformProcess::Sleep(0.002f);
+	}
+
+	connections.Empty();
+	listenSocket->Close();
+	ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(listenSocket);
+
+	UE_LOG(LogTemp, Display, TEXT("SpaceRPGCoordinator::Routed %d messages and %d player handoffs."), coordinator.GetNumMessagesRouted(), coordinator.GetNumHandoffs())
+	return 0;
+}
@@ -0,0 +1,21 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SpaceRPGCoordinatorCommandlet.generated.h"
+
+//Runs the district coordinator that shard servers connect to, until the process is asked to exit:
+//UE4Editor-Cmd CityBuilderRPG -run=SpaceRPGCoordinator [-port=7800] [-shards=4] [-cityCells=1024] [-borderCells=4]
+//Shards are dedicated servers started with -DistrictShard=<index> -DistrictCoordinator=127.0.0.1:7800
+UCLASS()
+class USpaceRPGCoordinatorCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USpaceRPGCoordinatorCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -2,14 +2,161 @@
 
 #include "SpaceRPGGameMode.h"
 #include "SpaceRPGCharacter.h"
-#include "UObject/ConstructorHelpers.h"
+#include "CitySnapshotComponent.h"
+#include "CityAutosaveSubsystem.h"
+#include "CityReplaySubsystem.h"
+#include "DistrictShardSubsystem.h"
+#include "LoadTestBotComponent.h"
+#include "LoadTestMetricsSubsystem.h"
+#include "StartupPreloadSubsystem.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "Kismet/GameplayStatics.h"
 
-ASpaceRPGGameMode::ASpaceRPGGameMode()
+void ASpaceRPGGameMode::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage)
 {
-	// set default pawn class to our Blueprinted character
-	static ConstructorHelpers::FClassFinder<APawn> PlayerPawnBPClass(TEXT("/Game/ThirdPersonCPP/Blueprints/ThirdPersonCharacter"));
-	if (PlayerPawnBPClass.Class != NULL)
+	Super::InitGame(MapName, Options, ErrorMessage);
+
+	// the blueprinted character loads alongside the other gameplay assets instead of on its own when the module starts
+	UStartupPreloadSubsystem* preload = UStartupPreloadSubsystem::Get(this);
+	if (preload != nullptr)
+	{
+		preload->Preload(playerPawnClass.ToSoftObjectPath(), FStreamableDelegate::CreateUObject(this, &ASpaceRPGGameMode::OnPlayerPawnClassLoaded));
+	}
+	else
+	{
+		playerPawnClass.LoadSynchronous();
+		OnPlayerPawnClassLoaded();
+	}
+}
+
+void ASpaceRPGGameMode::StartPlay()
+{
+	Super::StartPlay();
+
+	// the city is restored once everything it is built from has loaded
+	UStartupPreloadSubsystem* preload = UStartupPreloadSubsystem::Get(this);
+	if (preload != nullptr)
+	{
+		preload->CallWhenComplete(FSimpleDelegate::CreateUObject(this, &ASpaceRPGGameMode::OnPreloadComplete));
+	}
+	else
+	{
+		OnPreloadComplete();
+	}
+}
+
+void ASpaceRPGGameMode::OnPlayerPawnClassLoaded()
+{
+	if (UClass* pawnClass = playerPawnClass.Get())
 	{
-		DefaultPawnClass = PlayerPawnBPClass.Class;
+		DefaultPawnClass = pawnClass;
 	}
 }
+
+void ASpaceRPGGameMode::OnPreloadComplete()
+{
+	if (UCityAutosaveSubsystem* autosave = GetWorld()->GetSubsystem<UCityAutosaveSubsystem>())
+	{
+		autosave->LoadAutosave();
+	}
+
+	// the recording starts from the restored city, so it can be replayed into an empty world
+	UCityReplaySubsystem* replay = GetWorld()->GetSubsystem<UCityReplaySubsystem>();
+	if (replay != nullptr && replay->ShouldRecordOnStart())
+	{
+		replay->StartRecording();
+	}
+
+	// players that arrived during the loading phase start now
+	TArray<TWeakObjectPtr<APlayerController>> players = MoveTemp(waitingPlayers);
+	waitingPlayers.Reset();
+	for (const TWeakObjectPtr<APlayerController>& player : players)
+	{
+		if (player.IsValid())
+		{
+			HandleStartingNewPlayer(player.Get());
+		}
+	}
+
+	// a dedicated server is playable once it can take players, a client once it controls its pawn
+	UStartupPreloadSubsystem* preload = UStartupPreloadSubsystem::Get(this);
+	if (preload != nullptr && GetNetMode() == NM_DedicatedServer)
+	{
+		preload->MarkPlayable(TEXT("dedicated server"));
+	}
+}
+
+FString ASpaceRPGGameMode::InitNewPlayer(APlayerController* NewPlayerController, const FUniqueNetIdRepl& UniqueId, const FString& Options, const FString& Portal)
+{
+	FString errorMessage = Super::InitNewPlayer(NewPlayerController, UniqueId, Options, Portal);
+	if (!errorMessage.IsEmpty() || NewPlayerController == nullptr)
+	{
+		return errorMessage;
+	}
+
+	UDistrictShardSubsystem* shards = GetWorld()->GetSubsystem<UDistrictShardSubsystem>();
+	if (shards != nullptr && UGameplayStatics::HasOption(Options, TEXT("DistrictHandoff")))
+	{
+		shards->ClaimHandoff(NewPlayerController, UGameplayStatics::ParseOption(Options, TEXT("DistrictHandoff")));
+	}
+
+#if !UE_BUILD_SHIPPING
+	// bots are only accepted by a server started for a load test with -LoadTestReport, never from a client's options alone
+	ULoadTestMetricsSubsystem* metrics = GetWorld()->GetSubsystem<ULoadTestMetricsSubsystem>();
+	if (metrics == nullptr || !metrics->IsCollecting() || !UGameplayStatics::HasOption(Options, TEXT("LoadTestBot")))
+	{
+		return errorMessage;
+	}
+
+	// the bot runs on its own client, the replicated component tells it how to behave
+	ULoadTestBotComponent* bot = NewObject<ULoadTestBotComponent>(NewPlayerController, TEXT("LoadTestBot"));
+	bot->behaviour = UGameplayStatics::ParseOption(Options, TEXT("LoadTestBot")) == TEXT("Walker") ? ELoadTestBotBehaviour::Walker : ELoadTestBotBehaviour::Builder;
+	bot->seed = numLoadTestBots++;
+	bot->RegisterComponent();
+	metrics->OnBotJoined();
+#endif
+	return errorMessage;
+}
+
+void ASpaceRPGGameMode::PostLogin(APlayerController* NewPlayer)
+{
+	Super::PostLogin(NewPlayer);
+
+	// local players already share the server's world, so only remote players need the city sent to them
+	if (NewPlayer == nullptr || NewPlayer->IsLocalController())
+	{
+		return;
+	}
+
+	UCitySnapshotComponent* snapshotComponent = NewObject<UCitySnapshotComponent>(NewPlayer, TEXT("CitySnapshot"));
+	snapshotComponent->SetIsReplicated(true);
+	snapshotComponent->RegisterComponent();
+	snapshotComponent->BeginSnapshot();
+}
+
+void ASpaceRPGGameMode::HandleStartingNewPlayer_Implementation(APlayerController* NewPlayer)
+{
+	UStartupPreloadSubsystem* preload = UStartupPreloadSubsystem::Get(this);
+	if (preload != nullptr && !preload->IsComplete())
+	{
+		waitingPlayers.AddUnique(NewPlayer);
+		return;
+	}
+
+	Super::HandleStartingNewPlayer_Implementation(NewPlayer);
+}
+
+void ASpaceRPGGameMode::RestartPlayer(AController* NewPlayer)
+{
+	// a player crossing a district border carries on from the spot they left the other shard at
+	UDistrictShardSubsystem* shards = GetWorld()->GetSubsystem<UDistrictShardSubsystem>();
+	FTransform spawnTransform;
+	if (shards != nullptr && shards->TakeHandoffSpawn(NewPlayer, spawnTransform))
+	{
+		RestartPlayerAtTransform(NewPlayer, spawnTransform);
+		return;
+	}
+
+	Super::RestartPlayer(NewPlayer);
+}
@@ -12,8 +12,35 @@ class ASpaceRPGGameMode : public AGameModeBase
 	GENERATED_BODY()
 
 public:
-	ASpaceRPGGameMode();
-};
+	//Adds the player's pawn to the startup preload
+	virtual void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) override;
+
+	//Restores the autosaved city once the startup preload has finished and before players arrive, and starts recording a replay if configured
+	virtual void StartPlay() override;
+
+	//Turns players that join with ?LoadTestBot into scripted load test bots, and matches players crossing from another district shard to their handoff
+	virtual FString InitNewPlayer(APlayerController* NewPlayerController, const FUniqueNetIdRepl& UniqueId, const FString& Options, const FString& Portal = TEXT("")) override;
+
+	//Starts streaming the city to players as they join
+	virtual void PostLogin(APlayerController* NewPlayer) override;
 
+	//Holds players back until the startup preload has finished
+	virtual void HandleStartingNewPlayer_Implementation(APlayerController* NewPlayer) override;
 
+	//Spawns players handed off from another district shard where they left it
+	virtual void RestartPlayer(AController* NewPlayer) override;
 
+private:
+	//Pawn players spawn as, loaded by the startup preload rather than when the game mode's defaults are built
+	UPROPERTY(Config)
+	TSoftClassPtr<APawn> playerPawnClass = TSoftClassPtr<APawn>(FSoftObjectPath(TEXT("/Game/ThirdPersonCPP/Blueprints/ThirdPersonCharacter.ThirdPersonCharacter_C")));
+
+	//Load test bots joined so far, gives each bot its own random seed
+	int32 numLoadTestBots = 0;
+
+	//Players that joined while the startup preload was still running
+	TArray<TWeakObjectPtr<APlayerController>> waitingPlayers;
+
+	void OnPlayerPawnClassLoaded();
+	void OnPreloadComplete();
+};
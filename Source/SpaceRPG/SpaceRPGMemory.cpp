@@ -0,0 +1,67 @@
+// Copyright SpaceRPG 2020
+
+#include "SpaceRPGMemory.h"
+#include "HAL/LowLevelMemStats.h"
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+DECLARE_LLM_MEMORY_STAT(TEXT("SpaceRPG"), STAT_SpaceRPGSummaryLLM, STATGROUP_LLM);
+DECLARE_LLM_MEMORY_STAT(TEXT("SpaceRPG Buildings"), STAT_SpaceRPGBuildingsLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SpaceRPG Previews"), STAT_SpaceRPGPreviewsLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SpaceRPG Time"), STAT_SpaceRPGTimeLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SpaceRPG Simulation"), STAT_SpaceRPGSimulationLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SpaceRPG Economy"), STAT_SpaceRPGEconomyLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SpaceRPG Collision"), STAT_SpaceRPGCollisionLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SpaceRPG CityData"), STAT_SpaceRPGCityDataLLM, STATGROUP_LLMFULL);
+#endif
+
+const TCHAR* GetSpaceRPGMemoryTagName(ESpaceRPGMemoryTag tag)
+{
+	switch (tag)
+	{
+	case ESpaceRPGMemoryTag::Buildings:
+		return TEXT("Buildings");
+	case ESpaceRPGMemoryTag::Previews:
+		return TEXT("Previews");
+	case ESpaceRPGMemoryTag::Time:
+		return TEXT("Time");
+	case ESpaceRPGMemoryTag::Simulation:
+		return TEXT("Simulation");
+	case ESpaceRPGMemoryTag::Economy:
+		return TEXT("Economy");
+	case ESpaceRPGMemoryTag::Collision:
+		return TEXT("Collision");
+	case ESpaceRPGMemoryTag::CityData:
+		return TEXT("CityData");
+	default:
+		return TEXT("Unknown");
+	}
+}
+
+void RegisterSpaceRPGMemoryTags()
+{
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	//Without stats the tags are still tracked, they just have no stat to show in
+#if STATS
+	const FName summaryStatName = GET_STATFNAME(STAT_SpaceRPGSummaryLLM);
+	const FName statNames[NumSpaceRPGMemoryTags] =
+	{
+		GET_STATFNAME(STAT_SpaceRPGBuildingsLLM),
+		GET_STATFNAME(STAT_SpaceRPGPreviewsLLM),
+		GET_STATFNAME(STAT_SpaceRPGTimeLLM),
+		GET_STATFNAME(STAT_SpaceRPGSimulationLLM),
+		GET_STATFNAME(STAT_SpaceRPGEconomyLLM),
+		GET_STATFNAME(STAT_SpaceRPGCollisionLLM),
+		GET_STATFNAME(STAT_SpaceRPGCityDataLLM)
+	};
+#else
+	const FName summaryStatName = NAME_None;
+	const FName statNames[NumSpaceRPGMemoryTags] = {};
+#endif
+
+	for (int32 i = 0; i < NumSpaceRPGMemoryTags; i++)
+	{
+		ESpaceRPGMemoryTag tag = (ESpaceRPGMemoryTag)i;
+		FLowLevelMemTracker::Get().RegisterProjectTag((int32)ToLLMTag(tag), GetSpaceRPGMemoryTagName(tag), statNames[i], summaryStatName);
+	}
+#endif
+}
@@ -0,0 +1,46 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/LowLevelMemTracker.h"
+
+//Low level memory tracker tags of the module, registered as project tags when the module starts
+enum class ESpaceRPGMemoryTag : uint8
+{
+	//Placed building actors, their components and the registry
+	Buildings,
+	//Build previews and their pool
+	Previews,
+	//Time controller calendar and clock state
+	Time,
+	//Simulation scheduler, utility networks, the support graph and world snapshots
+	Simulation,
+	Economy,
+	//Merged chunk collision bodies
+	Collision,
+	//Snapshots, autosave journals, replays and generated cities
+	CityData,
+
+	Count
+};
+
+static constexpr int32 NumSpaceRPGMemoryTags = (int32)ESpaceRPGMemoryTag::Count;
+
+//Names used for the tags in LLM, stats, budgets and memory dumps
+const TCHAR* GetSpaceRPGMemoryTagName(ESpaceRPGMemoryTag tag);
+
+//Registers the tag names with the low level memory tracker
+void RegisterSpaceRPGMemoryTags();
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+FORCEINLINE ELLMTag ToLLMTag(ESpaceRPGMemoryTag tag)
+{
+	return (ELLMTag)((LLM_TAG_TYPE)ELLMTag::ProjectTagStart + (LLM_TAG_TYPE)tag);
+}
+
+//Attributes allocations in the current scope to one of the module's tags
+#define SPACERPG_LLM_SCOPE(Tag) LLM_SCOPE(ToLLMTag(ESpaceRPGMemoryTag::Tag))
+#else
+#define SPACERPG_LLM_SCOPE(Tag)
+#endif
@@ -0,0 +1,333 @@
+// Copyright SpaceRPG 2020
+
+#include "StartupPreloadSubsystem.h"
+#include "SpaceRPG.h"
+#include "Engine/AssetManager.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "CoreGlobals.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "UObject/UObjectGlobals.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Startup Assets Pending"), STAT_StartupAssetsPending, STATGROUP_SpaceRPG);
+
+void UStartupPreloadSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	preloadStartSeconds = GetBootSeconds();
+	FTraceEntry& engineStart = trace.AddDefaulted_GetRef();
+	engineStart.name = TEXT("Engine start");
+	engineStart.category = TEXT("phase");
+	engineStart.endSeconds = preloadStartSeconds;
+
+	preLoadMapHandle = FCoreUObjectDelegates::PreLoadMap.AddUObject(this, &UStartupPreloadSubsystem::OnPreLoadMap);
+	postLoadMapHandle = FCoreUObjectDelegates::PostLoadMapWithWorld.AddUObject(this, &UStartupPreloadSubsystem::OnPostLoadMap);
+
+	//Every request goes to the async loader before any of them is waited on, so their reads overlap
+	for (const FSoftObjectPath& path : preloadAssets)
+	{
+		Preload(path);
+	}
+
+	for (const FString& mapName : preloadMaps)
+	{
+		if (!bEnablePreload || FindPackage(nullptr, *mapName) != nullptr)
+		{
+			continue;
+		}
+
+		//Maps are not held by a handle, a world kept alive past its map change would be reported as leaked
+		int32 traceIndex = BeginTrace(mapName, TEXT("map"));
+		numPending++;
+		LoadPackageAsync(mapName, FLoadPackageAsyncDelegate::CreateUObject(this, &UStartupPreloadSubsystem::OnMapPackageLoaded, traceIndex));
+	}
+
+	SET_DWORD_STAT(STAT_StartupAssetsPending, numPending);
+	CheckComplete();
+}
+
+void UStartupPreloadSubsystem::Deinitialize()
+{
+	FCoreUObjectDelegates::PreLoadMap.Remove(preLoadMapHandle);
+	FCoreUObjectDelegates::PostLoadMapWithWorld.Remove(postLoadMapHandle);
+
+	for (auto& pair : pendingAssets)
+	{
+		if (pair.Value.handle.IsValid())
+		{
+			pair.Value.handle->CancelHandle();
+		}
+	}
+	pendingAssets.Empty();
+
+	for (TSharedPtr<FStreamableHandle>& handle : loadedHandles)
+	{
+		if (handle.IsValid())
+		{
+			handle->ReleaseHandle();
+		}
+	}
+	loadedHandles.Empty();
+	onCompleteDelegates.Empty();
+
+	Super::Deinitialize();
+}
+
+UStartupPreloadSubsystem* UStartupPreloadSubsystem::Get(const UObject* worldContextObject)
+{
+	UWorld* world = worldContextObject ? worldContextObject->GetWorld() : nullptr;
+	UGameInstance* gameInstance = world ? world->GetGameInstance() : nullptr;
+	return gameInstance ? gameInstance->GetSubsystem<UStartupPreloadSubsystem>() : nullptr;
+}
+
+void UStartupPreloadSubsystem::Preload(const FSoftObjectPath& path, FStreamableDelegate onLoaded)
+{
+	if (path.IsNull())
+	{
+		onLoaded.ExecuteIfBound();
+		return;
+	}
+
+	//Several systems can ask for the same asset, they all wait on the one request
+	if (FPendingAsset* pending = pendingAssets.Find(path))
+	{
+		pending->onLoaded.Add(onLoaded);
+		return;
+	}
+
+	if (path.ResolveObject() != nullptr)
+	{
+		onLoaded.ExecuteIfBound();
+		return;
+	}
+
+	numAssets++;
+	if (!bEnablePreload)
+	{
+		int32 traceIndex = BeginTrace(path.ToString(), TEXT("sync"));
+		path.TryLoad();
+		EndTrace(traceIndex);
+		onLoaded.ExecuteIfBound();
+		return;
+	}
+
+	//The entry exists before the request, which completes straight away for assets that are already loading
+	FPendingAsset& pending = pendingAssets.Add(path);
+	pending.onLoaded.Add(onLoaded);
+	pending.traceIndex = BeginTrace(path.ToString(), TEXT("asset"));
+	numPending++;
+	SET_DWORD_STAT(STAT_StartupAssetsPending, numPending);
+
+	TSharedPtr<FStreamableHandle> handle = UAssetManager::GetStreamableManager().RequestAsyncLoad(path,
+		FStreamableDelegate::CreateUObject(this, &UStartupPreloadSubsystem::OnAssetLoaded, path), FStreamableManager::AsyncLoadHighPriority);
+	if (FPendingAsset* stillPending = pendingAssets.Find(path))
+	{
+		stillPending->handle = handle;
+	}
+	else if (handle.IsValid())
+	{
+		loadedHandles.Add(handle);
+	}
+}
+
+void UStartupPreloadSubsystem::CallWhenComplete(FSimpleDelegate onComplete)
+{
+	if (IsComplete())
+	{
+		onComplete.ExecuteIfBound();
+		return;
+	}
+	onCompleteDelegates.Add(onComplete);
+}
+
+void UStartupPreloadSubsystem::MarkPlayable(const TCHAR* what)
+{
+	if (firstPlayableSeconds > 0.0)
+	{
+		return;
+	}
+
+	//Playable only counts once the loading phase is over
+	if (!IsComplete())
+	{
+		FString whatString = what;
+		CallWhenComplete(FSimpleDelegate::CreateWeakLambda(this, [this, whatString]() { MarkPlayable(*whatString); }));
+		return;
+	}
+
+	firstPlayableSeconds = GetBootSeconds();
+	FTraceEntry& entry = trace.AddDefaulted_GetRef();
+	entry.name = FString::Printf(TEXT("First playable as %s"), what);
+	entry.category = TEXT("phase");
+	entry.endSeconds = firstPlayableSeconds;
+
+	UE_LOG(LogTemp, Display, TEXT("StartupPreloadSubsystem::First playable %.3f seconds after boot as %s, %s %d assets took %.3f seconds."),
+		firstPlayableSeconds, what, bEnablePreload ? TEXT("preloading") : TEXT("synchronously loading"), numAssets, preloadEndSeconds - preloadStartSeconds)
+
+	if (bWriteTrace)
+	{
+		WriteTrace();
+	}
+}
+
+void UStartupPreloadSubsystem::DumpTrace() const
+{
+	for (const FTraceEntry& entry : trace)
+	{
+		UE_LOG(LogTemp, Log, TEXT("StartupPreloadSubsystem::%8.3f s to %8.3f s, %8.2f ms, %s %s"),
+			entry.startSeconds, entry.endSeconds, (entry.endSeconds - entry.startSeconds) * 1000.0, *entry.category, *entry.name)
+	}
+}
+
+void UStartupPreloadSubsystem::OnAssetLoaded(FSoftObjectPath path)
+{
+	FPendingAsset pending;
+	if (!pendingAssets.RemoveAndCopyValue(path, pending))
+	{
+		return;
+	}
+
+	EndTrace(pending.traceIndex);
+	if (path.ResolveObject() == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("StartupPreloadSubsystem::Could not load %s."), *path.ToString())
+	}
+
+	if (pending.handle.IsValid())
+	{
+		loadedHandles.Add(pending.handle);
+	}
+	for (FStreamableDelegate& onLoaded : pending.onLoaded)
+	{
+		onLoaded.ExecuteIfBound();
+	}
+
+	numPending--;
+	CheckComplete();
+}
+
+void UStartupPreloadSubsystem::OnMapPackageLoaded(const FName& packageName, UPackage* package, EAsyncLoadingResult::Type result, int32 traceIndex)
+{
+	EndTrace(traceIndex);
+	if (result != EAsyncLoadingResult::Succeeded)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("StartupPreloadSubsystem::Could not load map %s."), *packageName.ToString())
+	}
+
+	numPending--;
+	CheckComplete();
+}
+
+void UStartupPreloadSubsystem::OnPreLoadMap(const FString& mapName)
+{
+	mapTraceIndex = BeginTrace(FString::Printf(TEXT("Load map %s"), *mapName), TEXT("phase"));
+}
+
+void UStartupPreloadSubsystem::OnPostLoadMap(UWorld* world)
+{
+	if (mapTraceIndex != INDEX_NONE)
+	{
+		EndTrace(mapTraceIndex);
+		mapTraceIndex = INDEX_NONE;
+	}
+}
+
+void UStartupPreloadSubsystem::CheckComplete()
+{
+	SET_DWORD_STAT(STAT_StartupAssetsPending, numPending);
+	if (!IsComplete())
+	{
+		return;
+	}
+
+	preloadEndSeconds = GetBootSeconds();
+
+	//Delegates can ask for more assets, which hold back the ones added after them
+	TArray<FSimpleDelegate> delegates = MoveTemp(onCompleteDelegates);
+	onCompleteDelegates.Reset();
+	for (int32 i = 0; i < delegates.Num(); i++)
+	{
+		if (!IsComplete())
+		{
+			onCompleteDelegates.Append(&delegates[i], delegates.Num() - i);
+			return;
+		}
+		delegates[i].ExecuteIfBound();
+	}
+}
+
+double UStartupPreloadSubsystem::GetBootSeconds()
+{
+	return FPlatformTime::Seconds() - GStartTime;
+}
+
+int32 UStartupPreloadSubsystem::BeginTrace(const FString& name, const TCHAR* category)
+{
+	FTraceEntry& entry = trace.AddDefaulted_GetRef();
+	entry.name = name;
+	entry.category = category;
+	entry.startSeconds = GetBootSeconds();
+	entry.endSeconds = entry.startSeconds;
+	return trace.Num() - 1;
+}
+
+void UStartupPreloadSubsystem::EndTrace(int32 index)
+{
+	if (trace.IsValidIndex(index))
+	{
+		trace[index].endSeconds = GetBootSeconds();
+	}
+}
+
+void UStartupPreloadSubsystem::WriteTrace() const
+{
+	//Complete events, one row per category
+	TArray<TSharedPtr<FJsonValue>> events;
+	TArray<FString> categories;
+	for (const FTraceEntry& entry : trace)
+	{
+		TSharedRef<FJsonObject> event = MakeShared<FJsonObject>();
+		event->SetStringField(TEXT("name"), entry.name);
+		event->SetStringField(TEXT("cat"), entry.category);
+		event->SetStringField(TEXT("ph"), TEXT("X"));
+		event->SetNumberField(TEXT("ts"), entry.startSeconds * 1000000.0);
+		event->SetNumberField(TEXT("dur"), (entry.endSeconds - entry.startSeconds) * 1000000.0);
+		event->SetNumberField(TEXT("pid"), 0);
+		event->SetNumberField(TEXT("tid"), categories.AddUnique(entry.category));
+		events.Add(MakeShared<FJsonValueObject>(event));
+	}
+
+	TSharedRef<FJsonObject> root = MakeShared<FJsonObject>();
+	root->SetArrayField(TEXT("traceEvents"), events);
+
+	FString tracePath = FPaths::ProfilingDir() / FString::Printf(TEXT("StartupTrace-%s-%s.json"),
+		IsRunningDedicatedServer() ? TEXT("Server") : TEXT("Client"), *FDateTime::Now().ToString());
+	FString traceString;
+	TSharedRef<TJsonWriter<>> writer = TJsonWriterFactory<>::Create(&traceString);
+	FJsonSerializer::Serialize(root, writer);
+	if (!FFileHelper::SaveStringToFile(traceString, *tracePath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("StartupPreloadSubsystem::Could not write trace to %s."), *tracePath)
+		return;
+	}
+	UE_LOG(LogTemp, Log, TEXT("StartupPreloadSubsystem::Trace written to %s."), *tracePath)
+}
+
+static FAutoConsoleCommandWithWorld DumpStartupTraceCommand(
+	TEXT("SpaceRPG.DumpStartupTrace"),
+	TEXT("Logs how long each startup phase and preloaded asset took."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* world)
+	{
+		if (UStartupPreloadSubsystem* preload = UStartupPreloadSubsystem::Get(world))
+		{
+			preload->DumpTrace();
+		}
+	}));
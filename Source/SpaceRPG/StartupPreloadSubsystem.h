@@ -0,0 +1,113 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Engine/StreamableManager.h"
+#include "StartupPreloadSubsystem.generated.h"
+
+//Loads the gameplay assets the module needs in parallel as the game starts, instead of each one synchronously on first use.
+//Assets are declared in the config or by systems through Preload. The game mode holds back the autosave and players until
+//everything has loaded, and the time from boot to first playable is traced per asset to Saved/Profiling, in the
+//chrome://tracing format
+UCLASS(Config = Game)
+class SPACERPG_API UStartupPreloadSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//Helper to find the subsystem from any world context object
+	static UStartupPreloadSubsystem* Get(const UObject* worldContextObject);
+
+	//Adds an asset to the preload, the delegate runs once it has loaded, straight away if it already has.
+	//With preloading turned off the asset is loaded synchronously here, as it was before the pipeline
+	void Preload(const FSoftObjectPath& path, FStreamableDelegate onLoaded = FStreamableDelegate());
+
+	//Whether every asset asked for so far has loaded
+	FORCEINLINE bool IsComplete() const { return numPending == 0; }
+
+	//Runs the delegate once every asset has loaded, straight away if they already have
+	void CallWhenComplete(FSimpleDelegate onComplete);
+
+	//Called once the game can be played: a dedicated server that has restored the city, or a client controlling its pawn
+	void MarkPlayable(const TCHAR* what);
+
+	//Logs the startup trace
+	void DumpTrace() const;
+
+private:
+	//Whether assets are loaded in parallel, turn off to measure the synchronous loading it replaces
+	UPROPERTY(Config)
+	bool bEnablePreload = true;
+
+	//Gameplay assets loaded as the game starts, their meshes and materials come with them
+	UPROPERTY(Config)
+	TArray<FSoftObjectPath> preloadAssets = {
+		FSoftObjectPath(TEXT("/Game/Blueprints/Building/BP_Building.BP_Building_C")),
+		FSoftObjectPath(TEXT("/Game/Blueprints/Building/BP_BuildingPreview.BP_BuildingPreview_C")),
+		FSoftObjectPath(TEXT("/Game/Blueprints/World/BP_TimeController.BP_TimeController_C")),
+		FSoftObjectPath(TEXT("/Game/Blueprints/UI/NamePlate.NamePlate_C"))
+	};
+
+	//Map packages loaded alongside the assets, for maps the game travels to soon after starting
+	UPROPERTY(Config)
+	TArray<FString> preloadMaps;
+
+	//Whether the trace is written to Saved/Profiling when the game becomes playable
+	UPROPERTY(Config)
+	bool bWriteTrace = true;
+
+	//A span of the startup, in seconds since the process started
+	struct FTraceEntry
+	{
+		FString name;
+		FString category;
+		double startSeconds = 0.0;
+		double endSeconds = 0.0;
+	};
+	TArray<FTraceEntry> trace;
+
+	//An asset being loaded, with the delegates waiting for it
+	struct FPendingAsset
+	{
+		TSharedPtr<FStreamableHandle> handle;
+		TArray<FStreamableDelegate> onLoaded;
+		int32 traceIndex = INDEX_NONE;
+	};
+	TMap<FSoftObjectPath, FPendingAsset> pendingAssets;
+	int32 numPending = 0;
+
+	//Handles of loaded assets, keeping them resident for as long as the game runs
+	TArray<TSharedPtr<FStreamableHandle>> loadedHandles;
+
+	TArray<FSimpleDelegate> onCompleteDelegates;
+
+	double preloadStartSeconds = 0.0;
+	double preloadEndSeconds = 0.0;
+	double firstPlayableSeconds = 0.0;
+	int32 numAssets = 0;
+
+	FDelegateHandle preLoadMapHandle;
+	FDelegateHandle postLoadMapHandle;
+	int32 mapTraceIndex = INDEX_NONE;
+
+	void OnAssetLoaded(FSoftObjectPath path);
+	void OnMapPackageLoaded(const FName& packageName, UPackage* package, EAsyncLoadingResult::Type result, int32 traceIndex);
+	void OnPreLoadMap(const FString& mapName);
+	void OnPostLoadMap(class UWorld* world);
+
+	//Closes the preload once nothing is pending and runs the waiting delegates
+	void CheckComplete();
+
+	//Seconds since the process started, which is where the trace begins
+	static double GetBootSeconds();
+
+	int32 BeginTrace(const FString& name, const TCHAR* category);
+	void EndTrace(int32 index);
+
+	void WriteTrace() const;
+};
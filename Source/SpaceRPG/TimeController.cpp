@@ -1,6 +1,8 @@
 // Copyright SpaceRPG 2020
 
 #include "TimeController.h"
+#include "SpaceRPGMemory.h"
+#include "SimulationScheduler.h"
 #include "Math/UnrealMathUtility.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Kismet/KismetStringLibrary.h"
@@ -10,6 +12,41 @@
 #include "Kismet/KismetTextLibrary.h"
 #include "Math/Color.h"
 #include "Net/UnrealNetwork.h"
+#include "Misc/DateTime.h"
+
+FOnTimeControllerEvent ATimeController::OnHourChangedEvent;
+FOnTimeControllerEvent ATimeController::OnDayChangedEvent;
+
+//Clockwork in a whole day, the clockwork counts minutes
+static constexpr double ClockworkPerDay = 60.0 * 24.0;
+
+void FClockEpoch::Evaluate(int64 atUtcTicks, int32& outDays, float& outClockwork) const
+{
+	//Doubles keep the clock exact for years of real time
+	double elapsedSeconds = (double)(atUtcTicks - utcTicks) / ETimespan::TicksPerSecond;
+	double totalClockwork = clockwork + FMath::Max(elapsedSeconds, 0.0) * clockworkPerSecond * timeRate;
+	double days = FMath::FloorToDouble(totalClockwork / ClockworkPerDay);
+	outDays = (int32)days;
+	outClockwork = (float)(totalClockwork - days * ClockworkPerDay);
+}
+
+void FClockEpoch::EvaluateDate(int64 atUtcTicks, float& outClockwork, int32& outDay, int32& outMonth, int32& outYear) const
+{
+	int32 days;
+	Evaluate(atUtcTicks, days, outClockwork);
+
+	FDateTime date = FDateTime(year, month, day) + FTimespan::FromDays(days);
+	date.GetDate(outYear, outMonth, outDay);
+}
+
+FClockEpoch FClockEpoch::Rebase(int64 atUtcTicks, float newTimeRate) const
+{
+	FClockEpoch rebased = *this;
+	EvaluateDate(atUtcTicks, rebased.clockwork, rebased.day, rebased.month, rebased.year);
+	rebased.utcTicks = atUtcTicks;
+	rebased.timeRate = newTimeRate;
+	return rebased;
+}
 
 // Sets default values
 ATimeController::ATimeController()
@@ -30,6 +67,8 @@ void ATimeController::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutL
 // Called when the game starts or when spawned
 void ATimeController::BeginPlay()
 {	
+	SPACERPG_LLM_SCOPE(Time);
+
 	Super::BeginPlay();
 
 	//Limits size of array to 3 to stop overflow
@@ -60,6 +99,8 @@ void ATimeController::BeginPlay()
 // Called every frame
 void ATimeController::Tick(float DeltaTime)
 {
+	SPACERPG_LLM_SCOPE(Time);
+
 	Super::Tick(DeltaTime);
 
 	//Time based stuff
@@ -83,6 +124,16 @@ void ATimeController::TimeTick() {
 
 //Sets clockwork for working out game speed.
 void ATimeController::SetClockwork(float DeltaSeconds) {
+	//Shards all derive the clock from the same epoch, days are handed to the calendar as they pass
+	if (clockEpoch.IsSet())
+	{
+		int32 epochDays;
+		clockEpoch.Evaluate(FDateTime::UtcNow().GetTicks(), epochDays, clockwork);
+		dayTick = epochDays - epochDaysApplied;
+		epochDaysApplied = epochDays;
+		return;
+	}
+
 	//Works out game speed
 	float DeltaTimeUnit = (DeltaSeconds / timeUnit * 0.24) * gameSpeedMultiplier;
 	float AddedClockwork = DeltaTimeUnit + clockwork;
@@ -181,7 +232,10 @@ void ATimeController::OnHourChanged()
 	UE_LOG(LogTemp, Warning, TEXT("Hour Passed"))
 
 	//Call blueprint function
-	UpdateHour();
+	QueueBlueprintEvent(TEXT("UpdateHour"), &ATimeController::UpdateHour);
+
+	//Notify native systems
+	OnHourChangedEvent.Broadcast(this);
 }
 
 void ATimeController::OnDayChanged() 
@@ -191,7 +245,95 @@ void ATimeController::OnDayChanged()
 	UE_LOG(LogTemp, Warning, TEXT("Day Passed"))
 
 	//Call blueprint function
-	UpdateDay();
+	QueueBlueprintEvent(TEXT("UpdateDay"), &ATimeController::UpdateDay);
+
+	//Notify native systems
+	OnDayChangedEvent.Broadcast(this);
+}
+
+void ATimeController::QueueBlueprintEvent(FName name, void (ATimeController::*blueprintEvent)())
+{
+	USimulationScheduler* scheduler = GetWorld()->GetSubsystem<USimulationScheduler>();
+	if (scheduler == nullptr)
+	{
+		(this->*blueprintEvent)();
+		return;
+	}
+
+	//Low priority so simulation work queued by the native events runs first, each event is a single step
+	scheduler->QueueJob(this, name, ESimulationJobPriority::Low, [this, blueprintEvent](double deadline)
+	{
+		(this->*blueprintEvent)();
+		return true;
+	}, blueprintEventDeadline);
+}
+
+FEnvironmentState ATimeController::GetEnvironment() const
+{
+	//Clients only receive the replicated date array
+	if (gameDate.Num() == 3)
+	{
+		return FEnvironmentModel::Evaluate(gameDate[0], gameDate[1], gameDate[2], weatherSeed, latitude);
+	}
+	return FEnvironmentModel::Evaluate(day, month, year, weatherSeed, latitude);
+}
+
+FEnvironmentState ATimeController::GetEnvironmentForDate(int32 forDay, int32 forMonth, int32 forYear) const
+{
+	return FEnvironmentModel::Evaluate(forDay, forMonth, forYear, weatherSeed, latitude);
+}
+
+void ATimeController::GetClockState(float& outClockwork, int32& outDay, int32& outMonth, int32& outYear) const
+{
+	outClockwork = clockwork;
+	outDay = day;
+	outMonth = month;
+	outYear = year;
+}
+
+void ATimeController::SetClockState(float newClockwork, int32 newDay, int32 newMonth, int32 newYear)
+{
+	clockwork = newClockwork;
+	day = newDay;
+	month = newMonth;
+	year = newYear;
+
+	//Sets game date variables into array
+	gameDate.SetNum(3);
+	gameDate[0] = day;
+	gameDate[1] = month;
+	gameDate[2] = year;
+
+	//Don't fire day changed for the restored date, and push the state to clients
+	lastDay = day;
+	net_clockwork = clockwork;
+	net_GameDate = gameDate;
+}
+
+void ATimeController::SetClockEpoch(const FClockEpoch& newEpoch)
+{
+	clockEpoch = newEpoch;
+	gameSpeedMultiplier = clockEpoch.timeRate;
+
+	float newClockwork;
+	int32 newDay, newMonth, newYear;
+	int64 nowTicks = FDateTime::UtcNow().GetTicks();
+	clockEpoch.Evaluate(nowTicks, epochDaysApplied, newClockwork);
+	clockEpoch.EvaluateDate(nowTicks, newClockwork, newDay, newMonth, newYear);
+	SetClockState(newClockwork, newDay, newMonth, newYear);
+}
+
+FClockEpoch ATimeController::MakeClockEpoch() const
+{
+	FClockEpoch epoch;
+	epoch.utcTicks = FDateTime::UtcNow().GetTicks();
+	epoch.clockwork = clockwork;
+	epoch.day = day;
+	epoch.month = month;
+	epoch.year = year;
+	epoch.timeRate = gameSpeedMultiplier;
+	epoch.clockworkPerSecond = 0.24f / timeUnit;
+	return epoch;
 }
 
 void ATimeController::OnRep_Clockwork() 
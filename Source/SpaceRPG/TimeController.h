@@ -4,8 +4,46 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "EnvironmentModel.h"
 #include "TimeController.generated.h"
 
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnTimeControllerEvent, class ATimeController*);
+
+//Authoritative clock shared by several servers: the clock state at a moment in real time and the rate it runs at from then on.
+//Servers derive their clock from the epoch instead of accumulating frame times, so they cannot drift apart
+struct SPACERPG_API FClockEpoch
+{
+	//Real time the epoch starts at, in UTC ticks, 0 if the epoch is not set
+	int64 utcTicks = 0;
+
+	//Clock state at the start of the epoch
+	float clockwork = 0.0f;
+	int32 day = 1;
+	int32 month = 1;
+	int32 year = 1;
+
+	//Game speed multiplier, and clockwork per real second at a multiplier of 1
+	float timeRate = 1.0f;
+	float clockworkPerSecond = 1.0f;
+
+	FORCEINLINE bool IsSet() const { return utcTicks != 0; }
+
+	//Whole days passed since the start of the epoch at a later moment, and the clockwork into the last day
+	void Evaluate(int64 atUtcTicks, int32& outDays, float& outClockwork) const;
+
+	//Clock state at a later moment
+	void EvaluateDate(int64 atUtcTicks, float& outClockwork, int32& outDay, int32& outMonth, int32& outYear) const;
+
+	//Epoch continuing this one's clock from a later moment at a new rate
+	FClockEpoch Rebase(int64 atUtcTicks, float newTimeRate) const;
+
+	friend FArchive& operator<<(FArchive& Ar, FClockEpoch& epoch)
+	{
+		Ar << epoch.utcTicks << epoch.clockwork << epoch.day << epoch.month << epoch.year << epoch.timeRate << epoch.clockworkPerSecond;
+		return Ar;
+	}
+};
+
 UCLASS()
 class SPACERPG_API ATimeController : public AActor
 {
@@ -39,14 +77,50 @@ public:
 	UFUNCTION(BlueprintImplementableEvent, Category = "Calendar")
 	void UpdateTime();
 
-	//Update function for every hour
+	//Update function for every hour, run by the simulation scheduler within its frame budget
 	UFUNCTION(BlueprintImplementableEvent, Category = "Calendar")
 	void UpdateHour();
 
-	//Update function for every day
+	//Update function for every day, run by the simulation scheduler within its frame budget
 	UFUNCTION(BlueprintImplementableEvent, Category = "Calendar")
 	void UpdateDay();
 
+	//Seconds the hour and day events may wait for the scheduler before they count as late
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Calendar")
+	float blueprintEventDeadline = 1.0f;
+
+	//Seed for the weather, the same on the server and clients so the weather never needs replicating
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Environment")
+	int32 weatherSeed = 0;
+
+	//Latitude in degrees, sets how much the day length changes over the year
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Environment")
+	float latitude = 45.0f;
+
+	//Season, daylight and weather for the current date
+	UFUNCTION(BlueprintPure, Category = "Environment")
+	FEnvironmentState GetEnvironment() const;
+
+	//Season, daylight and weather for any date, without advancing the calendar
+	UFUNCTION(BlueprintPure, Category = "Environment")
+	FEnvironmentState GetEnvironmentForDate(int32 forDay, int32 forMonth, int32 forYear) const;
+
+	//Clock state used for saving and loading
+	void GetClockState(float& outClockwork, int32& outDay, int32& outMonth, int32& outYear) const;
+	void SetClockState(float newClockwork, int32 newDay, int32 newMonth, int32 newYear);
+
+	//Runs the clock from an authoritative epoch instead of frame times, used by district shards
+	void SetClockEpoch(const FClockEpoch& newEpoch);
+
+	//Epoch starting now from the current clock state and game speed
+	FClockEpoch MakeClockEpoch() const;
+
+	FORCEINLINE const FClockEpoch& GetClockEpoch() const { return clockEpoch; }
+
+	//Native events for every hour and day, shared by all worlds so listeners should check the controller's world
+	static FOnTimeControllerEvent OnHourChangedEvent;
+	static FOnTimeControllerEvent OnDayChangedEvent;
+
 	//Celestial / skysphere variables
 	//Sun Angle
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Time")
@@ -87,6 +161,10 @@ private:
 	void OnHourChanged();
 	void OnDayChanged();
 
+	//Queues a Blueprint event on the simulation scheduler, so events landing on the same frame as each other or as
+	//other simulation work are spread over the following frames
+	void QueueBlueprintEvent(FName name, void (ATimeController::*blueprintEvent)());
+
 	//Clock variables
 	float timeUnit = 0.25f;
 	float clockwork;
@@ -101,6 +179,10 @@ private:
 	int32 lastHour;
 	int32 lastDay;
 
+	//Authoritative epoch the clock follows when set, and the whole days of it already added to the calendar
+	FClockEpoch clockEpoch;
+	int32 epochDaysApplied = 0;
+
 	//Time functions
 	//Function for every tick to update Time related stuff
 	void TimeTick();
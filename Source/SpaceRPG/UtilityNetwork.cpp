@@ -0,0 +1,354 @@
+// Copyright SpaceRPG 2020
+
+#include "UtilityNetwork.h"
+#include "Async/ParallelFor.h"
+
+int32 FUtilityNetworkSystem::AddBuilding(const FIntVector& cell, TArrayView<const FIntVector> socketCells, const float* supply, const float* demand)
+{
+	if (buildingsByCell.Contains(cell))
+	{
+		return INDEX_NONE;
+	}
+
+	int32 building;
+	if (freeBuildings.Num() > 0)
+	{
+		building = freeBuildings.Pop(false);
+	}
+	else
+	{
+		building = cells.AddDefaulted();
+		networkOf.Add(INDEX_NONE);
+		memberIndex.Add(INDEX_NONE);
+		alive.Add(false);
+		neighbours.AddDefaulted();
+		supplies.AddZeroed(NumUtilityTypes);
+		demands.AddZeroed(NumUtilityTypes);
+	}
+
+	cells[building] = cell;
+	alive[building] = true;
+	neighbours[building].Reset();
+	for (int32 i = 0; i < NumUtilityTypes; i++)
+	{
+		supplies[building * NumUtilityTypes + i] = supply[i];
+		demands[building * NumUtilityTypes + i] = demand[i];
+	}
+	buildingsByCell.Add(cell, building);
+
+	//Join the networks of every connected neighbour, merging them if there are several
+	int32 network = INDEX_NONE;
+	for (const FIntVector& socketCell : socketCells)
+	{
+		int32 neighbour = FindBuilding(socketCell);
+		if (neighbour == INDEX_NONE || neighbours[building].Contains(neighbour))
+		{
+			continue;
+		}
+
+		neighbours[building].Add(neighbour);
+		neighbours[neighbour].AddUnique(building);
+
+		int32 neighbourNetwork = networkOf[neighbour];
+		network = network == INDEX_NONE ? neighbourNetwork : MergeNetworks(network, neighbourNetwork);
+	}
+
+	if (network == INDEX_NONE)
+	{
+		network = CreateNetwork();
+	}
+
+	AddMember(network, building);
+	MarkFlowDirty(network);
+	return building;
+}
+
+void FUtilityNetworkSystem::RemoveBuilding(int32 building)
+{
+	if (!IsValidBuilding(building))
+	{
+		return;
+	}
+
+	int32 network = networkOf[building];
+	for (int32 neighbour : neighbours[building])
+	{
+		neighbours[neighbour].RemoveSingleSwap(building, false);
+	}
+
+	//Removing a building with more than one connection may split its network
+	if (neighbours[building].Num() > 1)
+	{
+		networks[network].bTopologyDirty = true;
+	}
+
+	RemoveMember(building);
+	neighbours[building].Reset();
+	buildingsByCell.Remove(cells[building]);
+	alive[building] = false;
+	freeBuildings.Add(building);
+
+	if (networks[network].members.Num() == 0)
+	{
+		FreeNetwork(network);
+	}
+	else
+	{
+		MarkFlowDirty(network);
+	}
+}
+
+void FUtilityNetworkSystem::SetSupply(int32 building, EUtilityType utility, float value)
+{
+	float& supply = supplies[building * NumUtilityTypes + (int32)utility];
+	if (supply != value)
+	{
+		supply = value;
+		MarkFlowDirty(networkOf[building]);
+	}
+}
+
+void FUtilityNetworkSystem::SetDemand(int32 building, EUtilityType utility, float value)
+{
+	float& demand = demands[building * NumUtilityTypes + (int32)utility];
+	if (demand != value)
+	{
+		demand = value;
+		MarkFlowDirty(networkOf[building]);
+	}
+}
+
+int32 FUtilityNetworkSystem::Solve()
+{
+	int32 numSolved = 0;
+	while (dirtyNetworks.Num() > 0)
+	{
+		numSolved += SolveSlice(MAX_int32);
+	}
+	return numSolved;
+}
+
+int32 FUtilityNetworkSystem::SolveSlice(int32 maxNetworks)
+{
+	int32 numSolved = FMath::Min(maxNetworks, dirtyNetworks.Num());
+
+	//Splitting creates networks, so it runs on the calling thread before the parallel solve
+	for (int32 i = 0; i < numSolved; i++)
+	{
+		int32 network = dirtyNetworks[i];
+		if (networks[network].bAlive && networks[network].bTopologyDirty)
+		{
+			SplitNetwork(network);
+		}
+	}
+
+	//Each network only writes its own ratios, so independent networks solve in parallel
+	ParallelFor(numSolved, [this](int32 index)
+	{
+		int32 network = dirtyNetworks[index];
+		if (networks[network].bAlive)
+		{
+			SolveNetwork(network);
+		}
+	});
+
+	dirtyNetworks.RemoveAt(0, numSolved, false);
+	return numSolved;
+}
+
+int32 FUtilityNetworkSystem::FindBuilding(const FIntVector& cell) const
+{
+	const int32* building = buildingsByCell.Find(cell);
+	return building ? *building : INDEX_NONE;
+}
+
+SIZE_T FUtilityNetworkSystem::GetAllocatedSize() const
+{
+	SIZE_T size = cells.GetAllocatedSize() + networkOf.GetAllocatedSize() + memberIndex.GetAllocatedSize() + alive.GetAllocatedSize()
+		+ neighbours.GetAllocatedSize() + freeBuildings.GetAllocatedSize() + buildingsByCell.GetAllocatedSize()
+		+ supplies.GetAllocatedSize() + demands.GetAllocatedSize()
+		+ networks.GetAllocatedSize() + networkRatios.GetAllocatedSize() + freeNetworks.GetAllocatedSize() + dirtyNetworks.GetAllocatedSize();
+	for (const auto& buildingNeighbours : neighbours)
+	{
+		size += buildingNeighbours.GetAllocatedSize();
+	}
+	for (const FNetwork& network : networks)
+	{
+		size += network.members.GetAllocatedSize();
+	}
+	return size;
+}
+
+void FUtilityNetworkSystem::Reset()
+{
+	cells.Reset();
+	networkOf.Reset();
+	memberIndex.Reset();
+	alive.Reset();
+	neighbours.Reset();
+	freeBuildings.Reset();
+	buildingsByCell.Reset();
+	supplies.Reset();
+	demands.Reset();
+	networks.Reset();
+	networkRatios.Reset();
+	freeNetworks.Reset();
+	dirtyNetworks.Reset();
+}
+
+int32 FUtilityNetworkSystem::CreateNetwork()
+{
+	int32 network;
+	if (freeNetworks.Num() > 0)
+	{
+		network = freeNetworks.Pop(false);
+	}
+	else
+	{
+		network = networks.AddDefaulted();
+		networkRatios.AddZeroed(NumUtilityTypes);
+	}
+
+	FNetwork& newNetwork = networks[network];
+	newNetwork.members.Reset();
+	newNetwork.bAlive = true;
+	newNetwork.bTopologyDirty = false;
+	newNetwork.bFlowDirty = false;
+	return network;
+}
+
+void FUtilityNetworkSystem::FreeNetwork(int32 network)
+{
+	//The index is reused by the next network created, which would then be listed twice and solved by two threads at once
+	if (networks[network].bFlowDirty)
+	{
+		dirtyNetworks.RemoveSingle(network);
+	}
+
+	networks[network].bAlive = false;
+	networks[network].bTopologyDirty = false;
+	networks[network].bFlowDirty = false;
+	networks[network].members.Reset();
+	freeNetworks.Add(network);
+}
+
+void FUtilityNetworkSystem::AddMember(int32 network, int32 building)
+{
+	networkOf[building] = network;
+	memberIndex[building] = networks[network].members.Add(building);
+}
+
+void FUtilityNetworkSystem::RemoveMember(int32 building)
+{
+	TArray<int32>& members = networks[networkOf[building]].members;
+	int32 index = memberIndex[building];
+
+	members.RemoveAtSwap(index, 1, false);
+	if (index < members.Num())
+	{
+		memberIndex[members[index]] = index;
+	}
+
+	networkOf[building] = INDEX_NONE;
+	memberIndex[building] = INDEX_NONE;
+}
+
+void FUtilityNetworkSystem::MarkFlowDirty(int32 network)
+{
+	if (network != INDEX_NONE && !networks[network].bFlowDirty)
+	{
+		networks[network].bFlowDirty = true;
+		dirtyNetworks.Add(network);
+	}
+}
+
+int32 FUtilityNetworkSystem::MergeNetworks(int32 a, int32 b)
+{
+	if (a == b)
+	{
+		return a;
+	}
+
+	if (networks[a].members.Num() < networks[b].members.Num())
+	{
+		Swap(a, b);
+	}
+
+	for (int32 building : networks[b].members)
+	{
+		AddMember(a, building);
+	}
+
+	networks[a].bTopologyDirty |= networks[b].bTopologyDirty;
+	FreeNetwork(b);
+	MarkFlowDirty(a);
+	return a;
+}
+
+void FUtilityNetworkSystem::SplitNetwork(int32 network)
+{
+	networks[network].bTopologyDirty = false;
+
+	//Flood fill from each unvisited member, the first component keeps the network
+	TArray<int32> oldMembers = MoveTemp(networks[network].members);
+	networks[network].members.Reset();
+	for (int32 building : oldMembers)
+	{
+		networkOf[building] = INDEX_NONE;
+	}
+
+	TArray<int32> stack;
+	bool bFirstComponent = true;
+	for (int32 start : oldMembers)
+	{
+		if (networkOf[start] != INDEX_NONE)
+		{
+			continue;
+		}
+
+		int32 component = bFirstComponent ? network : CreateNetwork();
+		bFirstComponent = false;
+		MarkFlowDirty(component);
+
+		AddMember(component, start);
+		stack.Add(start);
+		while (stack.Num() > 0)
+		{
+			int32 building = stack.Pop(false);
+			for (int32 neighbour : neighbours[building])
+			{
+				if (networkOf[neighbour] == INDEX_NONE)
+				{
+					AddMember(component, neighbour);
+					stack.Add(neighbour);
+				}
+			}
+		}
+	}
+}
+
+void FUtilityNetworkSystem::SolveNetwork(int32 network)
+{
+	FNetwork& solvedNetwork = networks[network];
+	solvedNetwork.bFlowDirty = false;
+
+	float totalSupply[NumUtilityTypes] = {};
+	float totalDemand[NumUtilityTypes] = {};
+	for (int32 building : solvedNetwork.members)
+	{
+		const float* supply = &supplies[building * NumUtilityTypes];
+		const float* demand = &demands[building * NumUtilityTypes];
+		for (int32 i = 0; i < NumUtilityTypes; i++)
+		{
+			totalSupply[i] += supply[i];
+			totalDemand[i] += demand[i];
+		}
+	}
+
+	//Shortfalls are shared evenly across every consumer in the network
+	float* ratios = &networkRatios[network * NumUtilityTypes];
+	for (int32 i = 0; i < NumUtilityTypes; i++)
+	{
+		ratios[i] = totalDemand[i] > 0.0f ? FMath::Min(totalSupply[i] / totalDemand[i], 1.0f) : 1.0f;
+	}
+}
@@ -0,0 +1,97 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UtilityNetwork.generated.h"
+
+UENUM(BlueprintType)
+enum class EUtilityType : uint8
+{
+	Power,
+	Water,
+	Count UMETA(Hidden)
+};
+
+static constexpr int32 NumUtilityTypes = (int32)EUtilityType::Count;
+
+//Resource networks over connected buildings, each connected component of buildings is one network
+//Building data lives in flat arrays indexed by handle, and flow is only recomputed for networks marked dirty
+class SPACERPG_API FUtilityNetworkSystem
+{
+public:
+	//Adds a building connected to any buildings at its socket cells, returns its handle
+	int32 AddBuilding(const FIntVector& cell, TArrayView<const FIntVector> socketCells, const float* supply, const float* demand);
+
+	void RemoveBuilding(int32 building);
+
+	//Changes what a building produces or consumes, marking its network for a flow update
+	void SetSupply(int32 building, EUtilityType utility, float value);
+	void SetDemand(int32 building, EUtilityType utility, float value);
+
+	//Splits networks whose topology changed, then recomputes flow for every dirty network in parallel
+	//Returns the number of networks solved
+	int32 Solve();
+
+	//Splits and solves at most maxNetworks of the dirty networks, so the work can be spread over several frames
+	//Networks created by splits are solved by later slices, returns the number of networks solved
+	int32 SolveSlice(int32 maxNetworks);
+
+	FORCEINLINE bool HasDirtyNetworks() const { return dirtyNetworks.Num() > 0; }
+
+	//Fraction of the building's demand that its network can meet, from 0 to 1
+	FORCEINLINE float GetSatisfaction(int32 building, EUtilityType utility) const { return networkRatios[networkOf[building] * NumUtilityTypes + (int32)utility]; }
+
+	FORCEINLINE int32 GetNetwork(int32 building) const { return networkOf[building]; }
+	FORCEINLINE bool IsValidBuilding(int32 building) const { return alive.IsValidIndex(building) && alive[building]; }
+	int32 FindBuilding(const FIntVector& cell) const;
+	int32 GetNumNetworks() const { return networks.Num() - freeNetworks.Num(); }
+
+	//Memory held by the building and network arrays
+	SIZE_T GetAllocatedSize() const;
+
+	void Reset();
+
+private:
+	struct FNetwork
+	{
+		TArray<int32> members;
+		bool bAlive = false;
+		bool bTopologyDirty = false;
+		bool bFlowDirty = false;
+	};
+
+	//Per building data, indexed by handle
+	TArray<FIntVector> cells;
+	TArray<int32> networkOf;
+	TArray<int32> memberIndex;
+	TArray<bool> alive;
+	TArray<TArray<int32, TInlineAllocator<6>>> neighbours;
+	TArray<int32> freeBuildings;
+	TMap<FIntVector, int32> buildingsByCell;
+
+	//Supply and demand, NumUtilityTypes values per building
+	TArray<float> supplies;
+	TArray<float> demands;
+
+	//Networks and their supply to demand ratio, NumUtilityTypes values per network
+	TArray<FNetwork> networks;
+	TArray<float> networkRatios;
+	TArray<int32> freeNetworks;
+	TArray<int32> dirtyNetworks;
+
+	int32 CreateNetwork();
+	void FreeNetwork(int32 network);
+	void AddMember(int32 network, int32 building);
+	void RemoveMember(int32 building);
+	void MarkFlowDirty(int32 network);
+
+	//Moves every member of the smaller network into the larger one
+	int32 MergeNetworks(int32 a, int32 b);
+
+	//Splits a network into its connected components after removals
+	void SplitNetwork(int32 network);
+
+	//Sums supply and demand over a network's members and stores the ratio
+	void SolveNetwork(int32 network);
+};
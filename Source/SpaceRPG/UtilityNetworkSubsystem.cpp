@@ -0,0 +1,158 @@
+// Copyright SpaceRPG 2020
+
+#include "UtilityNetworkSubsystem.h"
+#include "SpaceRPG.h"
+#include "SpaceRPGMemory.h"
+#include "Building.h"
+#include "BuildingPalette.h"
+#include "BuildingRegistry.h"
+#include "BuildingStreamingSubsystem.h"
+#include "DistrictShardSubsystem.h"
+#include "SimulationScheduler.h"
+#include "TimeController.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Utility Network Update"), STAT_UtilityNetworkUpdate, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Utility Networks Solved"), STAT_UtilityNetworksSolved, STATGROUP_SpaceRPG);
+
+void UUtilityNetworkSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	UBuildingRegistry* registry = Cast<UBuildingRegistry>(Collection.InitializeDependency(UBuildingRegistry::StaticClass()));
+	if (registry != nullptr)
+	{
+		buildingAddedHandle = registry->OnBuildingAdded.AddUObject(this, &UUtilityNetworkSubsystem::OnBuildingAdded);
+		buildingRemovedHandle = registry->OnBuildingRemoved.AddUObject(this, &UUtilityNetworkSubsystem::OnBuildingRemoved);
+	}
+
+	Collection.InitializeDependency(USimulationScheduler::StaticClass());
+	hourChangedHandle = ATimeController::OnHourChangedEvent.AddUObject(this, &UUtilityNetworkSubsystem::OnHourChanged);
+}
+
+void UUtilityNetworkSubsystem::Deinitialize()
+{
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->OnBuildingAdded.Remove(buildingAddedHandle);
+		registry->OnBuildingRemoved.Remove(buildingRemovedHandle);
+	}
+	ATimeController::OnHourChangedEvent.Remove(hourChangedHandle);
+	if (USimulationScheduler* scheduler = GetWorld()->GetSubsystem<USimulationScheduler>())
+	{
+		scheduler->CancelJobs(this);
+	}
+
+	networkSystem.Reset();
+	buildingHandles.Empty();
+
+	Super::Deinitialize();
+}
+
+float UUtilityNetworkSubsystem::GetSatisfaction(ABuilding* building, EUtilityType utility) const
+{
+	const int32* handle = buildingHandles.Find(building);
+	return handle ? networkSystem.GetSatisfaction(*handle, utility) : 0.0f;
+}
+
+void UUtilityNetworkSubsystem::SetDemand(ABuilding* building, EUtilityType utility, float demand)
+{
+	if (const int32* handle = buildingHandles.Find(building))
+	{
+		networkSystem.SetDemand(*handle, utility, demand);
+	}
+}
+
+void UUtilityNetworkSubsystem::UpdateNetworks()
+{
+	SPACERPG_LLM_SCOPE(Simulation);
+
+	SCOPE_CYCLE_COUNTER(STAT_UtilityNetworkUpdate);
+
+	int32 numSolved = networkSystem.Solve();
+	SET_DWORD_STAT(STAT_UtilityNetworksSolved, numSolved);
+}
+
+void UUtilityNetworkSubsystem::ScheduleUpdate()
+{
+	USimulationScheduler* scheduler = GetWorld()->GetSubsystem<USimulationScheduler>();
+	if (scheduler == nullptr)
+	{
+		UpdateNetworks();
+		return;
+	}
+
+	//An update still in progress picks up the new changes as it goes
+	if (scheduler->IsJobPending(updateJob))
+	{
+		return;
+	}
+
+	updateJob = scheduler->QueueJob(this, TEXT("UtilityNetworks"), ESimulationJobPriority::High, [this](double deadline)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_UtilityNetworkUpdate);
+
+		int32 numSolved = 0;
+		do
+		{
+			numSolved += networkSystem.SolveSlice(networksPerSlice);
+		}
+		while (networkSystem.HasDirtyNetworks() && FPlatformTime::Seconds() < deadline);
+
+		INC_DWORD_STAT_BY(STAT_UtilityNetworksSolved, numSolved);
+		return !networkSystem.HasDirtyNetworks();
+	}, updateDeadline);
+}
+
+void UUtilityNetworkSubsystem::OnBuildingAdded(ABuilding* building)
+{
+	SPACERPG_LLM_SCOPE(Simulation);
+
+	//Ghosts are simulated by the shard that owns them
+	if (UDistrictShardSubsystem::IsGhost(building))
+	{
+		return;
+	}
+
+	//Utility values come from the building's type in the palette
+	float supply[NumUtilityTypes] = {};
+	float demand[NumUtilityTypes] = {};
+
+	UBuildingStreamingSubsystem* streaming = UBuildingStreamingSubsystem::Get(this);
+	UBuildingPalette* palette = streaming ? streaming->GetPalette() : nullptr;
+	if (palette != nullptr && palette->IsValidType(building->buildingType))
+	{
+		const FBuildingType& type = palette->buildingTypes[building->buildingType];
+		supply[(int32)EUtilityType::Power] = type.powerSupply;
+		demand[(int32)EUtilityType::Power] = type.powerDemand;
+		supply[(int32)EUtilityType::Water] = type.waterSupply;
+		demand[(int32)EUtilityType::Water] = type.waterDemand;
+	}
+
+	TArray<FIntVector, TInlineAllocator<6>> socketCells;
+	building->GetSocketCells(socketCells);
+
+	int32 handle = networkSystem.AddBuilding(building->gridCell, socketCells, supply, demand);
+	if (handle != INDEX_NONE)
+	{
+		buildingHandles.Add(building, handle);
+	}
+}
+
+void UUtilityNetworkSubsystem::OnBuildingRemoved(ABuilding* building)
+{
+	int32 handle;
+	if (buildingHandles.RemoveAndCopyValue(building, handle))
+	{
+		networkSystem.RemoveBuilding(handle);
+	}
+}
+
+void UUtilityNetworkSubsystem::OnHourChanged(ATimeController* timeController)
+{
+	//The event is shared by every world
+	if (timeController->GetWorld() == GetWorld())
+	{
+		ScheduleUpdate();
+	}
+}
@@ -0,0 +1,64 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UtilityNetwork.h"
+#include "UtilityNetworkSubsystem.generated.h"
+
+//Runs the power and water networks of placed buildings, updating flow on each game hour
+UCLASS(Config = Game)
+class SPACERPG_API UUtilityNetworkSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//Fraction of the building's demand its network met at the last update
+	UFUNCTION(BlueprintPure, Category = Utilities)
+	float GetSatisfaction(class ABuilding* building, EUtilityType utility) const;
+
+	//Overrides the demand of a single building, for example when it is switched off
+	UFUNCTION(BlueprintCallable, Category = Utilities)
+	void SetDemand(class ABuilding* building, EUtilityType utility, float demand);
+
+	UFUNCTION(BlueprintPure, Category = Utilities)
+	int32 GetNumNetworks() const { return networkSystem.GetNumNetworks(); }
+
+	//Memory held by the networks and the building handles
+	SIZE_T GetAllocatedSize() const { return networkSystem.GetAllocatedSize() + buildingHandles.GetAllocatedSize(); }
+
+	//Recomputes flow for networks that changed since the last update
+	void UpdateNetworks();
+
+	//Queues the network update with the simulation scheduler, so it is spread over frames instead of one
+	void ScheduleUpdate();
+
+private:
+	//Networks solved per slice of a scheduled update
+	UPROPERTY(Config)
+	int32 networksPerSlice = 64;
+
+	//Seconds a scheduled update should finish within
+	UPROPERTY(Config)
+	float updateDeadline = 0.5f;
+
+	//Scheduler job of the update in progress
+	int32 updateJob = INDEX_NONE;
+
+	FUtilityNetworkSystem networkSystem;
+
+	//Network handle for each building
+	TMap<TWeakObjectPtr<class ABuilding>, int32> buildingHandles;
+
+	FDelegateHandle buildingAddedHandle;
+	FDelegateHandle buildingRemovedHandle;
+	FDelegateHandle hourChangedHandle;
+
+	void OnBuildingAdded(class ABuilding* building);
+	void OnBuildingRemoved(class ABuilding* building);
+	void OnHourChanged(class ATimeController* timeController);
+};
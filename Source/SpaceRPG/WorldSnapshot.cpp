@@ -0,0 +1,200 @@
+// Copyright SpaceRPG 2020
+
+#include "WorldSnapshot.h"
+#include "SpaceRPGMemory.h"
+#include "Algo/BinarySearch.h"
+
+const FWorldSnapshotBuilding* FWorldSnapshot::FindBuilding(const FIntVector& cell) const
+{
+	if (!layout.IsValid())
+	{
+		return nullptr;
+	}
+
+	int32 index = Algo::LowerBoundBy(layout->buildings, cell, &FWorldSnapshotBuilding::cell, &FWorldSnapshot::CellLess);
+	if (index < layout->buildings.Num() && layout->buildings[index].cell == cell)
+	{
+		return &layout->buildings[index];
+	}
+	return nullptr;
+}
+
+FWorldSnapshotRef::~FWorldSnapshotRef()
+{
+	if (readers != nullptr)
+	{
+		--(*readers);
+	}
+}
+
+FWorldSnapshotRef::FWorldSnapshotRef(FWorldSnapshotRef&& other)
+	: snapshot(other.snapshot)
+	, readers(other.readers)
+{
+	other.snapshot = nullptr;
+	other.readers = nullptr;
+}
+
+FWorldSnapshotRef& FWorldSnapshotRef::operator=(FWorldSnapshotRef&& other)
+{
+	if (this != &other)
+	{
+		if (readers != nullptr)
+		{
+			--(*readers);
+		}
+		snapshot = other.snapshot;
+		readers = other.readers;
+		other.snapshot = nullptr;
+		other.readers = nullptr;
+	}
+	return *this;
+}
+
+void FWorldSnapshotPublisher::SetBuilding(const FWorldSnapshotBuilding& building, TArrayView<const FIntVector> socketCells)
+{
+	FPendingEdit& edit = pendingEdits.FindOrAdd(building.cell);
+	edit.bRemove = false;
+	edit.building = building;
+	edit.socketCells = TArray<FIntVector, TInlineAllocator<6>>(socketCells.GetData(), socketCells.Num());
+}
+
+void FWorldSnapshotPublisher::RemoveBuilding(const FIntVector& cell)
+{
+	FPendingEdit& edit = pendingEdits.FindOrAdd(cell);
+	edit.bRemove = true;
+	edit.building.cell = cell;
+	edit.socketCells.Reset();
+}
+
+bool FWorldSnapshotPublisher::Publish(uint64 frameNumber, const FWorldSnapshotTime& time)
+{
+	FBuffer* front = current.Load();
+	FBuffer* back = front == &buffers[0] ? &buffers[1] : &buffers[0];
+
+	//Readers only count themselves on the buffer that is current, after checking it still is. A reader seen here is
+	//still on last frame's snapshot, and any reader that arrives while the buffer is filled finds it isn't current
+	if (back->readers.Load() != 0)
+	{
+		numSkippedPublishes++;
+		return false;
+	}
+
+	if (pendingEdits.Num() > 0)
+	{
+		ApplyEdits();
+	}
+
+	back->snapshot.version = ++version;
+	back->snapshot.frameNumber = frameNumber;
+	back->snapshot.time = time;
+	back->snapshot.layout = layout;
+
+	current.Store(back);
+	return true;
+}
+
+FWorldSnapshotRef FWorldSnapshotPublisher::Acquire() const
+{
+	for (;;)
+	{
+		FBuffer* buffer = current.Load();
+		if (buffer == nullptr)
+		{
+			return FWorldSnapshotRef();
+		}
+
+		//If a publish swapped the buffer out before it was counted, the game thread may be filling it, so try again
+		++buffer->readers;
+		if (current.Load() == buffer)
+		{
+			return FWorldSnapshotRef(&buffer->snapshot, &buffer->readers);
+		}
+		--buffer->readers;
+	}
+}
+
+SIZE_T FWorldSnapshotPublisher::GetAllocatedSize() const
+{
+	SIZE_T bytes = pendingEdits.GetAllocatedSize();
+
+	//For a frame after the buildings change the buffers hold different layouts, each layout is counted once
+	const FWorldSnapshot::FLayout* layouts[] = { layout.Get(), buffers[0].snapshot.layout.Get(), buffers[1].snapshot.layout.Get() };
+	for (int32 i = 0; i < UE_ARRAY_COUNT(layouts); i++)
+	{
+		if (layouts[i] != nullptr && (i == 0 || layouts[i] != layouts[0]) && (i < 2 || layouts[i] != layouts[1]))
+		{
+			bytes += sizeof(FWorldSnapshot::FLayout) + layouts[i]->buildings.GetAllocatedSize() + layouts[i]->socketCells.GetAllocatedSize();
+		}
+	}
+	return bytes;
+}
+
+void FWorldSnapshotPublisher::ApplyEdits()
+{
+	SPACERPG_LLM_SCOPE(Simulation);
+
+	TArray<const FPendingEdit*> edits;
+	edits.Reserve(pendingEdits.Num());
+	int32 numAdded = 0;
+	for (const auto& pair : pendingEdits)
+	{
+		edits.Add(&pair.Value);
+		numAdded += pair.Value.bRemove ? 0 : 1;
+	}
+	edits.Sort([](const FPendingEdit& a, const FPendingEdit& b) { return FWorldSnapshot::CellLess(a.building.cell, b.building.cell); });
+
+	static const FWorldSnapshot::FLayout EmptyLayout;
+	const FWorldSnapshot::FLayout& previous = layout.IsValid() ? *layout : EmptyLayout;
+
+	TSharedRef<FWorldSnapshot::FLayout, ESPMode::ThreadSafe> next = MakeShared<FWorldSnapshot::FLayout, ESPMode::ThreadSafe>();
+	next->buildings.Reserve(previous.buildings.Num() + numAdded);
+	next->socketCells.Reserve(previous.socketCells.Num() + numAdded * 6);
+	next->version = ++layoutVersion;
+
+	auto addBuilding = [&next](const FWorldSnapshotBuilding& building, const FIntVector* socketCells, int32 numSockets)
+	{
+		FWorldSnapshotBuilding& added = next->buildings.Add_GetRef(building);
+		added.firstSocket = next->socketCells.Num();
+		added.numSockets = numSockets;
+		next->socketCells.Append(socketCells, numSockets);
+	};
+
+	//Both are in cell order, so the edits are merged in while the previous layout is copied
+	int32 editIndex = 0;
+	for (const FWorldSnapshotBuilding& building : previous.buildings)
+	{
+		while (editIndex < edits.Num() && FWorldSnapshot::CellLess(edits[editIndex]->building.cell, building.cell))
+		{
+			const FPendingEdit& edit = *edits[editIndex++];
+			if (!edit.bRemove)
+			{
+				addBuilding(edit.building, edit.socketCells.GetData(), edit.socketCells.Num());
+			}
+		}
+
+		//An edit of an occupied cell replaces or removes its building
+		if (editIndex < edits.Num() && edits[editIndex]->building.cell == building.cell)
+		{
+			const FPendingEdit& edit = *edits[editIndex++];
+			if (!edit.bRemove)
+			{
+				addBuilding(edit.building, edit.socketCells.GetData(), edit.socketCells.Num());
+			}
+			continue;
+		}
+
+		addBuilding(building, previous.socketCells.GetData() + building.firstSocket, building.numSockets);
+	}
+
+	for (; editIndex < edits.Num(); editIndex++)
+	{
+		if (!edits[editIndex]->bRemove)
+		{
+			addBuilding(edits[editIndex]->building, edits[editIndex]->socketCells.GetData(), edits[editIndex]->socketCells.Num());
+		}
+	}
+
+	layout = next;
+	pendingEdits.Reset();
+}
@@ -0,0 +1,149 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Atomic.h"
+
+//A placed building as worker threads see it
+struct SPACERPG_API FWorldSnapshotBuilding
+{
+	FIntVector cell = FIntVector::ZeroValue;
+	int32 buildingType = INDEX_NONE;
+	FTransform transform;
+	FVector bounds = FVector::ZeroVector;
+
+	//Range of the building's cells in the snapshot's socket cells
+	int32 firstSocket = 0;
+	int32 numSockets = 0;
+};
+
+//Game time when a snapshot was taken
+struct SPACERPG_API FWorldSnapshotTime
+{
+	double worldSeconds = 0.0;
+	float clockwork = 0.0f;
+	int32 day = 1;
+	int32 month = 1;
+	int32 year = 1;
+};
+
+//Read only state of the world at the end of a game frame, safe to read from any thread while it is held
+struct SPACERPG_API FWorldSnapshot
+{
+	//Buildings in cell order and their socket cells. Layouts never change once built, snapshots share one until a building is placed or removed
+	struct FLayout
+	{
+		TArray<FWorldSnapshotBuilding> buildings;
+		TArray<FIntVector> socketCells;
+		uint64 version = 0;
+	};
+
+	//Increases with every publish, the layout version only when the buildings change
+	uint64 version = 0;
+	uint64 frameNumber = 0;
+	FWorldSnapshotTime time;
+	TSharedPtr<const FLayout, ESPMode::ThreadSafe> layout;
+
+	FORCEINLINE uint64 GetLayoutVersion() const { return layout.IsValid() ? layout->version : 0; }
+	FORCEINLINE int32 GetNumBuildings() const { return layout.IsValid() ? layout->buildings.Num() : 0; }
+	FORCEINLINE TArrayView<const FWorldSnapshotBuilding> GetBuildings() const { return layout.IsValid() ? TArrayView<const FWorldSnapshotBuilding>(layout->buildings) : TArrayView<const FWorldSnapshotBuilding>(); }
+
+	//Returns the building at the cell, or nullptr
+	const FWorldSnapshotBuilding* FindBuilding(const FIntVector& cell) const;
+
+	FORCEINLINE bool IsOccupied(const FIntVector& cell) const { return FindBuilding(cell) != nullptr; }
+
+	//Cells a neighbour snapped to each of the building's snap positions would occupy
+	FORCEINLINE TArrayView<const FIntVector> GetSocketCells(const FWorldSnapshotBuilding& building) const
+	{
+		return TArrayView<const FIntVector>(layout->socketCells.GetData() + building.firstSocket, building.numSockets);
+	}
+
+	//Order buildings are kept in, by X, then Y, then Z
+	static FORCEINLINE bool CellLess(const FIntVector& a, const FIntVector& b)
+	{
+		return a.X != b.X ? a.X < b.X : (a.Y != b.Y ? a.Y < b.Y : a.Z < b.Z);
+	}
+};
+
+//Holds a published snapshot, which the game thread won't write to again until every reference to it is gone.
+//Hold one for the length of a job, not across frames, or the world stops being published
+class SPACERPG_API FWorldSnapshotRef
+{
+public:
+	FWorldSnapshotRef() = default;
+	~FWorldSnapshotRef();
+
+	FWorldSnapshotRef(FWorldSnapshotRef&& other);
+	FWorldSnapshotRef& operator=(FWorldSnapshotRef&& other);
+	FWorldSnapshotRef(const FWorldSnapshotRef&) = delete;
+	FWorldSnapshotRef& operator=(const FWorldSnapshotRef&) = delete;
+
+	//Invalid until the world has been published once
+	FORCEINLINE bool IsValid() const { return snapshot != nullptr; }
+	FORCEINLINE const FWorldSnapshot& operator*() const { return *snapshot; }
+	FORCEINLINE const FWorldSnapshot* operator->() const { return snapshot; }
+
+private:
+	friend class FWorldSnapshotPublisher;
+	FWorldSnapshotRef(const FWorldSnapshot* inSnapshot, TAtomic<int32>* inReaders) : snapshot(inSnapshot), readers(inReaders) {}
+
+	const FWorldSnapshot* snapshot = nullptr;
+	TAtomic<int32>* readers = nullptr;
+};
+
+//Publishes the world to other threads through two snapshot buffers. The game thread fills the one readers aren't on
+//and swaps it in with a single atomic store, readers take the current one without locking.
+//Layout edits are gathered through the frame and merged into a new layout at the next publish
+class SPACERPG_API FWorldSnapshotPublisher
+{
+public:
+	//Game thread, a building placed at or removed from a cell, applied at the next publish
+	void SetBuilding(const FWorldSnapshotBuilding& building, TArrayView<const FIntVector> socketCells);
+	void RemoveBuilding(const FIntVector& cell);
+
+	//Game thread, fills the buffer readers aren't on and makes it current. When a reader still holds that buffer from
+	//an earlier frame nothing is published, edits wait for the next publish, and false is returned
+	bool Publish(uint64 frameNumber, const FWorldSnapshotTime& time);
+
+	//Any thread, holds the current snapshot until the reference is destroyed
+	FWorldSnapshotRef Acquire() const;
+
+	FORCEINLINE uint64 GetVersion() const { return version; }
+	FORCEINLINE int32 GetNumSkippedPublishes() const { return numSkippedPublishes; }
+	FORCEINLINE int32 GetNumPendingEdits() const { return pendingEdits.Num(); }
+
+	//Game thread, memory held by the layouts and pending edits
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	struct FBuffer
+	{
+		FWorldSnapshot snapshot;
+		mutable TAtomic<int32> readers { 0 };
+	};
+	FBuffer buffers[2];
+
+	//Buffer readers are given, null until the first publish
+	TAtomic<FBuffer*> current { nullptr };
+
+	//Latest layout, shared with the buffers that were published with it
+	TSharedPtr<const FWorldSnapshot::FLayout, ESPMode::ThreadSafe> layout;
+
+	//Latest edit of each cell since the last publish
+	struct FPendingEdit
+	{
+		bool bRemove = false;
+		FWorldSnapshotBuilding building;
+		TArray<FIntVector, TInlineAllocator<6>> socketCells;
+	};
+	TMap<FIntVector, FPendingEdit> pendingEdits;
+
+	uint64 version = 0;
+	uint64 layoutVersion = 0;
+	int32 numSkippedPublishes = 0;
+
+	//Merges the pending edits into a new layout, in one pass over the current one
+	void ApplyEdits();
+};
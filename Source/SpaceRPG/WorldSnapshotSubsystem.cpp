@@ -0,0 +1,104 @@
+// Copyright SpaceRPG 2020
+
+#include "WorldSnapshotSubsystem.h"
+#include "SpaceRPG.h"
+#include "Building.h"
+#include "BuildingRegistry.h"
+#include "TimeController.h"
+#include "EngineUtils.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("World Snapshot Publish"), STAT_WorldSnapshotPublish, STATGROUP_SpaceRPG);
+DECLARE_DWORD_COUNTER_STAT(TEXT("World Snapshot Buildings"), STAT_WorldSnapshotBuildings, STATGROUP_SpaceRPG);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("World Snapshot Publishes Skipped"), STAT_WorldSnapshotSkipped, STATGROUP_SpaceRPG);
+
+void UWorldSnapshotSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	UBuildingRegistry* registry = Cast<UBuildingRegistry>(Collection.InitializeDependency(UBuildingRegistry::StaticClass()));
+	if (registry != nullptr)
+	{
+		buildingAddedHandle = registry->OnBuildingAdded.AddUObject(this, &UWorldSnapshotSubsystem::OnBuildingAdded);
+		buildingRemovedHandle = registry->OnBuildingRemoved.AddUObject(this, &UWorldSnapshotSubsystem::OnBuildingRemoved);
+
+		for (const auto& pair : registry->GetBuildings())
+		{
+			OnBuildingAdded(pair.Value);
+		}
+	}
+}
+
+void UWorldSnapshotSubsystem::Deinitialize()
+{
+	if (UBuildingRegistry* registry = GetWorld()->GetSubsystem<UBuildingRegistry>())
+	{
+		registry->OnBuildingAdded.Remove(buildingAddedHandle);
+		registry->OnBuildingRemoved.Remove(buildingRemovedHandle);
+	}
+
+	Super::Deinitialize();
+}
+
+void UWorldSnapshotSubsystem::Tick(float DeltaTime)
+{
+	PublishSnapshot();
+}
+
+ETickableTickType UWorldSnapshotSubsystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Always;
+}
+
+TStatId UWorldSnapshotSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UWorldSnapshotSubsystem, STATGROUP_Tickables);
+}
+
+void UWorldSnapshotSubsystem::PublishSnapshot()
+{
+	SCOPE_CYCLE_COUNTER(STAT_WorldSnapshotPublish);
+
+	FWorldSnapshotTime time;
+	time.worldSeconds = GetWorld()->GetTimeSeconds();
+	if (ATimeController* controller = FindTimeController())
+	{
+		controller->GetClockState(time.clockwork, time.day, time.month, time.year);
+	}
+
+	//Ticking after the actors, the snapshot is the world as this frame left it
+	if (!publisher->Publish(GFrameCounter, time))
+	{
+		INC_DWORD_STAT(STAT_WorldSnapshotSkipped);
+	}
+	FWorldSnapshotRef snapshot = publisher->Acquire();
+	SET_DWORD_STAT(STAT_WorldSnapshotBuildings, snapshot.IsValid() ? snapshot->GetNumBuildings() : 0);
+}
+
+ATimeController* UWorldSnapshotSubsystem::FindTimeController()
+{
+	if (!timeController.IsValid())
+	{
+		TActorIterator<ATimeController> it(GetWorld());
+		timeController = it ? *it : nullptr;
+	}
+	return timeController.Get();
+}
+
+void UWorldSnapshotSubsystem::OnBuildingAdded(ABuilding* building)
+{
+	FWorldSnapshotBuilding snapshotBuilding;
+	snapshotBuilding.cell = building->gridCell;
+	snapshotBuilding.buildingType = building->buildingType;
+	snapshotBuilding.transform = building->GetActorTransform();
+	snapshotBuilding.bounds = building->buildingBounds;
+
+	TArray<FIntVector, TInlineAllocator<6>> socketCells;
+	building->GetSocketCells(socketCells);
+	publisher->SetBuilding(snapshotBuilding, socketCells);
+}
+
+void UWorldSnapshotSubsystem::OnBuildingRemoved(ABuilding* building)
+{
+	publisher->RemoveBuilding(building->gridCell);
+}
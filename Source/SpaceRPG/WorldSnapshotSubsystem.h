@@ -0,0 +1,50 @@
+// Copyright SpaceRPG 2020
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+#include "WorldSnapshot.h"
+#include "WorldSnapshotSubsystem.generated.h"
+
+//Publishes the building layout and game time once a frame for task graph jobs, which must not touch buildings or the
+//time controller themselves. Jobs capture the publisher and acquire the snapshot when they run, so they stay safe if
+//the world ends before they do
+UCLASS()
+class SPACERPG_API UWorldSnapshotSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//FTickableGameObject interface
+	virtual void Tick(float DeltaTime) override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override { return GetWorld(); }
+	virtual TStatId GetStatId() const override;
+
+	FORCEINLINE TSharedRef<FWorldSnapshotPublisher, ESPMode::ThreadSafe> GetPublisher() const { return publisher; }
+
+	//Holds the latest snapshot, from any thread
+	FORCEINLINE FWorldSnapshotRef AcquireSnapshot() const { return publisher->Acquire(); }
+
+	//Publishes the world as it is now, called every frame by the tick
+	void PublishSnapshot();
+
+	FORCEINLINE SIZE_T GetAllocatedSize() const { return publisher->GetAllocatedSize(); }
+
+private:
+	TSharedRef<FWorldSnapshotPublisher, ESPMode::ThreadSafe> publisher = MakeShared<FWorldSnapshotPublisher, ESPMode::ThreadSafe>();
+
+	FDelegateHandle buildingAddedHandle;
+	FDelegateHandle buildingRemovedHandle;
+
+	TWeakObjectPtr<class ATimeController> timeController;
+	class ATimeController* FindTimeController();
+
+	void OnBuildingAdded(class ABuilding* building);
+	void OnBuildingRemoved(class ABuilding* building);
+};